@@ -42,6 +42,8 @@
 #include "modest-tny-msg.h"
 #include "modest-platform.h"
 #include "modest-defs.h"
+#include "modest-startup-trace.h"
+#include "modest-folder-counts.h"
 #include <libmodest-dbus-client/libmodest-dbus-client.h>
 #include <stdio.h>
 #include <string.h>
@@ -354,49 +356,6 @@ on_compose_mail(GArray * arguments, gpointer data, osso_rpc_t * retval)
 	return OSSO_OK;
 }
 
-static TnyMsg *
-find_message_by_url (const char *uri,  TnyAccount **ac_out)
-{
-	ModestTnyAccountStore *astore;
-	TnyAccount *account = NULL;
-	TnyFolder *folder = NULL;
-	TnyMsg *msg = NULL;
-
-	astore = modest_runtime_get_account_store ();
-	
-	if (astore == NULL)
-		return NULL;
-
-	if (uri && g_str_has_prefix (uri, "merge://")) {
-		/* we assume we're talking about outbox folder, as this 
-		 * is the only merge folder we work with in modest */
-		return modest_tny_account_store_find_msg_in_outboxes (astore, uri, ac_out);
-	}
-	account = tny_account_store_find_account (TNY_ACCOUNT_STORE (astore),
-						  uri);
-	
-	if (account == NULL || !TNY_IS_STORE_ACCOUNT (account))
-		goto out;
-	*ac_out = account;
-
-	folder = tny_store_account_find_folder (TNY_STORE_ACCOUNT (account), uri, NULL);
-
-	if (folder == NULL)
-		goto out;
-	
-	msg = tny_folder_find_msg (folder, uri, NULL);
-	
-out:
-	if (account && !msg) {
-		g_object_unref (account);
-		*ac_out = NULL;
-	}
-	if (folder)
-		g_object_unref (folder);
-
-	return msg;
-}
-
 typedef struct {
 	TnyAccount *account;
 	gchar *uri;
@@ -537,6 +496,7 @@ find_msg_async_cb (TnyFolder *folder,
 				ModestMailOperation *mail_op;
 				
                                 tny_header_set_flag (header, TNY_HEADER_FLAG_SEEN);
+				modest_search_header_changed (header);
 				modest_platform_emit_msg_read_changed_signal (msg_uid, TRUE);
 				/* Sync folder, we need this to save the seen flag */
 				mail_op = modest_mail_operation_new (NULL);
@@ -767,24 +727,34 @@ static void
 on_remove_msgs_finished (ModestMailOperation *mail_op,
 			 gpointer user_data)
 {	
-	TnyHeader *header;
-	ModestWindow *top_win = NULL, *msg_view = NULL;
+	TnyList *headers;
+	TnyIterator *iter;
+	ModestWindow *top_win = NULL;
 
-	header = (TnyHeader *) user_data;
+	headers = (TnyList *) user_data;
 
 	/* Get the main window if exists */
 	top_win = modest_window_mgr_get_current_top (modest_runtime_get_window_mgr());
 	if (!top_win) {
-		g_object_unref (header);
+		g_object_unref (headers);
 		return;
 	}
 
-	if (modest_window_mgr_find_registered_header (modest_runtime_get_window_mgr(),
-						      header, &msg_view)) {
-		if (MODEST_IS_MSG_VIEW_WINDOW (msg_view))
-			modest_ui_actions_refresh_message_window_after_delete (MODEST_MSG_VIEW_WINDOW (msg_view));
-	}	
-	g_object_unref (header);
+	iter = tny_list_create_iterator (headers);
+	while (!tny_iterator_is_done (iter)) {
+		TnyHeader *header = TNY_HEADER (tny_iterator_get_current (iter));
+		ModestWindow *msg_view = NULL;
+
+		if (modest_window_mgr_find_registered_header (modest_runtime_get_window_mgr(),
+							      header, &msg_view)) {
+			if (MODEST_IS_MSG_VIEW_WINDOW (msg_view))
+				modest_ui_actions_refresh_message_window_after_delete (MODEST_MSG_VIEW_WINDOW (msg_view));
+		}
+		g_object_unref (header);
+		tny_iterator_next (iter);
+	}
+	g_object_unref (iter);
+	g_object_unref (headers);
 
 	/* Refilter the header views explicitely */
 
@@ -792,132 +762,125 @@ on_remove_msgs_finished (ModestMailOperation *mail_op,
 	/* this call will go through all the windows, get the header views and refilter them */
 }
 
+/* The messages to delete from one folder */
+typedef struct {
+	TnyFolder *folder;
+	GSList *uids;
+} DeleteMessagesFolder;
+
+static void
+add_delete_messages_folder (gpointer key, gpointer value, gpointer user_data)
+{
+	GList **folders = (GList **) user_data;
+
+	*folders = g_list_prepend (*folders, value);
+}
+
 static gpointer
-thread_prepare_delete_message (gpointer userdata)
+thread_prepare_delete_messages (gpointer userdata)
 {
-	TnyList *headers = NULL, *tmp_headers = NULL;
-	TnyFolder *folder = NULL;
-	TnyIterator *iter = NULL; 
-	TnyHeader *header = NULL, *msg_header = NULL;
-	TnyMsg *msg = NULL;
-	TnyAccount *account = NULL;
-	char *uri;
-	gchar *uid = NULL;
-	ModestMailOperation *mail_op = NULL;
-	ModestWindow *top_win = NULL;
+	GSList *uris, *node;
+	GHashTable *folders_table;
+	GList *folders = NULL, *folder_node;
+	ModestTnyAccountStore *astore;
+	gboolean failed = FALSE;
 
-	uri = (char *) userdata;
+	uris = (GSList *) userdata;
+	astore = modest_runtime_get_account_store ();
 
-	msg = find_message_by_url (uri, &account);
-	if (account)
+	/* Group the messages by folder. Only the uris are parsed, no
+	   message is retrieved */
+	folders_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	for (node = uris; node != NULL; node = g_slist_next (node)) {
+		TnyAccount *account = NULL;
+		TnyFolder *folder = NULL;
+		DeleteMessagesFolder *info;
+		gchar *uid = NULL, *folder_url;
+
+		if (!modest_tny_account_store_resolve_msg_url (astore, (const gchar *) node->data,
+							       &account, &folder, &uid)) {
+			g_debug ("%s: Could not find message '%s'", __FUNCTION__, (gchar *) node->data);
+			failed = TRUE;
+			continue;
+		}
 		g_object_unref (account);
 
-	if (!msg) {
-		g_debug ("%s: Could not find message '%s'", __FUNCTION__, uri);
-		g_idle_add (notify_error_in_dbus_callback, NULL);
-		g_free (uri);
-		return FALSE; 
-	}
-
-	top_win = modest_window_mgr_get_current_top (modest_runtime_get_window_mgr());
+		folder_url = tny_folder_get_url_string (folder);
+		info = g_hash_table_lookup (folders_table, folder_url);
+		if (!info) {
+			info = g_slice_new0 (DeleteMessagesFolder);
+			info->folder = folder;
+			g_hash_table_insert (folders_table, folder_url, info);
+		} else {
+			g_object_unref (folder);
+			g_free (folder_url);
+		}
+		info->uids = g_slist_prepend (info->uids, uid);
+	}
+	g_hash_table_foreach (folders_table, add_delete_messages_folder, &folders);
+	g_hash_table_destroy (folders_table);
+	g_slist_foreach (uris, (GFunc) g_free, NULL);
+	g_slist_free (uris);
+
+	/* One remove operation per folder */
+	for (folder_node = folders; folder_node != NULL; folder_node = g_list_next (folder_node)) {
+		DeleteMessagesFolder *info = (DeleteMessagesFolder *) folder_node->data;
+		TnyList *headers;
+
+		headers = tny_simple_list_new ();
+		if (modest_tny_folder_get_headers_by_uid (info->folder, info->uids, headers) <
+		    g_slist_length (info->uids)) {
+			g_debug ("%s: some messages were not found in the summary", __FUNCTION__);
+			failed = TRUE;
+		}
 
-	folder = tny_msg_get_folder (msg);
-	if (!folder) {
-		g_debug ("%s: Could not find folder (uri:'%s')", __FUNCTION__, uri);
-		g_object_unref (msg);
-		g_idle_add (notify_error_in_dbus_callback, NULL);
-		g_free (uri);
-		return FALSE; 
-	}
+		if (tny_list_get_length (headers) > 0) {
+			ModestMailOperation *mail_op;
+			ModestWindow *top_win;
 
-	/* Get UID */
-	msg_header = tny_msg_get_header (msg);
-	uid = tny_header_dup_uid (msg_header);
-	g_object_unref (msg);
-	g_object_unref (msg_header);
+			/* This is a GDK lock because we are a thread and
+			 * the code below is or does Gtk+ code */
+			gdk_threads_enter (); /* CHECKED */
 
-	headers = tny_simple_list_new ();
-	tny_folder_get_headers (folder, headers, TRUE, NULL);
-	iter = tny_list_create_iterator (headers);
+			top_win = modest_window_mgr_get_current_top (modest_runtime_get_window_mgr());
+			mail_op = modest_mail_operation_new (top_win ? G_OBJECT(top_win) : NULL);
+			modest_mail_operation_queue_add (modest_runtime_get_mail_operation_queue (), mail_op);
 
-	while (!tny_iterator_is_done (iter)) {
-		gchar *cur_id = NULL;
+			g_signal_connect (G_OBJECT (mail_op),
+					  "operation-finished",
+					  G_CALLBACK (on_remove_msgs_finished),
+					  g_object_ref (headers));
 
-		header = TNY_HEADER (tny_iterator_get_current (iter));
-		if (header)
-			cur_id = tny_header_dup_uid (header);
-		
-		if (cur_id && uid && g_str_equal (cur_id, uid)) {
-			g_free (cur_id);
-			/* g_debug ("Found corresponding header from folder"); */
-			break;
-		}
-		g_free (cur_id);
+			modest_mail_operation_remove_msgs (mail_op, headers, FALSE);
 
-		if (header) {
-			g_object_unref (header);
-			header = NULL;
+			g_object_unref (G_OBJECT (mail_op));
+			gdk_threads_leave (); /* CHECKED */
 		}
-		
-		tny_iterator_next (iter);
-	}
-	g_free (uid);
-	g_object_unref (iter);
-	g_object_unref (headers);
 
-	if (header == NULL) {
-		if (folder)
-			g_object_unref (folder);
-		g_idle_add (notify_error_in_dbus_callback, NULL);			
-		g_free (uri);
-		return FALSE;
+		/* Clean */
+		g_object_unref (headers);
+		g_object_unref (info->folder);
+		g_slist_foreach (info->uids, (GFunc) g_free, NULL);
+		g_slist_free (info->uids);
+		g_slice_free (DeleteMessagesFolder, info);
 	}
-		
-	/* This is a GDK lock because we are an idle callback and
-	 * the code below is or does Gtk+ code */
-	gdk_threads_enter (); /* CHECKED */
-
-	mail_op = modest_mail_operation_new (top_win ? G_OBJECT(top_win) : NULL);
-	modest_mail_operation_queue_add (modest_runtime_get_mail_operation_queue (), mail_op);
+	g_list_free (folders);
 
-	g_signal_connect (G_OBJECT (mail_op),
-			  "operation-finished",
-			  G_CALLBACK (on_remove_msgs_finished),
-			  g_object_ref (header));
-
-	tmp_headers = tny_simple_list_new ();
-	tny_list_append (tmp_headers, (GObject *) header);
-
-	modest_mail_operation_remove_msgs (mail_op, tmp_headers, FALSE);
+	if (failed)
+		g_idle_add (notify_error_in_dbus_callback, NULL);
 
-	g_object_unref (tmp_headers);
-	g_object_unref (G_OBJECT (mail_op));
-	gdk_threads_leave (); /* CHECKED */
-	
-	/* Clean */
-	if (header)
-		g_object_unref (header);
-	g_free (uri);
-	
-	return FALSE;
+	return NULL;
 }
 
 static gboolean
-on_idle_delete_message (gpointer user_data)
+on_idle_delete_messages (gpointer user_data)
 {
-	const char *uri = NULL;
-
-	uri = (char *) user_data;
-
-	g_thread_create (thread_prepare_delete_message, g_strdup (uri), FALSE, NULL);
+	/* the thread takes ownership of the list of uris */
+	g_thread_create (thread_prepare_delete_messages, user_data, FALSE, NULL);
 
 	return FALSE;
-	
 }
 
-
-
-
 static gint
 on_delete_message (GArray *arguments, gpointer data, osso_rpc_t *retval)
 {
@@ -925,10 +888,10 @@ on_delete_message (GArray *arguments, gpointer data, osso_rpc_t *retval)
  	osso_rpc_t val = g_array_index (arguments,
 			     osso_rpc_t,
 			     MODEST_DBUS_DELETE_MESSAGE_ARG_URI);
- 	gchar *uri = g_strdup (val.value.s);
+ 	GSList *uris = g_slist_prepend (NULL, g_strdup (val.value.s));
  	
 	/* Use g_idle to context-switch into the application's thread: */
- 	g_idle_add(on_idle_delete_message, (gpointer)uri);
+ 	g_idle_add (on_idle_delete_messages, uris);
  	
 	return OSSO_OK;
 }
@@ -1113,6 +1076,78 @@ on_dbus_method_dump_operation_queue (DBusConnection *con, DBusMessage *message)
 
 
 
+static gint 
+on_dbus_method_dump_startup_trace (DBusConnection *con, DBusMessage *message)
+{
+	gchar *str;
+	
+	DBusMessage *reply;
+	dbus_uint32_t serial = 0;
+
+	/* trace-event JSON, see modest-startup-trace.h */
+	str = modest_startup_trace_to_json ();
+
+	reply = dbus_message_new_method_return (message);
+	if (reply) {
+		dbus_message_append_args (reply,
+					  DBUS_TYPE_STRING, &str,
+					  DBUS_TYPE_INVALID);
+		dbus_connection_send (con, reply, &serial);
+		dbus_connection_flush (con);
+		dbus_message_unref (reply);
+	}	
+	g_free (str);
+
+	/* Let modest die */
+	g_idle_add (notify_error_in_dbus_callback, NULL);
+
+	return OSSO_OK;
+}
+
+static gboolean modest_dbus_check_present_modal ();
+
+static void
+on_dbus_method_delete_messages (DBusConnection *con, DBusMessage *message)
+{
+	DBusMessage *reply;
+	DBusError error;
+	dbus_uint32_t serial = 0;
+	gchar **uris = NULL;
+	gint n_uris = 0, i;
+	GSList *uri_list = NULL;
+
+	dbus_error_init (&error);
+	if (!dbus_message_get_args (message, &error,
+				    DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &uris, &n_uris,
+				    DBUS_TYPE_INVALID)) {
+		g_warning ("%s: %s", __FUNCTION__, error.message);
+		reply = dbus_message_new_error (message, error.name, error.message);
+		dbus_error_free (&error);
+	} else {
+		for (i = n_uris - 1; i >= 0; i--)
+			uri_list = g_slist_prepend (uri_list, g_strdup (uris[i]));
+		dbus_free_string_array (uris);
+		reply = dbus_message_new_method_return (message);
+	}
+
+	if (reply) {
+		dbus_connection_send (con, reply, &serial);
+		dbus_connection_flush (con);
+		dbus_message_unref (reply);
+	}
+
+	/* Same as DeleteMessage, but the messages of the same folder
+	   are removed with a single operation */
+	if (uri_list) {
+		if (modest_dbus_check_present_modal ()) {
+			g_slist_foreach (uri_list, (GFunc) g_free, NULL);
+			g_slist_free (uri_list);
+		} else {
+			g_idle_add (on_idle_delete_messages, uri_list);
+		}
+	}
+}
+
 static gint 
 on_dbus_method_dump_accounts (DBusConnection *con, DBusMessage *message)
 {
@@ -1466,6 +1501,8 @@ on_idle_top_application (gpointer user_data)
 static gint
 on_top_application(GArray * arguments, gpointer data, osso_rpc_t * retval)
 {
+	modest_startup_trace_mark ("top-application");
+
 	/* Use g_idle to context-switch into the application's thread: */
  	g_idle_add(on_idle_top_application, NULL);
 
@@ -1580,12 +1617,26 @@ modest_dbus_check_present_modal ()
 	return (NULL != dialog);
 }
 
+static void
+trace_first_request (void)
+{
+	static gboolean traced = FALSE;
+
+	/* used to measure the time to the first D-Bus reply */
+	if (!traced) {
+		modest_startup_trace_mark ("first-dbus-request");
+		traced = TRUE;
+	}
+}
+
 /* Callback for normal D-BUS messages */
 gint
 modest_dbus_req_handler(const gchar * interface, const gchar * method,
 			GArray * arguments, gpointer data,
 			osso_rpc_t * retval)
 {
+	trace_first_request ();
+
 	/* Check memory low conditions */
 	if (modest_platform_check_memory_low (NULL, FALSE)) {
 		g_idle_add (on_idle_show_memory_low, NULL);
@@ -1681,13 +1732,77 @@ modest_dbus_req_handler(const gchar * interface, const gchar * method,
 	ACCOUNT_HIT_DBUS_TYPE \
 	DBUS_STRUCT_END_CHAR_AS_STRING
 
+typedef struct {
+	DBusMessageIter *array_iter;
+	GString         *msgid;	/* reused for all the hits */
+} HitMarshalHelper;
+
+static void
+append_search_hit (const ModestSearchResultHit *hit, gpointer user_data)
+{
+	HitMarshalHelper *helper = (HitMarshalHelper *) user_data;
+	DBusMessageIter  struct_iter;
+	const char      *msg_url;
+	guint64          size;
+	gboolean         has_attachment;
+	gboolean         is_unread;
+	gint64           ts;
+
+	msg_url = modest_search_result_hit_get_msgid (hit, helper->msgid);
+	size           = hit->msize;
+	has_attachment = hit->has_attachment;
+	is_unread      = hit->is_unread;
+	ts             = hit->timestamp;
+
+	dbus_message_iter_open_container (helper->array_iter,
+					  DBUS_TYPE_STRUCT,
+					  NULL,
+					  &struct_iter);
+
+	/* The strings are appended straight from the search results */
+	dbus_message_iter_append_basic (&struct_iter,
+					DBUS_TYPE_STRING,
+					&msg_url);
+
+	dbus_message_iter_append_basic (&struct_iter,
+					DBUS_TYPE_STRING,
+					&(hit->subject));
+
+	dbus_message_iter_append_basic (&struct_iter,
+					DBUS_TYPE_STRING,
+					&(hit->folder));
+
+	dbus_message_iter_append_basic (&struct_iter,
+					DBUS_TYPE_STRING,
+					&(hit->sender));
+
+	dbus_message_iter_append_basic (&struct_iter,
+					DBUS_TYPE_UINT64,
+					&size);
+
+	dbus_message_iter_append_basic (&struct_iter,
+					DBUS_TYPE_BOOLEAN,
+					&has_attachment);
+
+	dbus_message_iter_append_basic (&struct_iter,
+					DBUS_TYPE_BOOLEAN,
+					&is_unread);
+
+	dbus_message_iter_append_basic (&struct_iter,
+					DBUS_TYPE_INT64,
+					&ts);
+
+	dbus_message_iter_close_container (helper->array_iter,
+					   &struct_iter);
+}
+
 static DBusMessage *
 search_result_to_message (DBusMessage *reply,
-			   GList       *hits)
+			  ModestSearchResult *result)
 {
 	DBusMessageIter iter;
 	DBusMessageIter array_iter;
-	GList          *hit_iter;
+	HitMarshalHelper helper;
 
 	dbus_message_iter_init_append (reply, &iter); 
 	dbus_message_iter_open_container (&iter,
@@ -1695,78 +1810,13 @@ search_result_to_message (DBusMessage *reply,
 					  SEARCH_HIT_DBUS_TYPE,
 					  &array_iter); 
 
-	for (hit_iter = hits; hit_iter; hit_iter = hit_iter->next) {
-		DBusMessageIter  struct_iter;
-		ModestSearchResultHit *hit;
-		char            *msg_url;
-		const char      *subject;
-		const char      *folder;
-		const char      *sender;
-		guint64          size;
-		gboolean         has_attachment;
-		gboolean         is_unread;
-		gint64           ts;
-
-		hit = (ModestSearchResultHit *) hit_iter->data;
-
-		msg_url = hit->msgid;
-		subject = hit->subject;
-		folder  = hit->folder;
-		sender  = hit->sender;
-		size           = hit->msize;
-		has_attachment = hit->has_attachment;
-		is_unread      = hit->is_unread;
-		ts             = hit->timestamp;
-
-		g_debug ("DEBUG: %s: Adding hit: %s", __FUNCTION__, msg_url);	
-		
-		dbus_message_iter_open_container (&array_iter,
-						  DBUS_TYPE_STRUCT,
-						  NULL,
-						  &struct_iter);
-
-   		dbus_message_iter_append_basic (&struct_iter,
-						DBUS_TYPE_STRING,
-						&msg_url);
-
-		dbus_message_iter_append_basic (&struct_iter,
-						DBUS_TYPE_STRING,
-						&subject); 
-
-		dbus_message_iter_append_basic (&struct_iter,
-						DBUS_TYPE_STRING,
-						&folder);
-
-		dbus_message_iter_append_basic (&struct_iter,
-						DBUS_TYPE_STRING,
-						&sender);
-
-		dbus_message_iter_append_basic (&struct_iter,
-						DBUS_TYPE_UINT64,
-						&size);
-
-		dbus_message_iter_append_basic (&struct_iter,
-						DBUS_TYPE_BOOLEAN,
-						&has_attachment);
-
-		dbus_message_iter_append_basic (&struct_iter,
-						DBUS_TYPE_BOOLEAN,
-						&is_unread);
-		
-		dbus_message_iter_append_basic (&struct_iter,
-						DBUS_TYPE_INT64,
-						&ts);
-
-		dbus_message_iter_close_container (&array_iter,
-						   &struct_iter); 
+	g_debug ("DEBUG: %s: Adding %d hits", __FUNCTION__,
+		 modest_search_result_get_length (result));
 
-		g_free (hit->msgid);
-		g_free (hit->subject);
-		g_free (hit->folder);
-		g_free (hit->sender);
-
-		g_slice_free (ModestSearchResultHit, hit);
-	}
+	helper.array_iter = &array_iter;
+	helper.msgid = g_string_sized_new (256);
+	modest_search_result_foreach (result, append_search_hit, &helper);
+	g_string_free (helper.msgid, TRUE);
 
 	dbus_message_iter_close_container (&iter, &array_iter);
 
@@ -1781,7 +1831,7 @@ typedef struct
 } SearchHelper;
 
 static void
-search_all_cb (GList *hits, gpointer user_data)
+search_all_cb (ModestSearchResult *result, gpointer user_data)
 {
 	DBusMessage  *reply;
 	SearchHelper *helper = (SearchHelper *) user_data;
@@ -1791,7 +1841,7 @@ search_all_cb (GList *hits, gpointer user_data)
 	if (reply) {
 		dbus_uint32_t serial = 0;
 		
-		search_result_to_message (reply, hits);
+		search_result_to_message (reply, result);
 
 		dbus_connection_send (helper->con, reply, &serial);
 		dbus_connection_flush (helper->con);
@@ -1913,32 +1963,40 @@ on_dbus_method_search (DBusConnection *con, DBusMessage *message)
 	modest_search_all_accounts (search, search_all_cb, helper);
 }
 
-static gint
-headers_cmp (TnyHeader *a, TnyHeader *b)
-{
-	time_t date_a, date_b;
-	date_a = tny_header_get_date_received (a);
-	date_b = tny_header_get_date_received (b);
-
-	return date_a - date_b;
-}
+/* Seconds to wait for all the accounts before replying with the
+   results we already have, so a slow account does not stall the
+   caller (usually the status bar widget) */
+#define GET_UNREAD_MESSAGES_TIMEOUT 10
 
 /**
   * The helper structure for handling GetUnreadMessages DBus request
   */
 typedef struct {
-	TnyList *accounts_list;
-	TnyList *inboxes_list;
 	gint unread_msgs_count;
 	DBusConnection *con;
 	DBusMessage *message;
 	GList *account_hits_list;
 	ModestMailOperation *mail_op;
+	GList *pending_accounts; /**< Accounts (GetUnreadAccountHelper) not finished yet */
+	guint timeout_id;
+	gboolean replied;
+} GetUnreadMessagesHelper;
+
+/**
+  * The state of the request for one account. All the accounts are
+  * queried at the same time
+  */
+typedef struct {
+	GetUnreadMessagesHelper *helper;
+	TnyAccount *account;
+	TnyList *inboxes_list;
+	gchar *inbox_url; /**< Used to get the cached counts if the account does not answer in time */
+	gboolean has_hits;
 	guint folder_requests_total; /**< Total get-folder requests number for multi-mailbox accounts */
 	guint folder_requests_done; /**< Done get-folder requests number for multi-mailbox accounts */
 	guint get_headers_tries_left;
 	TnyFolder *tmp_folder_ptr;
-} GetUnreadMessagesHelper;
+} GetUnreadAccountHelper;
 
 typedef struct {
 	gchar *account_id;
@@ -1948,14 +2006,135 @@ typedef struct {
 	GList *header_list;
 } AccountHits;
 
+typedef struct {
+	time_t date;
+	TnyHeader *header;
+} UnreadHeader;
+
+static AccountHits *
+account_hits_new (TnyAccount *account, gint unread_count, GList *header_list)
+{
+	AccountHits *account_hits;
+	ModestProtocol *store_protocol;
+
+	account_hits = g_slice_new (AccountHits);
+	account_hits->account_id = g_strdup (modest_tny_account_get_parent_modest_account_name_for_server_account (account));
+	account_hits->account_name = g_strdup (tny_account_get_name (account));
+	store_protocol = modest_protocol_registry_get_protocol_by_type (modest_runtime_get_protocol_registry (),
+									modest_tny_account_get_protocol_type (account));
+	account_hits->store_protocol = g_strdup (modest_protocol_get_name (store_protocol));
+	account_hits->header_list = header_list;
+	account_hits->unread_count = unread_count;
+
+	return account_hits;
+}
+
+static void
+account_hits_free (AccountHits *account_hits)
+{
+	g_free (account_hits->account_id);
+	g_free (account_hits->account_name);
+	g_free (account_hits->store_protocol);
+	g_list_foreach (account_hits->header_list, (GFunc) g_object_unref, NULL);
+	g_list_free (account_hits->header_list);
+	g_slice_free (AccountHits, account_hits);
+}
+
+/*
+ * The unread headers are kept in a min-heap on the received date
+ * bounded to the number of requested messages, the root is the
+ * oldest one, i.e., the first to be dropped when a newer one comes
+ */
+static void
+unread_heap_sift_down (GArray *heap, guint i)
+{
+	UnreadHeader tmp;
+
+	while (TRUE) {
+		guint left = 2 * i + 1, right = left + 1, smallest = i;
+
+		if (left < heap->len &&
+		    g_array_index (heap, UnreadHeader, left).date < g_array_index (heap, UnreadHeader, smallest).date)
+			smallest = left;
+		if (right < heap->len &&
+		    g_array_index (heap, UnreadHeader, right).date < g_array_index (heap, UnreadHeader, smallest).date)
+			smallest = right;
+		if (smallest == i)
+			break;
+
+		tmp = g_array_index (heap, UnreadHeader, i);
+		g_array_index (heap, UnreadHeader, i) = g_array_index (heap, UnreadHeader, smallest);
+		g_array_index (heap, UnreadHeader, smallest) = tmp;
+		i = smallest;
+	}
+}
+
+static void
+unread_heap_push (GArray *heap, guint max, TnyHeader *header)
+{
+	UnreadHeader item;
+
+	if (max == 0)
+		return;
+
+	item.date = tny_header_get_date_received (header);
+	if (heap->len < max) {
+		guint i;
+
+		item.header = g_object_ref (header);
+		g_array_set_size (heap, heap->len + 1);
+		i = heap->len - 1;
+		while (i > 0) {
+			guint parent = (i - 1) / 2;
+			if (g_array_index (heap, UnreadHeader, parent).date <= item.date)
+				break;
+			g_array_index (heap, UnreadHeader, i) = g_array_index (heap, UnreadHeader, parent);
+			i = parent;
+		}
+		g_array_index (heap, UnreadHeader, i) = item;
+	} else if (item.date > g_array_index (heap, UnreadHeader, 0).date) {
+		item.header = g_object_ref (header);
+		g_object_unref (g_array_index (heap, UnreadHeader, 0).header);
+		g_array_index (heap, UnreadHeader, 0) = item;
+		unread_heap_sift_down (heap, 0);
+	}
+}
+
+static gint
+unread_header_cmp (const UnreadHeader *a, const UnreadHeader *b)
+{
+	return (a->date > b->date) - (a->date < b->date);
+}
+
+/* Frees the heap and returns its headers, the oldest first */
+static GList *
+unread_heap_free_to_list (GArray *heap)
+{
+	GList *list = NULL;
+	guint i;
+
+	g_array_sort (heap, (GCompareFunc) unread_header_cmp);
+	for (i = heap->len; i > 0; i--)
+		list = g_list_prepend (list, g_array_index (heap, UnreadHeader, i - 1).header);
+	g_array_free (heap, TRUE);
+
+	return list;
+}
+
 static void return_results (GetUnreadMessagesHelper *helper)
 {
 	DBusMessage *reply;
+	GList *node;
+
+	if (helper->timeout_id) {
+		g_source_remove (helper->timeout_id);
+		helper->timeout_id = 0;
+	}
+	helper->replied = TRUE;
 
 	reply = dbus_message_new_method_return (helper->message);
 	if (reply) {
 		dbus_uint32_t serial = 0;
-		GList *node;
 		DBusMessageIter iter;
 		DBusMessageIter array_iter;
 
@@ -2018,17 +2197,13 @@ static void return_results (GetUnreadMessagesHelper *helper)
 
 				dbus_message_iter_close_container (&sh_array_iter,
 							   &sh_struct_iter); 
-				g_object_unref (header);
+				g_free (subject);
 			}
 			dbus_message_iter_close_container (&ah_struct_iter,
 							   &sh_array_iter); 
 
 			dbus_message_iter_close_container (&array_iter,
 							   &ah_struct_iter); 
-			g_free (ah->account_id);
-			g_free (ah->account_name);
-			g_free (ah->store_protocol);
-			g_list_free (ah->header_list);
 		}
 
 		dbus_message_iter_close_container (&iter,
@@ -2038,31 +2213,107 @@ static void return_results (GetUnreadMessagesHelper *helper)
 		dbus_message_unref (reply);
 
 	}
+	g_list_foreach (helper->account_hits_list, (GFunc) account_hits_free, NULL);
 	g_list_free (helper->account_hits_list);
+	helper->account_hits_list = NULL;
+}
+
+static void
+get_unread_messages_helper_free (GetUnreadMessagesHelper *helper)
+{
 	dbus_message_unref (helper->message);
-	g_object_unref (helper->accounts_list);
 	modest_mail_operation_queue_remove (modest_runtime_get_mail_operation_queue (),
 					    helper->mail_op);
 	g_object_unref (helper->mail_op);
 	g_slice_free (GetUnreadMessagesHelper, helper);
 }
 
-static void get_unread_messages_get_account (GetUnreadMessagesHelper *helper);
-static void get_unread_messages_get_headers (GetUnreadMessagesHelper *helper);
+static void
+add_account_hits (GetUnreadAccountHelper *acc_helper, gint unread_count, GList *header_list)
+{
+	GetUnreadMessagesHelper *helper = acc_helper->helper;
+
+	acc_helper->has_hits = TRUE;
+	if (helper->replied) {
+		/* Too late, we already answered */
+		g_list_foreach (header_list, (GFunc) g_object_unref, NULL);
+		g_list_free (header_list);
+		return;
+	}
+
+	helper->account_hits_list = g_list_prepend (helper->account_hits_list,
+						    account_hits_new (acc_helper->account,
+								      unread_count,
+								      header_list));
+}
+
+/* Called once the account has been completely queried */
+static void
+get_unread_messages_account_done (GetUnreadAccountHelper *acc_helper)
+{
+	GetUnreadMessagesHelper *helper = acc_helper->helper;
+
+	helper->pending_accounts = g_list_remove (helper->pending_accounts, acc_helper);
+
+	if (acc_helper->inboxes_list)
+		g_object_unref (acc_helper->inboxes_list);
+	g_free (acc_helper->inbox_url);
+	g_object_unref (acc_helper->account);
+	g_slice_free (GetUnreadAccountHelper, acc_helper);
+
+	if (helper->pending_accounts == NULL) {
+		if (!helper->replied)
+			return_results (helper);
+		get_unread_messages_helper_free (helper);
+	}
+}
+
+static gboolean
+on_get_unread_messages_timeout (GetUnreadMessagesHelper *helper)
+{
+	GList *node;
+
+	helper->timeout_id = 0;
+
+	/* Use the stored counts for the accounts that did not answer
+	   yet, and reply without waiting for them */
+	for (node = helper->pending_accounts; node != NULL; node = g_list_next (node)) {
+		GetUnreadAccountHelper *acc_helper = (GetUnreadAccountHelper *) node->data;
+		ModestFolderCounts counts;
+		gint unread_count = 0;
+
+		g_warning ("%s: account %s did not answer in time", __FUNCTION__,
+			   tny_account_get_id (acc_helper->account));
+
+		if (acc_helper->has_hits)
+			continue;
+
+		if (acc_helper->inbox_url &&
+		    modest_folder_counts_lookup (acc_helper->inbox_url, &counts))
+			unread_count = counts.unread_count;
+		add_account_hits (acc_helper, unread_count, NULL);
+	}
+
+	return_results (helper);
+
+	return FALSE;
+}
+
+static void get_unread_messages_get_headers (GetUnreadAccountHelper *acc_helper);
 static void get_unread_messages_get_headers_cb (TnyFolder *self, gboolean cancelled,
-	TnyList *headers, GError *err, GetUnreadMessagesHelper *helper);
+	TnyList *headers, GError *err, GetUnreadAccountHelper *acc_helper);
 
 static gboolean
-send_get_headers_request (GetUnreadMessagesHelper *helper)
+send_get_headers_request (GetUnreadAccountHelper *acc_helper)
 {
 	TnyList *headers_list;
 
 	headers_list = TNY_LIST (tny_simple_list_new ());
-	tny_folder_get_headers_async (helper->tmp_folder_ptr, headers_list, FALSE,
-		(TnyGetHeadersCallback) get_unread_messages_get_headers_cb, NULL, helper);
+	tny_folder_get_headers_async (acc_helper->tmp_folder_ptr, headers_list, FALSE,
+		(TnyGetHeadersCallback) get_unread_messages_get_headers_cb, NULL, acc_helper);
 	g_object_unref (headers_list);
-	g_object_unref (helper->tmp_folder_ptr);
-	helper->tmp_folder_ptr = NULL;
+	g_object_unref (acc_helper->tmp_folder_ptr);
+	acc_helper->tmp_folder_ptr = NULL;
 
 	return FALSE;
 }
@@ -2072,22 +2323,15 @@ static void get_unread_messages_get_headers_cb (TnyFolder *self,
 						gboolean cancelled,
 						TnyList *headers,
 						GError *err,
-						GetUnreadMessagesHelper *helper)
+						GetUnreadAccountHelper *acc_helper)
 {
-	TnyIterator *acc_iterator;
-	TnyAccount *account;
 	TnyIterator *headers_iterator;
-	GList *result_list = NULL;
-	gint members_count = 0;
-	AccountHits *account_hits;
-	ModestProtocolType store_protocol_type;
-	ModestProtocol *store_protocol;
+	GArray *heap;
 	gint unread_count;
-	ModestProtocolRegistry *registry;
-
-	acc_iterator = tny_list_create_iterator (helper->accounts_list);
-	account = TNY_ACCOUNT (tny_iterator_get_current (acc_iterator));
+	gboolean is_provider;
 
+	heap = g_array_sized_new (FALSE, FALSE, sizeof (UnreadHeader),
+				  MAX (acc_helper->helper->unread_msgs_count, 0));
 	headers_iterator = tny_list_create_iterator (headers);
 	unread_count = 0;
 	while (!tny_iterator_is_done (headers_iterator)) {
@@ -2098,13 +2342,7 @@ static void get_unread_messages_get_headers_cb (TnyFolder *self,
 		flags = tny_header_get_flags (header);
 		if (!(flags & TNY_HEADER_FLAG_SEEN)) {
 			unread_count++;
-			result_list = g_list_insert_sorted (result_list, g_object_ref (header), (GCompareFunc) headers_cmp);
-			if (members_count == helper->unread_msgs_count) {
-				g_object_unref (result_list->data);
-				result_list = g_list_delete_link (result_list, result_list);
-			} else {
-				members_count++;
-			}
+			unread_heap_push (heap, MAX (acc_helper->helper->unread_msgs_count, 0), header);
 		}
 
 		g_object_unref (header);
@@ -2112,25 +2350,31 @@ static void get_unread_messages_get_headers_cb (TnyFolder *self,
 	}
 	g_object_unref (headers_iterator);
 
-	registry = modest_runtime_get_protocol_registry ();
-	store_protocol_type = modest_tny_account_get_protocol_type (account);
+	is_provider = modest_protocol_registry_protocol_type_is_provider (modest_runtime_get_protocol_registry (),
+									  modest_tny_account_get_protocol_type (acc_helper->account));
 
 	/* Get the number of unread messages for plug-in based accounts */
-	if (modest_protocol_registry_protocol_type_is_provider (registry, store_protocol_type)) {
+	if (is_provider) {
 		guint folder_unread_count;
 
 		folder_unread_count = tny_folder_get_unread_count (self);
 		if (folder_unread_count != unread_count &&
-			unread_count != helper->unread_msgs_count) {
+			unread_count != acc_helper->helper->unread_msgs_count) {
 			/* the number of unread messages is incorrect, try again */
-			if (helper->get_headers_tries_left--) {
+			if (acc_helper->get_headers_tries_left-- && !acc_helper->helper->replied) {
+				GList *node;
+
 				/* try again at a small timeout */
-				helper->tmp_folder_ptr = g_object_ref (self);
+				acc_helper->tmp_folder_ptr = g_object_ref (self);
+
+				node = unread_heap_free_to_list (heap);
+				g_list_foreach (node, (GFunc) g_object_unref, NULL);
+				g_list_free (node);
 
-				g_timeout_add (200, (GSourceFunc)send_get_headers_request, helper);
+				g_timeout_add (200, (GSourceFunc)send_get_headers_request, acc_helper);
 
 				g_warning ("Getting unread messages, tries left: (%d)",
-					helper->get_headers_tries_left);
+					acc_helper->get_headers_tries_left);
 				return;
 			}
 			else {
@@ -2142,57 +2386,73 @@ static void get_unread_messages_get_headers_cb (TnyFolder *self,
 		else {
 			unread_count = folder_unread_count;
 		}
+	} else if (!cancelled && !err) {
+		gchar *url = tny_folder_get_url_string (self);
+
+		/* Remember the counts, the next request could skip
+		   fetching the headers (see get_unread_messages_get_headers) */
+		if (url) {
+			modest_folder_counts_update (url, tny_list_get_length (headers),
+						     unread_count, NULL);
+			g_free (url);
+		}
 	}
 
-	account_hits = g_slice_new (AccountHits);
-	account_hits->account_id = g_strdup (modest_tny_account_get_parent_modest_account_name_for_server_account (account));
-	account_hits->account_name = g_strdup (tny_account_get_name (account));
-	store_protocol = modest_protocol_registry_get_protocol_by_type (registry, store_protocol_type);
-	account_hits->store_protocol = g_strdup (modest_protocol_get_name (store_protocol));
-	account_hits->header_list = result_list;
-	account_hits->unread_count = unread_count;
+	add_account_hits (acc_helper, unread_count, unread_heap_free_to_list (heap));
 
-	helper->account_hits_list = g_list_prepend (helper->account_hits_list, account_hits);
+	get_unread_messages_get_headers (acc_helper);
+}
 
-	get_unread_messages_get_headers (helper);
+/* Whether the persistent folder counts say that @folder has no
+ * unread messages. Plug-in based accounts always load the headers,
+ * their counts are not reliable (see get_unread_messages_get_headers_cb) */
+static gboolean
+inbox_known_to_be_read (GetUnreadAccountHelper *acc_helper, TnyFolder *folder)
+{
+	guint unread_count = 0;
 
+	if (modest_protocol_registry_protocol_type_is_provider (modest_runtime_get_protocol_registry (),
+								modest_tny_account_get_protocol_type (acc_helper->account)))
+		return FALSE;
+
+	modest_folder_counts_get_for_folder (folder, NULL, &unread_count);
+
+	return unread_count == 0;
 }
 
 static void
-get_unread_messages_get_headers (GetUnreadMessagesHelper *helper)
+get_unread_messages_get_headers (GetUnreadAccountHelper *acc_helper)
 {
 	TnyIterator *iterator;
 
-	iterator = tny_list_create_iterator (helper->inboxes_list);
+	iterator = tny_list_create_iterator (acc_helper->inboxes_list);
 	do {
 		if (tny_iterator_is_done (iterator)) {
-			TnyIterator *accounts_iter;
-			TnyAccount *account;
-			g_object_unref (helper->inboxes_list);
-			helper->inboxes_list = NULL;
-
-			accounts_iter = tny_list_create_iterator (helper->accounts_list);
-			account = TNY_ACCOUNT (tny_iterator_get_current (accounts_iter));
-			g_object_unref (accounts_iter);
-
-			tny_list_remove (helper->accounts_list, (GObject *) account);
-			g_object_unref (account);
-			get_unread_messages_get_account (helper);
-			break;
+			g_object_unref (iterator);
+			get_unread_messages_account_done (acc_helper);
+			return;
 		} else {
 			TnyFolder *folder;
 
 			folder = TNY_FOLDER (tny_iterator_get_current (iterator));
-			if (folder) {
+			if (folder && inbox_known_to_be_read (acc_helper, folder)) {
+				/* Nothing to report, don't load the headers */
+				tny_list_remove (acc_helper->inboxes_list, G_OBJECT (folder));
+				g_object_unref (folder);
+				add_account_hits (acc_helper, 0, NULL);
+				g_object_unref (iterator);
+				get_unread_messages_get_headers (acc_helper);
+				return;
+			} else if (folder) {
 				TnyList *headers_list;
 
 				headers_list = TNY_LIST (tny_simple_list_new ());
-				helper->get_headers_tries_left = 20;
+				acc_helper->get_headers_tries_left = 20;
 				tny_folder_get_headers_async (folder, headers_list, FALSE,
 					(TnyGetHeadersCallback) get_unread_messages_get_headers_cb,
-					NULL, helper);
+					NULL, acc_helper);
 				g_object_unref (headers_list);
-				tny_list_remove (helper->inboxes_list, G_OBJECT (folder));
+				tny_list_remove (acc_helper->inboxes_list, G_OBJECT (folder));
 				g_object_unref (folder);
 				break;
 			}
@@ -2208,7 +2468,7 @@ get_unread_messages_get_headers (GetUnreadMessagesHelper *helper)
 
 static void get_account_folders_cb (TnyFolderStore *self, gboolean cancelled, TnyList *list, GError *err, gpointer user_data)
 {
-	GetUnreadMessagesHelper *helper = (GetUnreadMessagesHelper *) user_data;
+	GetUnreadAccountHelper *acc_helper = (GetUnreadAccountHelper *) user_data;
 	TnyIterator *iterator;
 	gboolean inbox_exists;
 
@@ -2219,7 +2479,8 @@ static void get_account_folders_cb (TnyFolderStore *self, gboolean cancelled, Tn
 
 		folder = TNY_FOLDER (tny_iterator_get_current (iterator));
 		if (tny_folder_get_folder_type (folder) == TNY_FOLDER_TYPE_INBOX) {
-			tny_list_prepend (helper->inboxes_list, G_OBJECT (folder));
+			tny_list_prepend (acc_helper->inboxes_list, G_OBJECT (folder));
+			acc_helper->inbox_url = tny_folder_get_url_string (folder);
 			g_object_unref (folder);
 			inbox_exists = TRUE;
 			break;
@@ -2230,42 +2491,25 @@ static void get_account_folders_cb (TnyFolderStore *self, gboolean cancelled, Tn
 	g_object_unref (iterator);
 
 	if (!inbox_exists) {
-		TnyAccount *account;
-		TnyIterator *accounts_it;
-		AccountHits *account_hit;
-		ModestProtocol *store_protocol;
-		ModestProtocolType store_protocol_type;
-
-		/* we have finished with the current account, prepare the account hit */
-		accounts_it = tny_list_create_iterator (helper->accounts_list);
-		account = TNY_ACCOUNT (tny_iterator_get_current (accounts_it));
+		TnyAccount *account = acc_helper->account;
 
 		if (!modest_tny_account_is_virtual_local_folders (account) &&
 			!modest_tny_account_is_memory_card_account (account)) {
 			/* the account does not have (yet) the inbox */
-			account_hit = g_slice_new (AccountHits);
-			account_hit->account_id = g_strdup (modest_tny_account_get_parent_modest_account_name_for_server_account (account));
-			account_hit->account_name = g_strdup (tny_account_get_name (account));
-			store_protocol_type = modest_tny_account_get_protocol_type (account);
-			store_protocol = modest_protocol_registry_get_protocol_by_type (modest_runtime_get_protocol_registry (), store_protocol_type);
-			account_hit->store_protocol = g_strdup (modest_protocol_get_name (store_protocol));
-			account_hit->header_list = NULL;
-			account_hit->unread_count = 0;
-
-			helper->account_hits_list = g_list_prepend (helper->account_hits_list, account_hit);
+			add_account_hits (acc_helper, 0, NULL);
 		}
 	}
 
-	get_unread_messages_get_headers (helper);
+	get_unread_messages_get_headers (acc_helper);
 }
 
 static void get_multi_mailbox_account_folders_cb (TnyFolderStore *self, gboolean cancelled, TnyList *list, GError *err, gpointer user_data)
 {
-	GetUnreadMessagesHelper *helper = (GetUnreadMessagesHelper *) user_data;
+	GetUnreadAccountHelper *acc_helper = (GetUnreadAccountHelper *) user_data;
 	TnyIterator *iterator;
 
 	/* another request has been finished */
-	helper->folder_requests_done += 1;
+	acc_helper->folder_requests_done += 1;
 
 	/* analize the folders we got */
 	iterator = tny_list_create_iterator (list);
@@ -2288,7 +2532,7 @@ static void get_multi_mailbox_account_folders_cb (TnyFolderStore *self, gboolean
 				TnyIterator *inboxes_it;
 
 				alread_in_list = FALSE;
-				inboxes_it = tny_list_create_iterator (helper->inboxes_list);
+				inboxes_it = tny_list_create_iterator (acc_helper->inboxes_list);
 				while (!tny_iterator_is_done (inboxes_it)) {
 					TnyFolder *folder;
 
@@ -2309,7 +2553,7 @@ static void get_multi_mailbox_account_folders_cb (TnyFolderStore *self, gboolean
 				g_object_unref (inboxes_it);
 
 				if (!alread_in_list) {
-					tny_list_prepend (helper->inboxes_list, G_OBJECT (folder));
+					tny_list_prepend (acc_helper->inboxes_list, G_OBJECT (folder));
 				}
 			}
 		}
@@ -2322,10 +2566,10 @@ static void get_multi_mailbox_account_folders_cb (TnyFolderStore *self, gboolean
 			if (folder_store) {
 				TnyList *folders_list;
 
-				helper->folder_requests_total += 1;
+				acc_helper->folder_requests_total += 1;
 				folders_list = tny_simple_list_new ();
 				tny_folder_store_get_folders_async (folder_store, folders_list,
-					NULL, FALSE, get_multi_mailbox_account_folders_cb, NULL, helper);
+					NULL, FALSE, get_multi_mailbox_account_folders_cb, NULL, acc_helper);
 				g_object_unref (folders_list);
 			}
 		}
@@ -2335,21 +2579,13 @@ static void get_multi_mailbox_account_folders_cb (TnyFolderStore *self, gboolean
 	g_object_unref (iterator);
 
 	/* Check if we have handled all the inbox folders for multi-mailbox accounts */
-	if (helper->folder_requests_done == helper->folder_requests_total) {
+	if (acc_helper->folder_requests_done == acc_helper->folder_requests_total) {
 		TnyIterator *inboxes_it;
-		TnyIterator *accounts_it;
-		TnyAccount *account;
 		guint unread_messages;
-		AccountHits* account_hits;
-		ModestProtocol *store_protocol;
-		ModestProtocolType store_protocol_type;
 
 		/* Store the number of unread messages for the handled account */
 		unread_messages = 0;
-		accounts_it = tny_list_create_iterator (helper->accounts_list);
-		account = TNY_ACCOUNT (tny_iterator_get_current (accounts_it));
-		g_object_unref (accounts_it);
-		inboxes_it = tny_list_create_iterator (helper->inboxes_list);
+		inboxes_it = tny_list_create_iterator (acc_helper->inboxes_list);
 		while (!tny_iterator_is_done (inboxes_it)) {
 			TnyFolder *folder;
 
@@ -2367,76 +2603,38 @@ static void get_multi_mailbox_account_folders_cb (TnyFolderStore *self, gboolean
 			tny_iterator_next (inboxes_it);
 		}
 		g_object_unref (inboxes_it);
-		g_object_unref (helper->inboxes_list);
-		helper->inboxes_list = NULL;
-		account_hits = g_slice_new (AccountHits);
-		account_hits->account_id = g_strdup (
-			modest_tny_account_get_parent_modest_account_name_for_server_account (account));
-		account_hits->account_name = g_strdup (tny_account_get_name (account));
-		store_protocol_type = modest_tny_account_get_protocol_type (account);
-		store_protocol = modest_protocol_registry_get_protocol_by_type (
-			modest_runtime_get_protocol_registry (), store_protocol_type);
-		account_hits->store_protocol = g_strdup (modest_protocol_get_name (store_protocol));
-		account_hits->header_list = NULL;
-		account_hits->unread_count = unread_messages;
-		helper->account_hits_list = g_list_prepend (helper->account_hits_list, account_hits);
-
-		/* remove the handled account from the accounts_list */
-		tny_list_remove (helper->accounts_list, G_OBJECT (account));
-		g_object_unref (account);
+		add_account_hits (acc_helper, unread_messages, NULL);
 
-		get_unread_messages_get_account (helper);
+		get_unread_messages_account_done (acc_helper);
 	}
 }
 
 static void
-get_unread_messages_get_account (GetUnreadMessagesHelper *helper)
+get_unread_messages_get_account (GetUnreadAccountHelper *acc_helper)
 {
-	TnyIterator *iterator;
-
-	/* Search through all accounts */
-	iterator = tny_list_create_iterator (helper->accounts_list);
-	do {
-		if (tny_iterator_is_done (iterator)) {
-			/* all results, then finish */
-			return_results (helper);
-			break;
-		} else {
-			TnyAccount *account;
-
-			account = TNY_ACCOUNT (tny_iterator_get_current (iterator));
-			if (account && TNY_FOLDER_STORE (account) && TNY_IS_FOLDER_STORE (TNY_FOLDER_STORE (account))) {
-				TnyList *folders_list;
-				ModestProtocolType protocol_type;
+	TnyList *folders_list;
+	ModestProtocolType protocol_type;
 
-				protocol_type = modest_tny_account_get_protocol_type (account);
+	protocol_type = modest_tny_account_get_protocol_type (acc_helper->account);
 
-				folders_list = tny_simple_list_new ();
-				helper->inboxes_list =  tny_simple_list_new ();
-				if (MODEST_PROTOCOL_REGISTRY_TYPE_INVALID != protocol_type &&
-					modest_protocol_registry_protocol_type_has_tag (modest_runtime_get_protocol_registry (),
-						protocol_type, MODEST_PROTOCOL_REGISTRY_MULTI_MAILBOX_PROVIDER_PROTOCOLS)) {
-					/* For multi-mailbox protocols we only can get the number of unread messages,
-					   we will not even try to get their email headers */
-					helper->folder_requests_done = 0;
-					helper->folder_requests_total = 1;
-					tny_folder_store_get_folders_async (TNY_FOLDER_STORE (account),
-						folders_list, NULL, FALSE, get_multi_mailbox_account_folders_cb, NULL, helper);
-				}
-				else {
-					/* For non-multi-mailbox protocols we will get their email headers */
-					tny_folder_store_get_folders_async (TNY_FOLDER_STORE (account),
-						folders_list, NULL, FALSE, get_account_folders_cb, NULL, helper);
-				}
-				g_object_unref (folders_list);
-				g_object_unref (account);
-				break;
-			}
-		}
-		/* incorrect item detected, move on to the next item */
-		tny_iterator_next (iterator);
-	} while (TRUE);
-	g_object_unref (iterator);
+	folders_list = tny_simple_list_new ();
+	acc_helper->inboxes_list = tny_simple_list_new ();
+	if (MODEST_PROTOCOL_REGISTRY_TYPE_INVALID != protocol_type &&
+		modest_protocol_registry_protocol_type_has_tag (modest_runtime_get_protocol_registry (),
+			protocol_type, MODEST_PROTOCOL_REGISTRY_MULTI_MAILBOX_PROVIDER_PROTOCOLS)) {
+		/* For multi-mailbox protocols we only can get the number of unread messages,
+		   we will not even try to get their email headers */
+		acc_helper->folder_requests_done = 0;
+		acc_helper->folder_requests_total = 1;
+		tny_folder_store_get_folders_async (TNY_FOLDER_STORE (acc_helper->account),
+			folders_list, NULL, FALSE, get_multi_mailbox_account_folders_cb, NULL, acc_helper);
+	}
+	else {
+		/* For non-multi-mailbox protocols we will get their email headers */
+		tny_folder_store_get_folders_async (TNY_FOLDER_STORE (acc_helper->account),
+			folders_list, NULL, FALSE, get_account_folders_cb, NULL, acc_helper);
+	}
+	g_object_unref (folders_list);
 }
 
 /**
@@ -2467,17 +2665,56 @@ static gboolean
 on_idle_get_unread_messages (GetUnreadMessagesHelper *helper)
 {
 	ModestTnyAccountStore *astore;
+	TnyList *accounts_list;
+	TnyIterator *iterator;
+	GList *accounts, *node;
 
 	astore = modest_runtime_get_account_store ();
 
+	accounts_list = TNY_LIST (tny_simple_list_new ());
 	tny_account_store_get_accounts (TNY_ACCOUNT_STORE (astore),
-					helper->accounts_list,
+					accounts_list,
 					TNY_ACCOUNT_STORE_STORE_ACCOUNTS);
 
 	/* remove the local accounts */
-	tny_list_remove_matches (helper->accounts_list, modest_local_accounts_matcher, NULL);
+	tny_list_remove_matches (accounts_list, modest_local_accounts_matcher, NULL);
+
+	iterator = tny_list_create_iterator (accounts_list);
+	while (!tny_iterator_is_done (iterator)) {
+		TnyAccount *account;
+
+		account = TNY_ACCOUNT (tny_iterator_get_current (iterator));
+		if (account && TNY_IS_FOLDER_STORE (account)) {
+			GetUnreadAccountHelper *acc_helper;
+
+			acc_helper = g_slice_new0 (GetUnreadAccountHelper);
+			acc_helper->helper = helper;
+			acc_helper->account = g_object_ref (account);
+			helper->pending_accounts = g_list_prepend (helper->pending_accounts, acc_helper);
+		}
+		if (account)
+			g_object_unref (account);
+		tny_iterator_next (iterator);
+	}
+	g_object_unref (iterator);
+	g_object_unref (accounts_list);
 
-	get_unread_messages_get_account (helper);
+	if (!helper->pending_accounts) {
+		return_results (helper);
+		get_unread_messages_helper_free (helper);
+		return FALSE;
+	}
+
+	helper->timeout_id = g_timeout_add_seconds (GET_UNREAD_MESSAGES_TIMEOUT,
+						    (GSourceFunc) on_get_unread_messages_timeout,
+						    helper);
+
+	/* Query all the accounts at the same time. Use a copy, they're
+	   removed from the pending list as soon as they finish */
+	accounts = g_list_copy (helper->pending_accounts);
+	for (node = accounts; node != NULL; node = g_list_next (node))
+		get_unread_messages_get_account ((GetUnreadAccountHelper *) node->data);
+	g_list_free (accounts);
 
 	return FALSE;
 }
@@ -2503,8 +2740,9 @@ on_dbus_method_get_unread_messages (DBusConnection *con, DBusMessage *message)
 	helper->message = message;
 	helper->con = con;
 	helper->account_hits_list = NULL;
-	helper->inboxes_list = NULL;
-	helper->accounts_list = TNY_LIST (tny_simple_list_new ());
+	helper->pending_accounts = NULL;
+	helper->timeout_id = 0;
+	helper->replied = FALSE;
 	helper->mail_op = modest_mail_operation_new (NULL);
 	modest_mail_operation_queue_add (modest_runtime_get_mail_operation_queue (),
 					 helper->mail_op);
@@ -2846,6 +3084,9 @@ modest_dbus_req_filter (DBusConnection *con,
 {
 	gboolean handled = FALSE;
 
+	if (dbus_message_get_type (message) == DBUS_MESSAGE_TYPE_METHOD_CALL)
+		trace_first_request ();
+
 	if (dbus_message_is_method_call (message,
 					 MODEST_DBUS_IFACE,
 					 MODEST_DBUS_METHOD_SEARCH)) {
@@ -2898,6 +3139,16 @@ modest_dbus_req_filter (DBusConnection *con,
 						MODEST_DBUS_METHOD_DUMP_SEND_QUEUES)) {
 		on_dbus_method_dump_send_queues (con, message);
 		handled = TRUE;
+	} else if (dbus_message_is_method_call (message,
+						MODEST_DBUS_IFACE,
+						MODEST_DBUS_METHOD_DUMP_STARTUP_TRACE)) {
+		on_dbus_method_dump_startup_trace (con, message);
+		handled = TRUE;
+	} else if (dbus_message_is_method_call (message,
+						MODEST_DBUS_IFACE,
+						MODEST_DBUS_METHOD_DELETE_MESSAGES)) {
+		on_dbus_method_delete_messages (con, message);
+		handled = TRUE;
 	} else {
 		/* Note that this mentions methods that were already handled in modest_dbus_req_handler(). */
 		/* 
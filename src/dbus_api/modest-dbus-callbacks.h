@@ -35,6 +35,14 @@
 #include <libosso.h>
 #include <libmodest-dbus-client/libmodest-dbus-api.h>
 
+/* not (yet) part of libmodest-dbus-client */
+#ifndef MODEST_DBUS_METHOD_DUMP_STARTUP_TRACE
+#define MODEST_DBUS_METHOD_DUMP_STARTUP_TRACE "DumpStartupTrace"
+#endif
+#ifndef MODEST_DBUS_METHOD_DELETE_MESSAGES
+#define MODEST_DBUS_METHOD_DELETE_MESSAGES "DeleteMessages"
+#endif
+
 gint modest_dbus_req_handler(const gchar * interface, const gchar * method,
                       GArray * arguments, gpointer data,
                       osso_rpc_t * retval);
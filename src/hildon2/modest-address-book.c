@@ -34,6 +34,7 @@
 #include "modest-platform.h"
 #include <modest-address-book.h>
 #include <modest-text-utils.h>
+#include <modest-address-index.h>
 #include <libebook/libebook.h>
 #include "modest-hildon-includes.h"
 #include <libosso-abook/osso-abook.h>
@@ -516,16 +517,12 @@ compare_addresses (const gchar *address1,
 		   const gchar *mail2)
 {
 	gint retval;
-	gchar *mail1, *mail1_down, *mail2_down;
+	gchar *mail1;
 
 	/* Perform a case insensitive comparison */
 	mail1 = modest_text_utils_get_email_address (address1);
-	mail1_down = g_ascii_strdown (mail1, -1);
-	mail2_down = g_ascii_strdown (mail2, -1);
-	retval = g_strcmp0 (mail1_down, mail2_down);
+	retval = (mail1 && mail2) ? g_ascii_strcasecmp (mail1, mail2) : g_strcmp0 (mail1, mail2);
 	g_free (mail1);
-	g_free (mail1_down);
-	g_free (mail2_down);
 
 	return retval;
 }
@@ -1046,7 +1043,8 @@ static gboolean
 contact_name_or_email_starts_with (OssoABookContact *contact,
                                    gpointer          user_data)
 {
-	const char *prefix = user_data;
+	/* already lowercased by the caller */
+	const char *prefix_down = user_data;
 	GList *contacts, *l;
 	gboolean contact_match;
 
@@ -1066,9 +1064,8 @@ contact_name_or_email_starts_with (OssoABookContact *contact,
 			name = e_vcard_attribute_get_name (attr);
 
 			if (!g_strcmp0 (name, "N") ||
-			    (strchr (prefix, '@') && !g_strcmp0 (name, "EMAIL"))) {
+			    (strchr (prefix_down, '@') && !g_strcmp0 (name, "EMAIL"))) {
 				GList *values = e_vcard_attribute_get_values (attr);
-				gchar *prefix_down = g_utf8_strdown (prefix, -1);
 
 				for (;values; values = values->next) {
 					gchar *value_down = NULL;
@@ -1079,12 +1076,10 @@ contact_name_or_email_starts_with (OssoABookContact *contact,
 					if (value_down && g_str_has_prefix (value_down, prefix_down)) {
 						contact_match = TRUE;
 						g_free (value_down);
-						g_free (prefix_down);
 						goto out;
 					}
 					g_free (value_down);
 				}
-				g_free (prefix_down);
 			}
 		}
 	}
@@ -1103,6 +1098,7 @@ resolve_address (const gchar *address,
 	GList *resolved_contacts;
 	CheckNamesInfo *info;
 	OssoABookRoster *roster;
+	gchar *address_down;
 
 	g_return_val_if_fail (canceled, FALSE);
 
@@ -1124,10 +1120,12 @@ resolve_address (const gchar *address,
 	}
 
 	roster = osso_abook_aggregator_get_default (NULL);
+	address_down = g_utf8_strdown (address, -1);
 	resolved_contacts =
 		osso_abook_aggregator_find_contacts_full ((OssoABookAggregator *) roster,
 							  contact_name_or_email_starts_with,
-							  (gpointer) address);
+							  (gpointer) address_down);
+	g_free (address_down);
 #ifdef MODEST_PLATFORM_MAEMO
 	GList *external_contacts = asdbus_resolve_recipients (address);
 #else
@@ -1323,6 +1321,12 @@ modest_address_book_has_address (const gchar *address)
 
 	email = modest_text_utils_get_email_address (address);
 
+	/* We already know the contacts of the address book */
+	if (modest_address_index_is_contact (email)) {
+		g_free (email);
+		return TRUE;
+	}
+
 	roster = (OssoABookAggregator *) osso_abook_aggregator_get_default (NULL);
 	contacts = osso_abook_aggregator_find_contacts_for_email_address (roster, email);
 	if (!contacts) {
@@ -1334,6 +1338,7 @@ modest_address_book_has_address (const gchar *address)
 
 	if (contacts) {
 		g_list_free (contacts);
+		modest_address_index_add_contact (NULL, email);
 		result = TRUE;
 	}
 
@@ -1356,10 +1361,41 @@ modest_address_book_get_my_name ()
 		return NULL;
 }
 
+static gboolean
+add_contacts_to_index_idle (gpointer user_data)
+{
+	OssoABookAggregator *roster;
+	GList *contacts, *node;
+
+	roster = (OssoABookAggregator *) osso_abook_aggregator_get_default (NULL);
+	if (!roster)
+		return FALSE;
+
+	contacts = osso_abook_aggregator_list_master_contacts (roster);
+	for (node = contacts; node; node = g_list_next (node)) {
+		EContact *contact = E_CONTACT (node->data);
+		const gchar *name;
+		GList *emails, *email;
+
+		name = osso_abook_contact_get_display_name (OSSO_ABOOK_CONTACT (contact));
+		emails = e_contact_get (contact, E_CONTACT_EMAIL);
+		for (email = emails; email; email = g_list_next (email))
+			modest_address_index_add_contact (name, (const gchar *) email->data);
+
+		g_list_foreach (emails, (GFunc) g_free, NULL);
+		g_list_free (emails);
+	}
+	g_list_free (contacts);
+
+	return FALSE;
+}
+
 void
 modest_address_book_init (void)
 {
-	open_addressbook ();
+	/* Feed the recipient completion with the contacts */
+	if (open_addressbook ())
+		g_idle_add (add_contacts_to_index_idle, NULL);
 }
 
 void
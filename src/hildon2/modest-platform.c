@@ -157,6 +157,15 @@ check_required_files (void)
 }
 
 
+/* Hardware events. The caches are shrunk as soon as the system
+   reports that the memory is running low */
+static void
+on_hw_state_event (osso_hw_state_t *state, gpointer data)
+{
+	if (state->memory_low_ind)
+		modest_cache_mgr_memory_low (modest_runtime_get_cache_mgr ());
+}
+
 /* the gpointer here is the osso_context. */
 gboolean
 modest_platform_init (int argc, char *argv[])
@@ -205,7 +214,8 @@ modest_platform_init (int argc, char *argv[])
 
 	/* Register hardware event dbus callback: */
     	hw_state.shutdown_ind = TRUE;
-	osso_hw_set_event_cb(osso_context, NULL, NULL, NULL);
+	hw_state.memory_low_ind = TRUE;
+	osso_hw_set_event_cb(osso_context, &hw_state, on_hw_state_event, NULL);
 
 	/* Make sure that the update interval is changed whenever its gconf key 
 	 * is changed */
@@ -2501,9 +2511,11 @@ modest_platform_check_memory_low (ModestWindow *win,
 			_KR("memr_ib_operation_disabled"),
 			TRUE);
 
-	if (lowmem)
+	if (lowmem) {
 		g_debug ("%s: low memory reached. disallowing some operations",
 			 __FUNCTION__);
+		modest_cache_mgr_memory_low (modest_runtime_get_cache_mgr ());
+	}
 
 	return lowmem;
 }
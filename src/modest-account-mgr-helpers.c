@@ -726,6 +726,7 @@ modest_account_mgr_load_account_settings (ModestAccountMgr *self,
 
 	modest_account_settings_set_leave_messages_on_server 
 		(settings, modest_account_mgr_get_leave_on_server (self, name));
+	modest_account_settings_set_push (settings, modest_account_mgr_get_push (self, name));
 	modest_account_settings_set_use_connection_specific_smtp 
 		(settings, modest_account_mgr_get_use_connection_specific_smtp (self, name));
 
@@ -799,6 +800,8 @@ modest_account_mgr_save_account_settings (ModestAccountMgr *mgr,
 					       modest_account_settings_get_retrieve_limit (settings));
 	modest_account_mgr_set_leave_on_server (mgr, account_name,
 						modest_account_settings_get_leave_messages_on_server (settings));
+	modest_account_mgr_set_push (mgr, account_name,
+				     modest_account_settings_get_push (settings));
 	modest_account_mgr_set_signature (mgr, account_name,
 					  modest_account_settings_get_signature (settings),
 					  modest_account_settings_get_use_signature (settings));
@@ -1050,6 +1053,28 @@ modest_account_mgr_get_leave_on_server (ModestAccountMgr *self,
 					    FALSE);
 }
 
+void 
+modest_account_mgr_set_push (ModestAccountMgr *self, 
+			     const gchar *account_name, 
+			     gboolean push)
+{
+	modest_account_mgr_set_bool (self, 
+				     account_name,
+				     MODEST_ACCOUNT_PUSH, 
+				     push, 
+				     FALSE);
+}
+
+gboolean 
+modest_account_mgr_get_push (ModestAccountMgr *self, 
+			     const gchar* account_name)
+{
+	return modest_account_mgr_get_bool (self, 
+					    account_name,
+					    MODEST_ACCOUNT_PUSH, 
+					    FALSE);
+}
+
 gint 
 modest_account_mgr_get_last_updated (ModestAccountMgr *self, 
 				     const gchar* account_name)
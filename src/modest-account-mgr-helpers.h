@@ -419,6 +419,22 @@ void modest_account_mgr_set_leave_on_server (ModestAccountMgr *self,
 gboolean modest_account_mgr_get_leave_on_server (ModestAccountMgr *self, 
 						 const gchar* account_name);
 
+/**
+ * modest_account_mgr_set_push:
+ * @self: a ModestAccountMgr instance
+ * @account_name: the id of an account
+ * @push: whether the new messages of @account_name are pushed
+ *
+ * Sets the push mode of an account. Clearing it stops the push
+ * monitor of the account, if it was running.
+ */
+void modest_account_mgr_set_push (ModestAccountMgr *self, 
+				  const gchar* account_name, 
+				  gboolean push);
+
+gboolean modest_account_mgr_get_push (ModestAccountMgr *self, 
+				      const gchar* account_name);
+
 gint  modest_account_mgr_get_last_updated (ModestAccountMgr *self, 
 					   const gchar* account_name);
 
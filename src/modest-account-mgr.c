@@ -441,6 +441,8 @@ modest_account_mgr_add_account (ModestAccountMgr *self,
 	 * as per the UI spec, though it is only meaningful for accounts using POP.
 	 * (possibly this gconf key should be under the server account): */
 	modest_account_mgr_set_bool (self, name, MODEST_ACCOUNT_LEAVE_ON_SERVER, TRUE, FALSE);
+	/* The push mode keeps a connection open, so it's opt-in */
+	modest_account_mgr_set_bool (self, name, MODEST_ACCOUNT_PUSH, FALSE, FALSE);
 	modest_account_mgr_set_bool (self, name, MODEST_ACCOUNT_ENABLED, enabled,FALSE);
 
 	/* Fill other data */
@@ -1079,7 +1081,8 @@ modest_account_mgr_set_bool (ModestAccountMgr * self, const gchar * name,
 	} else {
 		/* check whether this field is one of those interesting for the 
 		 * "account-updated" signal */
-		if (strcmp (key, MODEST_ACCOUNT_HAS_NEW_MAILS) == 0) {
+		if (strcmp (key, MODEST_ACCOUNT_HAS_NEW_MAILS) == 0 ||
+		    (!server_account && strcmp (key, MODEST_ACCOUNT_PUSH) == 0)) {
 			g_signal_emit (G_OBJECT(self), signals[ACCOUNT_UPDATED_SIGNAL], 
 					0, name);
 		}
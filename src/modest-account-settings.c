@@ -47,6 +47,7 @@ struct _ModestAccountSettingsPrivate {
 	gboolean enabled;
 	gboolean is_default;
 	gboolean leave_messages_on_server;
+	gboolean push;
 	gboolean use_signature;
 	gchar *signature;
 	gboolean use_connection_specific_smtp;
@@ -116,6 +117,7 @@ modest_account_settings_instance_init (ModestAccountSettings *obj)
 	priv->enabled = TRUE;
 	priv->is_default = FALSE;
 	priv->leave_messages_on_server = TRUE;
+	priv->push = FALSE;
 	priv->use_signature = FALSE;
 	priv->signature = FALSE;
 	priv->use_connection_specific_smtp = FALSE;
@@ -479,6 +481,29 @@ modest_account_settings_set_leave_messages_on_server (ModestAccountSettings *set
 	priv->leave_messages_on_server = leave_messages_on_server;
 }
 
+gboolean 
+modest_account_settings_get_push (ModestAccountSettings *settings)
+{
+	ModestAccountSettingsPrivate *priv;
+
+	g_return_val_if_fail (MODEST_IS_ACCOUNT_SETTINGS (settings), FALSE);
+
+	priv = MODEST_ACCOUNT_SETTINGS_GET_PRIVATE (settings);
+	return priv->push;
+}
+
+void   
+modest_account_settings_set_push (ModestAccountSettings *settings,
+				  gboolean push)
+{
+	ModestAccountSettingsPrivate *priv;
+
+	g_return_if_fail (MODEST_IS_ACCOUNT_SETTINGS (settings));
+
+	priv = MODEST_ACCOUNT_SETTINGS_GET_PRIVATE (settings);
+	priv->push = push;
+}
+
 gboolean 
 modest_account_settings_get_use_connection_specific_smtp (ModestAccountSettings *settings)
 {
@@ -337,6 +337,27 @@ gboolean modest_account_settings_get_leave_messages_on_server (ModestAccountSett
 void modest_account_settings_set_leave_messages_on_server (ModestAccountSettings *settings, 
 							   gboolean leave_messages_on_server);
 
+/**
+ * modest_account_settings_get_push:
+ * @settings: a #ModestAccountSettings
+ *
+ * obtains whether the server should push the new messages, see
+ * modest_push_monitor_start(). Only meaningful for IMAP accounts
+ *
+ * Returns: a #gboolean
+ */
+gboolean modest_account_settings_get_push (ModestAccountSettings *settings);
+
+/**
+ * modest_account_settings_set_push:
+ * @settings: a #ModestAccountSettings
+ * @push: a #gboolean
+ *
+ * set if the server should push the new messages or not.
+ */
+void modest_account_settings_set_push (ModestAccountSettings *settings,
+				       gboolean push);
+
 
 /**
  * modest_account_settings_get_use_connection_specific_smtp:
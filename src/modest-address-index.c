@@ -0,0 +1,633 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <time.h>
+#include "modest-address-index.h"
+#include "modest-text-utils.h"
+#include "modest-defs.h"
+
+/* seconds to wait before writing the changes to disk */
+#define SAVE_TIMEOUT 10
+
+/* addresses not used for this long are not saved anymore */
+#define MAX_AGE (365 * 24 * 60 * 60)
+
+/* the score of an address goes down to a half after this time
+   without using it, to a third after twice this time... */
+#define SCORE_HALF_LIFE (30 * 24 * 60 * 60)
+
+#define SENT_WEIGHT     3.0
+#define RECEIVED_WEIGHT 1.0
+
+#define KEY_NAME  "name"
+#define KEY_SCORE "score"
+#define KEY_LAST  "last"
+
+typedef struct {
+	gchar    *email;
+	gchar    *name;		/* might be NULL */
+	gdouble   score;	/* score at last_used time */
+	time_t    last_used;	/* 0 if never used */
+	/* not saved */
+	gboolean  contact;	/* TRUE if it's in the address book */
+	guint     stamp;	/* to skip duplicated matches */
+	gdouble   rank;		/* the score at the time of the lookup */
+} AddressEntry;
+
+/* the prefix index: the email, the name and every word of the name
+   of the entries, casefolded and sorted, so all the keys starting
+   with a prefix are together */
+typedef struct {
+	gchar        *key;
+	AddressEntry *entry;
+} IndexKey;
+
+/* the headers might be harvested outside the main thread */
+G_LOCK_DEFINE_STATIC (address_index);
+static GHashTable *_entries = NULL;	/* lowercase email -> entry */
+static GArray     *_keys = NULL;
+static gboolean    _keys_dirty = FALSE;
+static guint       _stamp = 0;
+static guint       _save_timeout = 0;
+
+static void
+address_entry_free (AddressEntry *entry)
+{
+	g_free (entry->email);
+	g_free (entry->name);
+	g_slice_free (AddressEntry, entry);
+}
+
+static gchar*
+get_index_filename (void)
+{
+	return g_build_filename (MODEST_DIR, MODEST_ADDRESS_INDEX_FILE, NULL);
+}
+
+static gdouble
+get_current_score (AddressEntry *entry, time_t now)
+{
+	gdouble age;
+
+	if (entry->last_used == 0 || now <= entry->last_used)
+		return entry->score;
+
+	age = (gdouble) (now - entry->last_used) / SCORE_HALF_LIFE;
+	return entry->score / (1.0 + age);
+}
+
+/* first position whose key is not lower than @key */
+static guint
+lower_bound (const gchar *key)
+{
+	guint low = 0, high = _keys->len;
+
+	while (low < high) {
+		guint mid = low + (high - low) / 2;
+
+		if (strcmp (g_array_index (_keys, IndexKey, mid).key, key) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+static void
+add_key (AddressEntry *entry, gchar *key, gboolean sorted)
+{
+	IndexKey index_key;
+
+	index_key.key = key;
+	index_key.entry = entry;
+	if (sorted)
+		g_array_insert_val (_keys, lower_bound (key), index_key);
+	else
+		g_array_append_val (_keys, index_key);
+}
+
+static void
+add_entry_keys (AddressEntry *entry, gboolean sorted)
+{
+	add_key (entry, g_ascii_strdown (entry->email, -1), sorted);
+
+	if (entry->name) {
+		gchar *folded, *word;
+
+		folded = g_utf8_casefold (entry->name, -1);
+		/* every word of the name, so "smi" finds "John Smith" */
+		for (word = strchr (folded, ' '); word; word = strchr (word, ' ')) {
+			while (*word == ' ')
+				word++;
+			if (*word)
+				add_key (entry, g_strdup (word), sorted);
+		}
+		add_key (entry, folded, sorted);
+	}
+}
+
+static gint
+compare_keys (gconstpointer a, gconstpointer b)
+{
+	return strcmp (((const IndexKey *) a)->key, ((const IndexKey *) b)->key);
+}
+
+static void
+clear_keys (void)
+{
+	guint i;
+
+	for (i = 0; i < _keys->len; i++)
+		g_free (g_array_index (_keys, IndexKey, i).key);
+	g_array_set_size (_keys, 0);
+}
+
+/* call with the lock held. Changing the name of an entry can not
+   be done in place, so in that case we sort everything again, but
+   only once before the next lookup */
+static void
+rebuild_keys (void)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	clear_keys ();
+	g_hash_table_iter_init (&iter, _entries);
+	while (g_hash_table_iter_next (&iter, NULL, &value))
+		add_entry_keys ((AddressEntry *) value, FALSE);
+	g_array_sort (_keys, compare_keys);
+	_keys_dirty = FALSE;
+}
+
+static void
+load_index (void)
+{
+	GKeyFile *key_file;
+	gchar *filename;
+	gchar **groups;
+	gsize i, num_groups = 0;
+
+	_entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+					  (GDestroyNotify) address_entry_free);
+	_keys = g_array_new (FALSE, FALSE, sizeof (IndexKey));
+
+	key_file = g_key_file_new ();
+	filename = get_index_filename ();
+	if (!g_key_file_load_from_file (key_file, filename, G_KEY_FILE_NONE, NULL)) {
+		/* not an error, it's created on the first update */
+		g_key_file_free (key_file);
+		g_free (filename);
+		return;
+	}
+
+	groups = g_key_file_get_groups (key_file, &num_groups);
+	for (i = 0; i < num_groups; i++) {
+		AddressEntry *entry;
+		gchar *key;
+
+		key = g_ascii_strdown (groups[i], -1);
+		if (g_hash_table_lookup (_entries, key)) {
+			g_free (key);
+			continue;
+		}
+
+		entry = g_slice_new0 (AddressEntry);
+		entry->email = g_strdup (groups[i]);
+		entry->name = g_key_file_get_string (key_file, groups[i], KEY_NAME, NULL);
+		entry->score = g_key_file_get_double (key_file, groups[i], KEY_SCORE, NULL);
+		entry->last_used = (time_t) g_key_file_get_integer (key_file, groups[i], KEY_LAST, NULL);
+		g_hash_table_insert (_entries, key, entry);
+	}
+	/* sort all the keys at once in the first lookup */
+	_keys_dirty = TRUE;
+
+	g_strfreev (groups);
+	g_key_file_free (key_file);
+	g_free (filename);
+}
+
+/* call with the lock held */
+static GHashTable*
+get_entries (void)
+{
+	if (G_UNLIKELY (!_entries))
+		load_index ();
+	return _entries;
+}
+
+static void
+save_index (void)
+{
+	GKeyFile *key_file;
+	GHashTableIter iter;
+	gpointer value;
+	gchar *filename, *data;
+	gsize len;
+	time_t now;
+	GError *err = NULL;
+
+	G_LOCK (address_index);
+	if (!_entries) {
+		G_UNLOCK (address_index);
+		return;
+	}
+	now = time (NULL);
+	key_file = g_key_file_new ();
+	g_hash_table_iter_init (&iter, _entries);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		AddressEntry *entry = (AddressEntry *) value;
+
+		/* contacts that we never used are added again
+		   from the address book */
+		if (entry->last_used == 0 || now - entry->last_used > MAX_AGE)
+			continue;
+
+		if (entry->name)
+			g_key_file_set_string (key_file, entry->email, KEY_NAME, entry->name);
+		g_key_file_set_double (key_file, entry->email, KEY_SCORE, entry->score);
+		g_key_file_set_integer (key_file, entry->email, KEY_LAST, (gint) entry->last_used);
+	}
+	G_UNLOCK (address_index);
+
+	data = g_key_file_to_data (key_file, &len, NULL);
+
+	filename = get_index_filename ();
+	if (!g_file_set_contents (filename, data, len, &err)) {
+		g_warning ("%s: failed to save %s: %s", __FUNCTION__, filename,
+			   err ? err->message : "unknown error");
+		g_clear_error (&err);
+	}
+
+	g_free (filename);
+	g_free (data);
+	g_key_file_free (key_file);
+}
+
+static gboolean
+on_save_timeout (gpointer user_data)
+{
+	G_LOCK (address_index);
+	_save_timeout = 0;
+	G_UNLOCK (address_index);
+
+	save_index ();
+
+	return FALSE;
+}
+
+/* call with the lock held */
+static void
+schedule_save (void)
+{
+	if (_save_timeout == 0)
+		_save_timeout = g_timeout_add_seconds (SAVE_TIMEOUT, on_save_timeout, NULL);
+}
+
+static void
+update_entry (const gchar *email,
+	      const gchar *name,
+	      gdouble weight,
+	      gboolean contact)
+{
+	AddressEntry *entry;
+	gchar *key;
+
+	key = g_ascii_strdown (email, -1);
+
+	G_LOCK (address_index);
+	entry = g_hash_table_lookup (get_entries (), key);
+	if (!entry) {
+		entry = g_slice_new0 (AddressEntry);
+		entry->email = g_strdup (email);
+		entry->name = g_strdup (name);
+		g_hash_table_insert (_entries, key, entry);
+		if (!_keys_dirty)
+			add_entry_keys (entry, TRUE);
+	} else {
+		g_free (key);
+		/* the address book knows better than the headers */
+		if (name && (!entry->name || (contact && strcmp (entry->name, name)))) {
+			g_free (entry->name);
+			entry->name = g_strdup (name);
+			_keys_dirty = TRUE;
+			if (entry->last_used)
+				schedule_save ();
+		}
+	}
+
+	if (contact)
+		entry->contact = TRUE;
+
+	if (weight > 0.0) {
+		time_t now = time (NULL);
+
+		entry->score = get_current_score (entry, now) + weight;
+		entry->last_used = now;
+		schedule_save ();
+	}
+	G_UNLOCK (address_index);
+}
+
+/* gets the email and the display name, if any, of an address like
+   "\"John Smith\" <john@example.com>" */
+static gboolean
+parse_address (const gchar *address,
+	       gchar **name,
+	       gchar **email)
+{
+	*name = NULL;
+	*email = modest_text_utils_get_email_address (address);
+	if (!*email)
+		return FALSE;
+
+	g_strstrip (*email);
+	if (!strchr (*email, '@')) {
+		g_free (*email);
+		*email = NULL;
+		return FALSE;
+	}
+
+	if (strchr (address, '<')) {
+		gchar *display;
+		gsize len;
+
+		display = g_strdup (address);
+		modest_text_utils_get_display_address (display);
+		g_strstrip (display);
+		len = strlen (display);
+		if (len >= 2 && display[0] == '"' && display[len - 1] == '"') {
+			display[len - 1] = '\0';
+			memmove (display, display + 1, len - 1);
+			g_strstrip (display);
+		}
+		if (*display && display[0] != '<' && strcmp (display, *email))
+			*name = display;
+		else
+			g_free (display);
+	}
+
+	return TRUE;
+}
+
+void
+modest_address_index_add_addresses (const gchar *addresses,
+				    gboolean sent)
+{
+	GSList *list, *node;
+
+	if (!addresses || !*addresses)
+		return;
+
+	list = modest_text_utils_split_addresses_list (addresses);
+	for (node = list; node; node = g_slist_next (node)) {
+		gchar *name, *email;
+
+		if (parse_address ((const gchar *) node->data, &name, &email)) {
+			update_entry (email, name,
+				      sent ? SENT_WEIGHT : RECEIVED_WEIGHT,
+				      FALSE);
+			g_free (name);
+			g_free (email);
+		}
+		g_free (node->data);
+	}
+	g_slist_free (list);
+}
+
+void
+modest_address_index_add_header (TnyHeader *header)
+{
+	gchar *from, *cc;
+
+	g_return_if_fail (TNY_IS_HEADER (header));
+
+	from = tny_header_dup_from (header);
+	cc = tny_header_dup_cc (header);
+	modest_address_index_add_addresses (from, FALSE);
+	modest_address_index_add_addresses (cc, FALSE);
+	g_free (from);
+	g_free (cc);
+}
+
+void
+modest_address_index_add_contact (const gchar *name,
+				  const gchar *email)
+{
+	g_return_if_fail (email);
+
+	if (!strchr (email, '@'))
+		return;
+
+	update_entry (email, (name && *name) ? name : NULL, 0.0, TRUE);
+}
+
+gboolean
+modest_address_index_is_contact (const gchar *address)
+{
+	AddressEntry *entry;
+	gchar *email, *key;
+	gboolean retval = FALSE;
+
+	g_return_val_if_fail (address, FALSE);
+
+	email = modest_text_utils_get_email_address (address);
+	if (!email)
+		return FALSE;
+	key = g_ascii_strdown (g_strstrip (email), -1);
+
+	G_LOCK (address_index);
+	entry = g_hash_table_lookup (get_entries (), key);
+	if (entry)
+		retval = entry->contact;
+	G_UNLOCK (address_index);
+
+	g_free (key);
+	g_free (email);
+
+	return retval;
+}
+
+static gint
+compare_ranks (gconstpointer a, gconstpointer b)
+{
+	const AddressEntry *entry_a = *((const AddressEntry **) a);
+	const AddressEntry *entry_b = *((const AddressEntry **) b);
+
+	if (entry_a->rank != entry_b->rank)
+		return (entry_a->rank > entry_b->rank) ? -1 : 1;
+	if (entry_a->contact != entry_b->contact)
+		return entry_a->contact ? -1 : 1;
+	return strcmp (entry_a->email, entry_b->email);
+}
+
+/* call with the lock held. Returns the entries matching the
+   casefolded @prefix, best ranked first */
+static GPtrArray*
+find_entries (const gchar *prefix)
+{
+	GPtrArray *matches;
+	gsize len;
+	guint i;
+	time_t now;
+
+	matches = g_ptr_array_new ();
+	get_entries ();
+	if (_keys_dirty)
+		rebuild_keys ();
+
+	now = time (NULL);
+	len = strlen (prefix);
+	_stamp++;
+	for (i = lower_bound (prefix); i < _keys->len; i++) {
+		IndexKey *index_key = &g_array_index (_keys, IndexKey, i);
+
+		if (strncmp (index_key->key, prefix, len))
+			break;
+		if (index_key->entry->stamp != _stamp) {
+			index_key->entry->stamp = _stamp;
+			index_key->entry->rank = get_current_score (index_key->entry, now);
+			g_ptr_array_add (matches, index_key->entry);
+		}
+	}
+	g_ptr_array_sort (matches, compare_ranks);
+
+	return matches;
+}
+
+static gchar*
+format_entry (AddressEntry *entry)
+{
+	if (!entry->name)
+		return g_strdup (entry->email);
+
+	/* the separators of the recipient lists must be quoted */
+	if (strpbrk (entry->name, ",;"))
+		return g_strdup_printf ("\"%s\" <%s>", entry->name, entry->email);
+	else
+		return g_strdup_printf ("%s <%s>", entry->name, entry->email);
+}
+
+static gboolean
+has_folded_prefix (const gchar *str, const gchar *folded_prefix)
+{
+	gchar *folded;
+	gboolean retval;
+
+	folded = g_utf8_casefold (str, -1);
+	retval = g_str_has_prefix (folded, folded_prefix);
+	g_free (folded);
+
+	return retval;
+}
+
+GSList*
+modest_address_index_lookup (const gchar *prefix,
+			     guint max)
+{
+	GPtrArray *matches;
+	GSList *result = NULL;
+	gchar *folded;
+	guint i;
+
+	g_return_val_if_fail (prefix, NULL);
+
+	if (!*prefix || max == 0)
+		return NULL;
+
+	folded = g_utf8_casefold (prefix, -1);
+
+	G_LOCK (address_index);
+	matches = find_entries (folded);
+	for (i = 0; i < matches->len && i < max; i++)
+		result = g_slist_prepend (result, format_entry (g_ptr_array_index (matches, i)));
+	G_UNLOCK (address_index);
+
+	g_ptr_array_free (matches, TRUE);
+	g_free (folded);
+
+	return g_slist_reverse (result);
+}
+
+gchar*
+modest_address_index_complete (const gchar *prefix)
+{
+	GPtrArray *matches;
+	gchar *folded, *result = NULL;
+	guint i;
+
+	g_return_val_if_fail (prefix, NULL);
+
+	if (!*prefix)
+		return NULL;
+
+	folded = g_utf8_casefold (prefix, -1);
+
+	G_LOCK (address_index);
+	matches = find_entries (folded);
+	for (i = 0; i < matches->len && !result; i++) {
+		AddressEntry *entry = g_ptr_array_index (matches, i);
+		gchar *formatted;
+
+		/* the match could be a word in the middle of the
+		   name, that can not be completed inline */
+		formatted = format_entry (entry);
+		if (has_folded_prefix (formatted, folded))
+			result = formatted;
+		else if (has_folded_prefix (entry->email, folded))
+			result = g_strdup (entry->email);
+
+		if (result != formatted)
+			g_free (formatted);
+	}
+	G_UNLOCK (address_index);
+
+	g_ptr_array_free (matches, TRUE);
+	g_free (folded);
+
+	return result;
+}
+
+void
+modest_address_index_flush (void)
+{
+	gboolean pending = FALSE;
+
+	G_LOCK (address_index);
+	if (_save_timeout > 0) {
+		g_source_remove (_save_timeout);
+		_save_timeout = 0;
+		pending = TRUE;
+	}
+	G_UNLOCK (address_index);
+
+	if (pending)
+		save_index ();
+}
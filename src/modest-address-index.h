@@ -0,0 +1,127 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MODEST_ADDRESS_INDEX_H__
+#define __MODEST_ADDRESS_INDEX_H__
+
+#include <glib.h>
+#include <tny-header.h>
+
+G_BEGIN_DECLS
+
+/*
+ * a prefix index of the people we correspond with, harvested from
+ * the headers of the messages we send and receive and from the
+ * address book, used to complete recipients as they are typed. Every
+ * address is ranked by how often and how recently it was used. It's
+ * stored in MODEST_DIR/MODEST_ADDRESS_INDEX_FILE; the address book
+ * contacts are not saved, they're added again on every session
+ */
+
+/**
+ * modest_address_index_add_addresses:
+ * @addresses: a list of addresses, like the To: of a message
+ * @sent: %TRUE if we sent a message to them, %FALSE if we received it
+ *
+ * count a new use of each of the addresses of @addresses. Addresses we
+ * write to weight more than the ones we get mail from. The index is
+ * written to disk a bit later, so many updates in a row only cause
+ * one write
+ */
+void     modest_address_index_add_addresses (const gchar *addresses,
+					     gboolean sent);
+
+/**
+ * modest_address_index_add_header:
+ * @header: a #TnyHeader of a received message
+ *
+ * count the From: and Cc: addresses of @header as received
+ */
+void     modest_address_index_add_header    (TnyHeader *header);
+
+/**
+ * modest_address_index_add_contact:
+ * @name: the display name of the contact, or %NULL
+ * @email: an email address of the contact
+ *
+ * add an address from the address book. It does not count as a use
+ * of the address, and it's only kept during this session
+ */
+void     modest_address_index_add_contact   (const gchar *name,
+					     const gchar *email);
+
+/**
+ * modest_address_index_is_contact:
+ * @address: an address
+ *
+ * Returns: %TRUE if @address was added with
+ * modest_address_index_add_contact() during this session, %FALSE
+ * otherwise. %FALSE does not mean the address is not in the address
+ * book, only that we don't know it
+ */
+gboolean modest_address_index_is_contact    (const gchar *address);
+
+/**
+ * modest_address_index_lookup:
+ * @prefix: the text typed so far
+ * @max: the maximum number of results
+ *
+ * get the addresses whose email, display name, or any word of the
+ * display name start with @prefix, ignoring the case, best ranked
+ * first
+ *
+ * Returns: a newly allocated list of newly allocated strings, like
+ * "Name <email>", or just "email" if the name is not known
+ */
+GSList*  modest_address_index_lookup        (const gchar *prefix,
+					     guint max);
+
+/**
+ * modest_address_index_complete:
+ * @prefix: the text typed so far
+ *
+ * get the best ranked address that can be completed from @prefix,
+ * that is, whose formatted form (see modest_address_index_lookup())
+ * starts with @prefix ignoring the case. Suitable for inline
+ * completion
+ *
+ * Returns: a newly allocated string, or %NULL if there's none
+ */
+gchar*   modest_address_index_complete      (const gchar *prefix);
+
+/**
+ * modest_address_index_flush:
+ *
+ * write the pending changes to disk now
+ */
+void     modest_address_index_flush         (void);
+
+G_END_DECLS
+
+#endif /*__MODEST_ADDRESS_INDEX_H__*/
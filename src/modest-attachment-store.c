@@ -0,0 +1,440 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utime.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+#include <tny-fs-stream.h>
+#include <tny-camel-mem-stream.h>
+#include "modest-attachment-store.h"
+#include "modest-defs.h"
+
+/* the sha1 of the contents of a part, set on the parts already stored */
+#define BLOB_KEY "modest-attachment-blob"
+/* set on the parts queued to be stored */
+#define PENDING_KEY "modest-attachment-pending"
+
+/* prefix of the blobs being written */
+#define TMP_PREFIX "blob-"
+
+#define BUFFER_SIZE 4096
+
+/* A part to store, or a purge if part is NULL. The stream holds the
+   decoded contents of the part, the worker never decodes the part as
+   the main loop could be decoding it at the same time */
+typedef struct {
+	TnyMimePart *part;
+	TnyStream   *stream;
+} StoreJob;
+
+typedef struct {
+	gchar  *path;
+	time_t  mtime;
+	off_t   size;
+} BlobInfo;
+
+/* parts might be copied in the threads that create the messages */
+G_LOCK_DEFINE_STATIC (attachment_store);
+static gboolean     _purged = FALSE;
+static GThreadPool *_store_pool = NULL;
+/* bytes in the store, known after the first purge */
+static guint64      _store_size = 0;
+
+static gchar*
+get_store_dir (void)
+{
+	return g_build_filename (MODEST_DIR, MODEST_CACHE_DIR, MODEST_ATTACHMENT_STORE_DIR, NULL);
+}
+
+static TnyStream*
+open_blob (const gchar *hash)
+{
+	gchar *dir, *path;
+	gint fd;
+
+	dir = get_store_dir ();
+	path = g_build_filename (dir, hash, NULL);
+	fd = g_open (path, O_RDONLY, 0);
+	if (fd != -1) {
+		/* it's being used, keep it */
+		utime (path, NULL);
+	}
+	g_free (path);
+	g_free (dir);
+
+	return (fd != -1) ? tny_fs_stream_new (fd) : NULL;
+}
+
+/* Writes @stream, the decoded contents of a part, to the store,
+   returns the hash. @added gets the size of the blob if it was not
+   stored yet */
+static gchar*
+add_blob (TnyStream *stream, off_t *added)
+{
+	GChecksum *checksum;
+	gchar *dir, *tmp_path, *path = NULL, *hash = NULL;
+	gchar buffer[BUFFER_SIZE];
+	gboolean failed = FALSE;
+	off_t size = 0;
+	gint fd;
+
+	*added = 0;
+
+	dir = get_store_dir ();
+	if (g_mkdir_with_parents (dir, 0755) == -1) {
+		g_warning ("%s: failed to create %s: %s", __FUNCTION__, dir, g_strerror (errno));
+		g_free (dir);
+		return NULL;
+	}
+
+	/* The contents go to a temporary file first, we don't know
+	   the hash until we read all of them */
+	tmp_path = g_build_filename (dir, TMP_PREFIX "XXXXXX", NULL);
+	fd = g_mkstemp (tmp_path);
+	if (fd == -1) {
+		g_warning ("%s: failed to create %s: %s", __FUNCTION__, tmp_path, g_strerror (errno));
+		g_free (tmp_path);
+		g_free (dir);
+		return NULL;
+	}
+
+	checksum = g_checksum_new (G_CHECKSUM_SHA1);
+	tny_stream_reset (stream);
+	while (!failed && !tny_stream_is_eos (stream)) {
+		gssize read, written = 0;
+
+		read = tny_stream_read (stream, buffer, sizeof (buffer));
+		if (read < 0) {
+			failed = TRUE;
+			break;
+		} else if (read == 0) {
+			break;
+		}
+
+		g_checksum_update (checksum, (const guchar *) buffer, read);
+		while (!failed && written < read) {
+			gssize n = write (fd, buffer + written, read - written);
+			if (n < 0 && errno != EINTR)
+				failed = TRUE;
+			else if (n > 0)
+				written += n;
+		}
+		size += written;
+	}
+	tny_stream_reset (stream);
+
+	if (close (fd) == -1)
+		failed = TRUE;
+
+	if (!failed) {
+		hash = g_strdup (g_checksum_get_string (checksum));
+		path = g_build_filename (dir, hash, NULL);
+
+		/* The same contents were already stored, by another
+		   copy of the attachment or another message */
+		if (g_access (path, F_OK) == 0) {
+			g_unlink (tmp_path);
+			utime (path, NULL);
+		} else if (g_rename (tmp_path, path) == -1) {
+			failed = TRUE;
+		} else {
+			*added = size;
+		}
+	}
+
+	if (failed) {
+		g_warning ("%s: failed to store the attachment: %s", __FUNCTION__, g_strerror (errno));
+		g_unlink (tmp_path);
+		g_free (hash);
+		hash = NULL;
+	}
+
+	g_checksum_free (checksum);
+	g_free (path);
+	g_free (tmp_path);
+	g_free (dir);
+
+	return hash;
+}
+
+static gint
+compare_blob_mtime (gconstpointer a, gconstpointer b)
+{
+	const BlobInfo *blob_a = (const BlobInfo *) a;
+	const BlobInfo *blob_b = (const BlobInfo *) b;
+
+	if (blob_a->mtime == blob_b->mtime)
+		return 0;
+	return (blob_a->mtime < blob_b->mtime) ? -1 : 1;
+}
+
+static void
+purge_store (void)
+{
+	GDir *gdir;
+	gchar *dir;
+	const gchar *name;
+	GArray *blobs;
+	guint64 total = 0;
+	time_t now;
+	guint i;
+
+	dir = get_store_dir ();
+	gdir = g_dir_open (dir, 0, NULL);
+	if (!gdir) {
+		g_free (dir);
+		return;
+	}
+
+	/* Parts already built keep their file descriptors, so
+	   removing a blob does not break them */
+	blobs = g_array_new (FALSE, FALSE, sizeof (BlobInfo));
+	now = time (NULL);
+	while ((name = g_dir_read_name (gdir))) {
+		gchar *path = g_build_filename (dir, name, NULL);
+		struct stat st;
+
+		if (g_stat (path, &st) != 0) {
+			g_free (path);
+		} else if ((now - st.st_mtime) > MODEST_ATTACHMENT_STORE_MAX_AGE) {
+			g_unlink (path);
+			g_free (path);
+		} else if (g_str_has_prefix (name, TMP_PREFIX)) {
+			/* still being written by another thread */
+			total += st.st_size;
+			g_free (path);
+		} else {
+			BlobInfo blob;
+
+			blob.path = path;
+			blob.mtime = st.st_mtime;
+			blob.size = st.st_size;
+			g_array_append_val (blobs, blob);
+			total += st.st_size;
+		}
+	}
+	g_dir_close (gdir);
+	g_free (dir);
+
+	/* Opening a blob touches it, so the oldest ones are the least
+	   recently used */
+	g_array_sort (blobs, compare_blob_mtime);
+	for (i = 0; i < blobs->len; i++) {
+		BlobInfo *blob = &g_array_index (blobs, BlobInfo, i);
+
+		if (total > MODEST_ATTACHMENT_STORE_MAX_SIZE &&
+		    g_unlink (blob->path) == 0)
+			total -= blob->size;
+		g_free (blob->path);
+	}
+	g_array_free (blobs, TRUE);
+
+	G_LOCK (attachment_store);
+	_store_size = total;
+	G_UNLOCK (attachment_store);
+}
+
+/* Stores @stream, the decoded contents of @part, and purges the
+   store if it grew too much */
+static gchar*
+store_part (TnyMimePart *part, TnyStream *stream)
+{
+	gchar *hash;
+	off_t added;
+	gboolean purge;
+
+	hash = add_blob (stream, &added);
+
+	G_LOCK (attachment_store);
+	if (hash)
+		g_object_set_data_full (G_OBJECT (part), BLOB_KEY, g_strdup (hash), g_free);
+	_store_size += added;
+	purge = _store_size > MODEST_ATTACHMENT_STORE_MAX_SIZE;
+	if (purge)
+		_store_size = 0;
+	G_UNLOCK (attachment_store);
+
+	if (purge)
+		purge_store ();
+
+	return hash;
+}
+
+static void
+store_worker (gpointer data, gpointer user_data)
+{
+	StoreJob *job = (StoreJob *) data;
+
+	if (job->part) {
+		g_free (store_part (job->part, job->stream));
+		G_LOCK (attachment_store);
+		g_object_set_data (G_OBJECT (job->part), PENDING_KEY, NULL);
+		G_UNLOCK (attachment_store);
+		g_object_unref (job->stream);
+		g_object_unref (job->part);
+	} else {
+		purge_store ();
+	}
+
+	g_slice_free (StoreJob, job);
+}
+
+/* Call it with the lock held */
+static void
+push_job (TnyMimePart *part, TnyStream *stream)
+{
+	StoreJob *job;
+
+	if (G_UNLIKELY (!_store_pool))
+		_store_pool = g_thread_pool_new (store_worker, NULL, 1, FALSE, NULL);
+
+	job = g_slice_new0 (StoreJob);
+	if (part) {
+		job->part = g_object_ref (part);
+		job->stream = g_object_ref (stream);
+		g_object_set_data (G_OBJECT (part), PENDING_KEY, GINT_TO_POINTER (TRUE));
+	}
+	g_thread_pool_push (_store_pool, job, NULL);
+}
+
+TnyStream *
+modest_attachment_store_get_stream (TnyMimePart *part)
+{
+	TnyStream *stream = NULL;
+	gchar *hash;
+
+	g_return_val_if_fail (TNY_IS_MIME_PART (part), NULL);
+
+	G_LOCK (attachment_store);
+	if (!_purged) {
+		_purged = TRUE;
+		push_job (NULL, NULL);
+	}
+	hash = g_strdup (g_object_get_data (G_OBJECT (part), BLOB_KEY));
+	G_UNLOCK (attachment_store);
+
+	if (hash)
+		stream = open_blob (hash);
+	g_free (hash);
+
+	if (stream)
+		return stream;
+
+	/* Not stored yet, or purged since then */
+	if (g_main_context_is_owner (NULL)) {
+		gboolean pending;
+
+		/* Decode it once here, and don't block the UI hashing
+		   and writing it, the next copies will use the blob */
+		stream = TNY_STREAM (tny_camel_mem_stream_new ());
+		if (tny_mime_part_decode_to_stream (part, stream, NULL) < 0) {
+			g_object_unref (stream);
+			return NULL;
+		}
+		tny_stream_reset (stream);
+
+		/* Only the main loop queues parts */
+		G_LOCK (attachment_store);
+		pending = g_object_get_data (G_OBJECT (part), PENDING_KEY) != NULL;
+		G_UNLOCK (attachment_store);
+
+		if (!pending) {
+			TnyStream *job_stream;
+
+			/* The caller reads the stream we return, the
+			   worker gets a copy of its own */
+			job_stream = TNY_STREAM (tny_camel_mem_stream_new ());
+			tny_stream_write_to_stream (stream, job_stream);
+			tny_stream_reset (stream);
+			tny_stream_reset (job_stream);
+
+			G_LOCK (attachment_store);
+			push_job (part, job_stream);
+			G_UNLOCK (attachment_store);
+			g_object_unref (job_stream);
+		}
+	} else {
+		TnyStream *decoded;
+
+		decoded = tny_mime_part_get_decoded_stream (part);
+		if (!decoded)
+			return NULL;
+		hash = store_part (part, decoded);
+		g_object_unref (decoded);
+		if (hash)
+			stream = open_blob (hash);
+		g_free (hash);
+	}
+
+	return stream;
+}
+
+gboolean
+modest_attachment_store_construct_part (TnyMimePart *part,
+					TnyMimePart *copy)
+{
+	TnyStream *stream;
+	const gchar *hash;
+
+	g_return_val_if_fail (TNY_IS_MIME_PART (part), FALSE);
+	g_return_val_if_fail (TNY_IS_MIME_PART (copy), FALSE);
+
+	stream = modest_attachment_store_get_stream (part);
+	if (!stream)
+		return FALSE;
+
+	tny_mime_part_construct (copy, stream,
+				 tny_mime_part_get_content_type (part),
+				 tny_mime_part_get_transfer_encoding (part));
+
+	/* The copy shares the blob, copying it won't decode it */
+	G_LOCK (attachment_store);
+	hash = g_object_get_data (G_OBJECT (part), BLOB_KEY);
+	if (hash)
+		g_object_set_data_full (G_OBJECT (copy), BLOB_KEY, g_strdup (hash), g_free);
+	G_UNLOCK (attachment_store);
+
+	g_object_unref (stream);
+
+	return TRUE;
+}
+
+void
+modest_attachment_store_purge (void)
+{
+	G_LOCK (attachment_store);
+	push_job (NULL, NULL);
+	G_UNLOCK (attachment_store);
+}
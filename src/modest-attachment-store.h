@@ -0,0 +1,101 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MODEST_ATTACHMENT_STORE_H__
+#define __MODEST_ATTACHMENT_STORE_H__
+
+#include <glib.h>
+#include <tny-mime-part.h>
+#include <tny-stream.h>
+
+G_BEGIN_DECLS
+
+/*
+ * a content-addressed store of attachment payloads. The decoded
+ * contents of an attachment are written once to
+ * MODEST_DIR/MODEST_CACHE_DIR/MODEST_ATTACHMENT_STORE_DIR/<sha1>, and
+ * every copy of the attachment (each save of a draft, forwards, the
+ * outbox copy) reads them from that file instead of decoding the
+ * original part again. As the new parts are built from the file
+ * stream, the payload is only encoded when the message is written.
+ * It's a cache, blobs not used for MODEST_ATTACHMENT_STORE_MAX_AGE
+ * are removed, and the least recently used ones when the store grows
+ * over MODEST_ATTACHMENT_STORE_MAX_SIZE. Hashing and writing the
+ * blobs is never done in the main loop, there the parts are stored
+ * in the background and only used once they're stored
+ */
+
+/* seconds */
+#define MODEST_ATTACHMENT_STORE_MAX_AGE (7 * 24 * 60 * 60)
+
+/* bytes */
+#define MODEST_ATTACHMENT_STORE_MAX_SIZE (32 * 1024 * 1024)
+
+/**
+ * modest_attachment_store_get_stream:
+ * @part: a #TnyMimePart, not a multipart one
+ *
+ * get a stream with the decoded contents of @part, read from the
+ * store. The contents are added to the store the first time; after
+ * that, neither @part nor any part created with
+ * modest_attachment_store_construct_part() from it is decoded again.
+ * In the main loop, a part that is not stored yet is decoded once in
+ * memory, and a copy of the decoded contents is stored in the
+ * background
+ *
+ * Returns: a new #TnyStream, or %NULL if @part could not be decoded
+ */
+TnyStream *modest_attachment_store_get_stream      (TnyMimePart *part);
+
+/**
+ * modest_attachment_store_construct_part:
+ * @part: a #TnyMimePart, not a multipart one
+ * @copy: an empty #TnyMimePart
+ *
+ * construct @copy with the contents of @part, sharing the blob of
+ * the store
+ *
+ * Returns: %TRUE if @copy was constructed, %FALSE if @part could not
+ * be decoded (see modest_attachment_store_get_stream())
+ */
+gboolean   modest_attachment_store_construct_part  (TnyMimePart *part,
+						    TnyMimePart *copy);
+
+/**
+ * modest_attachment_store_purge:
+ *
+ * remove the blobs not used during MODEST_ATTACHMENT_STORE_MAX_AGE,
+ * and then the least recently used ones until the store fits in
+ * MODEST_ATTACHMENT_STORE_MAX_SIZE. It's done in a background thread
+ */
+void       modest_attachment_store_purge           (void);
+
+G_END_DECLS
+
+#endif /*__MODEST_ATTACHMENT_STORE_H__*/
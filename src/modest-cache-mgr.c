@@ -29,7 +29,9 @@
 
 #include <config.h>
 #include <modest-cache-mgr.h>
+#include <modest-string-pool.h>
 #include <stdio.h>
+#include <string.h>
 
 /* 'private'/'protected' functions */
 static void modest_cache_mgr_class_init (ModestCacheMgrClass *klass);
@@ -42,12 +44,47 @@ enum {
 	LAST_SIGNAL
 };
 
+/* approximate overhead of an entry: the entry itself and the node
+   of the hash table */
+#define ENTRY_OVERHEAD (sizeof (CacheEntry) + 4 * sizeof (gpointer))
+
+typedef struct {
+	ModestCache *cache;
+	gpointer     key;
+	gpointer     value;
+	gsize        size;
+	guint64      tick;	/* when it was last used */
+	GList        link;	/* in the lru queue of its cache */
+} CacheEntry;
+
+struct _ModestCache {
+	gchar          *name;
+	ModestCacheMgr *mgr;
+	GHashTable     *entries;	/* key -> CacheEntry */
+	GQueue          lru;		/* most recently used first */
+	GDestroyNotify  key_destroy_func;
+	GDestroyNotify  value_destroy_func;
+	GBoxedCopyFunc  value_copy_func;
+	ModestCacheSizeFunc size_func;
+	gsize           max_size;
+	gsize           size;
+	guint           hits;
+	guint           misses;
+	guint           evictions;
+};
+
 typedef struct _ModestCacheMgrPrivate ModestCacheMgrPrivate;
 struct _ModestCacheMgrPrivate {
-	GHashTable *date_str_cache;
-	GHashTable *display_str_cache;
-	GHashTable *pixbuf_cache;
 	GHashTable *send_queue_cache;
+
+	/* the LRU caches. All of them are protected by this lock,
+	   evicting an entry to fit in the budget involves all the
+	   caches */
+	GMutex     *lock;
+	GSList     *caches;
+	gsize       budget;
+	gsize       size;
+	guint64     tick;
 };
 #define MODEST_CACHE_MGR_GET_PRIVATE(o)      (G_TYPE_INSTANCE_GET_PRIVATE((o), \
                                               MODEST_TYPE_CACHE_MGR, \
@@ -109,28 +146,21 @@ modest_cache_mgr_init (ModestCacheMgr *obj)
 
  	priv = MODEST_CACHE_MGR_GET_PRIVATE(obj);
 	
-	priv->date_str_cache =
-		g_hash_table_new_full (g_int_hash,  /* time_t */
-				       g_int_equal,
-				       NULL,        /* int -> no need to free */
-				       g_free);     /* gchar* */
-	priv->display_str_cache =
-		g_hash_table_new_full (g_str_hash,  /* gchar* */
-				       g_str_equal,
-				       g_free,      /* gchar* */
-				       g_free);     /* gchar* */
-	priv->pixbuf_cache =
-		g_hash_table_new_full (g_str_hash,   /* gchar* */
-				       g_str_equal,  
-				       g_free,       /* gchar*/
-				       (GDestroyNotify)my_object_unref);
 	priv->send_queue_cache =
 		g_hash_table_new_full (g_direct_hash,   /* ptr */
 				       g_direct_equal,  
 				       (GDestroyNotify)my_object_unref,   /* ref'd GObject */
 				       (GDestroyNotify)my_object_unref);   /* ref'd GObject */  
+
+	priv->lock   = g_mutex_new ();
+	priv->caches = NULL;
+	priv->budget = MODEST_CACHE_MGR_BUDGET;
+	priv->size   = 0;
+	priv->tick   = 0;
 }
 
+static void cache_free (ModestCache *cache);
+
 
 static void
 modest_cache_mgr_finalize (GObject *obj)
@@ -142,12 +172,14 @@ modest_cache_mgr_finalize (GObject *obj)
  	priv = MODEST_CACHE_MGR_GET_PRIVATE(obj);
 	
 	modest_cache_mgr_flush_all (self);
-
-	priv->date_str_cache    = NULL;
-	priv->display_str_cache = NULL;
-	priv->pixbuf_cache      = NULL;
+	g_hash_table_destroy (priv->send_queue_cache);
 	priv->send_queue_cache  = NULL;
 
+	g_slist_foreach (priv->caches, (GFunc) cache_free, NULL);
+	g_slist_free (priv->caches);
+	priv->caches = NULL;
+	g_mutex_free (priv->lock);
+
 	G_OBJECT_CLASS(parent_class)->finalize (obj);
 }
 
@@ -155,12 +187,6 @@ static GHashTable*
 get_cache (ModestCacheMgrPrivate *priv, ModestCacheMgrCacheType type)
 {
 	switch (type) {
-	case MODEST_CACHE_MGR_CACHE_TYPE_DATE_STRING:
-		return priv->date_str_cache;
-	case MODEST_CACHE_MGR_CACHE_TYPE_DISPLAY_STRING:
-		return priv->display_str_cache;
-	case MODEST_CACHE_MGR_CACHE_TYPE_PIXBUF:
-		return priv->pixbuf_cache;
 	case MODEST_CACHE_MGR_CACHE_TYPE_SEND_QUEUE:
 		return priv->send_queue_cache;	
 	default:
@@ -210,7 +236,7 @@ modest_cache_mgr_flush (ModestCacheMgr *self, ModestCacheMgrCacheType type)
 
 	cache = get_cache (priv, type);
 	if (cache)
-		g_hash_table_destroy (cache);
+		g_hash_table_remove_all (cache);
 }
 
 
@@ -239,3 +265,305 @@ modest_cache_mgr_get_size (ModestCacheMgr *self, ModestCacheMgrCacheType type)
 	cache = get_cache (priv, type);
 	return cache ? g_hash_table_size (cache) : 0;
 }
+
+
+/* must be called with the lock held. The entry is only unlinked, it
+   is freed later with free_entries(), once the lock is released, as
+   the destroy functions of the cache could run arbitrary code */
+static void
+cache_unlink_entry (ModestCache *cache, CacheEntry *entry, GSList **dead)
+{
+	ModestCacheMgrPrivate *priv;
+
+	priv = MODEST_CACHE_MGR_GET_PRIVATE (cache->mgr);
+
+	g_hash_table_remove (cache->entries, entry->key);
+	g_queue_unlink (&cache->lru, &entry->link);
+	cache->size -= entry->size;
+	priv->size -= entry->size;
+	*dead = g_slist_prepend (*dead, entry);
+}
+
+/* must be called with the lock held */
+static void
+cache_shrink (ModestCache *cache, gsize size, GSList **dead)
+{
+	while (cache->lru.tail && cache->size > size) {
+		cache->evictions++;
+		cache_unlink_entry (cache, (CacheEntry *) cache->lru.tail->data, dead);
+	}
+}
+
+/* must be called with the lock held. Evicts the globally least
+   recently used entries until all the caches fit in @size */
+static void
+trim_caches (ModestCacheMgrPrivate *priv, gsize size, GSList **dead)
+{
+	while (priv->size > size) {
+		ModestCache *oldest = NULL;
+		CacheEntry *oldest_entry = NULL;
+		GSList *node;
+
+		for (node = priv->caches; node; node = g_slist_next (node)) {
+			ModestCache *cache = (ModestCache *) node->data;
+			CacheEntry *entry;
+
+			if (!cache->lru.tail)
+				continue;
+			entry = (CacheEntry *) cache->lru.tail->data;
+			if (!oldest_entry || entry->tick < oldest_entry->tick) {
+				oldest = cache;
+				oldest_entry = entry;
+			}
+		}
+
+		if (!oldest)
+			break;
+		oldest->evictions++;
+		cache_unlink_entry (oldest, oldest_entry, dead);
+	}
+}
+
+/* the entries could belong to different caches */
+static void
+free_entries (GSList *dead)
+{
+	GSList *node;
+
+	for (node = dead; node; node = g_slist_next (node)) {
+		CacheEntry *entry = (CacheEntry *) node->data;
+		ModestCache *cache = entry->cache;
+
+		if (cache->key_destroy_func)
+			cache->key_destroy_func (entry->key);
+		if (cache->value_destroy_func)
+			cache->value_destroy_func (entry->value);
+		g_slice_free (CacheEntry, entry);
+	}
+	g_slist_free (dead);
+}
+
+static void
+cache_free (ModestCache *cache)
+{
+	GSList *dead = NULL;
+
+	cache_shrink (cache, 0, &dead);
+	free_entries (dead);
+	g_hash_table_destroy (cache->entries);
+	g_free (cache->name);
+	g_slice_free (ModestCache, cache);
+}
+
+ModestCache*
+modest_cache_mgr_new_cache (ModestCacheMgr *self,
+			    const gchar *name,
+			    gsize max_size,
+			    GHashFunc hash_func,
+			    GEqualFunc key_equal_func,
+			    GDestroyNotify key_destroy_func,
+			    GDestroyNotify value_destroy_func,
+			    GBoxedCopyFunc value_copy_func,
+			    ModestCacheSizeFunc size_func)
+{
+	ModestCacheMgrPrivate *priv;
+	ModestCache *cache = NULL;
+	GSList *node;
+
+	g_return_val_if_fail (MODEST_IS_CACHE_MGR (self), NULL);
+	g_return_val_if_fail (name && hash_func && key_equal_func && value_copy_func, NULL);
+	g_return_val_if_fail (max_size > 0, NULL);
+
+	priv = MODEST_CACHE_MGR_GET_PRIVATE (self);
+
+	g_mutex_lock (priv->lock);
+	for (node = priv->caches; node && !cache; node = g_slist_next (node)) {
+		if (!strcmp (((ModestCache *) node->data)->name, name))
+			cache = (ModestCache *) node->data;
+	}
+
+	if (!cache) {
+		cache = g_slice_new0 (ModestCache);
+		cache->name = g_strdup (name);
+		cache->mgr = self;
+		cache->entries = g_hash_table_new (hash_func, key_equal_func);
+		g_queue_init (&cache->lru);
+		cache->key_destroy_func = key_destroy_func;
+		cache->value_destroy_func = value_destroy_func;
+		cache->value_copy_func = value_copy_func;
+		cache->size_func = size_func;
+		cache->max_size = max_size;
+
+		priv->caches = g_slist_prepend (priv->caches, cache);
+	}
+	g_mutex_unlock (priv->lock);
+
+	return cache;
+}
+
+void
+modest_cache_mgr_memory_low (ModestCacheMgr *self)
+{
+	ModestCacheMgrPrivate *priv;
+	GSList *node, *dead = NULL;
+	guint n_strings;
+	gsize pool_size, pool_saved;
+
+	g_return_if_fail (MODEST_IS_CACHE_MGR (self));
+	priv = MODEST_CACHE_MGR_GET_PRIVATE (self);
+
+	g_mutex_lock (priv->lock);
+	for (node = priv->caches; node; node = g_slist_next (node)) {
+		ModestCache *cache = (ModestCache *) node->data;
+
+		g_debug ("%s: cache %s: %u entries, %" G_GSIZE_FORMAT " bytes, "
+			 "%u hits, %u misses, %u evictions", __FUNCTION__, cache->name,
+			 g_hash_table_size (cache->entries), cache->size,
+			 cache->hits, cache->misses, cache->evictions);
+	}
+	trim_caches (priv, priv->budget / MODEST_CACHE_MGR_LOW_MEMORY_DIVISOR, &dead);
+	g_mutex_unlock (priv->lock);
+
+	free_entries (dead);
+
+	/* the interned strings can't be freed, but they're worth
+	   watching together with the caches */
+	modest_string_pool_get_stats (&n_strings, &pool_size, &pool_saved);
+	g_debug ("%s: string pool: %u strings, %" G_GSIZE_FORMAT " bytes, "
+		 "%" G_GSIZE_FORMAT " bytes saved", __FUNCTION__,
+		 n_strings, pool_size, pool_saved);
+}
+
+gpointer
+modest_cache_lookup (ModestCache *cache, gconstpointer key)
+{
+	ModestCacheMgrPrivate *priv;
+	CacheEntry *entry;
+	gpointer value = NULL;
+
+	g_return_val_if_fail (cache, NULL);
+	priv = MODEST_CACHE_MGR_GET_PRIVATE (cache->mgr);
+
+	g_mutex_lock (priv->lock);
+	entry = g_hash_table_lookup (cache->entries, key);
+	if (entry) {
+		cache->hits++;
+		entry->tick = ++priv->tick;
+		g_queue_unlink (&cache->lru, &entry->link);
+		g_queue_push_head_link (&cache->lru, &entry->link);
+		value = cache->value_copy_func (entry->value);
+	} else {
+		cache->misses++;
+	}
+	g_mutex_unlock (priv->lock);
+
+	return value;
+}
+
+void
+modest_cache_insert (ModestCache *cache, gpointer key, gpointer value)
+{
+	ModestCacheMgrPrivate *priv;
+	CacheEntry *entry;
+	GSList *dead = NULL;
+	gsize size;
+
+	g_return_if_fail (cache);
+	priv = MODEST_CACHE_MGR_GET_PRIVATE (cache->mgr);
+
+	size = ENTRY_OVERHEAD;
+	if (cache->size_func)
+		size += cache->size_func (key, value);
+
+	/* Too big to be cached at all */
+	if (size > cache->max_size || size > priv->budget) {
+		if (cache->key_destroy_func)
+			cache->key_destroy_func (key);
+		if (cache->value_destroy_func)
+			cache->value_destroy_func (value);
+		return;
+	}
+
+	g_mutex_lock (priv->lock);
+
+	entry = g_hash_table_lookup (cache->entries, key);
+	if (entry)
+		cache_unlink_entry (cache, entry, &dead);
+
+	/* Make room, first in the cache itself and then in the
+	   budget shared with the other caches */
+	cache_shrink (cache, cache->max_size - size, &dead);
+	trim_caches (priv, priv->budget - size, &dead);
+
+	entry = g_slice_new (CacheEntry);
+	entry->cache = cache;
+	entry->key = key;
+	entry->value = value;
+	entry->size = size;
+	entry->tick = ++priv->tick;
+	entry->link.data = entry;
+	entry->link.prev = entry->link.next = NULL;
+
+	g_hash_table_insert (cache->entries, key, entry);
+	g_queue_push_head_link (&cache->lru, &entry->link);
+	cache->size += size;
+	priv->size += size;
+
+	g_mutex_unlock (priv->lock);
+
+	free_entries (dead);
+}
+
+void
+modest_cache_remove (ModestCache *cache, gconstpointer key)
+{
+	ModestCacheMgrPrivate *priv;
+	CacheEntry *entry;
+	GSList *dead = NULL;
+
+	g_return_if_fail (cache);
+	priv = MODEST_CACHE_MGR_GET_PRIVATE (cache->mgr);
+
+	g_mutex_lock (priv->lock);
+	entry = g_hash_table_lookup (cache->entries, key);
+	if (entry)
+		cache_unlink_entry (cache, entry, &dead);
+	g_mutex_unlock (priv->lock);
+
+	free_entries (dead);
+}
+
+void
+modest_cache_clear (ModestCache *cache)
+{
+	ModestCacheMgrPrivate *priv;
+	GSList *dead = NULL;
+
+	g_return_if_fail (cache);
+	priv = MODEST_CACHE_MGR_GET_PRIVATE (cache->mgr);
+
+	g_mutex_lock (priv->lock);
+	while (cache->lru.head)
+		cache_unlink_entry (cache, (CacheEntry *) cache->lru.head->data, &dead);
+	g_mutex_unlock (priv->lock);
+
+	free_entries (dead);
+}
+
+void
+modest_cache_get_stats (ModestCache *cache, ModestCacheStats *stats)
+{
+	ModestCacheMgrPrivate *priv;
+
+	g_return_if_fail (cache && stats);
+	priv = MODEST_CACHE_MGR_GET_PRIVATE (cache->mgr);
+
+	g_mutex_lock (priv->lock);
+	stats->n_entries = g_hash_table_size (cache->entries);
+	stats->size      = cache->size;
+	stats->max_size  = cache->max_size;
+	stats->hits      = cache->hits;
+	stats->misses    = cache->misses;
+	stats->evictions = cache->evictions;
+	g_mutex_unlock (priv->lock);
+}
@@ -55,17 +55,41 @@ struct _ModestCacheMgrClass {
 };
 
 /*
- * the caches managed by this class
+ * the tables managed by this class. They're never evicted
  */
 typedef enum {
-	MODEST_CACHE_MGR_CACHE_TYPE_DATE_STRING,       /* time_t => string */
-	MODEST_CACHE_MGR_CACHE_TYPE_DISPLAY_STRING,    /* gchar* => gchar* */
-	MODEST_CACHE_MGR_CACHE_TYPE_PIXBUF,            /* gchar* => GdkPixbuf */
 	MODEST_CACHE_MGR_CACHE_TYPE_SEND_QUEUE,        /* TnyAccount* => TnySendQueue* */
 
 	MODEST_CACHE_MGR_CACHE_TYPE_NUM
 } ModestCacheMgrCacheType;
 
+/*
+ * the LRU caches created with modest_cache_mgr_new_cache(). Every one
+ * has its own maximum size, and all of them share the memory budget
+ * of the cache manager: when the total goes over it, the least
+ * recently used entries of all the caches are evicted. They're also
+ * shrunk when the platform reports that the memory is low
+ */
+typedef struct _ModestCache ModestCache;
+
+/* memory budget of all the LRU caches, in bytes */
+#define MODEST_CACHE_MGR_BUDGET (2*1024*1024)
+
+/* the caches are shrunk to this fraction of the budget on low memory */
+#define MODEST_CACHE_MGR_LOW_MEMORY_DIVISOR 4
+
+/* returns the approximate number of bytes used by an entry */
+typedef gsize (*ModestCacheSizeFunc) (gconstpointer key, gconstpointer value);
+
+typedef struct {
+	guint n_entries;
+	gsize size;
+	gsize max_size;
+	guint hits;
+	guint misses;
+	guint evictions;
+} ModestCacheStats;
+
 
 /**
  * modest_cache_mgr_get_type:
@@ -129,6 +153,98 @@ void            modest_cache_mgr_flush_all    (ModestCacheMgr *self);
  */
 guint           modest_cache_mgr_get_size     (ModestCacheMgr *self, ModestCacheMgrCacheType type);
 
+/**
+ * modest_cache_mgr_new_cache:
+ * @self: a valid cache mgr obj
+ * @name: a name that identifies the cache
+ * @max_size: the maximum size of the cache in bytes
+ * @hash_func: a #GHashFunc for the keys
+ * @key_equal_func: a #GEqualFunc for the keys
+ * @key_destroy_func: a function to free the keys, or %NULL
+ * @value_destroy_func: a function to free the values, or %NULL
+ * @value_copy_func: a function that returns a new copy (or
+ * reference) of a value, used by modest_cache_lookup()
+ * @size_func: a #ModestCacheSizeFunc, or %NULL to count
+ * the entries only by their overhead
+ *
+ * create a LRU cache managed by @self. If a cache
+ * called @name was already created, that one is returned and the
+ * other arguments are ignored. The cache belongs to @self, it's
+ * destroyed with it. All the caches can be used from any thread
+ *
+ * Returns: the #ModestCache, that should NOT be freed
+ */
+ModestCache*    modest_cache_mgr_new_cache    (ModestCacheMgr *self,
+					       const gchar *name,
+					       gsize max_size,
+					       GHashFunc hash_func,
+					       GEqualFunc key_equal_func,
+					       GDestroyNotify key_destroy_func,
+					       GDestroyNotify value_destroy_func,
+					       GBoxedCopyFunc value_copy_func,
+					       ModestCacheSizeFunc size_func);
+
+/**
+ * modest_cache_mgr_memory_low:
+ * @self: a valid cache mgr obj
+ *
+ * to be called by the platform when the device is running out of
+ * memory. The LRU caches are shrunk to a fraction of the budget,
+ * evicting the least recently used entries of all of them
+ */
+void            modest_cache_mgr_memory_low   (ModestCacheMgr *self);
+
+/**
+ * modest_cache_lookup:
+ * @cache: a #ModestCache
+ * @key: the key to look for
+ *
+ * look for @key in @cache, making it the most recently used entry
+ *
+ * Returns: a copy of the value, as returned by the value copy
+ * function of the cache, or %NULL if it's not cached
+ */
+gpointer        modest_cache_lookup           (ModestCache *cache, gconstpointer key);
+
+/**
+ * modest_cache_insert:
+ * @cache: a #ModestCache
+ * @key: the key
+ * @value: the value
+ *
+ * add (or replace) an entry in @cache. The cache takes ownership of
+ * both @key and @value. Other entries could be evicted to make room
+ * for it, and the entry itself is not stored if it's bigger than the
+ * maximum size of the cache or the budget of the manager
+ */
+void            modest_cache_insert           (ModestCache *cache, gpointer key, gpointer value);
+
+/**
+ * modest_cache_remove:
+ * @cache: a #ModestCache
+ * @key: the key
+ *
+ * remove the entry of @key from @cache, if any
+ */
+void            modest_cache_remove           (ModestCache *cache, gconstpointer key);
+
+/**
+ * modest_cache_clear:
+ * @cache: a #ModestCache
+ *
+ * remove all the entries of @cache
+ */
+void            modest_cache_clear            (ModestCache *cache);
+
+/**
+ * modest_cache_get_stats:
+ * @cache: a #ModestCache
+ * @stats: a #ModestCacheStats to fill
+ *
+ * get the size and the hit, miss and eviction counters of @cache
+ */
+void            modest_cache_get_stats        (ModestCache *cache, ModestCacheStats *stats);
+
 G_END_DECLS
 
 #endif /* __MODEST_CACHE_MGR_H__ */
@@ -56,6 +56,11 @@ const gchar *modest_defs_namespace (const gchar *string);
 #define MODEST_CACHE_DIR                  "cache"
 #define MODEST_IMAGES_CACHE_DIR           "images"
 #define MODEST_IMAGES_CACHE_SIZE          (1024*1024)
+#define MODEST_ATTACHMENT_STORE_DIR       "attachments"
+#define MODEST_ADDRESS_INDEX_FILE         "address-index"
+#define MODEST_FOLDER_COUNTS_FILE         "folder-counts"
+#define MODEST_OFFLINE_JOURNAL_FILE       "offline-journal"
+#define MODEST_COUNTRY_CACHE_FILE         "countries"
 
 #define MODEST_LOCAL_FOLDERS_ACCOUNT_ID   "local_folders"
 #define MODEST_LOCAL_FOLDERS_ACCOUNT_NAME MODEST_LOCAL_FOLDERS_ACCOUNT_ID
@@ -231,6 +236,8 @@ const gchar *modest_defs_namespace (const gchar *string);
 
 #define MODEST_ACCOUNT_UPDATE_ALL_FOLDERS	"update_all_folders"	/* boolean */
 
+#define MODEST_ACCOUNT_PUSH              "push"              /* boolean */
+
 #define MODEST_ACCOUNT_SECURITY "security"
 #define MODEST_ACCOUNT_SECURITY_VALUE_NONE "none"
 #define MODEST_ACCOUNT_SECURITY_VALUE_NORMAL "normal" /* Meaning "Normal (TLS)", as in our UI spec. */ 
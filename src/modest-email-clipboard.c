@@ -42,7 +42,7 @@ static GObjectClass *parent_class = NULL;
 struct _ModestEmailClipboardPrivate {
 	TnyList    *selection;
 	TnyFolder  *src;	
-	gchar      **hidding;
+	GHashTable *hidding;
 	gboolean   delete;
 };
 
@@ -168,7 +168,6 @@ modest_email_clipboard_set_data (ModestEmailClipboard *self,
 	TnyIterator *iter = NULL;
 	GObject *obj = NULL;			
 	gchar *id = NULL;
-	guint i, n_selected;
 
 	g_return_if_fail (MODEST_IS_EMAIL_CLIPBOARD (self));
 	g_return_if_fail (TNY_IS_FOLDER (src_folder));
@@ -185,31 +184,29 @@ modest_email_clipboard_set_data (ModestEmailClipboard *self,
 	priv->delete = delete;
 	priv->hidding = NULL;
 
-	/* Fill hidding array (for cut operation) */	
+	/* Fill hidding set (for cut operation) */
 	if (delete) {
-		n_selected = 1;
+		priv->hidding = g_hash_table_new_full (g_str_hash, g_str_equal,
+						       g_free, NULL);
 		if (data != NULL) {
-			n_selected = tny_list_get_length (data);	
-			priv->hidding = g_malloc0(sizeof(gchar *) * n_selected);	
 			iter = tny_list_create_iterator (priv->selection);
-			i = 0;
 			while (!tny_iterator_is_done (iter)) {
 				obj = tny_iterator_get_current (iter);
-				if (obj && TNY_IS_HEADER (obj))
-					id = tny_header_dup_message_id (TNY_HEADER (obj));
-				
-				priv->hidding[i++] = id;
+				if (obj && TNY_IS_HEADER (obj)) {
+					id = tny_header_dup_uid (TNY_HEADER (obj));
+					if (id)
+						g_hash_table_insert (priv->hidding, id, id);
+				}
 				tny_iterator_next (iter);
-				
+
 				if (obj)
 					g_object_unref (obj);
 			}
 			g_object_unref (iter);
 		}
 		else {
-			priv->hidding = g_malloc0(sizeof(gchar *));	
 			id = g_strdup (tny_folder_get_id (src_folder));
-			priv->hidding[0] = id;			
+			g_hash_table_insert (priv->hidding, id, id);
 		}
 	}
 }
@@ -218,23 +215,16 @@ void
 modest_email_clipboard_clear (ModestEmailClipboard *self)
 {
 	ModestEmailClipboardPrivate *priv = NULL;
-	guint i, n_selected;
 
 	g_return_if_fail (MODEST_IS_EMAIL_CLIPBOARD (self));
 	priv = MODEST_EMAIL_CLIPBOARD_GET_PRIVATE (self);
 
-	n_selected = 1;
 	if (priv->src) 
 		g_object_unref (priv->src);
-	if (priv->selection) {
-		n_selected = tny_list_get_length(priv->selection);
+	if (priv->selection)
 		g_object_unref (priv->selection);
-	}
-	if (priv->hidding) {		
-		for (i=0; i < n_selected; i++) 
-			g_free (priv->hidding[i]);
-		g_free(priv->hidding);
-	}
+	if (priv->hidding)
+		g_hash_table_unref (priv->hidding);
 
 	priv->src = NULL;
 	priv->selection = NULL;
@@ -333,22 +323,13 @@ modest_email_clipboard_get_folder_name (ModestEmailClipboard *self)
 	return folder_name;
 }
 
-const gchar **
-modest_email_clipboard_get_hidding_ids (ModestEmailClipboard *self,
-					guint *n_selected)
+GHashTable *
+modest_email_clipboard_get_hidding_set (ModestEmailClipboard *self)
 {
-	ModestEmailClipboardPrivate *priv = NULL;;
-
-	*n_selected = 0;
+	ModestEmailClipboardPrivate *priv = NULL;
 
 	g_return_val_if_fail (MODEST_IS_EMAIL_CLIPBOARD (self), NULL);
 	priv = MODEST_EMAIL_CLIPBOARD_GET_PRIVATE (self);
 
-	if (priv->selection != NULL)
-		*n_selected = tny_list_get_length (priv->selection);
-	else
-		*n_selected = 1;
-
-	return (const gchar **) priv->hidding;
+	return (priv->hidding) ? g_hash_table_ref (priv->hidding) : NULL;
 }
-
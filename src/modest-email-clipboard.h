@@ -147,16 +147,17 @@ modest_email_clipboard_check_source_folder (ModestEmailClipboard *self,
 					    TnyFolder *folder);
 
 /**
- * modest_email_clipboard_set_data:
+ * modest_email_clipboard_get_hidding_set:
  * @self: a #ModestEmailClipboard singlenton instance.   
- * @n_selected: the number of items copied and marked to delete.
  * 
- * Returns the string array of item identifiers stored on clipboard.
+ * Returns the set of item identifiers marked to delete by a cut
+ * operation, that is, header uids or the folder id. Keys and values
+ * of the hash table are the same string, so a lookup returns non NULL
+ * for the hidden items.
  * 
- * returns TRUE, if clipboard is cleared, FALSE otherwise.
+ * returns a new reference to the set, or NULL if nothing was cut.
  */
-const gchar **modest_email_clipboard_get_hidding_ids (ModestEmailClipboard *self,
-						      guint *n_selected);
+GHashTable *modest_email_clipboard_get_hidding_set (ModestEmailClipboard *self);
 
 /**
  * modest_email_clipboard_get_folder_name:
@@ -0,0 +1,408 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+#include <gdk/gdk.h>
+#include <tny-simple-list.h>
+#include <tny-iterator.h>
+#include <tny-folder-observer.h>
+#include "modest-folder-change-bus.h"
+#include "modest-folder-counts.h"
+
+typedef struct _BusObserver BusObserver;
+
+typedef struct {
+	guint                     id;
+	BusObserver              *bus;
+	ModestFolderChangeBusFunc func;
+	gpointer                  user_data;
+} Subscriber;
+
+/***** B U S    O B S E R V E R *****/
+/* One per observed folder, shared by all its subscribers. It
+ * accumulates the changes of the folder until the end of the frame */
+struct _BusObserver {
+	GObject    parent;
+	TnyFolder *folder;
+	GSList    *subscribers;		/* only used from the main loop */
+
+	/* protected by the bus lock */
+	gboolean   stopped;
+	guint      flush_id;
+	TnyFolderChangeChanged changed;
+	guint      all_count;
+	guint      unread_count;
+	gchar     *rename;
+	TnyMsg    *received_msg;
+	GHashTable *added;		/* uid -> TnyHeader */
+	GHashTable *expunged;		/* uid -> TnyHeader */
+};
+
+typedef struct {
+	GObjectClass parent;
+} BusObserverClass;
+
+static void bus_observer_iface_init (TnyFolderObserverIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (BusObserver,
+			 bus_observer,
+			 G_TYPE_OBJECT,
+			 G_IMPLEMENT_INTERFACE(TNY_TYPE_FOLDER_OBSERVER, bus_observer_iface_init));
+
+/* folder -> BusObserver and id -> Subscriber, only used from the
+   main loop */
+static GHashTable *_buses = NULL;
+static GHashTable *_subscriptions = NULL;
+static guint _last_id = 0;
+
+/* folder observers might be notified outside the main thread */
+G_LOCK_DEFINE_STATIC (bus);
+
+static GHashTable *
+headers_table_new (void)
+{
+	return g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+}
+
+static gchar *
+header_key (TnyHeader *header)
+{
+	gchar *uid;
+
+	/* Headers without uid can not be matched, so they're never
+	   merged with any other */
+	uid = tny_header_dup_uid (header);
+	if (!uid)
+		uid = g_strdup_printf ("%p", header);
+	return uid;
+}
+
+/* must be called with the bus lock held */
+static void
+bus_observer_merge_headers (BusObserver *self,
+			    TnyFolderChange *change,
+			    gboolean added)
+{
+	TnyList *list;
+	TnyIterator *iter;
+	GHashTable *same, *opposite;
+
+	same = (added) ? self->added : self->expunged;
+	opposite = (added) ? self->expunged : self->added;
+
+	list = tny_simple_list_new ();
+	if (added)
+		tny_folder_change_get_added_headers (change, list);
+	else
+		tny_folder_change_get_expunged_headers (change, list);
+
+	iter = tny_list_create_iterator (list);
+	while (!tny_iterator_is_done (iter)) {
+		TnyHeader *header = TNY_HEADER (tny_iterator_get_current (iter));
+		gchar *key = header_key (header);
+
+		/* A header added and expunged in the same frame (in
+		   any order) is not seen by the subscribers */
+		if (g_hash_table_remove (opposite, key)) {
+			g_free (key);
+			g_object_unref (header);
+		} else {
+			g_hash_table_replace (same, key, header);
+		}
+		tny_iterator_next (iter);
+	}
+	g_object_unref (iter);
+	g_object_unref (list);
+}
+
+static void
+add_header_to_change (gpointer key,
+		      gpointer value,
+		      gpointer user_data)
+{
+	TnyFolderChange *change = (TnyFolderChange *) user_data;
+	tny_folder_change_add_added_header (change, TNY_HEADER (value));
+}
+
+static void
+add_expunged_header_to_change (gpointer key,
+			       gpointer value,
+			       gpointer user_data)
+{
+	TnyFolderChange *change = (TnyFolderChange *) user_data;
+	tny_folder_change_add_expunged_header (change, TNY_HEADER (value));
+}
+
+static gboolean
+bus_observer_flush (gpointer user_data)
+{
+	BusObserver *self = (BusObserver *) user_data;
+	TnyFolderChangeChanged changed;
+	TnyFolderChange *change;
+	GHashTable *added, *expunged;
+	gchar *rename;
+	TnyMsg *received_msg;
+	guint all_count, unread_count;
+	GSList *ids, *node;
+
+	G_LOCK (bus);
+	self->flush_id = 0;
+	if (self->stopped) {
+		G_UNLOCK (bus);
+		return FALSE;
+	}
+	changed = self->changed;
+	all_count = self->all_count;
+	unread_count = self->unread_count;
+	rename = self->rename;
+	received_msg = self->received_msg;
+	added = self->added;
+	expunged = self->expunged;
+
+	self->changed = 0;
+	self->rename = NULL;
+	self->received_msg = NULL;
+	self->added = headers_table_new ();
+	self->expunged = headers_table_new ();
+	G_UNLOCK (bus);
+
+	/* Build the merged change outside the lock, the setters could
+	   query the folder */
+	change = tny_folder_change_new (self->folder);
+	if (changed & TNY_FOLDER_CHANGE_CHANGED_ALL_COUNT)
+		tny_folder_change_set_new_all_count (change, all_count);
+	if (changed & TNY_FOLDER_CHANGE_CHANGED_UNREAD_COUNT)
+		tny_folder_change_set_new_unread_count (change, unread_count);
+	g_hash_table_foreach (added, add_header_to_change, change);
+	g_hash_table_foreach (expunged, add_expunged_header_to_change, change);
+	if (rename)
+		tny_folder_change_set_rename (change, rename);
+	if (received_msg)
+		tny_folder_change_set_received_msg (change, received_msg);
+
+	/* Everything could have been cancelled out */
+	if (tny_folder_change_get_changed (change) == 0)
+		goto frees;
+
+	/* Keep the counts cache in sync before the subscribers, like
+	   the folder view, read it */
+	modest_folder_counts_update_from_change (change);
+
+	gdk_threads_enter ();
+
+	/* Subscribers could leave (or new ones come) while being
+	   notified, so iterate over a copy of the ids */
+	ids = NULL;
+	for (node = self->subscribers; node; node = g_slist_next (node))
+		ids = g_slist_prepend (ids, GUINT_TO_POINTER (((Subscriber *) node->data)->id));
+	ids = g_slist_reverse (ids);
+
+	for (node = ids; node; node = g_slist_next (node)) {
+		Subscriber *sub;
+
+		sub = g_hash_table_lookup (_subscriptions, node->data);
+		if (sub && sub->bus == self)
+			sub->func (self->folder, change, sub->user_data);
+	}
+	g_slist_free (ids);
+
+	gdk_threads_leave ();
+
+ frees:
+	g_object_unref (change);
+	g_hash_table_destroy (added);
+	g_hash_table_destroy (expunged);
+	g_free (rename);
+	if (received_msg)
+		g_object_unref (received_msg);
+
+	return FALSE;
+}
+
+static void
+bus_observer_update (TnyFolderObserver *observer, TnyFolderChange *change)
+{
+	BusObserver *self = (BusObserver *) observer;
+	TnyFolderChangeChanged changed;
+
+	changed = tny_folder_change_get_changed (change);
+
+	G_LOCK (bus);
+	if (self->stopped) {
+		G_UNLOCK (bus);
+		return;
+	}
+
+	/* The counts are absolute, so the last ones win */
+	if (changed & TNY_FOLDER_CHANGE_CHANGED_ALL_COUNT)
+		self->all_count = tny_folder_change_get_new_all_count (change);
+	if (changed & TNY_FOLDER_CHANGE_CHANGED_UNREAD_COUNT)
+		self->unread_count = tny_folder_change_get_new_unread_count (change);
+	self->changed |= changed & (TNY_FOLDER_CHANGE_CHANGED_ALL_COUNT |
+				    TNY_FOLDER_CHANGE_CHANGED_UNREAD_COUNT);
+
+	if (changed & TNY_FOLDER_CHANGE_CHANGED_ADDED_HEADERS)
+		bus_observer_merge_headers (self, change, TRUE);
+	if (changed & TNY_FOLDER_CHANGE_CHANGED_EXPUNGED_HEADERS)
+		bus_observer_merge_headers (self, change, FALSE);
+
+	if (changed & TNY_FOLDER_CHANGE_CHANGED_FOLDER_RENAME) {
+		g_free (self->rename);
+		self->rename = g_strdup (tny_folder_change_get_rename (change, NULL));
+	}
+
+	if (changed & TNY_FOLDER_CHANGE_CHANGED_MSG_RECEIVED) {
+		if (self->received_msg)
+			g_object_unref (self->received_msg);
+		self->received_msg = tny_folder_change_get_received_msg (change);
+	}
+
+	if (self->flush_id == 0)
+		self->flush_id = g_timeout_add_full (G_PRIORITY_DEFAULT,
+						     MODEST_FOLDER_CHANGE_BUS_FRAME,
+						     bus_observer_flush,
+						     g_object_ref (self),
+						     g_object_unref);
+	G_UNLOCK (bus);
+}
+
+static void
+bus_observer_init (BusObserver *self)
+{
+	self->added = headers_table_new ();
+	self->expunged = headers_table_new ();
+}
+
+static void
+bus_observer_finalize (GObject *object)
+{
+	BusObserver *self = (BusObserver *) object;
+
+	if (self->folder)
+		g_object_unref (self->folder);
+	g_hash_table_destroy (self->added);
+	g_hash_table_destroy (self->expunged);
+	g_free (self->rename);
+	if (self->received_msg)
+		g_object_unref (self->received_msg);
+
+	G_OBJECT_CLASS (bus_observer_parent_class)->finalize (object);
+}
+
+static void
+bus_observer_iface_init (TnyFolderObserverIface *iface)
+{
+	iface->update = bus_observer_update;
+}
+
+static void
+bus_observer_class_init (BusObserverClass *klass)
+{
+	GObjectClass *object_class;
+
+	object_class = (GObjectClass*) klass;
+	object_class->finalize = bus_observer_finalize;
+}
+
+static void
+bus_observer_stop (BusObserver *self)
+{
+	G_LOCK (bus);
+	self->stopped = TRUE;
+	if (self->flush_id) {
+		g_source_remove (self->flush_id);
+		self->flush_id = 0;
+	}
+	G_UNLOCK (bus);
+
+	g_hash_table_remove (_buses, self->folder);
+	tny_folder_remove_observer (self->folder, TNY_FOLDER_OBSERVER (self));
+	g_object_unref (self);
+}
+
+guint
+modest_folder_change_bus_subscribe (TnyFolder *folder,
+				    ModestFolderChangeBusFunc func,
+				    gpointer user_data)
+{
+	BusObserver *bus;
+	Subscriber *sub;
+
+	g_return_val_if_fail (TNY_IS_FOLDER (folder), 0);
+	g_return_val_if_fail (func, 0);
+
+	if (!_buses) {
+		_buses = g_hash_table_new (g_direct_hash, g_direct_equal);
+		_subscriptions = g_hash_table_new (g_direct_hash, g_direct_equal);
+	}
+
+	bus = g_hash_table_lookup (_buses, folder);
+	if (!bus) {
+		bus = g_object_new (bus_observer_get_type (), NULL);
+		bus->folder = g_object_ref (folder);
+		g_hash_table_insert (_buses, folder, bus);
+		tny_folder_add_observer (folder, TNY_FOLDER_OBSERVER (bus));
+	}
+
+	if (++_last_id == 0)
+		_last_id = 1;
+
+	sub = g_slice_new (Subscriber);
+	sub->id = _last_id;
+	sub->bus = bus;
+	sub->func = func;
+	sub->user_data = user_data;
+
+	bus->subscribers = g_slist_append (bus->subscribers, sub);
+	g_hash_table_insert (_subscriptions, GUINT_TO_POINTER (sub->id), sub);
+
+	return sub->id;
+}
+
+void
+modest_folder_change_bus_unsubscribe (guint subscription)
+{
+	Subscriber *sub;
+	BusObserver *bus;
+
+	if (!_subscriptions || subscription == 0)
+		return;
+
+	sub = g_hash_table_lookup (_subscriptions, GUINT_TO_POINTER (subscription));
+	if (!sub)
+		return;
+
+	g_hash_table_remove (_subscriptions, GUINT_TO_POINTER (subscription));
+	bus = sub->bus;
+	bus->subscribers = g_slist_remove (bus->subscribers, sub);
+	g_slice_free (Subscriber, sub);
+
+	if (!bus->subscribers)
+		bus_observer_stop (bus);
+}
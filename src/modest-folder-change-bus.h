@@ -0,0 +1,86 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MODEST_FOLDER_CHANGE_BUS_H__
+#define __MODEST_FOLDER_CHANGE_BUS_H__
+
+#include <glib.h>
+#include <tny-folder.h>
+#include <tny-folder-change.h>
+
+G_BEGIN_DECLS
+
+/*
+ * a single folder observer per folder shared by all the interested
+ * parties in the UI. The notifications that tinymail sends for a
+ * folder (that could be many of them, one per header, while a
+ * folder is being synchronized) are accumulated during a short frame
+ * and then merged into one #TnyFolderChange: the counts are the last
+ * ones, and a header that was both added and expunged during the
+ * frame is dropped. Subscribers are called from the main loop, with
+ * the gdk lock held
+ */
+
+/* milliseconds the changes of a folder are accumulated */
+#define MODEST_FOLDER_CHANGE_BUS_FRAME 200
+
+typedef void (*ModestFolderChangeBusFunc) (TnyFolder *folder,
+					   TnyFolderChange *change,
+					   gpointer user_data);
+
+/**
+ * modest_folder_change_bus_subscribe:
+ * @folder: a #TnyFolder
+ * @func: the function called with the batched changes of @folder
+ * @user_data: generic data passed to @func
+ *
+ * start receiving the changes of @folder. The first subscriber for
+ * a folder attaches the observer to it
+ *
+ * Returns: the id of the subscription, to be passed to
+ * modest_folder_change_bus_unsubscribe(), or 0 on error
+ **/
+guint modest_folder_change_bus_subscribe   (TnyFolder *folder,
+					    ModestFolderChangeBusFunc func,
+					    gpointer user_data);
+
+/**
+ * modest_folder_change_bus_unsubscribe:
+ * @subscription: a subscription id
+ *
+ * stop receiving changes for @subscription. It's safe to call it
+ * from the subscriber function itself. The observer is removed from
+ * the folder, and the pending changes discarded, when its last
+ * subscriber leaves
+ **/
+void  modest_folder_change_bus_unsubscribe (guint subscription);
+
+G_END_DECLS
+
+#endif /* __MODEST_FOLDER_CHANGE_BUS_H__ */
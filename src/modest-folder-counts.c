@@ -0,0 +1,508 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <tny-simple-list.h>
+#include <tny-iterator.h>
+#include <tny-header.h>
+#include "modest-folder-counts.h"
+#include "modest-defs.h"
+
+/* seconds to wait before writing the changes to disk */
+#define SAVE_TIMEOUT 5
+
+#define KEY_ALL      "all"
+#define KEY_UNREAD   "unread"
+#define KEY_LAST_UID "last-uid"
+#define KEY_MTIME    "mtime"
+#define KEY_OLDEST   "oldest"
+#define KEY_NEWEST   "newest"
+#define KEY_SYNCED_ALL    "synced-all"
+#define KEY_SYNCED_UNREAD "synced-unread"
+#define KEY_SYNCED_TIME   "synced"
+
+typedef struct {
+	guint     all_count;
+	guint     unread_count;
+	gchar    *last_uid;
+	time_t    mtime;
+	time_t    oldest_date;
+	time_t    newest_date;
+	guint     synced_all;
+	guint     synced_unread;
+	time_t    synced_time;
+	/* TRUE if the counts were updated from the folder itself
+	   during this session; not saved */
+	gboolean  live;
+} CountsEntry;
+
+/* folder observers might be notified outside the main thread */
+G_LOCK_DEFINE_STATIC (folder_counts);
+static GHashTable *_counts = NULL;
+static guint       _save_timeout = 0;
+
+static void
+counts_entry_free (CountsEntry *entry)
+{
+	g_free (entry->last_uid);
+	g_slice_free (CountsEntry, entry);
+}
+
+static gchar*
+get_counts_filename (void)
+{
+	return g_build_filename (MODEST_DIR, MODEST_FOLDER_COUNTS_FILE, NULL);
+}
+
+static void
+load_counts (void)
+{
+	GKeyFile *key_file;
+	gchar *filename;
+	gchar **groups;
+	gsize i, num_groups = 0;
+
+	_counts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+					 (GDestroyNotify) counts_entry_free);
+
+	key_file = g_key_file_new ();
+	filename = get_counts_filename ();
+	if (!g_key_file_load_from_file (key_file, filename, G_KEY_FILE_NONE, NULL)) {
+		/* not an error, it's created on the first update */
+		g_key_file_free (key_file);
+		g_free (filename);
+		return;
+	}
+
+	groups = g_key_file_get_groups (key_file, &num_groups);
+	for (i = 0; i < num_groups; i++) {
+		CountsEntry *entry;
+		GError *err = NULL;
+
+		entry = g_slice_new0 (CountsEntry);
+		entry->all_count = g_key_file_get_integer (key_file, groups[i], KEY_ALL, &err);
+		if (!err)
+			entry->unread_count = g_key_file_get_integer (key_file, groups[i],
+								      KEY_UNREAD, &err);
+		if (err) {
+			/* ignore broken entries, we'll get them again */
+			g_error_free (err);
+			counts_entry_free (entry);
+			continue;
+		}
+		entry->last_uid = g_key_file_get_string (key_file, groups[i], KEY_LAST_UID, NULL);
+		entry->mtime = (time_t) g_key_file_get_integer (key_file, groups[i], KEY_MTIME, NULL);
+		entry->oldest_date = (time_t) g_key_file_get_integer (key_file, groups[i], KEY_OLDEST, NULL);
+		entry->newest_date = (time_t) g_key_file_get_integer (key_file, groups[i], KEY_NEWEST, NULL);
+		entry->synced_all = g_key_file_get_integer (key_file, groups[i], KEY_SYNCED_ALL, NULL);
+		entry->synced_unread = g_key_file_get_integer (key_file, groups[i], KEY_SYNCED_UNREAD, NULL);
+		entry->synced_time = (time_t) g_key_file_get_integer (key_file, groups[i], KEY_SYNCED_TIME, NULL);
+
+		g_hash_table_insert (_counts, g_strdup (groups[i]), entry);
+	}
+
+	g_strfreev (groups);
+	g_key_file_free (key_file);
+	g_free (filename);
+}
+
+/* call with the lock held */
+static GHashTable*
+get_counts (void)
+{
+	if (G_UNLIKELY (!_counts))
+		load_counts ();
+	return _counts;
+}
+
+static void
+add_entry_to_key_file (gpointer key, gpointer value, gpointer user_data)
+{
+	GKeyFile *key_file = (GKeyFile *) user_data;
+	CountsEntry *entry = (CountsEntry *) value;
+	const gchar *url = (const gchar *) key;
+
+	g_key_file_set_integer (key_file, url, KEY_ALL, entry->all_count);
+	g_key_file_set_integer (key_file, url, KEY_UNREAD, entry->unread_count);
+	if (entry->last_uid)
+		g_key_file_set_string (key_file, url, KEY_LAST_UID, entry->last_uid);
+	g_key_file_set_integer (key_file, url, KEY_MTIME, (gint) entry->mtime);
+	if (entry->oldest_date || entry->newest_date) {
+		g_key_file_set_integer (key_file, url, KEY_OLDEST, (gint) entry->oldest_date);
+		g_key_file_set_integer (key_file, url, KEY_NEWEST, (gint) entry->newest_date);
+	}
+	if (entry->synced_time) {
+		g_key_file_set_integer (key_file, url, KEY_SYNCED_ALL, entry->synced_all);
+		g_key_file_set_integer (key_file, url, KEY_SYNCED_UNREAD, entry->synced_unread);
+		g_key_file_set_integer (key_file, url, KEY_SYNCED_TIME, (gint) entry->synced_time);
+	}
+}
+
+static void
+save_counts (void)
+{
+	GKeyFile *key_file;
+	gchar *filename, *data;
+	gsize len;
+	GError *err = NULL;
+
+	G_LOCK (folder_counts);
+	if (!_counts) {
+		G_UNLOCK (folder_counts);
+		return;
+	}
+	key_file = g_key_file_new ();
+	g_hash_table_foreach (_counts, add_entry_to_key_file, key_file);
+	G_UNLOCK (folder_counts);
+
+	data = g_key_file_to_data (key_file, &len, NULL);
+
+	/* g_file_set_contents writes to a temporary file and renames
+	   it, so we never leave a half-written cache behind */
+	filename = get_counts_filename ();
+	if (!g_file_set_contents (filename, data, len, &err)) {
+		g_warning ("%s: failed to save %s: %s", __FUNCTION__, filename,
+			   err ? err->message : "unknown error");
+		g_clear_error (&err);
+	}
+
+	g_free (filename);
+	g_free (data);
+	g_key_file_free (key_file);
+}
+
+static gboolean
+on_save_timeout (gpointer user_data)
+{
+	G_LOCK (folder_counts);
+	_save_timeout = 0;
+	G_UNLOCK (folder_counts);
+
+	save_counts ();
+
+	return FALSE;
+}
+
+/* call with the lock held */
+static void
+schedule_save (void)
+{
+	if (_save_timeout == 0)
+		_save_timeout = g_timeout_add_seconds (SAVE_TIMEOUT, on_save_timeout, NULL);
+}
+
+static void
+update_entry (const gchar *folder_url,
+	      guint all_count,
+	      guint unread_count,
+	      const gchar *last_uid,
+	      gboolean live)
+{
+	CountsEntry *entry;
+
+	G_LOCK (folder_counts);
+	entry = g_hash_table_lookup (get_counts (), folder_url);
+	if (!entry) {
+		entry = g_slice_new0 (CountsEntry);
+		g_hash_table_insert (_counts, g_strdup (folder_url), entry);
+	} else if (entry->all_count == all_count &&
+		   entry->unread_count == unread_count &&
+		   (!last_uid || !g_strcmp0 (entry->last_uid, last_uid))) {
+		/* nothing changed, don't touch the disk */
+		entry->live = entry->live || live;
+		G_UNLOCK (folder_counts);
+		return;
+	}
+
+	/* new or removed messages invalidate the date range */
+	if (entry->all_count != all_count ||
+	    (last_uid && g_strcmp0 (entry->last_uid, last_uid))) {
+		entry->oldest_date = 0;
+		entry->newest_date = 0;
+	}
+
+	entry->all_count = all_count;
+	entry->unread_count = unread_count;
+	if (last_uid) {
+		g_free (entry->last_uid);
+		entry->last_uid = g_strdup (last_uid);
+	}
+	entry->mtime = time (NULL);
+	entry->live = entry->live || live;
+
+	schedule_save ();
+	G_UNLOCK (folder_counts);
+}
+
+gboolean
+modest_folder_counts_lookup (const gchar *folder_url,
+			     ModestFolderCounts *counts)
+{
+	CountsEntry *entry;
+
+	g_return_val_if_fail (folder_url, FALSE);
+	g_return_val_if_fail (counts, FALSE);
+
+	G_LOCK (folder_counts);
+	entry = g_hash_table_lookup (get_counts (), folder_url);
+	if (entry) {
+		counts->all_count = entry->all_count;
+		counts->unread_count = entry->unread_count;
+		counts->last_uid = entry->last_uid;
+		counts->mtime = entry->mtime;
+		counts->oldest_date = entry->oldest_date;
+		counts->newest_date = entry->newest_date;
+		counts->synced_all = entry->synced_all;
+		counts->synced_unread = entry->synced_unread;
+		counts->synced_time = entry->synced_time;
+		counts->live = entry->live;
+	}
+	G_UNLOCK (folder_counts);
+
+	return entry != NULL;
+}
+
+void
+modest_folder_counts_get_for_folder (TnyFolder *folder,
+				     guint *all_count,
+				     guint *unread_count)
+{
+	CountsEntry *entry;
+	gchar *url;
+	guint all = 0, unread = 0;
+	gboolean from_disk = FALSE;
+
+	g_return_if_fail (TNY_IS_FOLDER (folder));
+
+	/* Until the folder reports its own counts in this session
+	   (see update_entry) the ones of the last session are more
+	   accurate than the ones of the folder list */
+	url = tny_folder_get_url_string (folder);
+	if (url) {
+		G_LOCK (folder_counts);
+		entry = g_hash_table_lookup (get_counts (), url);
+		if (entry && !entry->live) {
+			all = entry->all_count;
+			unread = entry->unread_count;
+			from_disk = TRUE;
+		}
+		G_UNLOCK (folder_counts);
+	}
+
+	/* The folder already has them, without loading its summary */
+	if (!from_disk) {
+		all = tny_folder_get_all_count (folder);
+		unread = tny_folder_get_unread_count (folder);
+	}
+
+	if (all_count)
+		*all_count = all;
+	if (unread_count)
+		*unread_count = unread;
+
+	g_free (url);
+}
+
+void
+modest_folder_counts_update (const gchar *folder_url,
+			     guint all_count,
+			     guint unread_count,
+			     const gchar *last_uid)
+{
+	g_return_if_fail (folder_url);
+
+	update_entry (folder_url, all_count, unread_count, last_uid, TRUE);
+}
+
+void
+modest_folder_counts_update_from_folder (TnyFolder *folder)
+{
+	gchar *url;
+
+	g_return_if_fail (TNY_IS_FOLDER (folder));
+
+	url = tny_folder_get_url_string (folder);
+	if (url) {
+		update_entry (url,
+			      tny_folder_get_all_count (folder),
+			      tny_folder_get_unread_count (folder),
+			      NULL, TRUE);
+		g_free (url);
+	}
+}
+
+void
+modest_folder_counts_update_from_change (TnyFolderChange *change)
+{
+	TnyFolderChangeChanged changed;
+	TnyFolder *folder;
+	gchar *url, *last_uid = NULL;
+	CountsEntry *entry;
+	gboolean live = FALSE;
+	guint all = 0, unread = 0;
+
+	g_return_if_fail (TNY_IS_FOLDER_CHANGE (change));
+
+	changed = tny_folder_change_get_changed (change);
+	if (!(changed & (TNY_FOLDER_CHANGE_CHANGED_ALL_COUNT |
+			 TNY_FOLDER_CHANGE_CHANGED_UNREAD_COUNT |
+			 TNY_FOLDER_CHANGE_CHANGED_ADDED_HEADERS)))
+		return;
+
+	folder = tny_folder_change_get_folder (change);
+	if (!folder)
+		return;
+
+	url = tny_folder_get_url_string (folder);
+	if (!url) {
+		g_object_unref (folder);
+		return;
+	}
+
+	/* the change only carries the counts that changed, the
+	   others are only trusted if they came from the folder */
+	G_LOCK (folder_counts);
+	entry = g_hash_table_lookup (get_counts (), url);
+	if (entry && entry->live) {
+		all = entry->all_count;
+		unread = entry->unread_count;
+		live = TRUE;
+	}
+	G_UNLOCK (folder_counts);
+
+	if (changed & TNY_FOLDER_CHANGE_CHANGED_ALL_COUNT)
+		all = tny_folder_change_get_new_all_count (change);
+	else if (!live)
+		all = tny_folder_get_all_count (folder);
+
+	if (changed & TNY_FOLDER_CHANGE_CHANGED_UNREAD_COUNT)
+		unread = tny_folder_change_get_new_unread_count (change);
+	else if (!live)
+		unread = tny_folder_get_unread_count (folder);
+
+	if (changed & TNY_FOLDER_CHANGE_CHANGED_ADDED_HEADERS) {
+		TnyList *added;
+		TnyIterator *iter;
+
+		/* headers are added in arrival order, keep the last one */
+		added = tny_simple_list_new ();
+		tny_folder_change_get_added_headers (change, added);
+		iter = tny_list_create_iterator (added);
+		while (!tny_iterator_is_done (iter)) {
+			TnyHeader *header = TNY_HEADER (tny_iterator_get_current (iter));
+			g_free (last_uid);
+			last_uid = tny_header_dup_uid (header);
+			g_object_unref (header);
+			tny_iterator_next (iter);
+		}
+		g_object_unref (iter);
+		g_object_unref (added);
+	}
+
+	update_entry (url, all, unread, last_uid, TRUE);
+
+	g_free (last_uid);
+	g_free (url);
+	g_object_unref (folder);
+}
+
+void
+modest_folder_counts_remove (const gchar *folder_url)
+{
+	g_return_if_fail (folder_url);
+
+	G_LOCK (folder_counts);
+	if (g_hash_table_remove (get_counts (), folder_url))
+		schedule_save ();
+	G_UNLOCK (folder_counts);
+}
+
+void
+modest_folder_counts_set_date_range (const gchar *folder_url,
+				     guint all_count,
+				     time_t oldest_date,
+				     time_t newest_date)
+{
+	CountsEntry *entry;
+
+	g_return_if_fail (folder_url);
+
+	G_LOCK (folder_counts);
+	entry = g_hash_table_lookup (get_counts (), folder_url);
+	if (entry && entry->all_count == all_count &&
+	    (entry->oldest_date != oldest_date || entry->newest_date != newest_date)) {
+		entry->oldest_date = oldest_date;
+		entry->newest_date = newest_date;
+		schedule_save ();
+	}
+	G_UNLOCK (folder_counts);
+}
+
+void
+modest_folder_counts_set_synced (const gchar *folder_url,
+				 guint all_count,
+				 guint unread_count)
+{
+	CountsEntry *entry;
+
+	g_return_if_fail (folder_url);
+
+	G_LOCK (folder_counts);
+	entry = g_hash_table_lookup (get_counts (), folder_url);
+	if (!entry) {
+		entry = g_slice_new0 (CountsEntry);
+		entry->all_count = all_count;
+		entry->unread_count = unread_count;
+		entry->mtime = time (NULL);
+		g_hash_table_insert (_counts, g_strdup (folder_url), entry);
+	}
+	entry->synced_all = all_count;
+	entry->synced_unread = unread_count;
+	entry->synced_time = time (NULL);
+	schedule_save ();
+	G_UNLOCK (folder_counts);
+}
+
+void
+modest_folder_counts_flush (void)
+{
+	gboolean pending = FALSE;
+
+	G_LOCK (folder_counts);
+	if (_save_timeout > 0) {
+		g_source_remove (_save_timeout);
+		_save_timeout = 0;
+		pending = TRUE;
+	}
+	G_UNLOCK (folder_counts);
+
+	if (pending)
+		save_counts ();
+}
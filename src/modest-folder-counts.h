@@ -0,0 +1,170 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MODEST_FOLDER_COUNTS_H__
+#define __MODEST_FOLDER_COUNTS_H__
+
+#include <time.h>
+#include <glib.h>
+#include <tny-folder.h>
+#include <tny-folder-change.h>
+
+G_BEGIN_DECLS
+
+/*
+ * a small persistent cache of the message counts of every folder we
+ * have seen, so that the folder view and the D-Bus API can show them
+ * at startup without connecting or loading the folder summaries. It's
+ * stored in MODEST_DIR/MODEST_FOLDER_COUNTS_FILE, and written
+ * atomically so a crash leaves either the old or the new version
+ */
+
+typedef struct {
+	guint        all_count;
+	guint        unread_count;
+	const gchar *last_uid;	/* might be NULL; owned by the cache */
+	time_t       mtime;	/* when the counts were last updated */
+	time_t       oldest_date;	/* sent dates of the messages, */
+	time_t       newest_date;	/* both 0 if not known */
+	guint        synced_all;	/* counts of the last full */
+	guint        synced_unread;	/* synchronization, and */
+	time_t       synced_time;	/* when it was; 0 if never */
+	gboolean     live;	/* updated from the folder itself during
+				   this session; if not, the counts come
+				   from disk and could be stale */
+} ModestFolderCounts;
+
+/**
+ * modest_folder_counts_lookup:
+ * @folder_url: the url string of a folder
+ * @counts: a #ModestFolderCounts to fill
+ *
+ * get the cached counts of a folder. Note that counts->last_uid is
+ * only valid until the next update of the cache
+ *
+ * Returns: %TRUE if the folder was found in the cache, %FALSE otherwise
+ */
+gboolean modest_folder_counts_lookup             (const gchar *folder_url,
+						  ModestFolderCounts *counts);
+
+/**
+ * modest_folder_counts_get_for_folder:
+ * @folder: a #TnyFolder
+ * @all_count: return location for the number of messages, or %NULL
+ * @unread_count: return location for the number of unread messages, or %NULL
+ *
+ * get the counts to show for @folder: the cached ones from the last
+ * session until the folder reports its own (after a refresh, or a
+ * change seen by a folder observer), and then the ones of @folder
+ * itself. It never writes to the cache
+ */
+void     modest_folder_counts_get_for_folder     (TnyFolder *folder,
+						  guint *all_count,
+						  guint *unread_count);
+
+/**
+ * modest_folder_counts_update:
+ * @folder_url: the url string of a folder
+ * @all_count: the number of messages
+ * @unread_count: the number of unread messages
+ * @last_uid: the uid of the newest message, or %NULL to keep the old one
+ *
+ * store the counts of a folder. The cache is written to disk a bit
+ * later, so many updates in a row only cause one write
+ */
+void     modest_folder_counts_update             (const gchar *folder_url,
+						  guint all_count,
+						  guint unread_count,
+						  const gchar *last_uid);
+
+/**
+ * modest_folder_counts_update_from_folder:
+ * @folder: a #TnyFolder
+ *
+ * store the current counts of @folder. Use it after a folder refresh
+ */
+void     modest_folder_counts_update_from_folder (TnyFolder *folder);
+
+/**
+ * modest_folder_counts_update_from_change:
+ * @change: a #TnyFolderChange
+ *
+ * store the counts reported by a folder observer
+ */
+void     modest_folder_counts_update_from_change (TnyFolderChange *change);
+
+/**
+ * modest_folder_counts_remove:
+ * @folder_url: the url string of a folder
+ *
+ * forget the counts of a folder, for instance, when it's deleted
+ */
+void     modest_folder_counts_remove             (const gchar *folder_url);
+
+/**
+ * modest_folder_counts_set_date_range:
+ * @folder_url: the url string of a folder
+ * @all_count: the number of messages the range was computed from
+ * @oldest_date: the oldest sent date of the messages
+ * @newest_date: the newest sent date of the messages
+ *
+ * store the range of dates of the messages of a folder. It's only
+ * kept while @all_count is the number of messages of the cache, any
+ * update with new messages forgets it
+ */
+void     modest_folder_counts_set_date_range     (const gchar *folder_url,
+						  guint all_count,
+						  time_t oldest_date,
+						  time_t newest_date);
+
+/**
+ * modest_folder_counts_set_synced:
+ * @folder_url: the url string of a folder
+ * @all_count: the number of messages after the synchronization
+ * @unread_count: the number of unread messages after the synchronization
+ *
+ * remember that the folder was fully synchronized with the server
+ * now, and the counts it had then. Later updates of the counts do
+ * not change these ones, so comparing them with the counts the
+ * server reports tells whether the folder changed since then
+ */
+void     modest_folder_counts_set_synced         (const gchar *folder_url,
+						  guint all_count,
+						  guint unread_count);
+
+/**
+ * modest_folder_counts_flush:
+ *
+ * write the pending changes to disk now
+ */
+void     modest_folder_counts_flush              (void);
+
+G_END_DECLS
+
+#endif /*__MODEST_FOLDER_COUNTS_H__*/
@@ -52,6 +52,7 @@
 #include "modest-tny-msg.h"
 #include <string.h>
 #include "modest-text-utils.h"
+#include "modest-startup-trace.h"
 #include <locale.h>
 #ifdef MODEST_TOOLKIT_HILDON2
 #include "modest-hildon-includes.h"
@@ -67,9 +68,40 @@ static void     init_default_settings (ModestConf *conf);
 static void     init_device_name (ModestConf *conf);
 static gboolean init_ui (gint argc, gchar** argv);
 
+static gboolean start_address_book (void);
+static gboolean start_header_columns (void);
+static gboolean start_send_queues (void);
+static gboolean start_window_caches (void);
+
 
 static gboolean _is_initialized = FALSE;
 
+/*
+ * services that are not started by modest_init, but when they are
+ * first needed (see modest_init_require_service). The ones that
+ * are only used by the UI are started when the first window is
+ * about to be shown, so a D-Bus activation that does not show any
+ * window does not pay for them
+ */
+#define MAX_SERVICE_DEPS 2
+
+typedef struct {
+	const gchar *name;
+	gboolean     (*start) (void);
+	gboolean     ui_only;
+	const gchar *deps[MAX_SERVICE_DEPS];
+	gboolean     started;
+} InitService;
+
+static InitService SERVICES[] = {
+	{ "address-book",   start_address_book,   TRUE,  { NULL },           FALSE },
+	{ "header-columns", start_header_columns, TRUE,  { NULL },           FALSE },
+	{ "send-queues",    start_send_queues,    FALSE, { NULL },           FALSE },
+	{ "window-caches",  start_window_caches,  TRUE,  { "address-book" }, FALSE }
+};
+
+static guint _background_services_idle = 0;
+
 /*
  * defaults for the column headers
  */
@@ -205,7 +237,9 @@ modest_init (int argc, char *argv[])
 		return FALSE;
 	}
 
+	modest_startup_trace_begin ("i18n");
 	init_i18n();
+	modest_startup_trace_end ("i18n");
 
 	if (!force_ke_recv_load()) {
 		g_printerr ("modest: %s: ke-recv is missing "
@@ -221,52 +255,61 @@ modest_init (int argc, char *argv[])
 	/* initialize the prng, we need it when creating random files */
 	srandom((int)getpid());
 
+	modest_startup_trace_begin ("runtime-init");
 	if (!modest_runtime_init()) {
 		modest_init_uninit ();
 		g_printerr ("modest: failed to initialize the modest runtime\n");
 		return FALSE;
 	}
+	modest_startup_trace_end ("runtime-init");
 
+	modest_startup_trace_begin ("plugins");
 	modest_plugin_factory_load_all (modest_runtime_get_plugin_factory ());
+	modest_startup_trace_end ("plugins");
 
 	/* do an initial guess for the device name */
 	init_device_name (modest_runtime_get_conf());
 
+	modest_startup_trace_begin ("platform-init");
 	if (!modest_platform_init(argc, argv)) {
 		modest_init_uninit ();
 		g_printerr ("modest: failed to run platform-specific initialization\n");
 		return FALSE;
 	}
+	modest_startup_trace_end ("platform-init");
 
-	/* Initialize addressbook */
-	modest_address_book_init ();
+	/* The address book and the header columns are initialized
+	   on demand, see SERVICES */
 
 	reset = modest_runtime_get_debug_flags () & MODEST_RUNTIME_DEBUG_FACTORY_SETTINGS;
-	if (!init_header_columns(modest_runtime_get_conf(), TRUE)) {
-		modest_init_uninit ();
-		g_printerr ("modest: failed to init header columns\n");
-		return FALSE;
-	}
 
+	modest_startup_trace_begin ("default-settings");
 	init_default_settings (modest_runtime_get_conf ());
+	modest_startup_trace_end ("default-settings");
 
+	modest_startup_trace_begin ("local-folders");
 	if (!modest_init_local_folders(NULL)) {
 		modest_init_uninit ();
 		g_printerr ("modest: failed to init local folders\n");
 		return FALSE;
 	}
+	modest_startup_trace_end ("local-folders");
 
+	modest_startup_trace_begin ("default-account");
 	if (!init_default_account_maybe (modest_runtime_get_account_mgr ())) {
 		modest_init_uninit ();
 		g_printerr ("modest: failed to init default account\n");
 		return FALSE;
 	}
+	modest_startup_trace_end ("default-account");
 
+	modest_startup_trace_begin ("ui-init");
 	if (!init_ui (argc, argv)) {
 		modest_init_uninit ();
 		g_printerr ("modest: failed to init ui\n");
 		return FALSE;
 	}
+	modest_startup_trace_end ("ui-init");
 
 	return _is_initialized = TRUE;
 }
@@ -293,8 +336,17 @@ init_ui (gint argc, gchar** argv)
 gboolean
 modest_init_uninit (void)
 {
+	int i;
+
 	if (!_is_initialized)
 		return TRUE; 
+
+	if (_background_services_idle > 0) {
+		g_source_remove (_background_services_idle);
+		_background_services_idle = 0;
+	}
+	for (i = 0; i != G_N_ELEMENTS (SERVICES); ++i)
+		SERVICES[i].started = FALSE;
 	
 	if (!modest_runtime_uninit())
 		g_printerr ("modest: failed to uninit runtime\n");
@@ -309,6 +361,126 @@ modest_init_uninit (void)
 
 
 
+static InitService*
+find_service (const gchar *name)
+{
+	int i;
+
+	for (i = 0; i != G_N_ELEMENTS (SERVICES); ++i)
+		if (strcmp (SERVICES[i].name, name) == 0)
+			return &SERVICES[i];
+
+	return NULL;
+}
+
+gboolean
+modest_init_require_service (const gchar *name)
+{
+	InitService *service;
+	int i;
+
+	g_return_val_if_fail (name, FALSE);
+
+	service = find_service (name);
+	if (!service) {
+		g_warning ("%s: unknown service '%s'", __FUNCTION__, name);
+		return FALSE;
+	}
+
+	if (service->started)
+		return TRUE;
+
+	/* mark it before starting it, so a service requiring itself
+	   (even indirectly) does not loop forever */
+	service->started = TRUE;
+
+	for (i = 0; i != MAX_SERVICE_DEPS && service->deps[i]; ++i) {
+		if (!modest_init_require_service (service->deps[i])) {
+			g_warning ("%s: cannot start '%s', dependency '%s' failed",
+				   __FUNCTION__, name, service->deps[i]);
+			service->started = FALSE;
+			return FALSE;
+		}
+	}
+
+	modest_startup_trace_begin (service->name);
+	if (!service->start ()) {
+		g_printerr ("modest: failed to start %s\n", service->name);
+		service->started = FALSE;
+	}
+	modest_startup_trace_end (service->name);
+
+	return service->started;
+}
+
+void
+modest_init_start_ui_services (void)
+{
+	int i;
+
+	for (i = 0; i != G_N_ELEMENTS (SERVICES); ++i)
+		if (SERVICES[i].ui_only && !SERVICES[i].started)
+			modest_init_require_service (SERVICES[i].name);
+}
+
+static gboolean
+on_idle_start_background_services (gpointer user_data)
+{
+	int i;
+
+	gdk_threads_enter ();
+	for (i = 0; i != G_N_ELEMENTS (SERVICES); ++i)
+		if (!SERVICES[i].ui_only && !SERVICES[i].started)
+			modest_init_require_service (SERVICES[i].name);
+	_background_services_idle = 0;
+	gdk_threads_leave ();
+
+	return FALSE;
+}
+
+void
+modest_init_start_background_services (void)
+{
+	if (_background_services_idle == 0)
+		_background_services_idle =
+			g_idle_add_full (G_PRIORITY_LOW, on_idle_start_background_services,
+					 NULL, NULL);
+}
+
+static gboolean
+start_address_book (void)
+{
+	modest_address_book_init ();
+	return TRUE;
+}
+
+static gboolean
+start_header_columns (void)
+{
+	return init_header_columns (modest_runtime_get_conf (), TRUE);
+}
+
+static gboolean
+start_send_queues (void)
+{
+	ModestTnyAccountStore *acc_store;
+
+	acc_store = modest_runtime_get_account_store ();
+	if (!acc_store)
+		return FALSE;
+
+	modest_tny_account_store_start_send_queues (acc_store);
+	return TRUE;
+}
+
+static gboolean
+start_window_caches (void)
+{
+	modest_window_mgr_create_caches (modest_runtime_get_window_mgr ());
+	return TRUE;
+}
+
+
 /* NOTE: the exact details of this format are important, as they
  * are also used in modest-widget-memory. FIXME: make a shared function
  * for this with widget-memory
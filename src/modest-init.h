@@ -92,6 +92,37 @@ gboolean modest_init_one_local_folder (gchar *maildir_path);
  */
 GList * modest_init_get_default_header_view_column_ids (TnyFolderType folder_type, ModestHeaderViewStyle style);
 
+/**
+ * modest_init_require_service:
+ * @name: the name of a deferred service, ie. "address-book",
+ * "header-columns", "send-queues" or "window-caches"
+ *
+ * some subsystems are not started by modest_init, but only when
+ * they're needed for the first time. This function starts the service
+ * @name (and the services it depends on) if it was not started yet.
+ *
+ * Returns: TRUE if the service is running, FALSE in case of error
+ */
+gboolean modest_init_require_service (const gchar *name);
+
+/**
+ * modest_init_start_ui_services:
+ *
+ * start all the deferred services that are only needed by the UI. It
+ * must be called before the first window is shown. Services that
+ * were already started are not started again.
+ */
+void     modest_init_start_ui_services (void);
+
+/**
+ * modest_init_start_background_services:
+ *
+ * schedule the start of the deferred services that are not only
+ * needed by the UI (like the send queues) in a low priority idle, so
+ * that pending D-Bus requests are served first
+ */
+void     modest_init_start_background_services (void);
+
 G_END_DECLS
 
 #endif /*__MODEST_INIT_H__*/
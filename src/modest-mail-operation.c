@@ -66,6 +66,9 @@
 #include <clockd/libtime.h>
 #endif
 #include "modest-account-protocol.h"
+#include "modest-folder-counts.h"
+#include "modest-address-index.h"
+#include "modest-search.h"
 #include <camel/camel-stream-null.h>
 #include <widgets/modest-msg-view-window.h>
 
@@ -141,6 +144,7 @@ typedef struct
 	gboolean interactive;
 	gboolean msg_readed;
 	gboolean update_folder_counts;
+	gboolean push;
 	guint retries_left;
 } UpdateAccountInfo;
 
@@ -170,6 +174,7 @@ struct _ModestMailOperationPrivate {
 	TnyAccount                *account;
 	guint                      done;
 	guint                      total;
+	guint                      skipped;
 	GObject                   *source;
 	GError                    *error;
 	ErrorCheckingUserCallback  error_checking;
@@ -559,8 +564,13 @@ modest_mail_operation_cancel (ModestMailOperation *self)
 	/* Set new status */
 	priv->status = MODEST_MAIL_OPERATION_STATUS_CANCELED;
 	
+	/* Operations that did not start yet (like the send&receive
+	   of the accounts waiting for their turn) have no account,
+	   setting the status is all we can do */
+	if (!priv->account)
+		return canceled;
+
 	/* Cancel the mail operation */
-	g_return_val_if_fail (priv->account, FALSE);
 	tny_account_cancel (priv->account);
 
 	if (priv->op_type == MODEST_MAIL_OPERATION_TYPE_SEND) {
@@ -649,6 +659,7 @@ modest_mail_operation_clone_state (ModestMailOperation *self)
 	state->finished = modest_mail_operation_is_finished (self);
 	state->bytes_done = 0;
 	state->bytes_total = 0;
+	state->skipped = priv->skipped;
 
 	return state;
 }
@@ -771,7 +782,15 @@ send_mail_on_added_to_outbox (TnySendQueue *send_queue,
 			     "Error adding a msg to the send queue\n");
 		priv->status = MODEST_MAIL_OPERATION_STATUS_FINISHED_WITH_ERRORS;
 	} else {
+		TnyFolder *outbox;
+
 		priv->status = MODEST_MAIL_OPERATION_STATUS_SUCCESS;
+
+		outbox = tny_send_queue_get_outbox (send_queue);
+		if (outbox) {
+			modest_search_folder_changed (outbox);
+			g_object_unref (outbox);
+		}
 	}
 
  end:
@@ -1183,6 +1202,12 @@ modest_mail_operation_send_new_mail (ModestMailOperation *self,
 		modest_mail_operation_notify_end (self);
 		return;
 	}
+
+	/* Remember the recipients to complete them later */
+	modest_address_index_add_addresses (to, TRUE);
+	modest_address_index_add_addresses (cc, TRUE);
+	modest_address_index_add_addresses (bcc, TRUE);
+
 	info = g_slice_new0 (SendNewMailInfo);
 	info->transport_account = transport_account;
 	if (transport_account)
@@ -1281,6 +1306,7 @@ modest_mail_operation_save_to_drafts_add_msg_cb(TnyFolder *self,
 		g_debug ("--- REMOVE AND SYNC");
 		/* Remove the old draft */
 		tny_folder_remove_msg (src_folder, header, NULL);
+		modest_search_folder_changed (src_folder);
 
 		/* Synchronize to expunge and to update the msg counts */
 		tny_folder_sync_async (info->drafts, TRUE, NULL, NULL, NULL);
@@ -1304,6 +1330,9 @@ modest_mail_operation_save_to_drafts_add_msg_cb(TnyFolder *self,
 		priv->status = MODEST_MAIL_OPERATION_STATUS_SUCCESS;
 	}
 
+	if (!err)
+		modest_search_folder_changed (info->drafts);
+
 	if (info->transport_account) {
 		ModestProtocolType transport_protocol_type;
 		ModestProtocol *transport_protocol;
@@ -1470,8 +1499,19 @@ typedef struct
 typedef struct {
 	GObject parent;
 	TnyList *new_headers;
+	/* url -> FolderStatus, the counts the server reported for
+	   each folder. Protected by the internal_folder_observer lock */
+	GHashTable *status;
 } InternalFolderObserver;
 
+typedef struct {
+	guint all_count;
+	guint unread_count;
+} FolderStatus;
+
+/* folder observers might be notified outside the main thread */
+G_LOCK_DEFINE_STATIC (internal_folder_observer);
+
 typedef struct {
 	GObjectClass parent;
 } InternalFolderObserverClass;
@@ -1500,6 +1540,34 @@ internal_folder_observer_update (TnyFolderObserver *self, TnyFolderChange *chang
 
 	changed = tny_folder_change_get_changed (change);
 
+	/* Keep the persistent counts up to date */
+	modest_folder_counts_update_from_change (change);
+	modest_search_update_from_change (change);
+
+	/* Remember the counts of the server, see folder_is_unchanged */
+	if (changed & (TNY_FOLDER_CHANGE_CHANGED_ALL_COUNT |
+		       TNY_FOLDER_CHANGE_CHANGED_UNREAD_COUNT)) {
+		TnyFolder *folder = tny_folder_change_get_folder (change);
+		gchar *url = (folder) ? tny_folder_get_url_string (folder) : NULL;
+
+		if (url) {
+			FolderStatus *status = g_slice_new (FolderStatus);
+
+			status->all_count = (changed & TNY_FOLDER_CHANGE_CHANGED_ALL_COUNT) ?
+				tny_folder_change_get_new_all_count (change) :
+				tny_folder_get_all_count (folder);
+			status->unread_count = (changed & TNY_FOLDER_CHANGE_CHANGED_UNREAD_COUNT) ?
+				tny_folder_change_get_new_unread_count (change) :
+				tny_folder_get_unread_count (folder);
+
+			G_LOCK (internal_folder_observer);
+			g_hash_table_replace (derived->status, url, status);
+			G_UNLOCK (internal_folder_observer);
+		}
+		if (folder)
+			g_object_unref (folder);
+	}
+
 	if (changed & TNY_FOLDER_CHANGE_CHANGED_ADDED_HEADERS) {
 		TnyList *list;
 
@@ -1515,10 +1583,18 @@ internal_folder_observer_update (TnyFolderObserver *self, TnyFolderChange *chang
 	}
 }
 
+static void
+folder_status_free (FolderStatus *status)
+{
+	g_slice_free (FolderStatus, status);
+}
+
 static void
 internal_folder_observer_init (InternalFolderObserver *self) 
 {
 	self->new_headers = tny_simple_list_new ();
+	self->status = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+					      (GDestroyNotify) folder_status_free);
 }
 static void
 internal_folder_observer_finalize (GObject *object) 
@@ -1527,6 +1603,7 @@ internal_folder_observer_finalize (GObject *object)
 
 	self = (InternalFolderObserver *) object;
 	g_object_unref (self->new_headers);
+	g_hash_table_destroy (self->status);
 
 	G_OBJECT_CLASS (internal_folder_observer_parent_class)->finalize (object);
 }
@@ -1562,7 +1639,7 @@ update_account_send_mail (UpdateAccountInfo *info)
 	TnyTransportAccount *transport_account = NULL;
 	ModestTnyAccountStore *account_store;
 
-	if (info->update_folder_counts)
+	if (info->update_folder_counts || info->push)
 		return;
 
 	account_store = modest_runtime_get_account_store ();
@@ -1720,12 +1797,34 @@ folder_refreshed_timeout_cb (gpointer user_data)
 }
 
 static void
-folder_refreshed_cb (TnyFolder *current_folder, 
-		    gboolean canceled, 
-		    GError *err, 
-		    gpointer user_data)
-{	
-	UpdateAccountInfo *info;
+update_account_finish (UpdateAccountInfo *info,
+		       TnyList *new_headers)
+{
+	ModestMailOperationPrivate *priv;
+
+	priv = MODEST_MAIL_OPERATION_GET_PRIVATE (info->mail_op);
+
+	/* If we don't have to retrieve the new messages then
+	   simply send mail */
+	update_account_send_mail (info);
+
+	/* Check if the operation was a success */
+	if (!priv->error)
+		priv->status = MODEST_MAIL_OPERATION_STATUS_SUCCESS;
+
+	/* Call the user callback and free */
+	update_account_notify_user_and_free (info, new_headers);
+}
+
+/* Processes the new headers caught by the observer of the update
+   account info, after a folder refresh or a push notification on
+   @current_folder. It applies the size and retrieval limits,
+   retrieves the new messages if needed and then finishes the
+   operation */
+static void
+update_account_process_new_headers (UpdateAccountInfo *info,
+				    TnyFolder *current_folder)
+{
 	ModestMailOperationPrivate *priv;
 	TnyIterator *new_headers_iter;
 	GPtrArray *new_headers_array = NULL;
@@ -1737,67 +1836,9 @@ folder_refreshed_cb (TnyFolder *current_folder,
 	time_t time_to_store;
 	TnyIterator *iter_all_folders;
 
-	info = (UpdateAccountInfo *) user_data;
 	priv = MODEST_MAIL_OPERATION_GET_PRIVATE (info->mail_op);
 	mgr = modest_runtime_get_account_mgr ();
 
-	if (canceled || err) {
-		priv->status = MODEST_MAIL_OPERATION_STATUS_FAILED;
-		if (err)
-			priv->error = g_error_copy (err);
-		else
-			g_set_error (&(priv->error), MODEST_MAIL_OPERATION_ERROR,
-				     MODEST_MAIL_OPERATION_ERROR_OPERATION_CANCELED,
-				     "canceled");
-
-		iter_all_folders = tny_list_create_iterator (info->folders);
-
-		while (!tny_iterator_is_done (iter_all_folders)) {
-			TnyFolder *folder = NULL;
-			folder = TNY_FOLDER (tny_iterator_get_current (iter_all_folders));
-
-			tny_folder_remove_observer (folder, info->observer);
-			tny_list_remove (info->folders2, (GObject*)folder);
-
-			g_object_unref (folder);
-			tny_iterator_next (iter_all_folders);
-		}
-
-		g_object_unref (iter_all_folders);
-
-		g_object_unref (info->observer);
-		info->observer = NULL;
-
-		/* Notify the user about the error and then exit */
-		update_account_notify_user_and_free (info, NULL);
-		return;
-	}
-
-	if (tny_list_get_length (info->folders2) > 0) {
-		iter_all_folders = tny_list_create_iterator (info->folders2);
-
-		if (!tny_iterator_is_done (iter_all_folders)) {
-			TnyFolder *folder = NULL;
-			folder = TNY_FOLDER (tny_iterator_get_current (iter_all_folders));
-
-			tny_list_remove (info->folders2, (GObject*)folder);
-
-			struct folder_refreshed_struct *data = malloc (sizeof (struct folder_refreshed_struct));
-			data->folder = g_object_ref (folder);
-			data->user_data = info;
-			g_timeout_add_seconds (1, folder_refreshed_timeout_cb, data);
-			g_object_unref (folder);
-		}
-
-		g_object_unref (iter_all_folders);
-		return;
-	}
-
-	if (!current_folder) {
-		/* Try to send anyway */
-		goto send_mail;
-	}
-
 	if (!info->update_folder_counts) {
 		/* Set the last updated as the current time */
 #ifdef MODEST_USE_LIBTIME
@@ -1832,6 +1873,8 @@ folder_refreshed_cb (TnyFolder *current_folder,
 			TnyHeader *header = NULL;
 
 			header = TNY_HEADER (tny_iterator_get_current (new_headers_iter));
+			modest_address_index_add_header (header);
+
 			/* Apply per-message size limits */
 			if (tny_header_get_message_size (header) < max_size)
 				g_ptr_array_add (new_headers_array, g_object_ref (header));
@@ -1927,16 +1970,165 @@ folder_refreshed_cb (TnyFolder *current_folder,
 		return;
 	}
  send_mail:
-	/* If we don't have to retrieve the new messages then
-	   simply send mail */
-	update_account_send_mail (info);
+	update_account_finish (info, new_headers);
+}
 
-	/* Check if the operation was a success */
-	if (!priv->error)
-		priv->status = MODEST_MAIL_OPERATION_STATUS_SUCCESS;
+/* Full synchronizations of the folders that look unchanged are
+   anyway done at least this often (in seconds). Equal counts do not
+   prove that nothing changed (a new message and an expunge, or a
+   flag change, leave them as they were) and tinymail does not give
+   us the UIDNEXT of the folder, so this is also how long such a
+   change can go unseen */
+#define FULL_SYNC_INTERVAL (60 * 60)
+
+/* Tells whether @folder can skip its refresh because the counts that
+ * the server reported (the poke status of the update) are the same
+ * ones it had when it was synchronized for the last time. The poke
+ * status is an IMAP STATUS, so this is a lot cheaper than resyncing
+ * the flags of every message of the folder. If the server did not
+ * report anything, the folder is refreshed as usual */
+static gboolean
+folder_is_unchanged (UpdateAccountInfo *info,
+		     TnyFolder *folder,
+		     guint *skipped)
+{
+	InternalFolderObserver *observer;
+	ModestFolderCounts counts;
+	FolderStatus status;
+	gboolean found = FALSE;
+	gchar *url;
 
-	/* Call the user callback and free */
-	update_account_notify_user_and_free (info, new_headers);
+	if (!info->poke_all || !info->observer)
+		return FALSE;
+
+	/* The INBOX is always synchronized, it's the folder where
+	   new mail arrives */
+	if (tny_folder_get_folder_type (folder) == TNY_FOLDER_TYPE_INBOX)
+		return FALSE;
+
+	url = tny_folder_get_url_string (folder);
+	if (!url)
+		return FALSE;
+
+	observer = (InternalFolderObserver *) info->observer;
+	G_LOCK (internal_folder_observer);
+	if (g_hash_table_lookup (observer->status, url)) {
+		status = *((FolderStatus *) g_hash_table_lookup (observer->status, url));
+		found = TRUE;
+	}
+	G_UNLOCK (internal_folder_observer);
+
+	if (found)
+		found = modest_folder_counts_lookup (url, &counts) &&
+			counts.synced_time != 0 &&
+			(time (NULL) - counts.synced_time) < FULL_SYNC_INTERVAL &&
+			counts.synced_all == status.all_count &&
+			counts.synced_unread == status.unread_count;
+	g_free (url);
+
+	if (found)
+		*skipped = status.all_count;
+
+	return found;
+}
+
+static void
+folder_refreshed_cb (TnyFolder *current_folder, 
+		    gboolean canceled, 
+		    GError *err, 
+		    gpointer user_data)
+{	
+	UpdateAccountInfo *info;
+	ModestMailOperationPrivate *priv;
+	TnyIterator *iter_all_folders;
+
+	info = (UpdateAccountInfo *) user_data;
+	priv = MODEST_MAIL_OPERATION_GET_PRIVATE (info->mail_op);
+
+	if (canceled || err) {
+		priv->status = MODEST_MAIL_OPERATION_STATUS_FAILED;
+		if (err)
+			priv->error = g_error_copy (err);
+		else
+			g_set_error (&(priv->error), MODEST_MAIL_OPERATION_ERROR,
+				     MODEST_MAIL_OPERATION_ERROR_OPERATION_CANCELED,
+				     "canceled");
+
+		iter_all_folders = tny_list_create_iterator (info->folders);
+
+		while (!tny_iterator_is_done (iter_all_folders)) {
+			TnyFolder *folder = NULL;
+			folder = TNY_FOLDER (tny_iterator_get_current (iter_all_folders));
+
+			tny_folder_remove_observer (folder, info->observer);
+			tny_list_remove (info->folders2, (GObject*)folder);
+
+			g_object_unref (folder);
+			tny_iterator_next (iter_all_folders);
+		}
+
+		g_object_unref (iter_all_folders);
+
+		g_object_unref (info->observer);
+		info->observer = NULL;
+
+		/* Notify the user about the error and then exit */
+		update_account_notify_user_and_free (info, NULL);
+		return;
+	}
+
+	/* The folder was just synchronized, store its counts */
+	if (current_folder) {
+		gchar *url = tny_folder_get_url_string (current_folder);
+
+		modest_folder_counts_update_from_folder (current_folder);
+		if (url) {
+			modest_folder_counts_set_synced (url,
+							 tny_folder_get_all_count (current_folder),
+							 tny_folder_get_unread_count (current_folder));
+			g_free (url);
+		}
+	}
+
+	while (tny_list_get_length (info->folders2) > 0) {
+		TnyFolder *folder = NULL;
+		guint skipped = 0;
+
+		iter_all_folders = tny_list_create_iterator (info->folders2);
+		folder = TNY_FOLDER (tny_iterator_get_current (iter_all_folders));
+		g_object_unref (iter_all_folders);
+
+		tny_list_remove (info->folders2, (GObject*)folder);
+
+		if (folder_is_unchanged (info, folder, &skipped)) {
+			ModestMailOperationState *state;
+
+			/* Nothing to synchronize, report the
+			   messages we did not have to look at */
+			priv->skipped += skipped;
+			state = modest_mail_operation_clone_state (info->mail_op);
+			g_signal_emit (G_OBJECT (info->mail_op), signals[PROGRESS_CHANGED_SIGNAL], 0, state, NULL);
+			g_slice_free (ModestMailOperationState, state);
+
+			g_object_unref (folder);
+			continue;
+		}
+
+		struct folder_refreshed_struct *data = malloc (sizeof (struct folder_refreshed_struct));
+		data->folder = g_object_ref (folder);
+		data->user_data = info;
+		g_timeout_add_seconds (1, folder_refreshed_timeout_cb, data);
+		g_object_unref (folder);
+		return;
+	}
+
+	if (!current_folder) {
+		/* Try to send anyway */
+		update_account_finish (info, NULL);
+		return;
+	}
+
+	update_account_process_new_headers (info, current_folder);
 }
 
 static void
@@ -2158,6 +2350,7 @@ modest_mail_operation_update_account (ModestMailOperation *self,
 	priv = MODEST_MAIL_OPERATION_GET_PRIVATE(self);
 	priv->total = 0;
 	priv->done  = 0;
+	priv->skipped = 0;
 	priv->status = MODEST_MAIL_OPERATION_STATUS_IN_PROGRESS;
 	priv->op_type = MODEST_MAIL_OPERATION_TYPE_SEND_AND_RECEIVE;
 
@@ -2230,6 +2423,55 @@ modest_mail_operation_update_account (ModestMailOperation *self,
 	
 }
 
+void
+modest_mail_operation_update_account_from_push (ModestMailOperation *self,
+						const gchar *account_name,
+						TnyFolder *folder,
+						TnyList *new_headers,
+						UpdateAccountCallback callback,
+						gpointer user_data)
+{
+	UpdateAccountInfo *info = NULL;
+	ModestMailOperationPrivate *priv = NULL;
+
+	g_return_if_fail (MODEST_IS_MAIL_OPERATION (self));
+	g_return_if_fail (TNY_IS_FOLDER (folder));
+	g_return_if_fail (TNY_IS_LIST (new_headers));
+
+	/* Init mail operation */
+	priv = MODEST_MAIL_OPERATION_GET_PRIVATE(self);
+	priv->total = 0;
+	priv->done  = 0;
+	priv->status = MODEST_MAIL_OPERATION_STATUS_IN_PROGRESS;
+	priv->op_type = MODEST_MAIL_OPERATION_TYPE_RECEIVE;
+	priv->account = tny_folder_get_account (folder);
+
+	/* Create the helper object. There is no folder walk nor
+	   refresh, the server already told us about the new headers,
+	   so we only feed them to the observer as if a refresh had
+	   found them */
+	info = g_slice_new0 (UpdateAccountInfo);
+	info->folders = tny_simple_list_new ();
+	info->folders2 = tny_simple_list_new ();
+	info->mail_op = g_object_ref (self);
+	info->poke_all = FALSE;
+	info->interactive = FALSE;
+	info->update_folder_counts = FALSE;
+	info->push = TRUE;
+	info->account_name = g_strdup (account_name);
+	info->callback = callback;
+	info->user_data = user_data;
+	info->observer = g_object_new (internal_folder_observer_get_type (), NULL);
+	tny_list_foreach (new_headers, foreach_add_item,
+			  ((InternalFolderObserver *) info->observer)->new_headers);
+
+	/* Set account busy */
+	modest_account_mgr_set_account_busy (modest_runtime_get_account_mgr (), account_name, TRUE);
+	modest_mail_operation_notify_start (self);
+
+	update_account_process_new_headers (info, folder);
+}
+
 void
 modest_mail_operation_update_folder_counts (ModestMailOperation *self,
 				      const gchar *account_name)
@@ -2514,12 +2756,21 @@ modest_mail_operation_remove_folder (ModestMailOperation *self,
 	} else {
 		TnyFolderStore *parent = tny_folder_get_folder_store (folder);
 		if (parent) {
+			gchar *url = tny_folder_get_url_string (folder);
+
 			modest_mail_operation_notify_start (self);
 			tny_folder_store_remove_folder (parent, folder, &(priv->error));
 			CHECK_EXCEPTION (priv, MODEST_MAIL_OPERATION_STATUS_FAILED);
 			
-			if (!priv->error)
+			if (!priv->error) {
 				priv->status = MODEST_MAIL_OPERATION_STATUS_SUCCESS;
+				if (url) {
+					modest_folder_counts_remove (url);
+					modest_tny_account_store_forget_folder (modest_runtime_get_account_store (),
+										url);
+				}
+			}
+			g_free (url);
 
 			g_object_unref (parent);
 		} else
@@ -2599,8 +2850,22 @@ transfer_folder_cb (TnyFolder *folder,
 			     _("Transference of %s was cancelled."),
 			     tny_folder_get_name (folder));
 	} else {
+		ModestTnyAccountStore *account_store;
+		gchar *url;
+
 		priv->done = 1;
 		priv->status = MODEST_MAIL_OPERATION_STATUS_SUCCESS;
+
+		/* Moves and renames change the urls of the folder and
+		   its children */
+		account_store = modest_runtime_get_account_store ();
+		url = tny_folder_get_url_string (folder);
+		if (url) {
+			modest_tny_account_store_forget_folder (account_store, url);
+			g_free (url);
+		}
+		if (new_folder)
+			modest_tny_account_store_index_folder (account_store, new_folder);
 	}
 
 	/* Update state of new folder */
@@ -3348,6 +3613,8 @@ remove_msgs_async_cb (TnyFolder *folder,
 		return;
 	}
 
+	modest_search_folder_changed (folder);
+
 	account = modest_tny_folder_get_account (folder);
 	account_name = modest_tny_account_get_parent_modest_account_name_for_server_account (account);
 	account_proto = modest_tny_account_get_protocol_type (account);
@@ -3644,6 +3911,10 @@ transfer_msgs_cb (TnyFolder *folder, gboolean cancelled, GError *err, gpointer u
 		TnyAccount *src_account;
 		TnyAccount *dest_account;
 
+		/* the cached search results of both folders are no longer valid */
+		modest_search_folder_changed (folder);
+		modest_search_folder_changed (helper->dest_folder);
+
 		/* send the notification that the source folder might have changed */
 		src_account = modest_tny_folder_get_account (folder);
 		if (src_account) {
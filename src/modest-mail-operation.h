@@ -253,6 +253,8 @@ typedef struct {
 	guint      total;
 	gdouble    bytes_done;
 	gdouble    bytes_total;
+	guint      skipped;	/* messages of the folders that did not
+				   need to be synchronized again */
 	gboolean   finished;
 	ModestMailOperationStatus        status;
 	ModestMailOperationTypeOperation op_type;
@@ -478,6 +480,29 @@ void          modest_mail_operation_update_account (ModestMailOperation *self,
 						    UpdateAccountCallback callback,
 						    gpointer user_data);
 
+/**
+ * modest_mail_operation_update_account_from_push:
+ * @self: a #ModestMailOperation
+ * @account_name: the id of a Modest account
+ * @folder: the #TnyFolder where the new headers were pushed
+ * @new_headers: a #TnyList of the headers the server notified
+ * @callback: a #UpdateAccountCallback, or %NULL
+ * @user_data: generic data passed to @callback
+ *
+ * Processes the headers that the server pushed into @folder while
+ * the account is in push mode (see modest_push_monitor_start()) the same
+ * way a refresh made by modest_mail_operation_update_account() would
+ * do, retrieving the messages if the account is not headers-only and
+ * calling @callback with the new headers. It does not walk the
+ * folders of the account, refresh them or send the outbox.
+ **/
+void          modest_mail_operation_update_account_from_push (ModestMailOperation *self,
+							      const gchar *account_name,
+							      TnyFolder *folder,
+							      TnyList *new_headers,
+							      UpdateAccountCallback callback,
+							      gpointer user_data);
+
 /**
  * modest_mail_operation_update_folder_counts:
  * @self: a #ModestMailOperation
@@ -35,6 +35,7 @@
 #include "modest-init.h"
 #include "modest-platform.h"
 #include "modest-ui-actions.h"
+#include "modest-startup-trace.h"
 
 static gboolean show_ui = FALSE;
 static GOptionEntry option_entries [] =
@@ -135,6 +136,8 @@ main (int argc, char *argv[])
 	GOptionContext *context;
 
 	ModestWindowMgr *mgr;
+
+	modest_startup_trace_begin ("main");
 #ifdef MODEST_TOOLKIT_HILDON2
 	hildon_gtk_init(&argc, &argv);
 #endif
@@ -164,21 +167,25 @@ main (int argc, char *argv[])
 		goto cleanup;
 	}
 
+	modest_startup_trace_begin ("gtk-init");
 	if (!gtk_init_check (&argc, &argv)) {
 		g_printerr ("modest: failed to initialize gtk\n");
 		retval = 1;
 		goto cleanup;
 	}
+	modest_startup_trace_end ("gtk-init");
 
+	modest_startup_trace_begin ("modest-init");
 	if (!modest_init (argc, argv)) {
 		g_printerr ("modest: cannot init modest\n");
 		retval = 1;
 		goto cleanup;
 	}
+	modest_startup_trace_end ("modest-init");
 
-	/* Create the account store & launch send queues */
+	/* Create the account store. The send queues are launched
+	   later, see modest_init_start_background_services */
 	acc_store = modest_runtime_get_account_store ();
-	modest_tny_account_store_start_send_queues (acc_store);
 
 	handlers = g_malloc0 (sizeof (MainSignalHandlers));
 	/* Connect to the "queue-emtpy" signal */
@@ -202,9 +209,10 @@ main (int argc, char *argv[])
 				  G_CALLBACK (modest_ui_actions_on_password_requested),
 				  NULL);
 
-	/* Create cached windows */
-	mgr = modest_runtime_get_window_mgr ();
-	modest_window_mgr_create_caches (mgr);
+	/* Launch the send queues once the main loop is running; the
+	   UI-only services (cached windows, address book...) are
+	   started when the first window is shown */
+	modest_init_start_background_services ();
 
 	/* Usually, we only show the UI when we get the "top_application" D-Bus method.
 	 * This allows modest to start via D-Bus activation to provide a service,
@@ -216,14 +224,19 @@ main (int argc, char *argv[])
 		ModestWindow *window;
 
 		mgr = modest_runtime_get_window_mgr();
+		modest_startup_trace_begin ("show-initial-window");
 		window = modest_window_mgr_show_initial_window (mgr);
 		if (!window) {
 			g_printerr ("modest: failed to get main window instance\n");
 			retval = 1;
 			goto cleanup;
 		}
+		modest_startup_trace_end ("show-initial-window");
 	}
 
+	modest_startup_trace_end ("main");
+	modest_startup_trace_dump ();
+
 	gtk_main ();
 
 cleanup:
@@ -0,0 +1,755 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib/gi18n.h>
+#include <tny-simple-list.h>
+#include <tny-iterator.h>
+#include <tny-account-store.h>
+#include <tny-device.h>
+#include "modest-offline-journal.h"
+#include "modest-runtime.h"
+#include "modest-defs.h"
+#include "modest-tny-folder.h"
+#include "modest-tny-account-store.h"
+#include "modest-tny-account.h"
+#include "modest-mail-operation-queue.h"
+#include "modest-platform.h"
+#include <widgets/modest-header-window.h>
+
+#define KEY_SOURCE      "source"
+#define KEY_DESTINATION "destination"
+#define KEY_DELETE      "delete"
+#define KEY_UIDS        "uids"
+#define KEY_FAILURES    "failures"
+
+typedef struct {
+	gchar    *src_url;
+	gchar    *dst_url;
+	gboolean  delete_original;
+	GSList   *uids;		/* uids in the source folder */
+	guint     replaying;	/* batches being transferred */
+	gboolean  failed;	/* some batch of this replay failed */
+	guint     failures;	/* failed replays in a row */
+} JournalEntry;
+
+typedef struct {
+	JournalEntry *entry;
+	GSList       *uids;
+} ReplayBatch;
+
+typedef struct {
+	JournalEntry *entry;
+	TnyFolder    *dst_folder;
+} ReplayInfo;
+
+/* The journal is only used from the main loop, so no locking */
+static GList      *_entries = NULL;
+static GHashTable *_pending = NULL;	/* msg uid -> JournalEntry, moves only */
+static gulong      _connection_handler = 0;
+
+static void
+journal_entry_free (JournalEntry *entry)
+{
+	g_free (entry->src_url);
+	g_free (entry->dst_url);
+	g_slist_foreach (entry->uids, (GFunc) g_free, NULL);
+	g_slist_free (entry->uids);
+	g_slice_free (JournalEntry, entry);
+}
+
+static gchar*
+get_journal_filename (void)
+{
+	return g_build_filename (MODEST_DIR, MODEST_OFFLINE_JOURNAL_FILE, NULL);
+}
+
+static gchar*
+get_msg_uid (const gchar *folder_url, const gchar *uid)
+{
+	return g_strconcat (folder_url, "/", uid, NULL);
+}
+
+static void
+set_pending (JournalEntry *entry, const gchar *uid)
+{
+	if (entry->delete_original)
+		g_hash_table_replace (_pending, get_msg_uid (entry->src_url, uid), entry);
+}
+
+/* forgets the pending state of @uid if it belongs to @entry */
+static void
+unset_pending (JournalEntry *entry, const gchar *uid)
+{
+	gchar *msg_uid = get_msg_uid (entry->src_url, uid);
+
+	if (g_hash_table_lookup (_pending, msg_uid) == entry)
+		g_hash_table_remove (_pending, msg_uid);
+	g_free (msg_uid);
+}
+
+static void
+on_account_connected (gboolean canceled,
+		      GError *err,
+		      ModestWindow *parent_window,
+		      TnyAccount *account,
+		      gpointer user_data)
+{
+	if (!canceled && !err && account)
+		modest_offline_journal_replay (account);
+}
+
+/* Connects the accounts that have transfers waiting, every one of
+   them replays its own transfers once it's connected */
+static void
+on_connection_changed (TnyDevice *device, gboolean online, gpointer user_data)
+{
+	TnyAccountStore *account_store;
+	GList *node, *accounts = NULL;
+
+	if (!online)
+		return;
+
+	account_store = TNY_ACCOUNT_STORE (modest_runtime_get_account_store ());
+	for (node = _entries; node; node = g_list_next (node)) {
+		JournalEntry *entry = (JournalEntry *) node->data;
+		TnyAccount *account;
+
+		if (entry->replaying || !entry->uids)
+			continue;
+
+		account = tny_account_store_find_account (account_store, entry->src_url);
+		if (!account)
+			continue;
+		if (!g_list_find (accounts, account))
+			accounts = g_list_prepend (accounts, g_object_ref (account));
+		g_object_unref (account);
+	}
+
+	for (node = accounts; node; node = g_list_next (node)) {
+		modest_platform_connect_and_perform (NULL, FALSE, TNY_ACCOUNT (node->data),
+						     on_account_connected, NULL);
+		g_object_unref (node->data);
+	}
+	g_list_free (accounts);
+}
+
+static void
+load_journal (void)
+{
+	GKeyFile *key_file;
+	gchar *filename;
+	gchar **groups;
+	gsize i, num_groups = 0;
+
+	_pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	_connection_handler = g_signal_connect (G_OBJECT (modest_runtime_get_device ()),
+						"connection_changed",
+						G_CALLBACK (on_connection_changed), NULL);
+
+	key_file = g_key_file_new ();
+	filename = get_journal_filename ();
+	if (!g_key_file_load_from_file (key_file, filename, G_KEY_FILE_NONE, NULL)) {
+		/* not an error, it's created on the first transfer */
+		g_key_file_free (key_file);
+		g_free (filename);
+		return;
+	}
+
+	groups = g_key_file_get_groups (key_file, &num_groups);
+	for (i = 0; i < num_groups; i++) {
+		JournalEntry *entry;
+		gchar **uids;
+		gsize j, num_uids = 0;
+
+		uids = g_key_file_get_string_list (key_file, groups[i], KEY_UIDS, &num_uids, NULL);
+		if (!uids)
+			continue;
+
+		entry = g_slice_new0 (JournalEntry);
+		entry->src_url = g_key_file_get_string (key_file, groups[i], KEY_SOURCE, NULL);
+		entry->dst_url = g_key_file_get_string (key_file, groups[i], KEY_DESTINATION, NULL);
+		entry->delete_original = g_key_file_get_boolean (key_file, groups[i], KEY_DELETE, NULL);
+		entry->failures = g_key_file_get_integer (key_file, groups[i], KEY_FAILURES, NULL);
+		if (!entry->src_url || !entry->dst_url) {
+			g_strfreev (uids);
+			journal_entry_free (entry);
+			continue;
+		}
+
+		for (j = 0; j < num_uids; j++) {
+			entry->uids = g_slist_prepend (entry->uids, g_strdup (uids[j]));
+			set_pending (entry, uids[j]);
+		}
+		entry->uids = g_slist_reverse (entry->uids);
+		_entries = g_list_append (_entries, entry);
+		g_strfreev (uids);
+	}
+
+	g_strfreev (groups);
+	g_key_file_free (key_file);
+	g_free (filename);
+}
+
+static void
+ensure_loaded (void)
+{
+	if (G_UNLIKELY (!_pending))
+		load_journal ();
+}
+
+/* Writes the whole journal. It's small, and g_file_set_contents
+   replaces the file atomically, so it's always either the old or the
+   new version */
+static gboolean
+save_journal (void)
+{
+	GKeyFile *key_file;
+	gchar *filename, *data;
+	gsize len;
+	GList *node;
+	guint n = 0;
+	gboolean retval;
+	GError *err = NULL;
+
+	key_file = g_key_file_new ();
+	for (node = _entries; node; node = g_list_next (node)) {
+		JournalEntry *entry = (JournalEntry *) node->data;
+		const gchar **uids;
+		GSList *uid;
+		gchar *group;
+		guint i = 0;
+
+		if (!entry->uids)
+			continue;
+
+		uids = g_new0 (const gchar *, g_slist_length (entry->uids) + 1);
+		for (uid = entry->uids; uid; uid = g_slist_next (uid))
+			uids[i++] = (const gchar *) uid->data;
+
+		group = g_strdup_printf ("xfer%u", n++);
+		g_key_file_set_string (key_file, group, KEY_SOURCE, entry->src_url);
+		g_key_file_set_string (key_file, group, KEY_DESTINATION, entry->dst_url);
+		g_key_file_set_boolean (key_file, group, KEY_DELETE, entry->delete_original);
+		if (entry->failures)
+			g_key_file_set_integer (key_file, group, KEY_FAILURES, entry->failures);
+		g_key_file_set_string_list (key_file, group, KEY_UIDS, uids, i);
+		g_free (group);
+		g_free (uids);
+	}
+
+	data = g_key_file_to_data (key_file, &len, NULL);
+	filename = get_journal_filename ();
+	retval = g_file_set_contents (filename, data, len, &err);
+	if (!retval) {
+		g_warning ("%s: failed to save %s: %s", __FUNCTION__, filename,
+			   err ? err->message : "unknown error");
+		g_clear_error (&err);
+	}
+
+	g_free (filename);
+	g_free (data);
+	g_key_file_free (key_file);
+
+	return retval;
+}
+
+/* removes the entries that have nothing left to transfer */
+static void
+remove_empty_entries (void)
+{
+	GList *node = _entries;
+
+	while (node) {
+		GList *next = g_list_next (node);
+		JournalEntry *entry = (JournalEntry *) node->data;
+
+		if (!entry->uids && !entry->replaying) {
+			_entries = g_list_delete_link (_entries, node);
+			journal_entry_free (entry);
+		}
+		node = next;
+	}
+}
+
+static JournalEntry*
+find_entry (const gchar *src_url, const gchar *dst_url, gboolean delete_original)
+{
+	GList *node;
+
+	for (node = _entries; node; node = g_list_next (node)) {
+		JournalEntry *entry = (JournalEntry *) node->data;
+
+		if (!entry->replaying &&
+		    entry->delete_original == delete_original &&
+		    !strcmp (entry->src_url, src_url) &&
+		    !strcmp (entry->dst_url, dst_url))
+			return entry;
+	}
+	return NULL;
+}
+
+static void
+remove_uid (JournalEntry *entry, const gchar *uid)
+{
+	GSList *node = g_slist_find_custom (entry->uids, uid, (GCompareFunc) strcmp);
+
+	if (node) {
+		g_free (node->data);
+		entry->uids = g_slist_delete_link (entry->uids, node);
+	}
+}
+
+gboolean
+modest_offline_journal_add_xfer (TnyList *headers,
+				 TnyFolder *dst_folder,
+				 gboolean delete_original)
+{
+	JournalEntry *entry = NULL;
+	TnyIterator *iter;
+	gchar *dst_url;
+
+	g_return_val_if_fail (TNY_IS_LIST (headers), FALSE);
+	g_return_val_if_fail (TNY_IS_FOLDER (dst_folder), FALSE);
+
+	ensure_loaded ();
+
+	dst_url = tny_folder_get_url_string (dst_folder);
+	if (!dst_url)
+		return FALSE;
+
+	iter = tny_list_create_iterator (headers);
+	while (!tny_iterator_is_done (iter)) {
+		TnyHeader *header = TNY_HEADER (tny_iterator_get_current (iter));
+		TnyFolder *folder = tny_header_get_folder (header);
+		gchar *uid = tny_header_dup_uid (header);
+		gchar *src_url = (folder) ? tny_folder_get_url_string (folder) : NULL;
+
+		if (uid && src_url) {
+			gchar *msg_uid = get_msg_uid (src_url, uid);
+			JournalEntry *previous = g_hash_table_lookup (_pending, msg_uid);
+
+			/* A second move of the same message while
+			   offline replaces the first one */
+			if (previous && !previous->replaying) {
+				remove_uid (previous, uid);
+				unset_pending (previous, uid);
+			}
+			g_free (msg_uid);
+
+			if (!entry)
+				entry = find_entry (src_url, dst_url, delete_original);
+			if (!entry) {
+				entry = g_slice_new0 (JournalEntry);
+				entry->src_url = g_strdup (src_url);
+				entry->dst_url = g_strdup (dst_url);
+				entry->delete_original = delete_original;
+				_entries = g_list_append (_entries, entry);
+			}
+
+			if (!g_slist_find_custom (entry->uids, uid, (GCompareFunc) strcmp))
+				entry->uids = g_slist_append (entry->uids, g_strdup (uid));
+			set_pending (entry, uid);
+		}
+
+		g_free (src_url);
+		g_free (uid);
+		if (folder)
+			g_object_unref (folder);
+		g_object_unref (header);
+		tny_iterator_next (iter);
+	}
+	g_object_unref (iter);
+	g_free (dst_url);
+
+	remove_empty_entries ();
+
+	return save_journal ();
+}
+
+gboolean
+modest_offline_journal_is_pending (TnyHeader *header)
+{
+	TnyFolder *folder;
+	gchar *uid, *url;
+	gboolean pending = FALSE;
+
+	g_return_val_if_fail (TNY_IS_HEADER (header), FALSE);
+
+	ensure_loaded ();
+
+	/* Quick check for the common case */
+	if (g_hash_table_size (_pending) == 0)
+		return FALSE;
+
+	folder = tny_header_get_folder (header);
+	if (!folder)
+		return FALSE;
+
+	url = tny_folder_get_url_string (folder);
+	uid = tny_header_dup_uid (header);
+	if (url && uid) {
+		gchar *msg_uid = get_msg_uid (url, uid);
+		pending = g_hash_table_lookup (_pending, msg_uid) != NULL;
+		g_free (msg_uid);
+	}
+
+	g_free (uid);
+	g_free (url);
+	g_object_unref (folder);
+
+	return pending;
+}
+
+/* @missing is set to TRUE if the account of the folder is known but
+   the folder is not there anymore */
+static TnyFolder*
+find_folder (const gchar *folder_url, const gchar *some_uid, gboolean *missing)
+{
+	ModestTnyAccountStore *account_store;
+	TnyAccount *account;
+	TnyFolder *folder;
+	gchar *msg_uid;
+
+	*missing = FALSE;
+	account_store = modest_runtime_get_account_store ();
+	folder = modest_tny_account_store_find_folder_by_url (account_store, folder_url);
+	if (folder)
+		return folder;
+
+	account = tny_account_store_find_account (TNY_ACCOUNT_STORE (account_store), folder_url);
+	if (!account)
+		return NULL;
+
+	/* It looks for the folder of a message uid */
+	msg_uid = get_msg_uid (folder_url, some_uid);
+	folder = modest_tny_folder_store_find_folder_from_uri (TNY_FOLDER_STORE (account), msg_uid);
+	g_free (msg_uid);
+	g_object_unref (account);
+
+	*missing = (folder == NULL);
+
+	return folder;
+}
+
+/* The messages of a dropped entry are shown again in their folder */
+static void
+refilter_header_views (void)
+{
+	GList *windows, *node;
+
+	windows = modest_window_mgr_get_window_list (modest_runtime_get_window_mgr ());
+	for (node = windows; node; node = g_list_next (node)) {
+		if (MODEST_IS_HEADER_WINDOW (node->data)) {
+			ModestHeaderWindow *window = MODEST_HEADER_WINDOW (node->data);
+			modest_header_view_refilter (modest_header_window_get_header_view (window));
+		}
+	}
+	g_list_free (windows);
+}
+
+/* Gives up the transfers of @entry, that could never be done: its
+   messages are not hidden anymore, and the user is told about it */
+static void
+drop_entry (JournalEntry *entry)
+{
+	GSList *node;
+
+	if (!entry->uids)
+		return;
+
+	g_warning ("%s: giving up the transfer of %u messages from %s to %s",
+		   __FUNCTION__, g_slist_length (entry->uids), entry->src_url, entry->dst_url);
+
+	for (node = entry->uids; node; node = g_slist_next (node)) {
+		unset_pending (entry, (const gchar *) node->data);
+		g_free (node->data);
+	}
+	g_slist_free (entry->uids);
+	entry->uids = NULL;
+
+	remove_empty_entries ();
+	save_journal ();
+
+	refilter_header_views ();
+	modest_platform_information_banner (NULL, NULL, _("emev_nc_unabletomove_item"));
+}
+
+/* Whether the accounts of the folders of @entry are connected, a
+   transfer failed while they're not is not the fault of the entry */
+static gboolean
+entry_is_connected (JournalEntry *entry)
+{
+	TnyAccountStore *account_store;
+	const gchar *urls[2];
+	gboolean connected = TRUE;
+	gint i;
+
+	if (!tny_device_is_online (modest_runtime_get_device ()))
+		return FALSE;
+
+	account_store = TNY_ACCOUNT_STORE (modest_runtime_get_account_store ());
+	urls[0] = entry->src_url;
+	urls[1] = entry->dst_url;
+	for (i = 0; i < 2 && connected; i++) {
+		TnyAccount *account = tny_account_store_find_account (account_store, urls[i]);
+
+		if (account) {
+			if (modest_tny_folder_store_is_remote (TNY_FOLDER_STORE (account)))
+				connected = (tny_account_get_connection_status (account) ==
+					     TNY_CONNECTION_STATUS_CONNECTED);
+			g_object_unref (account);
+		}
+	}
+
+	return connected;
+}
+
+/* Called when all the batches of a replay of @entry are done. A
+   replay that failed counts once, whatever the number of batches */
+static void
+replay_finished (JournalEntry *entry)
+{
+	if (entry->failed) {
+		entry->failed = FALSE;
+		if (++entry->failures >= MODEST_OFFLINE_JOURNAL_MAX_FAILURES) {
+			drop_entry (entry);
+			return;
+		}
+	}
+	remove_empty_entries ();
+	save_journal ();
+}
+
+static void
+on_batch_transferred (ModestMailOperation *mail_op,
+		      gpointer user_data)
+{
+	ReplayBatch *batch = (ReplayBatch *) user_data;
+	JournalEntry *entry = batch->entry;
+	ModestMailOperationStatus status;
+	GSList *node;
+
+	status = modest_mail_operation_get_status (mail_op);
+	if (status == MODEST_MAIL_OPERATION_STATUS_SUCCESS) {
+		for (node = batch->uids; node; node = g_slist_next (node)) {
+			remove_uid (entry, (const gchar *) node->data);
+			unset_pending (entry, (const gchar *) node->data);
+		}
+		entry->failures = 0;
+	} else if (status != MODEST_MAIL_OPERATION_STATUS_CANCELED &&
+		   entry_is_connected (entry)) {
+		entry->failed = TRUE;
+	}
+	/* otherwise the messages just stay in the journal for the
+	   next replay */
+
+	if (--entry->replaying == 0)
+		replay_finished (entry);
+
+	g_slist_foreach (batch->uids, (GFunc) g_free, NULL);
+	g_slist_free (batch->uids);
+	g_slice_free (ReplayBatch, batch);
+}
+
+static void
+replay_batch (JournalEntry *entry, TnyList *headers, TnyFolder *dst_folder)
+{
+	ModestMailOperation *mail_op;
+	ReplayBatch *batch;
+	TnyIterator *iter;
+
+	batch = g_slice_new0 (ReplayBatch);
+	batch->entry = entry;
+	iter = tny_list_create_iterator (headers);
+	while (!tny_iterator_is_done (iter)) {
+		TnyHeader *header = TNY_HEADER (tny_iterator_get_current (iter));
+		batch->uids = g_slist_prepend (batch->uids, tny_header_dup_uid (header));
+		g_object_unref (header);
+		tny_iterator_next (iter);
+	}
+	g_object_unref (iter);
+
+	entry->replaying++;
+	mail_op = modest_mail_operation_new (NULL);
+	modest_mail_operation_queue_add (modest_runtime_get_mail_operation_queue (), mail_op);
+	modest_mail_operation_xfer_msgs (mail_op, headers, dst_folder, entry->delete_original,
+					 on_batch_transferred, batch);
+	g_object_unref (mail_op);
+}
+
+static void
+on_replay_headers (TnyFolder *src_folder,
+		   gboolean cancelled,
+		   TnyList *headers,
+		   GError *err,
+		   gpointer user_data)
+{
+	ReplayInfo *info = (ReplayInfo *) user_data;
+	JournalEntry *entry = info->entry;
+	GHashTable *found;
+	TnyList *batch;
+	TnyIterator *iter;
+	GSList *node;
+
+	if (cancelled || err)
+		goto finish;
+
+	found = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	iter = tny_list_create_iterator (headers);
+	while (!tny_iterator_is_done (iter)) {
+		TnyHeader *header = TNY_HEADER (tny_iterator_get_current (iter));
+		gchar *uid = tny_header_dup_uid (header);
+
+		if (uid)
+			g_hash_table_insert (found, uid, NULL);
+		g_object_unref (header);
+		tny_iterator_next (iter);
+	}
+	g_object_unref (iter);
+
+	/* Forget the messages that are not in the folder anymore */
+	node = entry->uids;
+	while (node) {
+		GSList *next = g_slist_next (node);
+		gchar *uid = (gchar *) node->data;
+
+		if (!g_hash_table_lookup_extended (found, uid, NULL, NULL)) {
+			unset_pending (entry, uid);
+			entry->uids = g_slist_delete_link (entry->uids, node);
+			g_free (uid);
+		}
+		node = next;
+	}
+	g_hash_table_destroy (found);
+
+	/* All the messages to the same folder go in the same entry,
+	   transfer them in batches */
+	batch = tny_simple_list_new ();
+	iter = tny_list_create_iterator (headers);
+	while (!tny_iterator_is_done (iter)) {
+		GObject *header = tny_iterator_get_current (iter);
+
+		tny_list_append (batch, header);
+		g_object_unref (header);
+
+		if (tny_list_get_length (batch) == MODEST_OFFLINE_JOURNAL_BATCH_SIZE) {
+			replay_batch (entry, batch, info->dst_folder);
+			g_object_unref (batch);
+			batch = tny_simple_list_new ();
+		}
+		tny_iterator_next (iter);
+	}
+	g_object_unref (iter);
+	if (tny_list_get_length (batch) > 0)
+		replay_batch (entry, batch, info->dst_folder);
+	g_object_unref (batch);
+
+ finish:
+	if (--entry->replaying == 0)
+		replay_finished (entry);
+
+	g_object_unref (info->dst_folder);
+	g_slice_free (ReplayInfo, info);
+}
+
+static void
+replay_entry (JournalEntry *entry)
+{
+	TnyFolder *src_folder, *dst_folder;
+	ReplayInfo *info;
+	gboolean missing;
+
+	/* If the account is not loaded yet we try again in the next
+	   replay, but if it is and the folder is gone (it was
+	   deleted meanwhile) the transfer can never be done */
+	src_folder = find_folder (entry->src_url, (const gchar *) entry->uids->data, &missing);
+	if (!src_folder) {
+		if (missing)
+			drop_entry (entry);
+		return;
+	}
+
+	dst_folder = find_folder (entry->dst_url, (const gchar *) entry->uids->data, &missing);
+	if (!dst_folder) {
+		if (missing)
+			drop_entry (entry);
+		g_object_unref (src_folder);
+		return;
+	}
+
+	/* Keep the entry alive until all its batches are done, it's
+	   released in on_replay_headers */
+	entry->replaying++;
+	entry->failed = FALSE;
+
+	info = g_slice_new0 (ReplayInfo);
+	info->entry = entry;
+	info->dst_folder = dst_folder;
+	modest_tny_folder_get_headers_by_uid_async (src_folder, entry->uids,
+						    on_replay_headers, info);
+	g_object_unref (src_folder);
+}
+
+void
+modest_offline_journal_replay (TnyAccount *account)
+{
+	TnyAccountStore *account_store;
+	GList *entries, *node;
+
+	g_return_if_fail (TNY_IS_ACCOUNT (account));
+
+	ensure_loaded ();
+
+	if (!tny_device_is_online (modest_runtime_get_device ()))
+		return;
+
+	/* the callbacks of the transfers modify the list */
+	account_store = TNY_ACCOUNT_STORE (modest_runtime_get_account_store ());
+	entries = g_list_copy (_entries);
+	for (node = entries; node; node = g_list_next (node)) {
+		JournalEntry *entry = (JournalEntry *) node->data;
+		TnyAccount *src_account;
+
+		if (entry->replaying || !entry->uids)
+			continue;
+
+		/* Only the transfers from @account, the others wait
+		   for their own account to be connected */
+		src_account = tny_account_store_find_account (account_store, entry->src_url);
+		if (src_account == account)
+			replay_entry (entry);
+		if (src_account)
+			g_object_unref (src_account);
+	}
+	g_list_free (entries);
+
+	remove_empty_entries ();
+}
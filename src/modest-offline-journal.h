@@ -0,0 +1,108 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MODEST_OFFLINE_JOURNAL_H__
+#define __MODEST_OFFLINE_JOURNAL_H__
+
+#include <glib.h>
+#include <tny-account.h>
+#include <tny-folder.h>
+#include <tny-header.h>
+#include <tny-list.h>
+
+G_BEGIN_DECLS
+
+/*
+ * a journal of the message transfers that the user asked for while
+ * offline and that could not be done without a connection (the
+ * messages were not retrieved yet). Instead of asking to connect,
+ * the transfer is written to MODEST_DIR/MODEST_OFFLINE_JOURNAL_FILE
+ * and the messages are hidden from their source folder at once. When
+ * the device gets online the journal is replayed: the transfers to
+ * the same destination are merged, and done in batches of
+ * MODEST_OFFLINE_JOURNAL_BATCH_SIZE messages. The journal is saved
+ * before the messages are hidden and after every batch, so after a
+ * crash the pending transfers are still there. Transfers whose
+ * source or destination folder was removed, or whose replays failed
+ * MODEST_OFFLINE_JOURNAL_MAX_FAILURES times in a row while connected,
+ * are given up: their messages are shown again and the user is
+ * notified
+ */
+
+#define MODEST_OFFLINE_JOURNAL_BATCH_SIZE 50
+#define MODEST_OFFLINE_JOURNAL_MAX_FAILURES 5
+
+/**
+ * modest_offline_journal_add_xfer:
+ * @headers: a #TnyList of the headers of the messages, all of them
+ * of the same folder
+ * @dst_folder: the destination #TnyFolder
+ * @delete_original: %TRUE for a move, %FALSE for a copy
+ *
+ * record the transfer of @headers to @dst_folder, to be done when the
+ * device gets online. Moves hide the messages from their folder (see
+ * modest_offline_journal_is_pending()). A message that was already
+ * pending to be moved is moved to @dst_folder instead
+ *
+ * Returns: %TRUE if the transfer was recorded, %FALSE if it could not
+ * be saved
+ */
+gboolean modest_offline_journal_add_xfer    (TnyList *headers,
+					     TnyFolder *dst_folder,
+					     gboolean delete_original);
+
+/**
+ * modest_offline_journal_is_pending:
+ * @header: a #TnyHeader
+ *
+ * check if the message of @header is waiting in the journal to be
+ * moved to another folder. The views should not show these messages
+ *
+ * Returns: %TRUE if the message is going to be moved, %FALSE otherwise
+ */
+gboolean modest_offline_journal_is_pending  (TnyHeader *header);
+
+/**
+ * modest_offline_journal_replay:
+ * @account: the #TnyAccount that was just connected
+ *
+ * do the transfers of the journal from the folders of @account. The
+ * ones whose folders are not known yet (their account was not loaded)
+ * or that fail are kept for the next replay, up to
+ * MODEST_OFFLINE_JOURNAL_MAX_FAILURES times. Failures while some of
+ * the accounts involved is not connected are not counted. It's called
+ * from the connect_and_perform callbacks: the ones of the
+ * send&receive, and the ones of the accounts with pending transfers
+ * when the device gets online
+ */
+void     modest_offline_journal_replay      (TnyAccount *account);
+
+G_END_DECLS
+
+#endif /*__MODEST_OFFLINE_JOURNAL_H__*/
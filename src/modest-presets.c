@@ -48,34 +48,161 @@
 #define MODEST_PRESETS_KEY_APOP                "APOPSecureLogin"
 #define MODEST_PRESETS_KEY_SECURE_SMTP         "SecureSmtp"
 #define MODEST_PRESETS_KEY_SMTP_PORT           "SmtpPort"
-						    
+
+/* A provider of the presets file, already parsed. All the strings
+ * live in the string chunk of the presets, and the same value (like
+ * "true" or "pop") is stored only once */
+struct _ModestPresetsProvider {
+	const gchar *id;
+	const gchar *name;
+	const gchar *domain;
+	const gchar *incoming;
+	const gchar *incoming_security;
+	const gchar *outgoing;
+	const gchar *mailbox_type;
+	const gchar *apop;
+	const gchar *secure_smtp;
+	gint         mcc;	/* -1 if it could not be parsed */
+	guint        smtp_port;
+	guint        position;	/* in the presets file */
+};
+typedef struct _ModestPresetsProvider ModestPresetsProvider;
+
+static gint effective_mcc (gint mcc);
+
+static const gchar*
+get_string (ModestPresets *self, GKeyFile *keyfile,
+	    const gchar *provider_id, const gchar *key)
+{
+	const gchar *retval = NULL;
+	gchar *val;
+
+	val = g_key_file_get_string (keyfile, provider_id, key, NULL);
+	if (val) {
+		retval = g_string_chunk_insert_const (self->strings, val);
+		g_free (val);
+	}
+	return retval;
+}
+
+/* parse every provider once, and build the indexes by id, by
+ * (effective) mcc, and by domain, so we don't need the keyfile
+ * anymore */
+static void
+compile_presets (ModestPresets *self, GKeyFile *keyfile)
+{
+	gchar **provider_ids;
+	gsize len = 0;
+	gint i;
+
+	provider_ids = g_key_file_get_groups (keyfile, &len);
+
+	self->strings = g_string_chunk_new (4096);
+	self->providers = g_new0 (ModestPresetsProvider, len);
+	self->n_providers = len;
+	self->by_id = g_hash_table_new (g_str_hash, g_str_equal);
+	self->by_mcc = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					      NULL, (GDestroyNotify) g_slist_free);
+	self->by_domain = g_hash_table_new (g_str_hash, g_str_equal);
+
+	for (i = 0; i < (gint) len; i++) {
+		ModestPresetsProvider *provider = &self->providers[i];
+		GError *err = NULL;
+
+		provider->position = i;
+		provider->id = g_string_chunk_insert_const (self->strings, provider_ids[i]);
+		provider->name = get_string (self, keyfile, provider_ids[i], MODEST_PRESETS_KEY_NAME);
+		provider->domain = get_string (self, keyfile, provider_ids[i], MODEST_PRESETS_KEY_DOMAIN);
+		provider->incoming = get_string (self, keyfile, provider_ids[i], MODEST_PRESETS_KEY_INCOMING);
+		provider->incoming_security = get_string (self, keyfile, provider_ids[i],
+							  MODEST_PRESETS_KEY_INCOMING_SECURITY);
+		provider->outgoing = get_string (self, keyfile, provider_ids[i], MODEST_PRESETS_KEY_OUTGOING);
+		provider->mailbox_type = get_string (self, keyfile, provider_ids[i],
+						     MODEST_PRESETS_KEY_MAILBOX_TYPE);
+		provider->apop = get_string (self, keyfile, provider_ids[i], MODEST_PRESETS_KEY_APOP);
+		provider->secure_smtp = get_string (self, keyfile, provider_ids[i],
+						    MODEST_PRESETS_KEY_SECURE_SMTP);
+		provider->smtp_port = (guint) g_key_file_get_integer (keyfile, provider_ids[i],
+								      MODEST_PRESETS_KEY_SMTP_PORT, NULL);
+
+		provider->mcc = g_key_file_get_integer (keyfile, provider_ids[i],
+							MODEST_PRESETS_KEY_MCC, &err);
+		if (err) {
+			/* it won't be listed for any country */
+			g_printerr ("modest: error parsing keyfile: %s\n", err->message);
+			g_error_free (err);
+			provider->mcc = -1;
+		}
+
+		if (!g_hash_table_lookup (self->by_id, provider->id))
+			g_hash_table_insert (self->by_id, (gpointer) provider->id, provider);
+
+		/* the first provider of a domain wins */
+		if (provider->domain) {
+			gchar *domain = g_ascii_strdown (provider->domain, -1);
+			if (!g_hash_table_lookup (self->by_domain, domain))
+				g_hash_table_insert (self->by_domain,
+						     g_string_chunk_insert_const (self->strings, domain),
+						     provider);
+			g_free (domain);
+		}
+	}
+
+	/* the lists of each mcc keep the order of the file */
+	for (i = (gint) len - 1; i >= 0; i--) {
+		ModestPresetsProvider *provider = &self->providers[i];
+		gpointer key;
+		GSList *list;
+
+		if (provider->mcc < 0)
+			continue;
+
+		key = GINT_TO_POINTER (effective_mcc (provider->mcc));
+		list = g_hash_table_lookup (self->by_mcc, key);
+		g_hash_table_steal (self->by_mcc, key);
+		g_hash_table_insert (self->by_mcc, key, g_slist_prepend (list, provider));
+	}
+
+	g_strfreev (provider_ids);
+}
+
+static ModestPresetsProvider*
+get_provider (ModestPresets *self, const gchar *provider_id)
+{
+	if (!provider_id)
+		return NULL;
+
+	return (ModestPresetsProvider *) g_hash_table_lookup (self->by_id, provider_id);
+}
 
 ModestPresets*
 modest_presets_new (const gchar *presetfile)
 {
 	ModestPresets *presets = NULL;
+	GKeyFile      *keyfile;
 	GError        *err     = NULL;
 	
 	g_return_val_if_fail (presetfile, NULL);
 	
-	presets = g_new (ModestPresets, 1);
-	presets->keyfile = g_key_file_new ();
-
-	if (!presets->keyfile) {
+	keyfile = g_key_file_new ();
+	if (!keyfile) {
 		g_printerr ("modest: cannot instantiate GKeyFile\n");
-		g_free (presets);
 		return NULL;
 	}
 	
-	if (!g_key_file_load_from_file (presets->keyfile, presetfile,
+	if (!g_key_file_load_from_file (keyfile, presetfile,
 					G_KEY_FILE_NONE, &err)) {
 		g_printerr ("modest: cannot open keyfile from %s:\n  %s\n", presetfile,
 			    err ? err->message : "unknown reason");
 		g_error_free (err);
-		g_free (presets);
+		g_key_file_free (keyfile);
 		return NULL;
 	}
 
+	presets = g_new0 (ModestPresets, 1);
+	compile_presets (presets, keyfile);
+	g_key_file_free (keyfile);
+
 	return presets;
 }
 
@@ -114,114 +241,93 @@ gchar**
 modest_presets_get_providers  (ModestPresets *self, guint mcc,
 			       gboolean include_globals, gchar ***provider_ids)
 {
-	gchar **all_providers = NULL;
-	gchar **all_provider_ids = NULL;
+	GSList *local, *globals = NULL;
 	gchar **filtered  = NULL;
 	gchar **filtered_ids = NULL;
-	GError *err       = NULL;
-	guint i, j, len;
-
-	g_return_val_if_fail (self && self->keyfile, NULL);
-
-	/* Get all the provider IDs: */
-	all_provider_ids = g_key_file_get_groups (self->keyfile, NULL);
-	len = g_strv_length(all_provider_ids);
-
-	/* Get the names for all these providers: */
-	all_providers = g_new0(gchar*, len + 1); /* Provider names. */
-	for (i=0; i != len; ++i) {
-		const gchar * provider_id = all_provider_ids[i];
-		if(provider_id) {
-			gchar* name = g_key_file_get_string(self->keyfile, provider_id, 
-				MODEST_PRESETS_KEY_NAME, NULL);
-
-			/* Be forgiving of missing names.
-			 * If we use NULL then we will null-terminate the array.
-			 */
-			if(!name)
-				name = g_strdup("");
-
-			all_providers[i] = name;
-		}
-		else
-			all_providers[i] = NULL;
-	};
-
-	/* return *all* providers? */
-	/*
-	if (mcc == 0 && include_globals) {
-		*provider_ids = all_provider_ids;
-		return all_providers;
-	}
-	*/
+	guint i, len;
 
-	/* nope: filter them */
+	g_return_val_if_fail (self && self->by_mcc, NULL);
 
+	local = g_hash_table_lookup (self->by_mcc, GINT_TO_POINTER (effective_mcc (mcc)));
+	if (include_globals && effective_mcc (mcc) != 0)
+		globals = g_hash_table_lookup (self->by_mcc, GINT_TO_POINTER (0));
+
+	len = g_slist_length (local) + g_slist_length (globals);
 	filtered = g_new0(gchar*, len + 1); /* Provider names. */
 	filtered_ids = g_new0(gchar*, len + 1); /* Provider IDs */
 
-	for (i=0, j=0; i != len; ++i) {
-
-		int this_mcc;
-		this_mcc = g_key_file_get_integer (self->keyfile, all_provider_ids[i],
-						   MODEST_PRESETS_KEY_MCC, &err);
-		if (err) {
-			g_strfreev (all_providers);
-			g_strfreev (all_provider_ids);
-			g_strfreev (filtered);
-			g_strfreev (filtered_ids);
-
-			g_printerr ("modest: error parsing keyfile: %s\n", err->message);
-			g_error_free (err);
-
-			return NULL;
+	/* merge both lists, in the order of the presets file */
+	for (i = 0; local || globals; i++) {
+		ModestPresetsProvider *provider;
+
+		if (!globals ||
+		    (local && ((ModestPresetsProvider *) local->data)->position <
+		     ((ModestPresetsProvider *) globals->data)->position)) {
+			provider = (ModestPresetsProvider *) local->data;
+			local = g_slist_next (local);
+		} else {
+			provider = (ModestPresetsProvider *) globals->data;
+			globals = g_slist_next (globals);
 		}
 
-		if (this_mcc == mcc ||
-		    effective_mcc (this_mcc) == effective_mcc (mcc) ||
-		    (this_mcc == 0 && include_globals)) {
-			filtered[j]   = all_providers[i];
-			filtered_ids[j]   = all_provider_ids[i];
-			++j;
-			filtered[j] = NULL; /* the array must be NULL-terminated */
-			filtered_ids[j] = NULL; /* the array must be NULL-terminated */
-
-			all_providers[i]  = NULL; /*  g_strfreev: leave it alone */
-			all_provider_ids[i]  = NULL; /*  g_strfreev: leave it alone */
-		}
+		/* Be forgiving of missing names.
+		 * If we use NULL then we will null-terminate the array.
+		 */
+		filtered[i] = g_strdup (provider->name ? provider->name : "");
+		filtered_ids[i] = g_strdup (provider->id);
 	}
-	g_strfreev (all_providers);
-	g_strfreev (all_provider_ids);
-	
+
 	*provider_ids = filtered_ids;
 	return filtered;
 }
 
 
+gchar*
+modest_presets_get_provider_for_domain (ModestPresets *self,
+					const gchar *domain)
+{
+	ModestPresetsProvider *provider;
+	gchar *domain_down;
+
+	g_return_val_if_fail (self && self->by_domain, NULL);
+	g_return_val_if_fail (domain, NULL);
+
+	domain_down = g_ascii_strdown (domain, -1);
+	provider = (ModestPresetsProvider *) g_hash_table_lookup (self->by_domain, domain_down);
+	g_free (domain_down);
+
+	return provider ? g_strdup (provider->id) : NULL;
+}
+
+
 gchar*
 modest_presets_get_server (ModestPresets *self, const gchar *provider_id,
 			   gboolean incoming_server)
 {	
-	g_return_val_if_fail (self && self->keyfile, NULL);
+	ModestPresetsProvider *provider;
+
+	g_return_val_if_fail (self && self->by_id, NULL);
 	g_return_val_if_fail (provider_id, NULL);
 
-	return g_key_file_get_string (self->keyfile, provider_id, 
-				      incoming_server ?
-				      MODEST_PRESETS_KEY_INCOMING :
-				      MODEST_PRESETS_KEY_OUTGOING,
-				      NULL);
+	provider = get_provider (self, provider_id);
+	if (!provider)
+		return NULL;
+
+	return g_strdup (incoming_server ? provider->incoming : provider->outgoing);
 }
 
 gchar *
 modest_presets_get_domain      (ModestPresets *self,
 				const gchar *provider_id)
 {	
-	g_return_val_if_fail (self && self->keyfile, NULL);
+	ModestPresetsProvider *provider;
+
+	g_return_val_if_fail (self && self->by_id, NULL);
 	g_return_val_if_fail (provider_id, NULL);
 
-	return g_key_file_get_string (self->keyfile, provider_id, 
-				      MODEST_PRESETS_KEY_DOMAIN,
-				      NULL);
+	provider = get_provider (self, provider_id);
+
+	return provider ? g_strdup (provider->domain) : NULL;
 }		
 
 
@@ -235,34 +341,29 @@ modest_presets_get_info_server_type (ModestPresets *self,
 	ModestProtocolType protocol_type = MODEST_PROTOCOL_REGISTRY_TYPE_INVALID;
 	ModestProtocolRegistry *protocol_registry;
 	ModestProtocol *protocol;
-	gchar *val = NULL;
+	ModestPresetsProvider *provider;
 	
-	g_return_val_if_fail (self && self->keyfile, 0);
+	g_return_val_if_fail (self && self->by_id, 0);
 	protocol_registry = modest_runtime_get_protocol_registry ();
 
+	provider = get_provider (self, provider_id);
+	if (!provider)
+		return protocol_type;
+
 	if (incoming_server) {
-		val = g_key_file_get_string (self->keyfile, provider_id,
-					     MODEST_PRESETS_KEY_INCOMING, NULL);
-		if (!val)
+		if (!provider->incoming)
 			return protocol_type;
 		
-		g_free (val);
-		val = g_key_file_get_string (self->keyfile, provider_id,
-					     MODEST_PRESETS_KEY_MAILBOX_TYPE,NULL);
-		
-		protocol = modest_protocol_registry_get_protocol_by_name (protocol_registry, MODEST_PROTOCOL_REGISTRY_STORE_PROTOCOLS, val);
+		protocol = modest_protocol_registry_get_protocol_by_name (protocol_registry, MODEST_PROTOCOL_REGISTRY_STORE_PROTOCOLS, provider->mailbox_type);
 		if (protocol == NULL)
 			return protocol_type;
 		protocol_type = modest_protocol_get_type_id (protocol);
 	} else {
-		val = g_key_file_get_string (self->keyfile, provider_id,
-					     MODEST_PRESETS_KEY_OUTGOING, NULL);
-		if (!val)
+		if (!provider->outgoing)
 			return protocol_type;
 
 		protocol_type = MODEST_PROTOCOLS_TRANSPORT_SMTP;
 	}
-	g_free (val);
 
 	/* debug: */
 /* 	g_debug ("provider id: %s, server type: %d", provider_id, info); */
@@ -276,18 +377,18 @@ modest_presets_get_info_server_security (ModestPresets *self, const gchar *provi
 					 gboolean incoming_server)
 {
 	ModestProtocolType protocol_type = MODEST_PROTOCOLS_CONNECTION_NONE;
-	gchar *val = NULL;
+	ModestPresetsProvider *provider;
+	const gchar *val = NULL;
 	
-	g_return_val_if_fail (self && self->keyfile, MODEST_PROTOCOLS_CONNECTION_NONE);
+	g_return_val_if_fail (self && self->by_id, MODEST_PROTOCOLS_CONNECTION_NONE);
 
-	if (incoming_server) {
-		val = g_key_file_get_string (self->keyfile, provider_id,
-					     MODEST_PRESETS_KEY_INCOMING, NULL);
-		if (val) {
-			g_free (val);
+	provider = get_provider (self, provider_id);
+	if (!provider)
+		return protocol_type;
 
-			val = g_key_file_get_string (self->keyfile, provider_id,
-						     MODEST_PRESETS_KEY_INCOMING_SECURITY, NULL);
+	if (incoming_server) {
+		if (provider->incoming) {
+			val = provider->incoming_security;
 			if (val && strcmp (val, "1") == 0) {
 				protocol_type = MODEST_PROTOCOLS_CONNECTION_TLS;
 			} else if (val && strcmp (val, "2") == 0) {
@@ -297,16 +398,10 @@ modest_presets_get_info_server_security (ModestPresets *self, const gchar *provi
 			} else if (val && (strcmp (val, "ssl") == 0)) {
 				protocol_type = MODEST_PROTOCOLS_CONNECTION_SSL;
 			}
-			g_free (val);
 		}
 	} else /* outgoing: */ {
-		val = g_key_file_get_string (self->keyfile, provider_id,
-					     MODEST_PRESETS_KEY_OUTGOING, NULL);
-		if (val) {
-			g_free (val);
-
-			val = g_key_file_get_string (self->keyfile, provider_id,
-						     MODEST_PRESETS_KEY_SECURE_SMTP, NULL);
+		if (provider->outgoing) {
+			val = provider->secure_smtp;
 			if (val && strcmp(val,"true") == 0)
 				protocol_type = MODEST_PROTOCOLS_CONNECTION_SSL;
 			else if (val && strcmp (val, "ssl") == 0)
@@ -317,7 +412,6 @@ modest_presets_get_info_server_security (ModestPresets *self, const gchar *provi
 				protocol_type = MODEST_PROTOCOLS_CONNECTION_TLS;
 			else if (val && strcmp (val, "1") == 0)
 				protocol_type = MODEST_PROTOCOLS_CONNECTION_TLS;
-			g_free(val);
 		}
 	}
 
@@ -329,22 +423,20 @@ modest_presets_get_info_server_use_alternate_port (ModestPresets *self, const gc
 						   gboolean incoming_server)
 {
 	gboolean result = FALSE;
-	gchar *val = NULL;
+	ModestPresetsProvider *provider;
 	
-	g_return_val_if_fail (self && self->keyfile, MODEST_PROTOCOLS_CONNECTION_NONE);
+	g_return_val_if_fail (self && self->by_id, MODEST_PROTOCOLS_CONNECTION_NONE);
+
+	provider = get_provider (self, provider_id);
+	if (!provider)
+		return result;
 
 	if (incoming_server) {
-		val = g_key_file_get_string (self->keyfile, provider_id,
-					     MODEST_PRESETS_KEY_INCOMING, NULL);
-		if (val) {
-			g_free (val);	
-
-			val = g_key_file_get_string (self->keyfile, provider_id,
-						     MODEST_PRESETS_KEY_INCOMING_SECURITY, NULL);
-			if (val && (strcmp (val, "2") == 0)) {
+		if (provider->incoming) {
+			if (provider->incoming_security &&
+			    (strcmp (provider->incoming_security, "2") == 0)) {
 				result = TRUE;
 			}
-			g_free (val);
 		}
 	} 
 
@@ -356,34 +448,23 @@ modest_presets_get_info_server_auth (ModestPresets *self, const gchar *provider_
 					 gboolean incoming_server)
 {
 	ModestProtocolType protocol_type = MODEST_PROTOCOLS_AUTH_NONE;
-	gchar *val = NULL;
+	ModestPresetsProvider *provider;
 	
-	g_return_val_if_fail (self && self->keyfile, MODEST_PROTOCOLS_AUTH_NONE);
+	g_return_val_if_fail (self && self->by_id, MODEST_PROTOCOLS_AUTH_NONE);
+
+	provider = get_provider (self, provider_id);
+	if (!provider)
+		return protocol_type;
 
 	if (incoming_server) {
-		val = g_key_file_get_string (self->keyfile, provider_id,
-					     MODEST_PRESETS_KEY_INCOMING, NULL);
-		if (val) {
-                        g_free (val);
-                        val = g_key_file_get_string (self->keyfile, provider_id,
-                                                     MODEST_PRESETS_KEY_APOP, NULL);
-                        if (val && strcmp(val, "true") == 0)
+		if (provider->incoming) {
+                        if (provider->apop && strcmp(provider->apop, "true") == 0)
 				protocol_type = MODEST_PROTOCOLS_AUTH_PASSWORD;
-                        g_free(val);
-
 		}
 	} else /* outgoing: */ {
-		val = g_key_file_get_string (self->keyfile, provider_id,
-					     MODEST_PRESETS_KEY_OUTGOING, NULL);
-		if (val) {
-			g_free (val);
-			
-			val = g_key_file_get_string (self->keyfile, provider_id,
-						     MODEST_PRESETS_KEY_SECURE_SMTP, NULL);
-			/* printf("debug: %s: provider_id=%s, secure-smtp val=%s\n", __FUNCTION__, provider_id, val); */
-			if (val && strcmp(val,"true") == 0)
+		if (provider->outgoing) {
+			if (provider->secure_smtp && strcmp(provider->secure_smtp,"true") == 0)
 				protocol_type = MODEST_PROTOCOLS_AUTH_PASSWORD;
-			g_free(val);
 		}
 	}
 
@@ -397,15 +478,16 @@ guint
 modest_presets_get_port (ModestPresets *self, const gchar* provider_id,
 			 gboolean incoming_server)
 {
+	ModestPresetsProvider *provider;
 	guint port;
 	
-	g_return_val_if_fail (self && self->keyfile, 0);
+	g_return_val_if_fail (self && self->by_id, 0);
 
-	if (incoming_server)
+	provider = get_provider (self, provider_id);
+	if (incoming_server || !provider)
 		port = 0; /* not used yet */
 	else 
-		port = (guint)g_key_file_get_integer (self->keyfile, provider_id,
-						      MODEST_PRESETS_KEY_SMTP_PORT, NULL);
+		port = provider->smtp_port;
 
 	return port;
 }
@@ -420,8 +502,11 @@ modest_presets_destroy (ModestPresets *self)
 	if (!self)
 		return;
 
-	g_key_file_free (self->keyfile);
-	self->keyfile = NULL;
+	g_hash_table_destroy (self->by_id);
+	g_hash_table_destroy (self->by_mcc);
+	g_hash_table_destroy (self->by_domain);
+	g_free (self->providers);
+	g_string_chunk_free (self->strings);
 	
 	g_free (self);
 }
@@ -35,7 +35,12 @@
 
 struct _ModestPresets {
 /* private data: don't touch */
-	GKeyFile *keyfile;
+	GStringChunk                 *strings;
+	struct _ModestPresetsProvider *providers;
+	guint                         n_providers;
+	GHashTable                   *by_id;
+	GHashTable                   *by_mcc;
+	GHashTable                   *by_domain;
 };
 typedef struct _ModestPresets ModestPresets;
 
@@ -44,7 +49,8 @@ typedef struct _ModestPresets ModestPresets;
  * modest_presets_new:
  * @presetfile: the full path to the file with presets (in GKeyFile format)
  * 
- * make a new ModestPresets instance
+ * make a new ModestPresets instance. The file is parsed once,
+ * and indexed by provider, country and domain
  *
  * Returns: a new ModestPresets instance, or NULL in case of error.
  */
@@ -68,6 +74,21 @@ ModestPresets*            modest_presets_new             (const gchar *presetfil
 gchar **         modest_presets_get_providers   (ModestPresets *self, guint mcc, 
 						 gboolean include_globals, gchar ***provider_ids);
 
+/**
+ * modest_presets_get_provider_for_domain:
+ * @self: a valid ModestPresets instance
+ * @domain: the domain of an email address, for instance, hotmail.com
+ *
+ * find the provider whose domain is @domain, ignoring the case. If
+ * several providers have the same domain, the first one of the
+ * presets file is returned
+ *
+ * Returns: a newly allocated string with the provider ID, or NULL
+ * if no provider has that domain
+ */
+gchar *                   modest_presets_get_provider_for_domain (ModestPresets *self,
+								  const gchar *domain);
+
 /**
  * modest_presets_get_server:
  * @self: a valid ModestPresets instance
@@ -0,0 +1,442 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <gdk/gdk.h>
+#include <tny-simple-list.h>
+#include <tny-iterator.h>
+#include <tny-folder-observer.h>
+#include <tny-folder-change.h>
+#include <tny-folder-store.h>
+#include "modest-push-monitor.h"
+#include "modest-runtime.h"
+#include "modest-account-mgr.h"
+#include "modest-account-mgr-helpers.h"
+#include "modest-tny-account.h"
+#include "modest-tny-account-store.h"
+#include "modest-mail-operation-queue.h"
+#include "modest-protocol-registry.h"
+#include "modest-folder-counts.h"
+#include "modest-search.h"
+
+/* milliseconds to wait for more notifications before processing
+   the pushed headers, servers usually send several EXISTS in a row
+   when many messages arrive at once */
+#define FLUSH_DELAY 1500
+
+typedef struct {
+	gchar                 *account_name;
+	TnyAccount            *account;
+	UpdateAccountCallback  callback;
+	gpointer               user_data;
+	GSList                *observers;
+	gulong                 status_handler;
+} PushAccount;
+
+/***** P U S H    F O L D E R    O B S E R V E R *****/
+/* One per watched folder. It gathers the headers that the server
+ * pushes into the folder until they're processed in the main loop */
+typedef struct {
+	GObject    parent;
+	gchar     *account_name;
+	TnyFolder *folder;
+	TnyList   *new_headers;	/* protected by the push lock */
+	guint      flush_id;	/* protected by the push lock */
+} PushObserver;
+
+typedef struct {
+	GObjectClass parent;
+} PushObserverClass;
+
+static void push_observer_iface_init (TnyFolderObserverIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (PushObserver,
+			 push_observer,
+			 G_TYPE_OBJECT,
+			 G_IMPLEMENT_INTERFACE(TNY_TYPE_FOLDER_OBSERVER, push_observer_iface_init));
+
+/* account name -> PushAccount, only used from the main loop */
+static GHashTable *_push_accounts = NULL;
+static gulong _account_removed_handler = 0;
+static gulong _account_updated_handler = 0;
+
+/* folder observers might be notified outside the main thread */
+G_LOCK_DEFINE_STATIC (push);
+
+static gboolean
+push_observer_flush (gpointer user_data)
+{
+	PushObserver *self = (PushObserver *) user_data;
+	PushAccount *push_account = NULL;
+	TnyList *new_headers;
+
+	gdk_threads_enter ();
+
+	if (_push_accounts)
+		push_account = g_hash_table_lookup (_push_accounts, self->account_name);
+
+	/* While the account is being updated, the headers wait for
+	   the next flush. The update might not retrieve them (i.e. it
+	   might have listed the folder before they arrived) */
+	if (push_account &&
+	    modest_account_mgr_account_is_busy (modest_runtime_get_account_mgr (),
+						self->account_name)) {
+		gdk_threads_leave ();
+		return TRUE;
+	}
+
+	G_LOCK (push);
+	new_headers = self->new_headers;
+	self->new_headers = tny_simple_list_new ();
+	self->flush_id = 0;
+	G_UNLOCK (push);
+
+	if (push_account && tny_list_get_length (new_headers) > 0) {
+		ModestMailOperation *mail_op;
+
+		mail_op = modest_mail_operation_new (NULL);
+		modest_mail_operation_queue_add (modest_runtime_get_mail_operation_queue (),
+						 mail_op);
+		modest_mail_operation_update_account_from_push (mail_op, self->account_name,
+								self->folder, new_headers,
+								push_account->callback,
+								push_account->user_data);
+		g_object_unref (mail_op);
+	}
+
+	gdk_threads_leave ();
+
+	g_object_unref (new_headers);
+	return FALSE;
+}
+
+static void
+push_observer_update (TnyFolderObserver *observer, TnyFolderChange *change)
+{
+	PushObserver *self = (PushObserver *) observer;
+	TnyFolderChangeChanged changed;
+
+	changed = tny_folder_change_get_changed (change);
+
+	/* Keep the persistent counts and the search cache up to
+	   date, the server pushes the expunges as well */
+	modest_folder_counts_update_from_change (change);
+	modest_search_update_from_change (change);
+
+	if (changed & TNY_FOLDER_CHANGE_CHANGED_ADDED_HEADERS) {
+		TnyList *list;
+		TnyIterator *iter;
+
+		list = tny_simple_list_new ();
+		tny_folder_change_get_added_headers (change, list);
+
+		G_LOCK (push);
+		iter = tny_list_create_iterator (list);
+		while (!tny_iterator_is_done (iter)) {
+			GObject *header = tny_iterator_get_current (iter);
+			tny_list_append (self->new_headers, header);
+			g_object_unref (header);
+			tny_iterator_next (iter);
+		}
+		g_object_unref (iter);
+
+		if (self->flush_id == 0 && tny_list_get_length (self->new_headers) > 0)
+			self->flush_id = g_timeout_add_full (G_PRIORITY_DEFAULT, FLUSH_DELAY,
+							     push_observer_flush,
+							     g_object_ref (self),
+							     g_object_unref);
+		G_UNLOCK (push);
+
+		g_object_unref (list);
+	}
+}
+
+static void
+push_observer_init (PushObserver *self)
+{
+	self->new_headers = tny_simple_list_new ();
+}
+
+static void
+push_observer_finalize (GObject *object)
+{
+	PushObserver *self = (PushObserver *) object;
+
+	g_free (self->account_name);
+	if (self->folder)
+		g_object_unref (self->folder);
+	g_object_unref (self->new_headers);
+
+	G_OBJECT_CLASS (push_observer_parent_class)->finalize (object);
+}
+
+static void
+push_observer_iface_init (TnyFolderObserverIface *iface)
+{
+	iface->update = push_observer_update;
+}
+
+static void
+push_observer_class_init (PushObserverClass *klass)
+{
+	GObjectClass *object_class;
+
+	object_class = (GObjectClass*) klass;
+	object_class->finalize = push_observer_finalize;
+}
+
+static void
+push_observer_stop (PushObserver *self)
+{
+	G_LOCK (push);
+	if (self->flush_id) {
+		g_source_remove (self->flush_id);
+		self->flush_id = 0;
+	}
+	G_UNLOCK (push);
+
+	tny_folder_remove_observer (self->folder, TNY_FOLDER_OBSERVER (self));
+	g_object_unref (self);
+}
+
+static void
+push_account_free (PushAccount *push_account)
+{
+	g_slist_foreach (push_account->observers, (GFunc) push_observer_stop, NULL);
+	g_slist_free (push_account->observers);
+
+	if (g_signal_handler_is_connected (push_account->account, push_account->status_handler))
+		g_signal_handler_disconnect (push_account->account, push_account->status_handler);
+	g_object_unref (push_account->account);
+	g_free (push_account->account_name);
+	g_slice_free (PushAccount, push_account);
+}
+
+/* Refreshing a folder selects it on the server, and tinymail keeps
+ * an IDLE command running on the selected folder of an online
+ * account. It also gets the headers that arrived while we were not
+ * listening, our observer sees them as pushed ones */
+static void
+select_folder (TnyFolder *folder)
+{
+	tny_folder_refresh_async (folder, NULL, NULL, NULL);
+}
+
+static void
+on_connection_status_changed (TnyAccount *account,
+			      TnyConnectionStatus status,
+			      gpointer user_data)
+{
+	PushAccount *push_account = (PushAccount *) user_data;
+	GSList *node;
+
+	/* The IDLE does not survive a reconnection */
+	if (status != TNY_CONNECTION_STATUS_CONNECTED)
+		return;
+
+	for (node = push_account->observers; node; node = g_slist_next (node))
+		select_folder (((PushObserver *) node->data)->folder);
+}
+
+static void
+on_account_removed (ModestAccountMgr *mgr,
+		    const gchar *account_name,
+		    gpointer user_data)
+{
+	modest_push_monitor_stop (account_name);
+}
+
+static void
+on_account_updated (ModestAccountMgr *mgr,
+		    const gchar *account_name,
+		    gpointer user_data)
+{
+	/* The push mode was disabled in the account settings */
+	if (modest_push_monitor_is_active (account_name) &&
+	    !modest_account_mgr_get_push (mgr, account_name))
+		modest_push_monitor_stop (account_name);
+}
+
+static void
+push_account_watch_folder (PushAccount *push_account,
+			   TnyFolder *folder)
+{
+	PushObserver *observer;
+	GSList *node;
+
+	for (node = push_account->observers; node; node = g_slist_next (node)) {
+		if (((PushObserver *) node->data)->folder == folder)
+			return;
+	}
+
+	observer = g_object_new (push_observer_get_type (), NULL);
+	observer->account_name = g_strdup (push_account->account_name);
+	observer->folder = g_object_ref (folder);
+	push_account->observers = g_slist_prepend (push_account->observers, observer);
+
+	tny_folder_add_observer (folder, TNY_FOLDER_OBSERVER (observer));
+	select_folder (folder);
+}
+
+static void
+on_get_folders (TnyFolderStore *self,
+		gboolean canceled,
+		TnyList *list,
+		GError *err,
+		gpointer user_data)
+{
+	gchar *account_name = (gchar *) user_data;
+	PushAccount *push_account = NULL;
+	TnyIterator *iter;
+
+	/* The push mode could have been stopped meanwhile */
+	if (_push_accounts)
+		push_account = g_hash_table_lookup (_push_accounts, account_name);
+
+	if (!push_account || canceled || err) {
+		if (err)
+			g_warning ("%s: could not get the folders of %s: %s", __FUNCTION__,
+				   account_name, err->message);
+		g_free (account_name);
+		return;
+	}
+
+	iter = tny_list_create_iterator (list);
+	while (!tny_iterator_is_done (iter)) {
+		TnyFolder *folder = TNY_FOLDER (tny_iterator_get_current (iter));
+
+		if (tny_folder_get_folder_type (folder) == TNY_FOLDER_TYPE_INBOX)
+			push_account_watch_folder (push_account, folder);
+
+		g_object_unref (folder);
+		tny_iterator_next (iter);
+	}
+	g_object_unref (iter);
+	g_free (account_name);
+}
+
+gboolean
+modest_push_monitor_start (const gchar *account_name,
+			   UpdateAccountCallback callback,
+			   gpointer user_data)
+{
+	PushAccount *push_account;
+	TnyAccount *account;
+	TnyList *folders;
+
+	g_return_val_if_fail (account_name, FALSE);
+
+	if (modest_push_monitor_is_active (account_name))
+		return TRUE;
+
+	account = modest_tny_account_store_get_server_account (modest_runtime_get_account_store (),
+							       account_name,
+							       TNY_ACCOUNT_TYPE_STORE);
+	if (!account)
+		return FALSE;
+
+	/* Only IMAP servers can push */
+	if (modest_tny_account_get_protocol_type (account) != MODEST_PROTOCOLS_STORE_IMAP) {
+		g_object_unref (account);
+		return FALSE;
+	}
+
+	if (!_push_accounts) {
+		_push_accounts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+							(GDestroyNotify) push_account_free);
+		_account_removed_handler =
+			g_signal_connect (G_OBJECT (modest_runtime_get_account_mgr ()),
+					  "account_removed",
+					  G_CALLBACK (on_account_removed), NULL);
+		_account_updated_handler =
+			g_signal_connect (G_OBJECT (modest_runtime_get_account_mgr ()),
+					  "account_updated",
+					  G_CALLBACK (on_account_updated), NULL);
+	}
+
+	push_account = g_slice_new0 (PushAccount);
+	push_account->account_name = g_strdup (account_name);
+	push_account->account = account;
+	push_account->callback = callback;
+	push_account->user_data = user_data;
+	push_account->status_handler =
+		g_signal_connect (G_OBJECT (account), "connection-status-changed",
+				  G_CALLBACK (on_connection_status_changed), push_account);
+	g_hash_table_insert (_push_accounts, g_strdup (account_name), push_account);
+
+	/* Look for the INBOX, the folders are already known because
+	   the account was updated before, so do not refresh them */
+	folders = tny_simple_list_new ();
+	tny_folder_store_get_folders_async (TNY_FOLDER_STORE (account),
+					    folders, NULL, FALSE,
+					    on_get_folders,
+					    NULL, g_strdup (account_name));
+	g_object_unref (folders);
+
+	return TRUE;
+}
+
+void
+modest_push_monitor_stop (const gchar *account_name)
+{
+	g_return_if_fail (account_name);
+
+	if (_push_accounts)
+		g_hash_table_remove (_push_accounts, account_name);
+}
+
+void
+modest_push_monitor_stop_all (void)
+{
+	if (!_push_accounts)
+		return;
+
+	if (g_signal_handler_is_connected (modest_runtime_get_account_mgr (),
+					   _account_removed_handler))
+		g_signal_handler_disconnect (modest_runtime_get_account_mgr (),
+					     _account_removed_handler);
+	_account_removed_handler = 0;
+	if (g_signal_handler_is_connected (modest_runtime_get_account_mgr (),
+					   _account_updated_handler))
+		g_signal_handler_disconnect (modest_runtime_get_account_mgr (),
+					     _account_updated_handler);
+	_account_updated_handler = 0;
+
+	g_hash_table_destroy (_push_accounts);
+	_push_accounts = NULL;
+}
+
+gboolean
+modest_push_monitor_is_active (const gchar *account_name)
+{
+	g_return_val_if_fail (account_name, FALSE);
+
+	return _push_accounts && g_hash_table_lookup (_push_accounts, account_name);
+}
@@ -0,0 +1,96 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MODEST_PUSH_MONITOR_H__
+#define __MODEST_PUSH_MONITOR_H__
+
+#include <glib.h>
+#include "modest-mail-operation.h"
+
+G_BEGIN_DECLS
+
+/*
+ * push mode for IMAP accounts, enabled with the MODEST_ACCOUNT_PUSH
+ * setting. Instead of waiting for the next send&receive, the INBOX
+ * of the account is kept selected with a folder observer attached,
+ * so the IMAP IDLE command that tinymail keeps running on the
+ * selected folder reports the new messages as they arrive. Only one
+ * folder per account can be watched this way, as camel only IDLEs on
+ * the selected one. The new headers are processed by
+ * modest_mail_operation_update_account_from_push(), that is, they
+ * follow the same retrieval and notification path as the ones found
+ * by a send&receive, but without walking and refreshing all the
+ * folders of the account
+ */
+
+/**
+ * modest_push_monitor_start:
+ * @account_name: the id of a Modest account
+ * @callback: the #UpdateAccountCallback called with the new headers
+ * @user_data: generic data passed to @callback
+ *
+ * start the push mode for the store account of @account_name,
+ * watching its INBOX. It does nothing if the account is not an IMAP
+ * one, or if the push mode was already started for it
+ *
+ * Returns: %TRUE if the push mode is active for @account_name
+ */
+gboolean modest_push_monitor_start        (const gchar *account_name,
+					   UpdateAccountCallback callback,
+					   gpointer user_data);
+
+/**
+ * modest_push_monitor_stop:
+ * @account_name: the id of a Modest account
+ *
+ * stop the push mode for @account_name, if it was active. It's
+ * also stopped when the account is removed, or when its
+ * MODEST_ACCOUNT_PUSH setting is cleared
+ */
+void     modest_push_monitor_stop         (const gchar *account_name);
+
+/**
+ * modest_push_monitor_stop_all:
+ *
+ * stop the push mode of all the accounts, for example, before
+ * shutting down
+ */
+void     modest_push_monitor_stop_all     (void);
+
+/**
+ * modest_push_monitor_is_active:
+ * @account_name: the id of a Modest account
+ *
+ * Returns: %TRUE if the push mode was started for @account_name
+ */
+gboolean modest_push_monitor_is_active    (const gchar *account_name);
+
+G_END_DECLS
+
+#endif /*__MODEST_PUSH_MONITOR_H__*/
@@ -47,6 +47,9 @@
 #include <modest-icon-names.h>
 #include <modest-ui-actions.h>
 #include <modest-debug.h>
+#include <modest-folder-counts.h>
+#include <modest-address-index.h>
+#include <modest-push-monitor.h>
 
 static ModestSingletons       *_singletons    = NULL;
 
@@ -92,6 +95,13 @@ modest_runtime_uninit (void)
 
 	g_debug ("%s: cleaning up", __FUNCTION__);
 
+	/* write the pending folder counts and recipients */
+	modest_folder_counts_flush ();
+	modest_address_index_flush ();
+
+	/* stop watching the folders before the accounts go away */
+	modest_push_monitor_stop_all ();
+
 	if (_sig_handlers) {
 		modest_signal_mgr_disconnect_all_and_destroy (_sig_handlers);
 		_sig_handlers = NULL;
@@ -313,7 +323,8 @@ modest_runtime_get_debug_flags ()
 		{ "debug-objects",      MODEST_RUNTIME_DEBUG_OBJECTS },
 		{ "debug-signals",      MODEST_RUNTIME_DEBUG_SIGNALS },
 		{ "factory-settings",   MODEST_RUNTIME_DEBUG_FACTORY_SETTINGS},
-		{ "debug-code",         MODEST_RUNTIME_DEBUG_CODE}
+		{ "debug-code",         MODEST_RUNTIME_DEBUG_CODE},
+		{ "startup-trace",      MODEST_RUNTIME_DEBUG_STARTUP_TRACE}
 	};
 	const gchar *str;
 	static ModestRuntimeDebugFlags debug_flags = -1;
@@ -57,7 +57,8 @@ typedef enum {
 	MODEST_RUNTIME_DEBUG_OBJECTS               = 1 << 2, /* for g_type_init */
 	MODEST_RUNTIME_DEBUG_SIGNALS               = 1 << 3, /* for g_type_init */
 	MODEST_RUNTIME_DEBUG_FACTORY_SETTINGS      = 1 << 4, /* reset to factory defaults */
-	MODEST_RUNTIME_DEBUG_CODE                  = 1 << 5  /* print various debugging messages */
+	MODEST_RUNTIME_DEBUG_CODE                  = 1 << 5, /* print various debugging messages */
+	MODEST_RUNTIME_DEBUG_STARTUP_TRACE         = 1 << 6  /* dump a trace of the startup phases */
 } ModestRuntimeDebugFlags;
 
 /**
@@ -97,6 +98,8 @@ gboolean modest_runtime_uninit (void);
  *  g_type_init_with_debug_flags
  *  - "debug-signals": track the use of (g)signals in the program. this option influences
  *  g_type_init_with_debug_flags
+ * - "startup-trace": write a trace of the startup phases to a file in the
+ *  temporary dir (see modest-startup-trace.h)
  * if you would want to track signals and log actions, you could do something like:
  *  MODEST_DEBUG="log-actions:track-signals" ./modest
  * NOTE that the flags will stay the same during the run of the program, even
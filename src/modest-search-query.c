@@ -0,0 +1,949 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <time.h>
+#include <glib/gi18n.h>
+#include "modest-search-query.h"
+#include "modest-folder-counts.h"
+#include "modest-string-pool.h"
+
+/* keys of the casefolded fields cached in the headers */
+#define SUBJECT_FOLD_KEY "_subject_modest_search_query"
+#define FROM_FOLD_KEY    "_from_modest_search_query"
+#define TO_FOLD_KEY      "_to_modest_search_query"
+#define CC_FOLD_KEY      "_cc_modest_search_query"
+#define BCC_FOLD_KEY     "_bcc_modest_search_query"
+
+/* relative costs of the predicates, used to order the plan */
+#define COST_SUMMARY 1
+#define COST_FIELD   10
+#define COST_BODY    1000
+
+typedef enum {
+	NODE_AND,
+	NODE_OR,
+	NODE_NOT,
+	NODE_TEXT,
+	NODE_DATE,
+	NODE_SIZE,
+	NODE_FLAG
+} NodeType;
+
+typedef enum {
+	FIELD_SUBJECT = 1 << 0,
+	FIELD_FROM    = 1 << 1,
+	FIELD_TO      = 1 << 2,
+	FIELD_CC      = 1 << 3,
+	FIELD_BCC     = 1 << 4,
+	FIELD_BODY    = 1 << 5
+} Field;
+
+#define FIELD_HEADERS (FIELD_SUBJECT | FIELD_FROM | FIELD_TO | FIELD_CC | FIELD_BCC)
+
+typedef struct _QueryNode QueryNode;
+struct _QueryNode {
+	NodeType   type;
+	guint      cost;
+
+	/* NODE_AND, NODE_OR, NODE_NOT */
+	GPtrArray *children;
+
+	/* NODE_TEXT */
+	guint      fields;
+	gchar     *term;	/* casefolded */
+
+	/* NODE_DATE. end is (time_t) -1 if there is no upper limit */
+	time_t     start, end;
+
+	/* NODE_SIZE */
+	guint32    minsize;
+
+	/* NODE_FLAG */
+	TnyHeaderFlags flag;
+	gboolean   flag_set;
+};
+
+struct _ModestSearchQuery {
+	/* NULL matches nothing */
+	QueryNode *root;
+};
+
+typedef enum {
+	TOKEN_WORD,
+	TOKEN_OPEN,
+	TOKEN_CLOSE
+} TokenType;
+
+typedef struct {
+	TokenType type;
+	gchar    *text;
+	gboolean  quoted;
+	gboolean  negated;	/* it had a leading - */
+	/* length of the field: prefix, 0 if there's none */
+	gsize     field_len;
+} Token;
+
+typedef struct {
+	GArray *tokens;
+	guint   pos;
+} Parser;
+
+typedef struct {
+	TnyHeader     *header;
+	TnyHeaderFlags flags;
+	TnyMsg        *msg;	/* NULL while matching the summary */
+	ModestSearchQueryBodyFunc body_func;
+	gpointer       user_data;
+} MatchContext;
+
+static QueryNode *parse_or (Parser *parser);
+
+static QueryNode *
+node_new (NodeType type)
+{
+	QueryNode *node;
+
+	node = g_slice_new0 (QueryNode);
+	node->type = type;
+	if (type == NODE_AND || type == NODE_OR || type == NODE_NOT)
+		node->children = g_ptr_array_new ();
+
+	return node;
+}
+
+static void
+node_free (QueryNode *node)
+{
+	if (node->children) {
+		g_ptr_array_foreach (node->children, (GFunc) node_free, NULL);
+		g_ptr_array_free (node->children, TRUE);
+	}
+	g_free (node->term);
+	g_slice_free (QueryNode, node);
+}
+
+/* AND and OR are associative, so we keep them flat */
+static QueryNode *
+node_append (NodeType type, QueryNode *node, QueryNode *child)
+{
+	if (!node)
+		return child;
+	if (!child)
+		return node;
+
+	if (node->type != type) {
+		QueryNode *parent = node_new (type);
+		g_ptr_array_add (parent->children, node);
+		node = parent;
+	}
+	g_ptr_array_add (node->children, child);
+
+	return node;
+}
+
+static QueryNode *
+text_node_new (guint fields, const gchar *text)
+{
+	QueryNode *node;
+
+	if (!text || text[0] == '\0')
+		return NULL;
+
+	node = node_new (NODE_TEXT);
+	node->fields = fields;
+	node->term = g_utf8_casefold (text, -1);
+
+	return node;
+}
+
+static QueryNode *
+date_node_new (time_t start, time_t end)
+{
+	QueryNode *node;
+
+	node = node_new (NODE_DATE);
+	node->start = start;
+	node->end = end;
+
+	return node;
+}
+
+static QueryNode *
+flag_node_new (TnyHeaderFlags flag, gboolean set)
+{
+	QueryNode *node;
+
+	node = node_new (NODE_FLAG);
+	node->flag = flag;
+	node->flag_set = set;
+
+	return node;
+}
+
+/* the local midnight that starts the day @days_before days before
+   the one of @t */
+static time_t
+local_midnight (time_t t, gint days_before)
+{
+	struct tm tm;
+
+	localtime_r (&t, &tm);
+	tm.tm_hour = 0;
+	tm.tm_min = 0;
+	tm.tm_sec = 0;
+	tm.tm_mday -= days_before;
+	tm.tm_isdst = -1;
+
+	return mktime (&tm);
+}
+
+/* the last second of the local day that starts at @midnight, that
+   is not always 24 hours later because of the DST changes */
+static time_t
+local_day_end (time_t midnight)
+{
+	return local_midnight (midnight, -1) - 1;
+}
+
+static gboolean
+parse_date_side (const gchar *string, time_t *date_side)
+{
+	gchar *today;
+	gchar *yesterday;
+	gchar *casefold;
+	GDate *date;
+	gboolean result = FALSE;
+
+	if (string && string[0] == '\0') {
+		*date_side = 0;
+		return TRUE;
+	}
+
+	casefold = g_utf8_casefold (string, -1);
+	today = g_utf8_casefold (dgettext ("gtk20", "Today"), -1);
+	yesterday = g_utf8_casefold (dgettext ("gtk20", "Yesterday"), -1);
+	date = g_date_new ();
+
+	/* A day is always its local midnight, like the parsed dates */
+	if (g_utf8_collate (casefold, today) == 0) {
+		*date_side = local_midnight (time (NULL), 0);
+		result = TRUE;
+		goto frees;
+	}
+
+	if (g_utf8_collate (casefold, yesterday) == 0) {
+		*date_side = local_midnight (time (NULL), 1);
+		result = TRUE;
+		goto frees;
+	}
+
+	g_date_set_parse (date, string);
+	if (g_date_valid (date)) {
+		struct tm tm = {0};
+		g_date_to_struct_tm (date, &tm);
+		*date_side = mktime (&tm);
+		
+		result = TRUE;
+		goto frees;
+	}
+frees:
+	g_free (today);
+	g_free (yesterday);
+	g_free (casefold);
+	g_date_free (date);
+
+	return result;
+}
+
+static gboolean
+parse_date_range (const gchar *string, time_t *date_range_start, time_t *date_range_end)
+{
+	gchar ** parts;
+	gboolean valid;
+
+	parts = g_strsplit (string, "..", 2);
+	valid = TRUE;
+
+	if (g_strv_length (parts) != 2) {
+		valid = FALSE;
+		goto frees;
+	}
+
+	if (!parse_date_side (parts[0], date_range_start)) {
+		valid = FALSE;
+		goto frees;
+	}
+
+	if (parse_date_side (parts[1], date_range_end)) {
+		if (*date_range_end == 0) {
+			*date_range_end = (time_t) -1;
+		} else {
+			*date_range_end = local_day_end (*date_range_end);
+		}
+	} else {
+		valid = FALSE;
+		goto frees;
+	}
+		
+frees:
+	g_strfreev (parts);
+	return valid;
+}
+
+static gboolean
+parse_size (const gchar *string, guint32 *size)
+{
+	gchar *end;
+	guint64 value;
+
+	value = g_ascii_strtoull (string, &end, 10);
+	if (end == string)
+		return FALSE;
+
+	switch (g_ascii_tolower (*end)) {
+	case 'k':
+		value *= 1024;
+		end++;
+		break;
+	case 'm':
+		value *= 1024 * 1024;
+		end++;
+		break;
+	}
+
+	if (*end != '\0' || value > G_MAXUINT32)
+		return FALSE;
+
+	*size = (guint32) value;
+	return TRUE;
+}
+
+/* Returns TRUE if @field is known. In that case @node is set, and
+   might be NULL if the value is still empty or wrong */
+static gboolean
+parse_field_term (const gchar *field, const gchar *value, QueryNode **node)
+{
+	time_t start, end;
+	guint32 size;
+
+	*node = NULL;
+
+	if (!strcmp (field, "subject")) {
+		*node = text_node_new (FIELD_SUBJECT, value);
+	} else if (!strcmp (field, "from")) {
+		*node = text_node_new (FIELD_FROM, value);
+	} else if (!strcmp (field, "to")) {
+		*node = text_node_new (FIELD_TO, value);
+	} else if (!strcmp (field, "cc")) {
+		*node = text_node_new (FIELD_CC, value);
+	} else if (!strcmp (field, "bcc")) {
+		*node = text_node_new (FIELD_BCC, value);
+	} else if (!strcmp (field, "body")) {
+		*node = text_node_new (FIELD_BODY, value);
+	} else if (!strcmp (field, "date")) {
+		if (strstr (value, "..")) {
+			if (parse_date_range (value, &start, &end))
+				*node = date_node_new (start, end);
+		} else if (value[0] != '\0' && parse_date_side (value, &start)) {
+			*node = date_node_new (start, local_day_end (start));
+		}
+	} else if (!strcmp (field, "before")) {
+		if (value[0] != '\0' && parse_date_side (value, &end))
+			*node = date_node_new (0, end - 1);
+	} else if (!strcmp (field, "after")) {
+		if (value[0] != '\0' && parse_date_side (value, &start))
+			*node = date_node_new (local_day_end (start) + 1, (time_t) -1);
+	} else if (!strcmp (field, "size")) {
+		if (parse_size (value, &size)) {
+			*node = node_new (NODE_SIZE);
+			(*node)->minsize = size;
+		}
+	} else if (!strcmp (field, "has")) {
+		if (!g_ascii_strncasecmp (value, "attachment", strlen ("attachment")))
+			*node = flag_node_new (TNY_HEADER_FLAG_ATTACHMENTS, TRUE);
+	} else if (!strcmp (field, "is")) {
+		if (!g_ascii_strcasecmp (value, "unread"))
+			*node = flag_node_new (TNY_HEADER_FLAG_SEEN, FALSE);
+		else if (!g_ascii_strcasecmp (value, "read"))
+			*node = flag_node_new (TNY_HEADER_FLAG_SEEN, TRUE);
+	} else {
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static QueryNode *
+parse_term (Token *token)
+{
+	QueryNode *node;
+	time_t start, end;
+
+	if (token->field_len > 0) {
+		gchar *field;
+		gboolean known;
+
+		field = g_ascii_strdown (token->text, token->field_len);
+		known = parse_field_term (field, token->text + token->field_len + 1, &node);
+		g_free (field);
+
+		if (known)
+			return node;
+	}
+
+	/* A bare date range, the header view always supported them */
+	if (!token->quoted && strstr (token->text, "..") && strcmp (token->text, "..") &&
+	    parse_date_range (token->text, &start, &end))
+		return date_node_new (start, end);
+
+	return text_node_new (FIELD_HEADERS, token->text);
+}
+
+static GArray *
+tokenize (const gchar *text)
+{
+	GArray *tokens;
+	const gchar *p = text;
+
+	tokens = g_array_new (FALSE, TRUE, sizeof (Token));
+
+	while (*p) {
+		Token token = { TOKEN_WORD, NULL, FALSE, FALSE, 0 };
+		GString *word;
+
+		if (g_ascii_isspace (*p)) {
+			p++;
+			continue;
+		}
+
+		if (*p == '(' || *p == ')') {
+			token.type = (*p == '(') ? TOKEN_OPEN : TOKEN_CLOSE;
+			g_array_append_val (tokens, token);
+			p++;
+			continue;
+		}
+
+		/* -term is NOT term, but a lone - is an operator */
+		if (*p == '-' && p[1] && !g_ascii_isspace (p[1]) && p[1] != '(' && p[1] != ')') {
+			token.negated = TRUE;
+			p++;
+		}
+
+		word = g_string_new (NULL);
+		while (*p && !g_ascii_isspace (*p) && *p != '(' && *p != ')') {
+			if (*p == '"') {
+				/* quoted text, up to the closing quote
+				   or the end of the query */
+				token.quoted = TRUE;
+				for (p++; *p && *p != '"'; p++)
+					g_string_append_c (word, *p);
+				if (*p)
+					p++;
+			} else {
+				if (*p == ':' && !token.quoted && token.field_len == 0 && word->len > 0)
+					token.field_len = word->len;
+				g_string_append_c (word, *p);
+				p++;
+			}
+		}
+		token.text = g_string_free (word, FALSE);
+		g_array_append_val (tokens, token);
+	}
+
+	return tokens;
+}
+
+static void
+tokens_free (GArray *tokens)
+{
+	guint i;
+
+	for (i = 0; i < tokens->len; i++)
+		g_free (g_array_index (tokens, Token, i).text);
+	g_array_free (tokens, TRUE);
+}
+
+static Token *
+parser_peek (Parser *parser)
+{
+	if (parser->pos >= parser->tokens->len)
+		return NULL;
+	return &g_array_index (parser->tokens, Token, parser->pos);
+}
+
+static gboolean
+token_is_operator (Token *token, const gchar *operator)
+{
+	return token && token->type == TOKEN_WORD && !token->quoted && !token->negated &&
+		!strcmp (token->text, operator);
+}
+
+static QueryNode *
+parse_unary (Parser *parser)
+{
+	Token *token;
+	QueryNode *node, *child;
+
+	token = parser_peek (parser);
+	if (!token || token->type == TOKEN_CLOSE)
+		return NULL;
+	parser->pos++;
+
+	if (token->type == TOKEN_OPEN) {
+		node = parse_or (parser);
+		/* a missing ) is fine, the user might still be typing */
+		if ((token = parser_peek (parser)) && token->type == TOKEN_CLOSE)
+			parser->pos++;
+		return node;
+	}
+
+	if (token->negated) {
+		child = parse_term (token);
+	} else if (token_is_operator (token, "NOT") || token_is_operator (token, "-")) {
+		child = parse_unary (parser);
+	} else {
+		return parse_term (token);
+	}
+
+	if (!child)
+		return NULL;
+
+	node = node_new (NODE_NOT);
+	g_ptr_array_add (node->children, child);
+
+	return node;
+}
+
+static QueryNode *
+parse_and (Parser *parser)
+{
+	QueryNode *node = NULL;
+	Token *token;
+
+	while ((token = parser_peek (parser)) && token->type != TOKEN_CLOSE) {
+		if (token_is_operator (token, "OR"))
+			break;
+		if (token_is_operator (token, "AND")) {
+			parser->pos++;
+			continue;
+		}
+		node = node_append (NODE_AND, node, parse_unary (parser));
+	}
+
+	return node;
+}
+
+static QueryNode *
+parse_or (Parser *parser)
+{
+	QueryNode *node = NULL;
+
+	do {
+		node = node_append (NODE_OR, node, parse_and (parser));
+		if (!token_is_operator (parser_peek (parser), "OR"))
+			break;
+		parser->pos++;
+	} while (TRUE);
+
+	return node;
+}
+
+static gint
+compare_node_cost (gconstpointer a, gconstpointer b)
+{
+	const QueryNode *node_a = *((const QueryNode **) a);
+	const QueryNode *node_b = *((const QueryNode **) b);
+
+	return (gint) node_a->cost - (gint) node_b->cost;
+}
+
+/* Computes the cost of every node and sorts the operands of AND and
+   OR so the cheapest ones are evaluated first. As evaluation stops as
+   soon as the result is known, the strings and the bodies are only
+   fetched if the summary flags did not decide */
+static void
+plan_node (QueryNode *node)
+{
+	guint i, fields;
+
+	switch (node->type) {
+	case NODE_AND:
+	case NODE_OR:
+	case NODE_NOT:
+		node->cost = 0;
+		for (i = 0; i < node->children->len; i++) {
+			QueryNode *child = g_ptr_array_index (node->children, i);
+			plan_node (child);
+			node->cost += child->cost;
+		}
+		if (node->type != NODE_NOT)
+			g_ptr_array_sort (node->children, compare_node_cost);
+		break;
+	case NODE_TEXT:
+		node->cost = 0;
+		for (fields = node->fields & FIELD_HEADERS; fields; fields &= fields - 1)
+			node->cost += COST_FIELD;
+		if (node->fields & FIELD_BODY)
+			node->cost += COST_BODY;
+		break;
+	default:
+		node->cost = COST_SUMMARY;
+		break;
+	}
+}
+
+static ModestSearchQuery *
+query_new (QueryNode *root)
+{
+	ModestSearchQuery *query;
+
+	if (root)
+		plan_node (root);
+
+	query = g_slice_new0 (ModestSearchQuery);
+	query->root = root;
+
+	return query;
+}
+
+ModestSearchQuery *
+modest_search_query_new (const gchar *text)
+{
+	Parser parser;
+	QueryNode *root = NULL;
+	Token *token;
+
+	g_return_val_if_fail (text, NULL);
+
+	parser.tokens = tokenize (text);
+	parser.pos = 0;
+
+	while (parser.pos < parser.tokens->len) {
+		root = node_append (NODE_AND, root, parse_or (&parser));
+
+		/* skip unbalanced ) */
+		if ((token = parser_peek (&parser)) && token->type == TOKEN_CLOSE)
+			parser.pos++;
+	}
+
+	tokens_free (parser.tokens);
+
+	if (!root)
+		return NULL;
+
+	return query_new (root);
+}
+
+ModestSearchQuery *
+modest_search_query_new_from_search (ModestSearch *search)
+{
+	QueryNode *root = NULL, *texts = NULL;
+
+	g_return_val_if_fail (search, NULL);
+
+	if (search->flags & (MODEST_SEARCH_BEFORE | MODEST_SEARCH_AFTER))
+		root = date_node_new ((search->flags & MODEST_SEARCH_AFTER) ? search->start_date : 0,
+				      (search->flags & MODEST_SEARCH_BEFORE) ? search->end_date : (time_t) -1);
+
+	if (search->flags & MODEST_SEARCH_SIZE) {
+		QueryNode *size = node_new (NODE_SIZE);
+		size->minsize = search->minsize;
+		root = node_append (NODE_AND, root, size);
+	}
+
+	if (search->flags & MODEST_SEARCH_SUBJECT)
+		texts = node_append (NODE_OR, texts, text_node_new (FIELD_SUBJECT, search->subject));
+	if (search->flags & MODEST_SEARCH_SENDER)
+		texts = node_append (NODE_OR, texts, text_node_new (FIELD_FROM, search->from));
+	if (search->flags & MODEST_SEARCH_RECIPIENT)
+		texts = node_append (NODE_OR, texts, text_node_new (FIELD_TO, search->recipient));
+	if (search->flags & MODEST_SEARCH_BODY)
+		texts = node_append (NODE_OR, texts, text_node_new (FIELD_BODY, search->body));
+
+	/* Searches always looked for some text, a search without
+	   texts returns nothing */
+	if (!texts) {
+		if (root)
+			node_free (root);
+		return query_new (NULL);
+	}
+
+	return query_new (node_append (NODE_AND, root, texts));
+}
+
+/* Evaluates @node for a folder with @counts. It can only tell that
+   nothing matches, so everything else is NEEDS_BODY (unknown) */
+static ModestSearchQueryResult
+eval_folder_node (QueryNode *node, ModestFolderCounts *counts)
+{
+	guint i;
+
+	switch (node->type) {
+	case NODE_AND:
+		for (i = 0; i < node->children->len; i++)
+			if (eval_folder_node (g_ptr_array_index (node->children, i), counts) ==
+			    MODEST_SEARCH_QUERY_NO_MATCH)
+				return MODEST_SEARCH_QUERY_NO_MATCH;
+		break;
+	case NODE_OR:
+		for (i = 0; i < node->children->len; i++)
+			if (eval_folder_node (g_ptr_array_index (node->children, i), counts) !=
+			    MODEST_SEARCH_QUERY_NO_MATCH)
+				return MODEST_SEARCH_QUERY_NEEDS_BODY;
+		return MODEST_SEARCH_QUERY_NO_MATCH;
+	case NODE_DATE:
+		if (counts->oldest_date == 0 && counts->newest_date == 0)
+			break;
+		if (counts->newest_date < node->start ||
+		    (node->end != (time_t) -1 && counts->oldest_date > node->end))
+			return MODEST_SEARCH_QUERY_NO_MATCH;
+		break;
+	case NODE_FLAG:
+		if (node->flag == TNY_HEADER_FLAG_SEEN) {
+			if (!node->flag_set && counts->unread_count == 0)
+				return MODEST_SEARCH_QUERY_NO_MATCH;
+			if (node->flag_set && counts->unread_count >= counts->all_count)
+				return MODEST_SEARCH_QUERY_NO_MATCH;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return MODEST_SEARCH_QUERY_NEEDS_BODY;
+}
+
+gboolean
+modest_search_query_folder_may_match (ModestSearchQuery *query,
+				      TnyFolder *folder)
+{
+	ModestFolderCounts counts;
+	gchar *url;
+	gboolean cached;
+
+	g_return_val_if_fail (query, FALSE);
+	g_return_val_if_fail (TNY_IS_FOLDER (folder), FALSE);
+
+	if (!query->root)
+		return FALSE;
+
+	url = tny_folder_get_url_string (folder);
+	cached = url && modest_folder_counts_lookup (url, &counts);
+	g_free (url);
+
+	/* Counts read from disk could be stale (nothing observes
+	   the Sent or Drafts folders, for example), we can only trust
+	   the ones of the folders seen during this session */
+	if (!cached || !counts.live)
+		return TRUE;
+
+	if (counts.all_count == 0)
+		return FALSE;
+
+	return eval_folder_node (query->root, &counts) != MODEST_SEARCH_QUERY_NO_MATCH;
+}
+
+/* Returns an interned string owned by the header. The casefolded
+   senders and subjects repeat a lot, so they're shared by all the
+   headers, and they live as long as the header does: a live filter
+   asks for the same fields of every row on each keystroke */
+static const gchar *
+get_folded_field (TnyHeader *header, Field field)
+{
+	const gchar *key, *folded;
+	gchar *value;
+
+	switch (field) {
+	case FIELD_SUBJECT: key = SUBJECT_FOLD_KEY; break;
+	case FIELD_FROM:    key = FROM_FOLD_KEY; break;
+	case FIELD_TO:      key = TO_FOLD_KEY; break;
+	case FIELD_CC:      key = CC_FOLD_KEY; break;
+	case FIELD_BCC:     key = BCC_FOLD_KEY; break;
+	default:
+		g_return_val_if_reached (NULL);
+	}
+
+	folded = g_object_get_data (G_OBJECT (header), key);
+	if (folded)
+		return folded;
+
+	switch (field) {
+	case FIELD_SUBJECT: value = tny_header_dup_subject (header); break;
+	case FIELD_FROM:    value = tny_header_dup_from (header); break;
+	case FIELD_TO:      value = tny_header_dup_to (header); break;
+	case FIELD_CC:      value = tny_header_dup_cc (header); break;
+	default:            value = tny_header_dup_bcc (header); break;
+	}
+
+	/* an empty string is cached too, so we don't ask again */
+	folded = modest_string_pool_intern_take (value ? g_utf8_casefold (value, -1) : g_strdup (""));
+	g_free (value);
+	g_object_set_data_full (G_OBJECT (header), key, (gpointer) folded,
+				(GDestroyNotify) modest_string_pool_unref);
+
+	return folded;
+}
+
+static ModestSearchQueryResult
+eval_text_node (QueryNode *node, MatchContext *ctx)
+{
+	guint field;
+
+	for (field = FIELD_SUBJECT; field <= FIELD_BCC; field <<= 1) {
+		if (!(node->fields & field))
+			continue;
+
+		if (strstr (get_folded_field (ctx->header, field), node->term))
+			return MODEST_SEARCH_QUERY_MATCH;
+	}
+
+	if (node->fields & FIELD_BODY) {
+		if (!ctx->msg)
+			return MODEST_SEARCH_QUERY_NEEDS_BODY;
+		if (ctx->body_func && ctx->body_func (ctx->msg, node->term, ctx->user_data))
+			return MODEST_SEARCH_QUERY_MATCH;
+	}
+
+	return MODEST_SEARCH_QUERY_NO_MATCH;
+}
+
+/* Three-valued evaluation, NEEDS_BODY being "unknown" */
+static ModestSearchQueryResult
+eval_node (QueryNode *node, MatchContext *ctx)
+{
+	ModestSearchQueryResult result, child_result;
+	time_t date;
+	guint i;
+
+	switch (node->type) {
+	case NODE_AND:
+		result = MODEST_SEARCH_QUERY_MATCH;
+		for (i = 0; i < node->children->len; i++) {
+			child_result = eval_node (g_ptr_array_index (node->children, i), ctx);
+			if (child_result == MODEST_SEARCH_QUERY_NO_MATCH)
+				return MODEST_SEARCH_QUERY_NO_MATCH;
+			if (child_result == MODEST_SEARCH_QUERY_NEEDS_BODY)
+				result = MODEST_SEARCH_QUERY_NEEDS_BODY;
+		}
+		return result;
+	case NODE_OR:
+		result = MODEST_SEARCH_QUERY_NO_MATCH;
+		for (i = 0; i < node->children->len; i++) {
+			child_result = eval_node (g_ptr_array_index (node->children, i), ctx);
+			if (child_result == MODEST_SEARCH_QUERY_MATCH)
+				return MODEST_SEARCH_QUERY_MATCH;
+			if (child_result == MODEST_SEARCH_QUERY_NEEDS_BODY)
+				result = MODEST_SEARCH_QUERY_NEEDS_BODY;
+		}
+		return result;
+	case NODE_NOT:
+		child_result = eval_node (g_ptr_array_index (node->children, 0), ctx);
+		if (child_result == MODEST_SEARCH_QUERY_MATCH)
+			return MODEST_SEARCH_QUERY_NO_MATCH;
+		if (child_result == MODEST_SEARCH_QUERY_NO_MATCH)
+			return MODEST_SEARCH_QUERY_MATCH;
+		return MODEST_SEARCH_QUERY_NEEDS_BODY;
+	case NODE_TEXT:
+		return eval_text_node (node, ctx);
+	case NODE_DATE:
+		date = tny_header_get_date_sent (ctx->header);
+		if (date < node->start || (node->end != (time_t) -1 && date > node->end))
+			return MODEST_SEARCH_QUERY_NO_MATCH;
+		return MODEST_SEARCH_QUERY_MATCH;
+	case NODE_SIZE:
+		if (tny_header_get_message_size (ctx->header) < node->minsize)
+			return MODEST_SEARCH_QUERY_NO_MATCH;
+		return MODEST_SEARCH_QUERY_MATCH;
+	case NODE_FLAG:
+		if (((ctx->flags & node->flag) != 0) != node->flag_set)
+			return MODEST_SEARCH_QUERY_NO_MATCH;
+		return MODEST_SEARCH_QUERY_MATCH;
+	}
+
+	g_return_val_if_reached (MODEST_SEARCH_QUERY_NO_MATCH);
+}
+
+ModestSearchQueryResult
+modest_search_query_match_header (ModestSearchQuery *query,
+				  TnyHeader *header)
+{
+	MatchContext ctx = { 0 };
+
+	g_return_val_if_fail (query, MODEST_SEARCH_QUERY_NO_MATCH);
+	g_return_val_if_fail (TNY_IS_HEADER (header), MODEST_SEARCH_QUERY_NO_MATCH);
+
+	if (!query->root)
+		return MODEST_SEARCH_QUERY_NO_MATCH;
+
+	ctx.header = header;
+	ctx.flags = tny_header_get_flags (header);
+
+	return eval_node (query->root, &ctx);
+}
+
+gboolean
+modest_search_query_match_msg (ModestSearchQuery *query,
+			       TnyHeader *header,
+			       TnyMsg *msg,
+			       ModestSearchQueryBodyFunc body_func,
+			       gpointer user_data)
+{
+	MatchContext ctx;
+
+	g_return_val_if_fail (query, FALSE);
+	g_return_val_if_fail (TNY_IS_HEADER (header), FALSE);
+	g_return_val_if_fail (TNY_IS_MSG (msg), FALSE);
+
+	if (!query->root)
+		return FALSE;
+
+	ctx.header = header;
+	ctx.flags = tny_header_get_flags (header);
+	ctx.msg = msg;
+	ctx.body_func = body_func;
+	ctx.user_data = user_data;
+
+	return eval_node (query->root, &ctx) == MODEST_SEARCH_QUERY_MATCH;
+}
+
+void
+modest_search_query_free (ModestSearchQuery *query)
+{
+	if (!query)
+		return;
+
+	if (query->root)
+		node_free (query->root);
+	g_slice_free (ModestSearchQuery, query);
+}
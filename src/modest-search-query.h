@@ -0,0 +1,163 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MODEST_SEARCH_QUERY_H__
+#define __MODEST_SEARCH_QUERY_H__
+
+#include <glib.h>
+#include <tny-folder.h>
+#include <tny-header.h>
+#include <tny-msg.h>
+#include "modest-search.h"
+
+G_BEGIN_DECLS
+
+/*
+ * a compiled search query, shared by the D-Bus search and the header
+ * view filter. The query language is a list of terms, implicitly
+ * ANDed, that can be combined with AND, OR, NOT (or a leading -) and
+ * parentheses. A term is either a bare word or "quoted text", that
+ * is looked for in the subject and the addresses, or a field:value
+ * pair:
+ *
+ *   subject: from: to: cc: bcc: body:    text in that field
+ *   date:START..END date:DAY             date ranges, either side can be empty
+ *   before:DAY after:DAY
+ *   size:N                               minimum size, with k or M suffixes
+ *   has:attachment is:unread is:read
+ *
+ * The predicates are ordered by cost, so the flags and dates are
+ * checked before any string is fetched, and the message bodies are
+ * only looked at for the headers that could still match
+ */
+
+typedef struct _ModestSearchQuery ModestSearchQuery;
+
+typedef enum {
+	MODEST_SEARCH_QUERY_NO_MATCH,
+	MODEST_SEARCH_QUERY_MATCH,
+	MODEST_SEARCH_QUERY_NEEDS_BODY
+} ModestSearchQueryResult;
+
+/**
+ * ModestSearchQueryBodyFunc:
+ * @msg: the message to look into
+ * @term: the casefolded text to look for
+ * @user_data: the data passed to modest_search_query_match_msg
+ *
+ * Returns: %TRUE if the body of @msg contains @term
+ */
+typedef gboolean (*ModestSearchQueryBodyFunc) (TnyMsg *msg,
+					       const gchar *term,
+					       gpointer user_data);
+
+/**
+ * modest_search_query_new:
+ * @text: a query, see above
+ *
+ * compiles @text. The parser is tolerant with incomplete queries
+ * (unbalanced parentheses, trailing operators...) because they're
+ * typed live in the header view
+ *
+ * Returns: a new #ModestSearchQuery, or %NULL if @text has no terms
+ */
+ModestSearchQuery*      modest_search_query_new              (const gchar *text);
+
+/**
+ * modest_search_query_new_from_search:
+ * @search: a #ModestSearch
+ *
+ * compiles the criteria of @search: a message matches if it passes
+ * the date and size limits and contains any of the texts of @search.
+ *
+ * Returns: a new #ModestSearchQuery
+ */
+ModestSearchQuery*      modest_search_query_new_from_search  (ModestSearch *search);
+
+/**
+ * modest_search_query_folder_may_match:
+ * @query: a #ModestSearchQuery
+ * @folder: a #TnyFolder
+ *
+ * checks the cached counts and date range of @folder (see
+ * #ModestFolderCounts) without loading its summary. Only the counts
+ * updated from the folder during this session are trusted, for the
+ * rest the folder may always match
+ *
+ * Returns: %FALSE if no message of @folder can match @query
+ */
+gboolean                modest_search_query_folder_may_match (ModestSearchQuery *query,
+							      TnyFolder *folder);
+
+/**
+ * modest_search_query_match_header:
+ * @query: a #ModestSearchQuery
+ * @header: a #TnyHeader
+ *
+ * evaluates @query using only the summary of the message. The
+ * casefolded header fields are kept in @header, so evaluating it
+ * again (i.e. when refiltering) is cheap
+ *
+ * Returns: #MODEST_SEARCH_QUERY_NEEDS_BODY if the result depends on
+ * the contents of the message
+ */
+ModestSearchQueryResult modest_search_query_match_header     (ModestSearchQuery *query,
+							      TnyHeader *header);
+
+/**
+ * modest_search_query_match_msg:
+ * @query: a #ModestSearchQuery
+ * @header: the #TnyHeader of @msg
+ * @msg: a #TnyMsg
+ * @body_func: the function that looks for text in @msg
+ * @user_data: data for @body_func
+ *
+ * evaluates @query with the message contents, usually after
+ * modest_search_query_match_header returned
+ * #MODEST_SEARCH_QUERY_NEEDS_BODY
+ *
+ * Returns: %TRUE if the message matches
+ */
+gboolean                modest_search_query_match_msg        (ModestSearchQuery *query,
+							      TnyHeader *header,
+							      TnyMsg *msg,
+							      ModestSearchQueryBodyFunc body_func,
+							      gpointer user_data);
+
+/**
+ * modest_search_query_free:
+ * @query: a #ModestSearchQuery
+ *
+ * frees @query
+ */
+void                    modest_search_query_free             (ModestSearchQuery *query);
+
+G_END_DECLS
+
+#endif /* __MODEST_SEARCH_QUERY_H__ */
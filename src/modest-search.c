@@ -53,17 +53,71 @@
 #include "modest-tny-mime-part.h"
 #include "modest-tny-folder.h"
 #include "modest-search.h"
+#include "modest-search-query.h"
+#include "modest-folder-counts.h"
 #include "modest-runtime.h"
 #include "modest-platform.h"
 
+/* Number of recent searches whose results are kept, see
+ * search_cache_lookup */
+#define SEARCH_CACHE_SIZE 8
+
+typedef struct {
+	gchar *key;
+	ModestSearchFlags flags;
+	gchar *folder;
+	/* casefolded */
+	gchar *subject;
+	gchar *from;
+	gchar *recipient;
+	gchar *body;
+	time_t start_date, end_date;
+	guint32 minsize;
+} SearchCriteria;
+
+typedef struct {
+	gint ref_count;
+	SearchCriteria *criteria;
+	/* folder url -> FolderHits. Folders without hits are there
+	   with a NULL value, folders that are not there have to be
+	   searched again */
+	GHashTable *folders;
+} SearchCacheEntry;
+
+/* The hits of a folder. They're allocated together, with the strings
+ * in a chunk and the folder url and name stored once, and shared by
+ * the cache and the results of the searches */
+typedef struct {
+	gint          ref_count;	/* atomic */
+	GStringChunk *strings;
+	const gchar  *url;
+	const gchar  *name;
+	GArray       *hits;		/* ModestSearchResultHit */
+} FolderHits;
+
+struct _ModestSearchResult {
+	GPtrArray *folders;	/* FolderHits */
+};
+
 typedef struct 
 {
 	guint pending_calls;
-	GList *msg_hits;
+	ModestSearchResult *result;
 	ModestSearch *search;
+	ModestSearchQuery *query;
 	ModestSearchCallback callback;
 	gpointer user_data;
 	TnyList *all_folders;
+
+	/* the cached search we can reuse, and the one we fill */
+	SearchCacheEntry *base;
+	gboolean base_is_exact;
+	SearchCacheEntry *entry;
+
+	/* state of the folder being searched */
+	FolderHits *folder_hits;
+	guint folder_generation;
+	gboolean refiltering;
 } SearchHelper;
 
 static SearchHelper *create_helper (ModestSearchCallback callback, 
@@ -85,25 +139,423 @@ g_strdup_or_null (const gchar *str)
 	return string;
 }
 
-static GList*
-add_hit (GList *list, TnyHeader *header, TnyFolder *folder)
+/* folder observers might be notified outside the main thread */
+G_LOCK_DEFINE_STATIC (search_cache);
+static GQueue _search_cache = G_QUEUE_INIT; /* most recently used first */
+static guint  _search_cache_generation = 0;
+
+/* bytes of the first block of strings of a folder */
+#define FOLDER_HITS_CHUNK_SIZE 1024
+
+static FolderHits *
+folder_hits_new (TnyFolder *folder)
+{
+	FolderHits *folder_hits;
+	gchar *url;
+
+	folder_hits = g_slice_new (FolderHits);
+	folder_hits->ref_count = 1;
+	folder_hits->strings = g_string_chunk_new (FOLDER_HITS_CHUNK_SIZE);
+	folder_hits->hits = g_array_new (FALSE, FALSE, sizeof (ModestSearchResultHit));
+
+	url = tny_folder_get_url_string (folder);
+	if (!url)
+		g_warning ("%s: tny_folder_get_url_string(): returned NULL for folder. Folder name=%s\n",
+			   __FUNCTION__, tny_folder_get_name (folder));
+	folder_hits->url = g_string_chunk_insert (folder_hits->strings, url ? url : "");
+	folder_hits->name = g_string_chunk_insert (folder_hits->strings,
+						   tny_folder_get_name (folder) ? tny_folder_get_name (folder) : "");
+	g_free (url);
+
+	return folder_hits;
+}
+
+static FolderHits *
+folder_hits_ref (FolderHits *folder_hits)
+{
+	if (folder_hits)
+		g_atomic_int_inc (&folder_hits->ref_count);
+	return folder_hits;
+}
+
+static void
+folder_hits_unref (FolderHits *folder_hits)
+{
+	if (!folder_hits || !g_atomic_int_dec_and_test (&folder_hits->ref_count))
+		return;
+
+	g_string_chunk_free (folder_hits->strings);
+	g_array_free (folder_hits->hits, TRUE);
+	g_slice_free (FolderHits, folder_hits);
+}
+
+/* Takes ownership of @str. The senders and subjects repeat a lot in
+   a folder, so they're stored once */
+static const gchar *
+folder_hits_take_string (FolderHits *folder_hits, gchar *str)
+{
+	const gchar *stored;
+
+	stored = g_string_chunk_insert_const (folder_hits->strings, str ? str : "");
+	g_free (str);
+
+	return stored;
+}
+
+static ModestSearchResult *
+search_result_new (void)
+{
+	ModestSearchResult *result;
+
+	result = g_slice_new (ModestSearchResult);
+	result->folders = g_ptr_array_new ();
+
+	return result;
+}
+
+static void
+search_result_free (ModestSearchResult *result)
+{
+	g_ptr_array_foreach (result->folders, (GFunc) folder_hits_unref, NULL);
+	g_ptr_array_free (result->folders, TRUE);
+	g_slice_free (ModestSearchResult, result);
+}
+
+/* Takes the reference of @folder_hits */
+static void
+search_result_add_folder_hits (ModestSearchResult *result, FolderHits *folder_hits)
 {
-	ModestSearchResultHit *hit;
-	TnyHeaderFlags   flags;
-	char            *furl;
-	char            *msg_url;
-	char      *uid;
-	char      *subject;
-	char      *sender;
+	if (folder_hits)
+		g_ptr_array_add (result->folders, folder_hits);
+}
 
-	hit = g_slice_new0 (ModestSearchResultHit);
+guint
+modest_search_result_get_length (ModestSearchResult *result)
+{
+	guint i, length = 0;
+
+	g_return_val_if_fail (result, 0);
 
-	furl = tny_folder_get_url_string (folder);
-	g_debug ("%s: folder URL=%s\n", __FUNCTION__, furl);
-	if (!furl) {
-		g_warning ("%s: tny_folder_get_url_string(): returned NULL for folder. Folder name=%s\n", __FUNCTION__, tny_folder_get_name (folder));
+	for (i = 0; i < result->folders->len; i++)
+		length += ((FolderHits *) g_ptr_array_index (result->folders, i))->hits->len;
+
+	return length;
+}
+
+void
+modest_search_result_foreach (ModestSearchResult *result,
+			      ModestSearchResultFunc func,
+			      gpointer user_data)
+{
+	guint i, j;
+
+	g_return_if_fail (result && func);
+
+	for (i = 0; i < result->folders->len; i++) {
+		FolderHits *folder_hits = g_ptr_array_index (result->folders, i);
+
+		for (j = 0; j < folder_hits->hits->len; j++)
+			func (&g_array_index (folder_hits->hits, ModestSearchResultHit, j), user_data);
 	}
-	
+}
+
+const gchar *
+modest_search_result_hit_get_msgid (const ModestSearchResultHit *hit, GString *buffer)
+{
+	g_return_val_if_fail (hit && buffer, NULL);
+
+	g_string_assign (buffer, hit->folder_url);
+	g_string_append_c (buffer, '/');
+	g_string_append (buffer, hit->uid);
+
+	return buffer->str;
+}
+
+static gchar *
+casefold_or_null (const gchar *str)
+{
+	return str ? g_utf8_casefold (str, -1) : NULL;
+}
+
+static SearchCriteria *
+search_criteria_new (ModestSearch *search)
+{
+	SearchCriteria *criteria;
+
+	criteria = g_slice_new0 (SearchCriteria);
+	criteria->flags = search->flags;
+	criteria->folder = g_strdup_or_null (search->folder);
+	if (search->flags & MODEST_SEARCH_SUBJECT)
+		criteria->subject = casefold_or_null (search->subject);
+	if (search->flags & MODEST_SEARCH_SENDER)
+		criteria->from = casefold_or_null (search->from);
+	if (search->flags & MODEST_SEARCH_RECIPIENT)
+		criteria->recipient = casefold_or_null (search->recipient);
+	if (search->flags & MODEST_SEARCH_BODY)
+		criteria->body = casefold_or_null (search->body);
+	if (search->flags & MODEST_SEARCH_AFTER)
+		criteria->start_date = search->start_date;
+	if (search->flags & MODEST_SEARCH_BEFORE)
+		criteria->end_date = search->end_date;
+	if (search->flags & MODEST_SEARCH_SIZE)
+		criteria->minsize = search->minsize;
+
+	criteria->key = g_strdup_printf ("%d\n%s\n%ld\n%ld\n%u\n%s\n%s\n%s\n%s",
+					 (gint) criteria->flags,
+					 criteria->folder ? criteria->folder : "",
+					 (glong) criteria->start_date,
+					 (glong) criteria->end_date,
+					 criteria->minsize,
+					 criteria->subject ? criteria->subject : "",
+					 criteria->from ? criteria->from : "",
+					 criteria->recipient ? criteria->recipient : "",
+					 criteria->body ? criteria->body : "");
+
+	return criteria;
+}
+
+static void
+search_criteria_free (SearchCriteria *criteria)
+{
+	g_free (criteria->key);
+	g_free (criteria->folder);
+	g_free (criteria->subject);
+	g_free (criteria->from);
+	g_free (criteria->recipient);
+	g_free (criteria->body);
+	g_slice_free (SearchCriteria, criteria);
+}
+
+static gboolean
+term_extends (ModestSearchFlags flag, const gchar *term, 
+	      const SearchCriteria *old, const gchar *old_term)
+{
+	if (!term)
+		return TRUE;
+	if (!(old->flags & flag) || !old_term)
+		return FALSE;
+	return strstr (term, old_term) != NULL;
+}
+
+/* Returns TRUE if every message matching @criteria also matched
+   @old, so the hits of @old only need to be filtered again. That's
+   what happens when a search widget refines the query while the user
+   types */
+static gboolean
+search_criteria_extends (const SearchCriteria *criteria, const SearchCriteria *old)
+{
+	/* We don't know how the OGS queries relate */
+	if ((criteria->flags | old->flags) & MODEST_SEARCH_USE_OGS)
+		return FALSE;
+
+	if (g_strcmp0 (criteria->folder, old->folder))
+		return FALSE;
+
+	if ((old->flags & MODEST_SEARCH_AFTER) &&
+	    (!(criteria->flags & MODEST_SEARCH_AFTER) || criteria->start_date < old->start_date))
+		return FALSE;
+	if ((old->flags & MODEST_SEARCH_BEFORE) &&
+	    (!(criteria->flags & MODEST_SEARCH_BEFORE) || criteria->end_date > old->end_date))
+		return FALSE;
+	if ((old->flags & MODEST_SEARCH_SIZE) &&
+	    (!(criteria->flags & MODEST_SEARCH_SIZE) || criteria->minsize < old->minsize))
+		return FALSE;
+
+	/* The texts are ORed, so each one has to narrow one of the
+	   old ones in the same field */
+	return term_extends (MODEST_SEARCH_SUBJECT, criteria->subject, old, old->subject) &&
+		term_extends (MODEST_SEARCH_SENDER, criteria->from, old, old->from) &&
+		term_extends (MODEST_SEARCH_RECIPIENT, criteria->recipient, old, old->recipient) &&
+		term_extends (MODEST_SEARCH_BODY, criteria->body, old, old->body);
+}
+
+static SearchCacheEntry *
+search_cache_entry_new (SearchCriteria *criteria)
+{
+	SearchCacheEntry *entry;
+
+	entry = g_slice_new0 (SearchCacheEntry);
+	entry->ref_count = 1;
+	entry->criteria = criteria;
+	entry->folders = g_hash_table_new_full (g_str_hash, g_str_equal,
+						g_free, (GDestroyNotify) folder_hits_unref);
+
+	return entry;
+}
+
+/* call with the lock held */
+static void
+search_cache_entry_unref (SearchCacheEntry *entry)
+{
+	if (--entry->ref_count > 0)
+		return;
+
+	search_criteria_free (entry->criteria);
+	g_hash_table_destroy (entry->folders);
+	g_slice_free (SearchCacheEntry, entry);
+}
+
+/* Returns a new reference to the cached search that @criteria is
+   equal to or extends, or NULL */
+static SearchCacheEntry *
+search_cache_lookup (SearchCriteria *criteria, gboolean *exact)
+{
+	SearchCacheEntry *found = NULL;
+	GList *node;
+
+	G_LOCK (search_cache);
+	for (node = _search_cache.head; node; node = g_list_next (node)) {
+		SearchCacheEntry *entry = (SearchCacheEntry *) node->data;
+
+		if (!strcmp (entry->criteria->key, criteria->key)) {
+			found = entry;
+			*exact = TRUE;
+			break;
+		}
+		if (!found && search_criteria_extends (criteria, entry->criteria)) {
+			found = entry;
+			*exact = FALSE;
+		}
+	}
+	if (found)
+		found->ref_count++;
+	G_UNLOCK (search_cache);
+
+	return found;
+}
+
+/* Adds a new entry that will get the results of a search as it
+   goes. It's in the cache from the beginning, so the changes in the
+   folders already searched are not missed */
+static SearchCacheEntry *
+search_cache_add (SearchCriteria *criteria)
+{
+	SearchCacheEntry *entry;
+	GList *node;
+
+	entry = search_cache_entry_new (criteria);
+
+	G_LOCK (search_cache);
+	for (node = _search_cache.head; node; node = g_list_next (node)) {
+		SearchCacheEntry *old = (SearchCacheEntry *) node->data;
+		if (!strcmp (old->criteria->key, criteria->key)) {
+			g_queue_delete_link (&_search_cache, node);
+			search_cache_entry_unref (old);
+			break;
+		}
+	}
+	g_queue_push_head (&_search_cache, entry);
+	while (g_queue_get_length (&_search_cache) > SEARCH_CACHE_SIZE)
+		search_cache_entry_unref ((SearchCacheEntry *) g_queue_pop_tail (&_search_cache));
+
+	/* one for the cache, one for the search */
+	entry->ref_count++;
+	G_UNLOCK (search_cache);
+
+	return entry;
+}
+
+/* Returns TRUE if @entry has the results of the folder, in that case
+   @hits gets a new reference to them (NULL if there were no hits) */
+static gboolean
+search_cache_entry_get_hits (SearchCacheEntry *entry, const gchar *url, FolderHits **hits)
+{
+	FolderHits *cached = NULL;
+	gboolean found;
+
+	G_LOCK (search_cache);
+	found = g_hash_table_lookup_extended (entry->folders, url, NULL, (gpointer *) &cached);
+	*hits = (found) ? folder_hits_ref (cached) : NULL;
+	G_UNLOCK (search_cache);
+
+	return found;
+}
+
+static void
+search_cache_unref (SearchCacheEntry *entry)
+{
+	G_LOCK (search_cache);
+	search_cache_entry_unref (entry);
+	G_UNLOCK (search_cache);
+}
+
+static void
+forget_folder_hits (gpointer data, gpointer user_data)
+{
+	SearchCacheEntry *entry = (SearchCacheEntry *) data;
+
+	g_hash_table_remove (entry->folders, user_data);
+}
+
+void
+modest_search_folder_changed (TnyFolder *folder)
+{
+	gchar *url;
+
+	g_return_if_fail (TNY_IS_FOLDER (folder));
+
+	url = tny_folder_get_url_string (folder);
+	if (!url)
+		return;
+
+	G_LOCK (search_cache);
+	_search_cache_generation++;
+	g_queue_foreach (&_search_cache, forget_folder_hits, url);
+	G_UNLOCK (search_cache);
+
+	g_free (url);
+}
+
+void
+modest_search_update_from_change (TnyFolderChange *change)
+{
+	TnyFolderChangeChanged changed;
+	TnyFolder *folder;
+
+	g_return_if_fail (TNY_IS_FOLDER_CHANGE (change));
+
+	/* The hits keep the seen flag, and the changes of the flags are
+	   only notified through the unread count */
+	changed = tny_folder_change_get_changed (change);
+	if (!(changed & (TNY_FOLDER_CHANGE_CHANGED_ADDED_HEADERS |
+			 TNY_FOLDER_CHANGE_CHANGED_EXPUNGED_HEADERS |
+			 TNY_FOLDER_CHANGE_CHANGED_UNREAD_COUNT)))
+		return;
+
+	folder = tny_folder_change_get_folder (change);
+	if (folder) {
+		modest_search_folder_changed (folder);
+		g_object_unref (folder);
+	}
+}
+
+void
+modest_search_header_changed (TnyHeader *header)
+{
+	TnyFolder *folder;
+
+	g_return_if_fail (TNY_IS_HEADER (header));
+
+	folder = tny_header_get_folder (header);
+	if (folder) {
+		modest_search_folder_changed (folder);
+		g_object_unref (folder);
+	}
+}
+
+static void
+add_hit (SearchHelper *helper, TnyHeader *header, TnyFolder *folder)
+{
+	ModestSearchResultHit hit;
+	FolderHits *folder_hits;
+	TnyHeaderFlags flags;
+	gchar *uid;
+
+	/* The first hit of the folder */
+	if (!helper->folder_hits)
+		helper->folder_hits = folder_hits_new (folder);
+	folder_hits = helper->folder_hits;
+
 	/* Make sure that we use the short UID instead of the long UID,
 	 * and/or find out what UID form is used when finding, in camel_data_cache_get().
 	 * so we can find what we get. Philip is working on this.
@@ -114,26 +566,21 @@ add_hit (GList *list, TnyHeader *header, TnyFolder *folder)
 		g_warning ("%s: tny_header_get_uid(): returned NULL for message with subject=%s\n", __FUNCTION__, subject);
 		g_free (subject);
 	}
-	
-	msg_url = g_strdup_printf ("%s/%s", furl, uid);
-	g_free (furl);
-	g_free (uid);
-	
-	subject = tny_header_dup_subject (header);
-	sender = tny_header_dup_from (header);
-	
+
 	flags = tny_header_get_flags (header);
 
-	hit->msgid = msg_url;
-	hit->subject = subject;
-	hit->sender = sender;
-	hit->folder = g_strdup_or_null (tny_folder_get_name (folder));
-	hit->msize = tny_header_get_message_size (header);
-	hit->has_attachment = flags & TNY_HEADER_FLAG_ATTACHMENTS;
-	hit->is_unread = ! (flags & TNY_HEADER_FLAG_SEEN);
-	hit->timestamp = MIN (tny_header_get_date_received (header), tny_header_get_date_sent (header));
-	
-	return g_list_prepend (list, hit);
+	hit.folder_url = folder_hits->url;
+	hit.folder = folder_hits->name;
+	hit.uid = g_string_chunk_insert (folder_hits->strings, uid ? uid : "");
+	hit.subject = folder_hits_take_string (folder_hits, tny_header_dup_subject (header));
+	hit.sender = folder_hits_take_string (folder_hits, tny_header_dup_from (header));
+	hit.msize = tny_header_get_message_size (header);
+	hit.has_attachment = flags & TNY_HEADER_FLAG_ATTACHMENTS;
+	hit.is_unread = ! (flags & TNY_HEADER_FLAG_SEEN);
+	hit.timestamp = MIN (tny_header_get_date_received (header), tny_header_get_date_sent (header));
+
+	g_array_append_val (folder_hits->hits, hit);
+	g_free (uid);
 }
 
 /** Call this until it returns FALSE or nread is set to 0.
@@ -228,8 +675,28 @@ search_mime_part_ogs (TnyMimePart *part, ModestSearch *search)
 /*
  * This function assumes that the mime part is of type "text / *"
  */
+/* @buffer is a chunk of a text part, so it might end in the middle of
+   a character, or not be UTF-8 at all */
 static gboolean
-search_mime_part_strcmp (TnyMimePart *part, ModestSearch *search)
+buffer_contains_folded (const gchar *buffer, const gchar *term)
+{
+	const gchar *end;
+	gchar *folded;
+	gboolean found;
+
+	if (g_utf8_validate (buffer, -1, &end) || strlen (end) < 4)
+		folded = g_utf8_casefold (buffer, end - buffer);
+	else
+		folded = g_ascii_strdown (buffer, -1);
+
+	found = (strstr (folded, term) != NULL);
+	g_free (folded);
+
+	return found;
+}
+
+static gboolean
+search_mime_part_strcmp (TnyMimePart *part, const gchar *term)
 {
 	TnyStream *stream;
 	char       buffer[8193];
@@ -242,7 +709,7 @@ search_mime_part_strcmp (TnyMimePart *part, ModestSearch *search)
 	found = FALSE;
 	len = (sizeof (buffer) - 1) / 2;
 
-	if (strlen (search->body) > len) {
+	if (strlen (term) > len) {
 		g_debug ("Search term bigger then chunk."
 			 "We might not find everything");	
 	}
@@ -259,9 +726,7 @@ search_mime_part_strcmp (TnyMimePart *part, ModestSearch *search)
 		goto done;
 	}
 
-	found = !modest_text_utils_utf8_strcmp (search->body,
-						buffer,
-						TRUE);
+	found = buffer_contains_folded (buffer, term);
 	if (found) {
 		goto done;
 	}
@@ -284,9 +749,7 @@ search_mime_part_strcmp (TnyMimePart *part, ModestSearch *search)
 	while ((res = read_chunk (stream, chunk[1], len, &nread))) {
 		buffer[len + nread] = '\0';
 
-		found = !modest_text_utils_utf8_strcmp (search->body,
-							buffer,
-							TRUE);
+		found = buffer_contains_folded (buffer, term);
 
 		/* HACK: this helps UI refreshes because the search
 		   operations could be heavy */
@@ -307,41 +770,8 @@ done:
 }
 #endif /*MODEST_HAVE_OGS*/
 
-static gboolean
-search_string (const char      *what,
-	       const char      *where,
-	       ModestSearch    *search)
-{
-	gboolean found = FALSE;
-#ifdef MODEST_HAVE_OGS
-	if (search->flags & MODEST_SEARCH_USE_OGS) {
-		found = ogs_text_searcher_search_text (search->text_searcher,
-					   	       where,
-					   	       strlen (where));
-
-		ogs_text_searcher_reset (search->text_searcher);
-	} else {
-#endif
-		if (what == NULL || where == NULL) {
-			return FALSE;
-		}
-
-		found = !modest_text_utils_utf8_strcmp (what, where, TRUE);
-#ifdef MODEST_HAVE_OGS
-	}
-#endif
-
-	/* HACK: this helps UI refreshes because the search
-	   operations could be heavy */
-	while (gtk_events_pending ())
-		gtk_main_iteration ();
-
-	return found;
-}
-
-
 static gboolean 
-search_mime_part_and_child_parts (TnyMimePart *part, ModestSearch *search)
+search_mime_part_and_child_parts (TnyMimePart *part, const gchar *term, ModestSearch *search)
 {
 	gboolean found = FALSE;
 
@@ -352,7 +782,7 @@ search_mime_part_and_child_parts (TnyMimePart *part, ModestSearch *search)
 	#ifdef MODEST_HAVE_OGS
 	found = search_mime_part_ogs (part, search);
 	#else
-	found = search_mime_part_strcmp (part, search);
+	found = search_mime_part_strcmp (part, term);
 	#endif
 
 	if (found) {	
@@ -367,7 +797,7 @@ search_mime_part_and_child_parts (TnyMimePart *part, ModestSearch *search)
 	while (!found && !tny_iterator_is_done (piter)) {
 		TnyMimePart *pcur = (TnyMimePart *) tny_iterator_get_current (piter);
 		if (pcur) {
-			found = search_mime_part_and_child_parts (pcur, search);
+			found = search_mime_part_and_child_parts (pcur, term, search);
 
 			g_object_unref (pcur);
 		}
@@ -393,6 +823,64 @@ search_next_folder (SearchHelper *helper)
 	g_object_unref (iter);
 }
 
+/* Stores the hits of the folder in the cache, unless a folder
+   changed while we were searching it. The cache and the results
+   share them */
+static void
+record_folder_hits (TnyFolder *folder, SearchHelper *helper)
+{
+	gchar *url;
+
+	url = tny_folder_get_url_string (folder);
+	if (!url)
+		return;
+
+	G_LOCK (search_cache);
+	if (helper->folder_generation == _search_cache_generation) {
+		g_hash_table_replace (helper->entry->folders, url,
+				      folder_hits_ref (helper->folder_hits));
+		url = NULL;
+	}
+	G_UNLOCK (search_cache);
+
+	g_free (url);
+}
+
+static void
+search_folder_done (TnyFolder *folder, SearchHelper *helper, gboolean completed)
+{
+	if (completed)
+		record_folder_hits (folder, helper);
+	search_result_add_folder_hits (helper->result, helper->folder_hits);
+	helper->folder_hits = NULL;
+	helper->refiltering = FALSE;
+
+	/* Check search finished */
+	tny_list_remove (helper->all_folders, G_OBJECT (folder));
+	if (tny_list_get_length (helper->all_folders) == 0) {
+		/* callback */
+		helper->callback (helper->result, helper->user_data);
+		
+		/* free helper */
+		if (helper->base)
+			search_cache_unref (helper->base);
+		search_cache_unref (helper->entry);
+		modest_search_query_free (helper->query);
+		g_object_unref (helper->all_folders);
+		search_result_free (helper->result);
+		g_slice_free (SearchHelper, helper);
+	} else {
+		search_next_folder (helper);
+	}
+}
+
+static gboolean
+search_body (TnyMsg *msg, const gchar *term, gpointer user_data)
+{
+	return search_mime_part_and_child_parts (TNY_MIME_PART (msg), term,
+						 (ModestSearch *) user_data);
+}
+
 static void 
 modest_search_folder_get_headers_cb (TnyFolder *folder, 
 				     gboolean cancelled, 
@@ -402,128 +890,162 @@ modest_search_folder_get_headers_cb (TnyFolder *folder,
 {
 	TnyIterator *iter = NULL;
 	SearchHelper *helper;
+	GList *candidates = NULL, *node;
+	time_t oldest = 0, newest = 0;
+	gboolean has_dates = FALSE;
+	gchar *url;
 
 	helper = (SearchHelper *) user_data;
 
 	if (err || cancelled) {
-		goto end;
+		if (headers)
+			g_object_unref (headers);
+		search_folder_done (folder, helper, FALSE);
+		return;
 	}
 
+	/* First pass, only with the summary. The query checks the
+	   flags and dates before the strings, and tells us which
+	   headers depend on the message body */
 	iter = tny_list_create_iterator (headers);
-
 	while (!tny_iterator_is_done (iter)) {
-
 		TnyHeader *cur;
+		TnyHeaderFlags flags;
 		time_t t;
-		gboolean found;
 
 		cur = (TnyHeader *) tny_iterator_get_current (iter);
-		t = tny_header_get_date_sent (cur);
-		found = FALSE;
+		flags = tny_header_get_flags (cur);
 
 		/* Ignore deleted (not yet expunged) emails: */
-		if (tny_header_get_flags(cur) & TNY_HEADER_FLAG_DELETED)
+		if (flags & TNY_HEADER_FLAG_DELETED)
 			goto go_next;
 
-		if (helper->search->flags & MODEST_SEARCH_BEFORE)
-			if (!(t <= helper->search->end_date))
-				goto go_next;
+		t = tny_header_get_date_sent (cur);
+		if (!has_dates || t < oldest)
+			oldest = t;
+		if (!has_dates || t > newest)
+			newest = t;
+		has_dates = TRUE;
+
+		switch (modest_search_query_match_header (helper->query, cur)) {
+		case MODEST_SEARCH_QUERY_MATCH:
+			add_hit (helper, cur, folder);
+			break;
+		case MODEST_SEARCH_QUERY_NEEDS_BODY:
+			/* We only search in the messages we already have */
+			if (flags & TNY_HEADER_FLAG_CACHED)
+				candidates = g_list_prepend (candidates, g_object_ref (cur));
+			break;
+		default:
+			break;
+		}
+	go_next:
+		g_object_unref (cur);
+		tny_iterator_next (iter);
+	}
 
-		if (helper->search->flags & MODEST_SEARCH_AFTER)
-			if (!(t >= helper->search->start_date))
-				goto go_next;
+	/* Second pass, open the messages that could still match */
+	candidates = g_list_reverse (candidates);
+	for (node = candidates; node; node = g_list_next (node)) {
+		TnyHeader *cur = TNY_HEADER (node->data);
+		GError *msg_err = NULL;
+		TnyMsg *msg;
+
+		msg = tny_folder_get_msg (folder, cur, &msg_err);
+		if (msg_err != NULL || msg == NULL) {
+			g_warning ("%s: Could not get message.\n", __FUNCTION__);
+			if (msg_err)
+				g_error_free (msg_err);
+		} else if (modest_search_query_match_msg (helper->query, cur, msg,
+							  search_body, helper->search)) {
+			add_hit (helper, cur, folder);
+		}
 
-		if (helper->search->flags & MODEST_SEARCH_SIZE)
-			if (tny_header_get_message_size (cur) < helper->search->minsize)
-				goto go_next;
+		if (msg)
+			g_object_unref (msg);
+		g_object_unref (cur);
+	}
+	g_list_free (candidates);
 
-		if (helper->search->flags & MODEST_SEARCH_SUBJECT) {
-			char *str = tny_header_dup_subject (cur);
+	/* Remember the dates of the folder, later searches could
+	   skip it without loading its headers. Not when refiltering,
+	   we only got some of the headers then */
+	url = tny_folder_get_url_string (folder);
+	if (url && has_dates && !helper->refiltering)
+		modest_folder_counts_set_date_range (url, tny_folder_get_all_count (folder),
+						     oldest, newest);
+	g_free (url);
 
-			if ((found = search_string (helper->search->subject, str, helper->search))) {
-			    helper->msg_hits = add_hit (helper->msg_hits, cur, folder);
-			}
-			g_free (str);
-		}
-		
-		if (!found && helper->search->flags & MODEST_SEARCH_SENDER) {
-			char *str = tny_header_dup_from (cur);
+	/* Frees */
+	g_object_unref (iter);
+	g_object_unref (headers);
 
-			if ((found = search_string (helper->search->from, (const gchar *) str, helper->search))) {
-				helper->msg_hits = add_hit (helper->msg_hits, cur, folder);
-			}
-			g_free (str);
-		}
-		
-		if (!found && helper->search->flags & MODEST_SEARCH_RECIPIENT) {
-			char *str = tny_header_dup_to (cur);
+	search_folder_done (folder, helper, TRUE);
+}
 
-			if ((found = search_string (helper->search->recipient, str, helper->search))) {
-				helper->msg_hits = add_hit (helper->msg_hits, cur, folder);
-			}
-			g_free (str);
-		}
-	
-		if (!found && helper->search->flags & MODEST_SEARCH_BODY) {
-			TnyHeaderFlags flags;
-			GError      *err = NULL;
-			TnyMsg      *msg = NULL;
+/* The headers of the messages that matched before. The helper unrefs
+   them after calling us, but the search callback consumes the list */
+static void
+on_cached_hits_headers (TnyFolder *folder,
+			gboolean cancelled,
+			TnyList *headers,
+			GError *err,
+			gpointer user_data)
+{
+	SearchHelper *helper = (SearchHelper *) user_data;
 
-			flags = tny_header_get_flags (cur);
+	helper->refiltering = TRUE;
+	modest_search_folder_get_headers_cb (folder, cancelled, g_object_ref (headers),
+					     err, helper);
+}
 
-			if (!(flags & TNY_HEADER_FLAG_CACHED)) {
-				goto go_next;
-			}
+/* Uses the results of the cached search for @folder. Returns FALSE
+   if they're not there (or were invalidated by a change) */
+static gboolean
+search_folder_from_cache (TnyFolder *folder, SearchHelper *helper)
+{
+	FolderHits *cached_hits;
+	GSList *uids = NULL;
+	gchar *url;
+	gboolean found;
+	guint i;
 
-			msg = tny_folder_get_msg (folder, cur, &err);
-
-			if (err != NULL || msg == NULL) {
-				g_warning ("%s: Could not get message.\n", __FUNCTION__);
-				g_error_free (err);
-
-				if (msg) {
-					g_object_unref (msg);
-				}
-			} else {	
-				gchar *str;
-				str = tny_header_dup_subject (cur);
-				g_debug ("Searching in %s\n", str);
-				g_free (str);
-			
-				found = search_mime_part_and_child_parts (TNY_MIME_PART (msg),
-									  helper->search);
-				if (found) {
-					helper->msg_hits = add_hit (helper->msg_hits, cur, folder);
-				}
-			}
-			
-			if (msg)
-				g_object_unref (msg);
-		}
-	go_next:
-		g_object_unref (cur);
-		tny_iterator_next (iter);
+	if (!helper->base)
+		return FALSE;
+
+	url = tny_folder_get_url_string (folder);
+	found = url && search_cache_entry_get_hits (helper->base, url, &cached_hits);
+	g_free (url);
+
+	if (!found)
+		return FALSE;
+
+	if (helper->base_is_exact) {
+		helper->folder_hits = cached_hits;
+		search_folder_done (folder, helper, TRUE);
+		return TRUE;
 	}
 
-	/* Frees */
-	g_object_unref (iter);
- end:
-	if (headers)
-		g_object_unref (headers);
+	/* A narrower search, so we only need to check again the
+	   messages that matched before */
+	for (i = 0; cached_hits && i < cached_hits->hits->len; i++) {
+		ModestSearchResultHit *hit = &g_array_index (cached_hits->hits, ModestSearchResultHit, i);
 
-	/* Check search finished */
-	tny_list_remove (helper->all_folders, G_OBJECT (folder));
-	if (tny_list_get_length (helper->all_folders) == 0) {
-		/* callback */
-		helper->callback (helper->msg_hits, helper->user_data);
-		
-		/* free helper */
-		g_object_unref (helper->all_folders);
-		g_list_free (helper->msg_hits);
-		g_slice_free (SearchHelper, helper);
-	} else {
-		search_next_folder (helper);
+		if (hit->uid[0] != '\0')
+			uids = g_slist_prepend (uids, g_strdup (hit->uid));
+	}
+	folder_hits_unref (cached_hits);
+
+	if (!uids) {
+		search_folder_done (folder, helper, TRUE);
+		return TRUE;
 	}
+
+	modest_tny_folder_get_headers_by_uid_async (folder, uids, on_cached_hits_headers, helper);
+	g_slist_foreach (uids, (GFunc) g_free, NULL);
+	g_slist_free (uids);
+
+	return TRUE;
 }
 
 static void
@@ -533,6 +1055,12 @@ _search_folder (TnyFolder *folder,
 	TnyList *list = NULL;
 
 	g_debug ("%s: searching folder %s.", __FUNCTION__, tny_folder_get_name (folder));
+
+	/* The hits of this folder will be the ones added from now on */
+	helper->folder_hits = NULL;
+	G_LOCK (search_cache);
+	helper->folder_generation = _search_cache_generation;
+	G_UNLOCK (search_cache);
 	
 	/* Check that we should be searching this folder. */
 	/* Note that we don't try to search sub-folders. 
@@ -540,14 +1068,21 @@ _search_folder (TnyFolder *folder,
 	if (helper->search->folder && strlen (helper->search->folder)) {
 		if (!strcmp (helper->search->folder, "outbox")) {
 			if (modest_tny_folder_guess_folder_type (folder) != TNY_FOLDER_TYPE_OUTBOX) {
-				modest_search_folder_get_headers_cb (folder, TRUE, NULL, NULL, helper); 
+				search_folder_done (folder, helper, TRUE);
 				return;
 			}
 		} else if (strcmp (tny_folder_get_id (folder), helper->search->folder) != 0) {
-			modest_search_folder_get_headers_cb (folder, TRUE, NULL, NULL, helper); 
+			search_folder_done (folder, helper, TRUE);
 			return;
 		}
 	}
+
+	/* Skip the folders that can not match, like an empty folder
+	   or the ones out of the date range we're looking for */
+	if (!modest_search_query_folder_may_match (helper->query, folder)) {
+		search_folder_done (folder, helper, TRUE);
+		return;
+	}
 	
 #ifdef MODEST_HAVE_OGS
 	if (helper->search->flags & MODEST_SEARCH_USE_OGS) {
@@ -561,6 +1096,10 @@ _search_folder (TnyFolder *folder,
 		}
 	}
 #endif
+
+	if (search_folder_from_cache (folder, helper))
+		return;
+
 	list = tny_simple_list_new ();
 	/* Get the headers */
 	tny_folder_get_headers_async (folder, list, FALSE, 
@@ -720,15 +1259,22 @@ create_helper (ModestSearchCallback callback,
 	       gpointer user_data)
 {
 	SearchHelper *helper;
+	SearchCriteria *criteria;
 
 	helper = g_slice_new0 (SearchHelper);
 	helper->pending_calls = 0;
 	helper->search = search;
+	helper->query = modest_search_query_new_from_search (search);
 	helper->callback = callback;
 	helper->user_data = user_data;
-	helper->msg_hits = NULL;
+	helper->result = search_result_new ();
 	helper->all_folders = tny_simple_list_new ();
 
+	/* Reuse the results of a recent search if we can */
+	criteria = search_criteria_new (search);
+	helper->base = search_cache_lookup (criteria, &(helper->base_is_exact));
+	helper->entry = search_cache_add (criteria);
+
 	return helper;
 }
 
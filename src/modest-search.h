@@ -32,6 +32,7 @@
 
 #include <glib.h>
 #include <tny-folder.h>
+#include <tny-folder-change.h>
 
 #ifndef _GNU_SOURCE
 #define _GNU_SOURCE
@@ -58,17 +59,25 @@ typedef enum {
 	MODEST_SEARCH_USE_OGS   = (1 << 7),
 } ModestSearchFlags;
 
+/* The strings of the hits live in the memory of the search results,
+ * the ones of the folder are shared by all its hits. The URI of the
+ * message is folder_url/uid, see modest_search_result_hit_get_msgid() */
 typedef struct {
-	gchar     *msgid; /* E.g. the URI of the message. */
-	gchar     *subject;
-	gchar     *folder; /* The name, not the URI. */
-	gchar     *sender;
+	const gchar *folder_url;
+	const gchar *uid;
+	const gchar *subject;
+	const gchar *folder; /* The name, not the URI. */
+	const gchar *sender;
 	guint64    msize;
 	gboolean   has_attachment;
 	gboolean   is_unread;
 	gint64     timestamp;		 
 } ModestSearchResultHit;
 
+typedef struct _ModestSearchResult ModestSearchResult;
+
+typedef void (*ModestSearchResultFunc) (const ModestSearchResultHit *hit, gpointer user_data);
+
 typedef struct {
 	gchar *folder; /* The folder to search in */
 	
@@ -88,13 +97,29 @@ typedef struct {
 #endif
 } ModestSearch;
 
-typedef void (*ModestSearchCallback) (GList *hits, gpointer user_data);
+/* @result is freed after the callback returns */
+typedef void (*ModestSearchCallback) (ModestSearchResult *result, gpointer user_data);
 
 void modest_search_folder (TnyFolder *folder, ModestSearch *search, ModestSearchCallback callback, gpointer user_data);
 void modest_search_all_accounts (ModestSearch *search, ModestSearchCallback callback, gpointer user_data);
 void modest_search_account (TnyAccount *account, ModestSearch *search, ModestSearchCallback callback, gpointer user_data);
 void modest_search_free (ModestSearch *search);
 
+guint modest_search_result_get_length (ModestSearchResult *result);
+void modest_search_result_foreach (ModestSearchResult *result, ModestSearchResultFunc func, gpointer user_data);
+
+/* Writes the URI of the message of @hit in @buffer, and returns its
+ * contents. The same buffer can be reused for all the hits */
+const gchar *modest_search_result_hit_get_msgid (const ModestSearchResultHit *hit, GString *buffer);
+
+/* The results of the last searches are cached, so repeating or
+ * refining a search only looks again into the folders that changed.
+ * These tell the cache that the messages of a folder changed, the
+ * last one after changing the flags of @header */
+void modest_search_folder_changed (TnyFolder *folder);
+void modest_search_update_from_change (TnyFolderChange *change);
+void modest_search_header_changed (TnyHeader *header);
+
 G_END_DECLS
 
 #endif
@@ -0,0 +1,170 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <unistd.h>
+#include "modest-startup-trace.h"
+#include "modest-runtime.h"
+
+/* don't let a misbehaving caller eat all our memory */
+#define MAX_EVENTS 1024
+
+typedef struct {
+	gchar   *name;
+	gchar    phase;	/* 'B'egin, 'E'nd or 'i'nstant, as in the trace-event format */
+	gdouble  usecs;
+} TraceEvent;
+
+static GTimer *_timer  = NULL;
+static GArray *_events = NULL;
+
+static void
+add_event (const gchar *name, gchar phase)
+{
+	TraceEvent event;
+
+	g_return_if_fail (name);
+
+	if (!_timer) {
+		_timer  = g_timer_new ();
+		_events = g_array_sized_new (FALSE, FALSE, sizeof (TraceEvent), 64);
+	}
+
+	if (_events->len >= MAX_EVENTS)
+		return;
+
+	event.name  = g_strdup (name);
+	event.phase = phase;
+	event.usecs = g_timer_elapsed (_timer, NULL) * G_USEC_PER_SEC;
+
+	g_array_append_val (_events, event);
+}
+
+void
+modest_startup_trace_begin (const gchar *phase)
+{
+	add_event (phase, 'B');
+}
+
+void
+modest_startup_trace_end (const gchar *phase)
+{
+	add_event (phase, 'E');
+}
+
+void
+modest_startup_trace_mark (const gchar *name)
+{
+	add_event (name, 'i');
+}
+
+static void
+append_json_string (GString *str, const gchar *val)
+{
+	const gchar *cursor;
+
+	g_string_append_c (str, '"');
+	for (cursor = val; *cursor; ++cursor) {
+		switch (*cursor) {
+		case '"':  g_string_append (str, "\\\""); break;
+		case '\\': g_string_append (str, "\\\\"); break;
+		case '\n': g_string_append (str, "\\n");  break;
+		case '\t': g_string_append (str, "\\t");  break;
+		default:
+			if ((guchar) *cursor < 0x20)
+				g_string_append_printf (str, "\\u%04x", (guchar) *cursor);
+			else
+				g_string_append_c (str, *cursor);
+		}
+	}
+	g_string_append_c (str, '"');
+}
+
+gchar*
+modest_startup_trace_to_json (void)
+{
+	GString *str;
+	guint i;
+	gint pid;
+
+	pid = (gint) getpid ();
+	str = g_string_new ("{\"traceEvents\":[");
+
+	for (i = 0; _events && i < _events->len; ++i) {
+		TraceEvent *event = &g_array_index (_events, TraceEvent, i);
+
+		if (i > 0)
+			g_string_append_c (str, ',');
+		g_string_append (str, "\n{\"name\":");
+		append_json_string (str, event->name);
+		g_string_append_printf (str,
+					",\"cat\":\"startup\",\"ph\":\"%c\",\"ts\":%.0f,"
+					"\"pid\":%d,\"tid\":%d%s}",
+					event->phase, event->usecs, pid, pid,
+					event->phase == 'i' ? ",\"s\":\"p\"" : "");
+	}
+	g_string_append (str, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+	return g_string_free (str, FALSE);
+}
+
+gboolean
+modest_startup_trace_dump (void)
+{
+	const gchar *path;
+	gchar *tmp_path = NULL;
+	gchar *json;
+	GError *err = NULL;
+	gboolean retval;
+
+	path = g_getenv (MODEST_STARTUP_TRACE);
+	if (!path || !path[0]) {
+		if (!(modest_runtime_get_debug_flags () & MODEST_RUNTIME_DEBUG_STARTUP_TRACE))
+			return FALSE;
+		tmp_path = g_strdup_printf ("%s/modest-startup-trace-%d.json",
+					    g_get_tmp_dir (), (gint) getpid ());
+		path = tmp_path;
+	}
+
+	json = modest_startup_trace_to_json ();
+	retval = g_file_set_contents (path, json, -1, &err);
+	if (!retval) {
+		g_warning ("%s: failed to write %s: %s", __FUNCTION__, path,
+			   err ? err->message : "unknown error");
+		g_clear_error (&err);
+	} else {
+		g_debug ("%s: startup trace written to %s", __FUNCTION__, path);
+	}
+
+	g_free (json);
+	g_free (tmp_path);
+
+	return retval;
+}
@@ -0,0 +1,91 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MODEST_STARTUP_TRACE_H__
+#define __MODEST_STARTUP_TRACE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* environment variable; if set, the trace is written to the file it
+ * points to once startup is finished */
+#define MODEST_STARTUP_TRACE "MODEST_STARTUP_TRACE"
+
+/**
+ * modest_startup_trace_begin:
+ * @phase: the name of the phase
+ *
+ * record the (monotonic) start time of a startup phase. Every call
+ * must be matched by a modest_startup_trace_end with the same @phase.
+ * Only to be called from the main thread.
+ */
+void     modest_startup_trace_begin    (const gchar *phase);
+
+/**
+ * modest_startup_trace_end:
+ * @phase: the name of the phase
+ *
+ * record the (monotonic) end time of a startup phase
+ */
+void     modest_startup_trace_end      (const gchar *phase);
+
+/**
+ * modest_startup_trace_mark:
+ * @name: the name of the event
+ *
+ * record a single instant event, for milestones such as
+ * "first window shown"
+ */
+void     modest_startup_trace_mark     (const gchar *name);
+
+/**
+ * modest_startup_trace_to_json:
+ *
+ * get the recorded events in the Chrome trace-event format (JSON),
+ * that can be loaded in chrome://tracing or similar tools
+ *
+ * Returns: a newly allocated string, free with g_free
+ */
+gchar*   modest_startup_trace_to_json  (void);
+
+/**
+ * modest_startup_trace_dump:
+ *
+ * write the trace to the file in the MODEST_STARTUP_TRACE
+ * environment variable, or to a file in the temporary dir if
+ * MODEST_DEBUG contains "startup-trace". Does nothing otherwise.
+ *
+ * Returns: %TRUE if the trace was written, %FALSE otherwise
+ */
+gboolean modest_startup_trace_dump     (void);
+
+G_END_DECLS
+
+#endif /*__MODEST_STARTUP_TRACE_H__*/
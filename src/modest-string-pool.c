@@ -0,0 +1,184 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+#include <string.h>
+#include "modest-string-pool.h"
+
+#define N_SHARDS 16
+
+typedef struct {
+	gint  ref_count;	/* protected by the lock of the shard */
+	guint hash;
+	gchar str[1];
+} PoolString;
+
+#define POOL_STRING(s) ((PoolString *) ((s) - G_STRUCT_OFFSET (PoolString, str)))
+
+typedef struct {
+	GStaticMutex lock;
+	GHashTable  *strings;	/* str -> PoolString */
+} Shard;
+
+#define SHARD_INIT   { G_STATIC_MUTEX_INIT, NULL }
+#define SHARD_INIT_4 SHARD_INIT, SHARD_INIT, SHARD_INIT, SHARD_INIT
+
+static Shard _shards[N_SHARDS] = {
+	SHARD_INIT_4, SHARD_INIT_4, SHARD_INIT_4, SHARD_INIT_4
+};
+
+const gchar *
+modest_string_pool_intern (const gchar *str)
+{
+	PoolString *pool_str;
+	Shard *shard;
+	guint hash;
+
+	if (!str)
+		return NULL;
+
+	hash = g_str_hash (str);
+	shard = &_shards[hash % N_SHARDS];
+
+	g_static_mutex_lock (&shard->lock);
+	if (G_UNLIKELY (!shard->strings))
+		shard->strings = g_hash_table_new (g_str_hash, g_str_equal);
+
+	pool_str = g_hash_table_lookup (shard->strings, str);
+	if (pool_str) {
+		pool_str->ref_count++;
+	} else {
+		gsize len = strlen (str);
+
+		pool_str = g_malloc (G_STRUCT_OFFSET (PoolString, str) + len + 1);
+		pool_str->ref_count = 1;
+		pool_str->hash = hash;
+		memcpy (pool_str->str, str, len + 1);
+		g_hash_table_insert (shard->strings, pool_str->str, pool_str);
+	}
+	g_static_mutex_unlock (&shard->lock);
+
+	return pool_str->str;
+}
+
+const gchar *
+modest_string_pool_intern_take (gchar *str)
+{
+	const gchar *interned;
+
+	interned = modest_string_pool_intern (str);
+	g_free (str);
+
+	return interned;
+}
+
+const gchar *
+modest_string_pool_ref (const gchar *str)
+{
+	PoolString *pool_str;
+	Shard *shard;
+
+	if (!str)
+		return NULL;
+
+	pool_str = POOL_STRING (str);
+	shard = &_shards[pool_str->hash % N_SHARDS];
+
+	g_static_mutex_lock (&shard->lock);
+	pool_str->ref_count++;
+	g_static_mutex_unlock (&shard->lock);
+
+	return str;
+}
+
+void
+modest_string_pool_unref (const gchar *str)
+{
+	PoolString *pool_str;
+	Shard *shard;
+
+	if (!str)
+		return;
+
+	pool_str = POOL_STRING (str);
+	shard = &_shards[pool_str->hash % N_SHARDS];
+
+	/* The lookup in modest_string_pool_intern() must never find
+	   a string that is being freed, so the last unref and the
+	   removal happen with the lock held */
+	g_static_mutex_lock (&shard->lock);
+	if (--pool_str->ref_count == 0) {
+		g_hash_table_remove (shard->strings, pool_str->str);
+		g_free (pool_str);
+	}
+	g_static_mutex_unlock (&shard->lock);
+}
+
+typedef struct {
+	guint n_strings;
+	gsize size;
+	gsize saved;
+} PoolStats;
+
+static void
+add_string_stats (gpointer key, gpointer value, gpointer user_data)
+{
+	PoolString *pool_str = (PoolString *) value;
+	PoolStats *stats = (PoolStats *) user_data;
+	gsize len = strlen (pool_str->str) + 1;
+
+	stats->n_strings++;
+	stats->size += G_STRUCT_OFFSET (PoolString, str) + len;
+	stats->saved += (pool_str->ref_count - 1) * len;
+}
+
+void
+modest_string_pool_get_stats (guint *n_strings,
+			      gsize *size,
+			      gsize *saved)
+{
+	PoolStats stats = { 0, 0, 0 };
+	gint i;
+
+	for (i = 0; i < N_SHARDS; i++) {
+		Shard *shard = &_shards[i];
+
+		g_static_mutex_lock (&shard->lock);
+		if (shard->strings)
+			g_hash_table_foreach (shard->strings, add_string_stats, &stats);
+		g_static_mutex_unlock (&shard->lock);
+	}
+
+	if (n_strings)
+		*n_strings = stats.n_strings;
+	if (size)
+		*size = stats.size;
+	if (saved)
+		*saved = stats.saved;
+}
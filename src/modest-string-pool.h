@@ -0,0 +1,102 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MODEST_STRING_POOL_H__
+#define __MODEST_STRING_POOL_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * a process wide pool of refcounted, immutable strings. Interning
+ * the same contents returns always the same pointer, so the header
+ * fields that repeat a lot (senders, casefolded subjects of a
+ * thread, message ids...) are stored once, and interned strings can
+ * be compared by pointer. The pool is split in several shards, each
+ * one with its own lock, so it can be used from any thread
+ */
+
+/**
+ * modest_string_pool_intern:
+ * @str: a string, or %NULL
+ *
+ * get the interned copy of @str, adding it to the pool if needed
+ *
+ * Returns: a new reference to the interned string, to be released
+ * with modest_string_pool_unref(), or %NULL if @str is %NULL
+ **/
+const gchar *modest_string_pool_intern      (const gchar *str);
+
+/**
+ * modest_string_pool_intern_take:
+ * @str: a newly allocated string, or %NULL
+ *
+ * like modest_string_pool_intern() but it frees @str, handy for the
+ * results of the tny_header_dup_* functions
+ *
+ * Returns: a new reference to the interned string, or %NULL
+ **/
+const gchar *modest_string_pool_intern_take (gchar *str);
+
+/**
+ * modest_string_pool_ref:
+ * @str: an interned string, or %NULL
+ *
+ * add a reference to @str
+ *
+ * Returns: @str
+ **/
+const gchar *modest_string_pool_ref         (const gchar *str);
+
+/**
+ * modest_string_pool_unref:
+ * @str: an interned string, or %NULL
+ *
+ * release a reference to @str. It's removed from the pool when the
+ * last one is released
+ **/
+void         modest_string_pool_unref       (const gchar *str);
+
+/**
+ * modest_string_pool_get_stats:
+ * @n_strings: return location for the number of strings, or %NULL
+ * @size: return location for the bytes used by them, or %NULL
+ * @saved: return location for the bytes that the copies of those
+ * strings would use, or %NULL
+ *
+ * get the usage of the pool, to measure the effect of the interning
+ **/
+void         modest_string_pool_get_stats   (guint *n_strings,
+					     gsize *size,
+					     gsize *saved);
+
+G_END_DECLS
+
+#endif /* __MODEST_STRING_POOL_H__ */
@@ -64,6 +64,7 @@
 #include <widgets/modest-account-settings-dialog.h>
 #include <tny-camel-bs-msg-receive-strategy.h>
 #include <modest-tny-msg.h>
+#include "modest-startup-trace.h"
 
 #ifdef MODEST_PLATFORM_MAEMO
 #include <tny-maemo-conic-device.h>
@@ -138,12 +139,22 @@ struct _ModestTnyAccountStorePrivate {
 	/* Matches transport accounts and outbox folder */
 	GHashTable          *outbox_of_transport;
 
+	/* Lookup indexes, see get_url_index_key */
+	GHashTable          *accounts_by_id;
+	GHashTable          *accounts_by_url;
+	GHashTable          *folders_by_url;
+
 	/* is sending mail blocked? */
 	gboolean send_mail_blocked;
 
 	GVolumeMonitor *monitor;
 };
 
+static void    free_account_list           (GList *accounts);
+
+static void    forget_account              (ModestTnyAccountStorePrivate *priv,
+					    TnyAccount *account);
+
 #define MODEST_TNY_ACCOUNT_STORE_GET_PRIVATE(o)      (G_TYPE_INSTANCE_GET_PRIVATE((o), \
                                                       MODEST_TYPE_TNY_ACCOUNT_STORE, \
                                                       ModestTnyAccountStorePrivate))
@@ -151,6 +162,9 @@ struct _ModestTnyAccountStorePrivate {
 /* globals */
 static GObjectClass *parent_class = NULL;
 
+/* the indexes could be used from the mail operation threads */
+G_LOCK_DEFINE_STATIC (index);
+
 static guint signals[LAST_SIGNAL] = {0};
 
 GType
@@ -269,6 +283,13 @@ modest_tny_account_store_instance_init (ModestTnyAccountStore *obj)
 							   NULL,
 							   NULL);
 
+	priv->accounts_by_id = g_hash_table_new_full (g_str_hash, g_str_equal,
+						      g_free, g_object_unref);
+	priv->accounts_by_url = g_hash_table_new_full (g_str_hash, g_str_equal,
+						       g_free, (GDestroyNotify) free_account_list);
+	priv->folders_by_url = g_hash_table_new_full (g_str_hash, g_str_equal,
+						      g_free, g_object_unref);
+
 	/* An in-memory store of passwords, 
 	 * for passwords that are not remembered in the configuration,
          * so they need to be asked for from the user once in each session:
@@ -402,6 +423,7 @@ on_mount_removed(GVolumeMonitor *monitor,
 		if (found) {
 			/* Remove from the list */
 			tny_list_remove (priv->store_accounts, G_OBJECT (mmc_account));
+			forget_account (priv, mmc_account);
 			
 			/* Notify observers */
 			g_signal_emit (G_OBJECT (self),
@@ -793,6 +815,21 @@ modest_tny_account_store_finalize (GObject *obj)
 		priv->outbox_of_transport = NULL;
 	}
 
+	/* Drop the references held by the indexes before the
+	   accounts are destroyed */
+	if (priv->accounts_by_id) {
+		g_hash_table_destroy (priv->accounts_by_id);
+		priv->accounts_by_id = NULL;
+	}
+	if (priv->accounts_by_url) {
+		g_hash_table_destroy (priv->accounts_by_url);
+		priv->accounts_by_url = NULL;
+	}
+	if (priv->folders_by_url) {
+		g_hash_table_destroy (priv->folders_by_url);
+		priv->folders_by_url = NULL;
+	}
+
 	modest_signal_mgr_disconnect_all_and_destroy (priv->sighandlers);
 	priv->sighandlers = NULL;	
 
@@ -978,6 +1015,8 @@ modest_tny_account_store_new (ModestAccountMgr *account_mgr,
 	priv->transport_accounts = tny_simple_list_new ();
 	priv->store_accounts_outboxes = tny_simple_list_new ();
 
+	modest_startup_trace_begin ("account-store");
+
 	/* Create the local folders account */
 	local_account =
 		modest_tny_account_new_for_local_folders (priv->account_mgr, priv->session, NULL);
@@ -1004,6 +1043,8 @@ modest_tny_account_store_new (ModestAccountMgr *account_mgr,
 	/* Initialize session */
 	tny_session_camel_set_initialized (priv->session);
 
+	modest_startup_trace_end ("account-store");
+
 	return MODEST_TNY_ACCOUNT_STORE(obj);
 }
 
@@ -1240,6 +1281,242 @@ modest_tny_account_store_get_session  (TnyAccountStore *self)
 	return MODEST_TNY_ACCOUNT_STORE_GET_PRIVATE (self)->session;
 }
 
+/*
+ * Lookup indexes for get_tny_account_by and the folder urls. They're
+ * only caches: account hits are always checked against the query,
+ * misses fall back to scanning the lists, and the account index is
+ * dropped whenever an account is removed
+ */
+
+/* urls are keyed by <scheme>://<authority>, as the same account is
+   queried with the urls of all its folders and messages */
+static gchar *
+get_url_index_key (const gchar *url)
+{
+	const gchar *authority, *end;
+
+	authority = strstr (url, "://");
+	if (!authority)
+		return g_strdup (url);
+
+	authority += 3;
+	end = authority + strcspn (authority, "/;?");
+
+	return g_strndup (url, end - url);
+}
+
+static void
+free_account_list (GList *accounts)
+{
+	g_list_foreach (accounts, (GFunc) g_object_unref, NULL);
+	g_list_free (accounts);
+}
+
+static void
+clear_account_index (ModestTnyAccountStorePrivate *priv)
+{
+	G_LOCK (index);
+	g_hash_table_remove_all (priv->accounts_by_id);
+	g_hash_table_remove_all (priv->accounts_by_url);
+	G_UNLOCK (index);
+}
+
+static TnyAccount *
+lookup_account_index (ModestTnyAccountStorePrivate *priv,
+		      ModestTnyAccountStoreQueryType type,
+		      const gchar *str)
+{
+	TnyAccount *account = NULL;
+
+	G_LOCK (index);
+	if (type == MODEST_TNY_ACCOUNT_STORE_QUERY_ID) {
+		account = g_hash_table_lookup (priv->accounts_by_id, str);
+		if (account && g_strcmp0 (tny_account_get_id (account), str) == 0)
+			g_object_ref (account);
+		else
+			account = NULL;
+	} else {
+		GList *node;
+		gchar *key = get_url_index_key (str);
+
+		node = g_hash_table_lookup (priv->accounts_by_url, key);
+		for (; node && !account; node = g_list_next (node)) {
+			if (tny_account_matches_url_string (TNY_ACCOUNT (node->data), str))
+				account = g_object_ref (node->data);
+		}
+		g_free (key);
+	}
+	G_UNLOCK (index);
+
+	return account;
+}
+
+static void
+add_to_account_index (ModestTnyAccountStorePrivate *priv,
+		      ModestTnyAccountStoreQueryType type,
+		      const gchar *str,
+		      TnyAccount *account)
+{
+	G_LOCK (index);
+	if (type == MODEST_TNY_ACCOUNT_STORE_QUERY_ID) {
+		g_hash_table_replace (priv->accounts_by_id, g_strdup (str), g_object_ref (account));
+	} else {
+		GList *accounts;
+		gchar *key = get_url_index_key (str);
+
+		accounts = g_hash_table_lookup (priv->accounts_by_url, key);
+		if (!g_list_find (accounts, account)) {
+			g_hash_table_steal (priv->accounts_by_url, key);
+			accounts = g_list_prepend (accounts, g_object_ref (account));
+			g_hash_table_insert (priv->accounts_by_url, key, accounts);
+		} else {
+			g_free (key);
+		}
+	}
+	G_UNLOCK (index);
+}
+
+TnyFolder *
+modest_tny_account_store_find_folder_by_url (ModestTnyAccountStore *self,
+					     const gchar *url)
+{
+	ModestTnyAccountStorePrivate *priv;
+	TnyFolder *folder;
+
+	g_return_val_if_fail (MODEST_IS_TNY_ACCOUNT_STORE (self), NULL);
+	g_return_val_if_fail (url, NULL);
+
+	priv = MODEST_TNY_ACCOUNT_STORE_GET_PRIVATE (self);
+
+	G_LOCK (index);
+	folder = g_hash_table_lookup (priv->folders_by_url, url);
+	if (folder)
+		g_object_ref (folder);
+	G_UNLOCK (index);
+
+	return folder;
+}
+
+void
+modest_tny_account_store_index_folder (ModestTnyAccountStore *self,
+				       TnyFolder *folder)
+{
+	ModestTnyAccountStorePrivate *priv;
+	TnyFolder *old_folder;
+	gchar *url;
+
+	g_return_if_fail (MODEST_IS_TNY_ACCOUNT_STORE (self));
+	g_return_if_fail (TNY_IS_FOLDER (folder));
+
+	priv = MODEST_TNY_ACCOUNT_STORE_GET_PRIVATE (self);
+
+	url = tny_folder_get_url_string (folder);
+	if (!url)
+		return;
+
+	/* The index holds a reference, so a lookup from another
+	   thread never gets a folder that is being finalized. The
+	   replaced one is unreffed out of the lock */
+	G_LOCK (index);
+	old_folder = g_hash_table_lookup (priv->folders_by_url, url);
+	if (old_folder)
+		g_hash_table_steal (priv->folders_by_url, url);
+	g_hash_table_insert (priv->folders_by_url, url, g_object_ref (folder));
+	G_UNLOCK (index);
+
+	if (old_folder)
+		g_object_unref (old_folder);
+}
+
+typedef struct {
+	gconstpointer  data;
+	GSList        *dropped;
+} ForgetInfo;
+
+static gboolean
+is_same_or_child_url (gpointer key, gpointer value, gpointer user_data)
+{
+	ForgetInfo *info = (ForgetInfo *) user_data;
+	const gchar *url = (const gchar *) key;
+	const gchar *parent_url = (const gchar *) info->data;
+	gsize len = strlen (parent_url);
+
+	if (strncmp (url, parent_url, len) != 0 ||
+	    (url[len] != '\0' && url[len] != '/'))
+		return FALSE;
+
+	g_free (key);
+	info->dropped = g_slist_prepend (info->dropped, value);
+	return TRUE;
+}
+
+/* The folders are unreffed out of the index lock */
+static void
+free_dropped_folders (ForgetInfo *info)
+{
+	g_slist_foreach (info->dropped, (GFunc) g_object_unref, NULL);
+	g_slist_free (info->dropped);
+}
+
+void
+modest_tny_account_store_forget_folder (ModestTnyAccountStore *self,
+					const gchar *url)
+{
+	ModestTnyAccountStorePrivate *priv;
+	ForgetInfo info;
+
+	g_return_if_fail (MODEST_IS_TNY_ACCOUNT_STORE (self));
+	g_return_if_fail (url);
+
+	priv = MODEST_TNY_ACCOUNT_STORE_GET_PRIVATE (self);
+
+	/* The subfolders go away with it */
+	info.data = url;
+	info.dropped = NULL;
+	G_LOCK (index);
+	g_hash_table_foreach_steal (priv->folders_by_url, is_same_or_child_url, &info);
+	G_UNLOCK (index);
+
+	free_dropped_folders (&info);
+}
+
+static gboolean
+is_folder_of_account (gpointer key, gpointer value, gpointer user_data)
+{
+	ForgetInfo *info = (ForgetInfo *) user_data;
+	TnyAccount *folder_account;
+	gboolean retval;
+
+	folder_account = tny_folder_get_account (TNY_FOLDER (value));
+	retval = (folder_account == NULL || folder_account == (TnyAccount *) info->data);
+	if (folder_account)
+		g_object_unref (folder_account);
+
+	if (retval) {
+		g_free (key);
+		info->dropped = g_slist_prepend (info->dropped, value);
+	}
+
+	return retval;
+}
+
+/* Drops the indexes when an account goes away */
+static void
+forget_account (ModestTnyAccountStorePrivate *priv, TnyAccount *account)
+{
+	ForgetInfo info;
+
+	clear_account_index (priv);
+
+	info.data = account;
+	info.dropped = NULL;
+	G_LOCK (index);
+	g_hash_table_foreach_steal (priv->folders_by_url, is_folder_of_account, &info);
+	G_UNLOCK (index);
+
+	free_dropped_folders (&info);
+}
+
 static TnyAccount*
 get_tny_account_by (TnyList *accounts,
 		    ModestTnyAccountStoreQueryType type,
@@ -1307,6 +1584,10 @@ modest_tny_account_store_get_tny_account_by (ModestTnyAccountStore *self,
 	g_return_val_if_fail (str, NULL);
 	
 	priv = MODEST_TNY_ACCOUNT_STORE_GET_PRIVATE(self);
+
+	account = lookup_account_index (priv, type, str);
+	if (account)
+		return account;
 	
 	/* Search in store accounts */
 	account = get_tny_account_by (priv->store_accounts, type, str);
@@ -1321,6 +1602,9 @@ modest_tny_account_store_get_tny_account_by (ModestTnyAccountStore *self,
 			account = get_tny_account_by (priv->store_accounts_outboxes, type, str);
 	}
 
+	if (account)
+		add_to_account_index (priv, type, str, account);
+
 	/* Warn if nothing was found. This is generally unusual. */
 	if (!account) {
 		g_warning("%s: Failed to find account with %s=%s\n", 
@@ -1556,8 +1840,13 @@ add_existing_accounts (ModestTnyAccountStore *self)
 		const gchar *account_name = (const gchar*) iter->data;
 		
 		/* Insert all enabled accounts without notifying */
-		if (modest_account_mgr_get_enabled (priv->account_mgr, account_name))
+		if (modest_account_mgr_get_enabled (priv->account_mgr, account_name)) {
+			gchar *phase = g_strconcat ("account:", account_name, NULL);
+			modest_startup_trace_begin (phase);
 			insert_account (self, account_name, FALSE);
+			modest_startup_trace_end (phase);
+			g_free (phase);
+		}
 	}
 	modest_account_mgr_free_account_names (account_names);
 }
@@ -1824,6 +2113,7 @@ remove_transport_account (ModestTnyAccountStore *self,
 	   disconnection */
 	g_signal_emit (G_OBJECT (self), signals [ACCOUNT_REMOVED_SIGNAL], 0, transport_account);
 	tny_list_remove (priv->transport_accounts, (GObject *) transport_account);
+	forget_account (priv, TNY_ACCOUNT (transport_account));
 		
 	/* Remove the OUTBOX of the account from the global outbox */
 	outbox = g_hash_table_lookup (priv->outbox_of_transport, transport_account);
@@ -1834,6 +2124,7 @@ remove_transport_account (ModestTnyAccountStore *self,
 
 		if (outbox_account) {
 			tny_list_remove (priv->store_accounts_outboxes, G_OBJECT (outbox_account));
+			forget_account (priv, outbox_account);
 			/* Remove existing emails to send */
 			tny_store_account_delete_cache (TNY_STORE_ACCOUNT (outbox_account));
 			g_object_unref (outbox_account);
@@ -1910,6 +2201,7 @@ on_account_removed (ModestAccountMgr *acc_mgr,
 		   observers. Do not need to wait for account
 		   disconnection */
 		tny_list_remove (priv->store_accounts, (GObject *) store_account);
+		forget_account (priv, TNY_ACCOUNT (store_account));
 		g_signal_emit (G_OBJECT (self), signals [ACCOUNT_REMOVED_SIGNAL], 0, store_account);
 
 		/* Cancel all pending operations */
@@ -2125,6 +2417,72 @@ modest_tny_account_store_find_msg_in_outboxes (ModestTnyAccountStore *self,
 	return msg;
 }
 
+gboolean
+modest_tny_account_store_resolve_msg_url (ModestTnyAccountStore *self,
+					  const gchar *uri,
+					  TnyAccount **ac_out,
+					  TnyFolder **folder_out,
+					  gchar **uid_out)
+{
+	TnyAccount *account = NULL;
+	TnyFolder *folder = NULL;
+	gchar *uid = NULL;
+
+	g_return_val_if_fail (MODEST_IS_TNY_ACCOUNT_STORE (self), FALSE);
+	g_return_val_if_fail (uri && ac_out && folder_out && uid_out, FALSE);
+
+	if (g_str_has_prefix (uri, "merge://")) {
+		TnyMsg *msg;
+
+		/* Outbox messages are local, it's cheap to get them */
+		msg = modest_tny_account_store_find_msg_in_outboxes (self, uri, &account);
+		if (msg) {
+			TnyHeader *header = tny_msg_get_header (msg);
+
+			folder = tny_msg_get_folder (msg);
+			uid = tny_header_dup_uid (header);
+			g_object_unref (header);
+			g_object_unref (msg);
+		}
+	} else {
+		account = tny_account_store_find_account (TNY_ACCOUNT_STORE (self), uri);
+		if (account && TNY_IS_STORE_ACCOUNT (account))
+			folder = tny_store_account_find_folder (TNY_STORE_ACCOUNT (account), uri, NULL);
+
+		if (folder) {
+			gchar *folder_url;
+			gsize len;
+
+			/* message uris are <folder url>/<uid> */
+			folder_url = tny_folder_get_url_string (folder);
+			len = folder_url ? strlen (folder_url) : 0;
+			if (len && g_str_has_prefix (uri, folder_url) && uri[len] == '/') {
+				uid = g_strdup (uri + len + 1);
+			} else {
+				const gchar *sep = strrchr (uri, '/');
+				if (sep)
+					uid = g_strdup (sep + 1);
+			}
+			g_free (folder_url);
+		}
+	}
+
+	if (!folder || !uid || uid[0] == '\0') {
+		if (account)
+			g_object_unref (account);
+		if (folder)
+			g_object_unref (folder);
+		g_free (uid);
+		return FALSE;
+	}
+
+	*ac_out = account;
+	*folder_out = folder;
+	*uid_out = uid;
+
+	return TRUE;
+}
+
 TnyTransportAccount *
 modest_tny_account_store_get_transport_account_from_outbox_header(ModestTnyAccountStore *self, TnyHeader *header)
 {
@@ -210,6 +210,65 @@ TnyMsg *modest_tny_account_store_find_msg_in_outboxes (ModestTnyAccountStore *se
 						       const gchar *uri,
 						       TnyAccount **ac_out);
 
+/**
+ * modest_tny_account_store_resolve_msg_url:
+ * @self: a #ModestTnyAccountStore
+ * @uri: the uri of a message
+ * @ac_out: output attribute, the #TnyAccount of the message
+ * @folder_out: output attribute, the #TnyFolder of the message
+ * @uid_out: output attribute, the uid of the message in @folder_out
+ *
+ * splits a message uri in the account, folder and uid of the
+ * message, without retrieving the message itself. Messages in the
+ * outboxes (merge:// uris) are looked up in the local outboxes.
+ *
+ * Returns: %TRUE if the uri was resolved, in that case the caller
+ * must unref @ac_out and @folder_out and free @uid_out
+ **/
+gboolean modest_tny_account_store_resolve_msg_url (ModestTnyAccountStore *self,
+						   const gchar *uri,
+						   TnyAccount **ac_out,
+						   TnyFolder **folder_out,
+						   gchar **uid_out);
+
+/**
+ * modest_tny_account_store_find_folder_by_url:
+ * @self: a #ModestTnyAccountStore
+ * @url: the url of a folder
+ *
+ * looks up a folder already seen with
+ * modest_tny_account_store_index_folder. It never asks the accounts,
+ * so %NULL does not mean that the folder does not exist
+ *
+ * Returns: %NULL or a new reference to the #TnyFolder
+ **/
+TnyFolder *modest_tny_account_store_find_folder_by_url (ModestTnyAccountStore *self,
+							const gchar *url);
+
+/**
+ * modest_tny_account_store_index_folder:
+ * @self: a #ModestTnyAccountStore
+ * @folder: a #TnyFolder
+ *
+ * adds @folder to the url index used by
+ * modest_tny_account_store_find_folder_by_url. The index holds a
+ * reference to @folder until it is removed with
+ * modest_tny_account_store_forget_folder or its account goes away
+ **/
+void modest_tny_account_store_index_folder (ModestTnyAccountStore *self,
+					    TnyFolder *folder);
+
+/**
+ * modest_tny_account_store_forget_folder:
+ * @self: a #ModestTnyAccountStore
+ * @url: the url of a folder
+ *
+ * removes the folder with @url, and all its subfolders, from the url
+ * index. It must be called when a folder is moved, renamed or deleted
+ **/
+void modest_tny_account_store_forget_folder (ModestTnyAccountStore *self,
+					     const gchar *url);
+
 
 /**
  * modest_tny_account_store_get_transport_account_from_outbox_header:
@@ -48,7 +48,9 @@
 #include <tny-folder-stats.h>
 #include <tny-merge-folder.h>
 #include <modest-debug.h>
+#include <modest-folder-counts.h>
 #include <string.h>
+#include <gdk/gdk.h>
 #ifdef MODEST_TOOLKIT_HILDON2
 #include <hildon/hildon-file-system-info.h>
 #endif
@@ -872,13 +874,219 @@ modest_tny_account_new_for_per_account_local_outbox_folder (ModestAccountMgr *ac
 
 
 
-typedef struct _RecurseFoldersAsyncHelper {
+/*
+ * Folder stats. Getting the size of a folder stat()s all its cached
+ * messages, so it's done in a small pool of threads instead of the
+ * main loop, and the results are cached per folder while the folder
+ * counts (see modest-folder-counts.h) don't change
+ */
+
+/* threads computing folder stats */
+#define FOLDER_STATS_THREADS 2
+
+/* we also forget the cached sizes after a while, downloading a
+   message changes the size but not the counts */
+#define FOLDER_STATS_MAX_AGE (5*60)
+
+typedef struct {
+	guint  msg_count;
+	guint  local_size;
+	/* the folder counts the stats were computed with */
+	guint  all_count;
+	time_t counts_mtime;
+	time_t computed;
+} FolderStatsEntry;
+
+typedef struct {
+	guint id;
+	gint ref_count;
+	gboolean cancelled;
 	ModestFolderStats stats;
 	guint pending_calls;
 	GetFolderStatsCallback callback;
 	GetFolderStatsCallback status_callback;
 	gpointer user_data;
-} RecurseFoldersAsyncHelper;
+} FolderStatsRequest;
+
+typedef struct {
+	FolderStatsRequest *request;
+	TnyFolder *folder;
+	gchar *url;
+	guint msg_count;
+	guint local_size;
+} FolderStatsJob;
+
+G_LOCK_DEFINE_STATIC (folder_stats);
+static GHashTable  *_folder_stats_cache = NULL;	/* url -> FolderStatsEntry */
+static GThreadPool *_folder_stats_pool = NULL;
+
+/* only used in the main loop: id -> FolderStatsRequest */
+static GHashTable  *_folder_stats_requests = NULL;
+static guint        _folder_stats_last_id = 0;
+
+static void
+folder_stats_entry_free (FolderStatsEntry *entry)
+{
+	g_slice_free (FolderStatsEntry, entry);
+}
+
+/* call with the lock held */
+static GHashTable *
+get_folder_stats_cache (void)
+{
+	if (G_UNLIKELY (!_folder_stats_cache))
+		_folder_stats_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+							     (GDestroyNotify) folder_stats_entry_free);
+	return _folder_stats_cache;
+}
+
+static gboolean
+lookup_folder_stats (const gchar *url, guint *msg_count, guint *local_size)
+{
+	ModestFolderCounts counts;
+	FolderStatsEntry *entry;
+	gboolean has_counts, valid = FALSE;
+
+	has_counts = modest_folder_counts_lookup (url, &counts);
+
+	G_LOCK (folder_stats);
+	entry = g_hash_table_lookup (get_folder_stats_cache (), url);
+	/* the counts are only a valid token for the folder contents
+	   if they are being updated from the folder itself */
+	if (entry && has_counts && counts.live &&
+	    entry->all_count == counts.all_count &&
+	    entry->counts_mtime == counts.mtime &&
+	    time (NULL) - entry->computed < FOLDER_STATS_MAX_AGE) {
+		*msg_count = entry->msg_count;
+		*local_size = entry->local_size;
+		valid = TRUE;
+	}
+	G_UNLOCK (folder_stats);
+
+	return valid;
+}
+
+static void
+store_folder_stats (const gchar *url, guint msg_count, guint local_size)
+{
+	ModestFolderCounts counts;
+	FolderStatsEntry *entry;
+
+	/* without counts we could never tell if it's still valid */
+	if (!modest_folder_counts_lookup (url, &counts))
+		return;
+
+	entry = g_slice_new0 (FolderStatsEntry);
+	entry->msg_count = msg_count;
+	entry->local_size = local_size;
+	entry->all_count = counts.all_count;
+	entry->counts_mtime = counts.mtime;
+	entry->computed = time (NULL);
+
+	G_LOCK (folder_stats);
+	g_hash_table_replace (get_folder_stats_cache (), g_strdup (url), entry);
+	G_UNLOCK (folder_stats);
+}
+
+static void
+folder_stats_request_unref (FolderStatsRequest *request)
+{
+	if (g_atomic_int_dec_and_test (&request->ref_count))
+		g_slice_free (FolderStatsRequest, request);
+}
+
+/* Called when an async step of the request finishes */
+static void
+folder_stats_request_step_done (FolderStatsRequest *request)
+{
+	request->pending_calls--;
+
+	/* This means that we have all the folders */
+	if (request->pending_calls == 0) {
+		if (!request->cancelled) {
+			g_hash_table_remove (_folder_stats_requests, GUINT_TO_POINTER (request->id));
+			if (request->callback)
+				request->callback (request->stats, request->user_data);
+		}
+		folder_stats_request_unref (request);
+	}
+}
+
+static void
+add_folder_stats (FolderStatsRequest *request, guint msg_count, guint local_size)
+{
+	request->stats.msg_count += msg_count;
+	request->stats.local_size += local_size;
+
+	/* notify */
+	if (request->status_callback)
+		request->status_callback (request->stats, request->user_data);
+}
+
+static gboolean
+on_folder_stats_job_done (gpointer user_data)
+{
+	FolderStatsJob *job = (FolderStatsJob *) user_data;
+
+	/* The callbacks update the UI, like the tinymail ones they
+	   run with the gdk lock held */
+	gdk_threads_enter ();
+	if (!job->request->cancelled)
+		add_folder_stats (job->request, job->msg_count, job->local_size);
+	folder_stats_request_step_done (job->request);
+	gdk_threads_leave ();
+
+	folder_stats_request_unref (job->request);
+	g_object_unref (job->folder);
+	g_free (job->url);
+	g_slice_free (FolderStatsJob, job);
+
+	return FALSE;
+}
+
+static void
+folder_stats_worker (gpointer data, gpointer user_data)
+{
+	FolderStatsJob *job = (FolderStatsJob *) data;
+
+	/* Don't stat anything if the dialog was already closed */
+	if (!job->request->cancelled) {
+		job->msg_count = tny_folder_get_all_count (job->folder);
+		job->local_size = tny_folder_get_local_size (job->folder);
+		if (job->url)
+			store_folder_stats (job->url, job->msg_count, job->local_size);
+	}
+
+	g_idle_add (on_folder_stats_job_done, job);
+}
+
+static void
+request_folder_stats (FolderStatsRequest *request, TnyFolder *folder)
+{
+	FolderStatsJob *job;
+	guint msg_count, local_size;
+	gchar *url;
+
+	url = tny_folder_get_url_string (folder);
+	if (url && lookup_folder_stats (url, &msg_count, &local_size)) {
+		add_folder_stats (request, msg_count, local_size);
+		g_free (url);
+		return;
+	}
+
+	if (G_UNLIKELY (!_folder_stats_pool))
+		_folder_stats_pool = g_thread_pool_new (folder_stats_worker, NULL,
+							FOLDER_STATS_THREADS, FALSE, NULL);
+
+	job = g_slice_new0 (FolderStatsJob);
+	job->request = request;
+	g_atomic_int_inc (&request->ref_count);
+	job->folder = g_object_ref (folder);
+	job->url = url;
+
+	request->pending_calls++;
+	g_thread_pool_push (_folder_stats_pool, job, NULL);
+}
 
 static void 
 recurse_folders_async_cb (TnyFolderStore *folder_store, 
@@ -887,13 +1095,13 @@ recurse_folders_async_cb (TnyFolderStore *folder_store,
 			  GError *err, 
 			  gpointer user_data)
 {
-	RecurseFoldersAsyncHelper *helper;
+	FolderStatsRequest *request;
     	TnyIterator *iter;
 
-	helper = (RecurseFoldersAsyncHelper *) user_data;
+	request = (FolderStatsRequest *) user_data;
 
 	/* A goto just to avoid an indentation level */
-	if (err || canceled)
+	if (err || canceled || request->cancelled)
 		goto next_folder;
 
 	/* Retrieve children */
@@ -902,29 +1110,24 @@ recurse_folders_async_cb (TnyFolderStore *folder_store,
 		TnyList *folders = NULL;
 		TnyFolderStore *folder = NULL;
 
-		folders = tny_simple_list_new ();
 		folder = (TnyFolderStore*) tny_iterator_get_current (iter);
-	
-		/* Add pending call */
-		helper->pending_calls++;
-		helper->stats.folders++;
-		if (TNY_IS_FOLDER (folder)) {
-			helper->stats.msg_count += tny_folder_get_all_count (TNY_FOLDER (folder));
-			helper->stats.local_size += tny_folder_get_local_size (TNY_FOLDER (folder));
-		}
 
-		/* notify */
-		if (helper->status_callback)
-			helper->status_callback (helper->stats, helper->user_data);
+		request->stats.folders++;
+		if (TNY_IS_FOLDER (folder))
+			request_folder_stats (request, TNY_FOLDER (folder));
 
 		/* Avoid the outbox */
 		if (!TNY_IS_MERGE_FOLDER (folder) && 
 		    (TNY_IS_FOLDER (folder) && 
-		     tny_folder_get_folder_type (TNY_FOLDER (folder)) != TNY_FOLDER_TYPE_OUTBOX))
+		     tny_folder_get_folder_type (TNY_FOLDER (folder)) != TNY_FOLDER_TYPE_OUTBOX)) {
+			/* Add pending call */
+			request->pending_calls++;
+			folders = tny_simple_list_new ();
 			tny_folder_store_get_folders_async (folder, folders, NULL, FALSE,
 							    recurse_folders_async_cb, 
-							    NULL, helper);
-		g_object_unref (folders);
+							    NULL, request);
+			g_object_unref (folders);
+		}
 		g_object_unref (G_OBJECT (folder));
 		
 		tny_iterator_next (iter);
@@ -933,48 +1136,61 @@ recurse_folders_async_cb (TnyFolderStore *folder_store,
 
 next_folder:
 	/* Remove my own pending call */
-	helper->pending_calls--;
-
-	/* This means that we have all the folders */
-	if (helper->pending_calls == 0) {
-		/* notify */
-		if (helper->callback)
-			helper->callback (helper->stats, helper->user_data);
-
-		/* Free resources */
-		g_slice_free (RecurseFoldersAsyncHelper, helper);
-	}
+	folder_stats_request_step_done (request);
 }
 
-void
+guint
 modest_tny_folder_store_get_folder_stats (TnyFolderStore *self,
 					  GetFolderStatsCallback callback,
 					  GetFolderStatsCallback status_callback,
 					  gpointer user_data)
 {
-	RecurseFoldersAsyncHelper *helper;
+	FolderStatsRequest *request;
 	TnyList *folders;
 
-	g_return_if_fail (TNY_IS_FOLDER_STORE (self));
+	g_return_val_if_fail (TNY_IS_FOLDER_STORE (self), 0);
 
-	/* Create helper */
-	helper = g_slice_new0 (RecurseFoldersAsyncHelper);
-	helper->pending_calls = 1;
-	helper->callback = callback;
-	helper->status_callback = status_callback;
-	helper->user_data = user_data;
+	/* Create request */
+	request = g_slice_new0 (FolderStatsRequest);
+	request->id = ++_folder_stats_last_id;
+	request->ref_count = 1;
+	request->pending_calls = 1;
+	request->callback = callback;
+	request->status_callback = status_callback;
+	request->user_data = user_data;
 
-	if (TNY_IS_FOLDER (self)) {
-		helper->stats.msg_count = tny_folder_get_all_count (TNY_FOLDER (self));
-		helper->stats.local_size = tny_folder_get_local_size (TNY_FOLDER (self));
-	}
+	if (G_UNLIKELY (!_folder_stats_requests))
+		_folder_stats_requests = g_hash_table_new (g_direct_hash, g_direct_equal);
+	g_hash_table_insert (_folder_stats_requests, GUINT_TO_POINTER (request->id), request);
+
+	if (TNY_IS_FOLDER (self))
+		request_folder_stats (request, TNY_FOLDER (self));
 
 	folders = tny_simple_list_new ();
 	tny_folder_store_get_folders_async (TNY_FOLDER_STORE (self),
 					    folders, NULL, FALSE,
 					    recurse_folders_async_cb, 
-					    NULL, helper);
+					    NULL, request);
 	g_object_unref (folders);
+
+	return request->id;
+}
+
+void
+modest_tny_folder_store_cancel_folder_stats (guint request_id)
+{
+	FolderStatsRequest *request;
+
+	if (!_folder_stats_requests)
+		return;
+
+	request = g_hash_table_lookup (_folder_stats_requests, GUINT_TO_POINTER (request_id));
+	if (!request)
+		return;
+
+	/* The pending steps still finish, but nobody is notified */
+	request->cancelled = TRUE;
+	g_hash_table_remove (_folder_stats_requests, GUINT_TO_POINTER (request_id));
 }
 
 const gchar* 
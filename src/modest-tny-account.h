@@ -151,14 +151,33 @@ typedef void (*GetFolderStatsCallback) (ModestFolderStats stats,
 /**
  * modest_tny_folder_store_get_folder_stats:
  * @self: a #TnyFolderStore
- * 
+ * @callback: called with the totals once all the folders are done
+ * @status_callback: called with the partial totals after every folder
+ * @user_data: data for the callbacks
+ *
+ * computes the number of folders, messages and the local size of
+ * @self and all its subfolders. The sizes are computed in a thread
+ * pool and cached per folder, the callbacks are always called from
+ * the main loop with the gdk lock held.
+ *
+ * Returns: an id for modest_tny_folder_store_cancel_folder_stats
  **/
-void
+guint
 modest_tny_folder_store_get_folder_stats (TnyFolderStore *self,
 					  GetFolderStatsCallback callback,
 					  GetFolderStatsCallback status_callback,
 					  gpointer user_data);
 
+/**
+ * modest_tny_folder_store_cancel_folder_stats:
+ * @request_id: the id returned by modest_tny_folder_store_get_folder_stats
+ *
+ * stops computing the stats, none of the callbacks will be called
+ * after this. It does nothing if the request already finished
+ **/
+void
+modest_tny_folder_store_cancel_folder_stats (guint request_id);
+
 /**
  * modest_tny_folder_store_is_remote:
  * @folder_store: The folder store (folder or account) that needs to
@@ -529,31 +529,17 @@ modest_tny_folder_get_display_name (TnyFolder *folder)
 	return fname;
 }
 
-TnyFolder *
-modest_tny_folder_store_find_folder_from_uri (TnyFolderStore *folder_store, const gchar *uri)
+static TnyFolder *
+find_folder_by_url_in_store (TnyFolderStore *folder_store, const gchar *url)
 {
 	TnyList *children;
 	TnyIterator *iterator;
 	TnyFolder *result;
-	gchar *uri_to_find, *slash;
-	gint uri_lenght;
-
-	if (uri == NULL)
-		return NULL;
-
-	slash = strrchr (uri, '/');
-	if (slash == NULL)
-		return NULL;
 
 	result = NULL;
 	children = TNY_LIST (tny_simple_list_new ());
 	tny_folder_store_get_folders (folder_store, children, NULL, FALSE, NULL);
 
-	uri_lenght = slash - uri + 1;
-	uri_to_find = g_malloc0 (sizeof(char) * uri_lenght);
-	strncpy (uri_to_find, uri, uri_lenght);
-	uri_to_find[uri_lenght - 1] = '\0';
-
 	for (iterator = tny_list_create_iterator (children);
 	     iterator && !tny_iterator_is_done (iterator) && (result == NULL);
 	     tny_iterator_next (iterator)) {
@@ -567,21 +553,171 @@ modest_tny_folder_store_find_folder_from_uri (TnyFolderStore *folder_store, cons
 			gchar *folder_url;
 
 			folder_url = tny_folder_get_url_string (TNY_FOLDER (child));
-			if (uri_to_find && folder_url && !strcmp (folder_url, uri_to_find))
+			if (folder_url && !strcmp (folder_url, url))
 				result = TNY_FOLDER(g_object_ref (child));
 			g_free (folder_url);
 		}
 
 		if ((result == NULL) && TNY_IS_FOLDER_STORE (child)) {
-			result = modest_tny_folder_store_find_folder_from_uri (child, uri);
+			result = find_folder_by_url_in_store (child, url);
 		}
 
 		g_object_unref (child);
 	}
 
-	g_free (uri_to_find);
 	g_object_unref (iterator);
 	g_object_unref (children);
 
 	return result;
 }
+
+TnyFolder *
+modest_tny_folder_store_find_folder_from_uri (TnyFolderStore *folder_store, const gchar *uri)
+{
+	ModestTnyAccountStore *account_store;
+	TnyFolder *result;
+	gchar *uri_to_find, *slash;
+
+	if (uri == NULL)
+		return NULL;
+
+	slash = strrchr (uri, '/');
+	if (slash == NULL)
+		return NULL;
+
+	uri_to_find = g_strndup (uri, slash - uri);
+
+	/* Try first with the folders we already found, walking the
+	   whole folder tree is expensive with lots of folders */
+	account_store = modest_runtime_get_account_store ();
+	result = modest_tny_account_store_find_folder_by_url (account_store, uri_to_find);
+	if (result && !modest_tny_folder_is_ancestor (result, folder_store)) {
+		g_object_unref (result);
+		result = NULL;
+	}
+
+	if (result == NULL) {
+		result = find_folder_by_url_in_store (folder_store, uri_to_find);
+		if (result)
+			modest_tny_account_store_index_folder (account_store, result);
+	}
+
+	g_free (uri_to_find);
+
+	return result;
+}
+
+/* Appends to @headers the ones of @all_headers whose uid is in
+   @wanted, removing them from it */
+static guint
+filter_headers_by_uid (TnyList *all_headers,
+		       GHashTable *wanted,
+		       TnyList *headers)
+{
+	TnyIterator *iter;
+	guint found = 0;
+
+	iter = tny_list_create_iterator (all_headers);
+	while (!tny_iterator_is_done (iter) && g_hash_table_size (wanted) > 0) {
+		TnyHeader *header;
+		gchar *uid;
+
+		header = TNY_HEADER (tny_iterator_get_current (iter));
+		uid = tny_header_dup_uid (header);
+		if (uid && g_hash_table_remove (wanted, uid)) {
+			tny_list_append (headers, G_OBJECT (header));
+			found++;
+		}
+		g_free (uid);
+		g_object_unref (header);
+		tny_iterator_next (iter);
+	}
+	g_object_unref (iter);
+
+	return found;
+}
+
+guint
+modest_tny_folder_get_headers_by_uid (TnyFolder *folder,
+				      GSList *uids,
+				      TnyList *headers)
+{
+	GHashTable *wanted;
+	TnyList *all_headers;
+	GSList *node;
+	guint found;
+
+	g_return_val_if_fail (TNY_IS_FOLDER (folder), 0);
+	g_return_val_if_fail (TNY_IS_LIST (headers), 0);
+
+	if (!uids)
+		return 0;
+
+	wanted = g_hash_table_new (g_str_hash, g_str_equal);
+	for (node = uids; node; node = g_slist_next (node))
+		g_hash_table_insert (wanted, node->data, node->data);
+
+	/* No refresh, we only want what's in the summary */
+	all_headers = tny_simple_list_new ();
+	tny_folder_get_headers (folder, all_headers, FALSE, NULL);
+	found = filter_headers_by_uid (all_headers, wanted, headers);
+
+	g_object_unref (all_headers);
+	g_hash_table_destroy (wanted);
+
+	return found;
+}
+
+typedef struct {
+	GHashTable *wanted;
+	TnyGetHeadersCallback callback;
+	gpointer user_data;
+} GetHeadersByUidInfo;
+
+static void
+on_get_headers_by_uid (TnyFolder *folder,
+		       gboolean cancelled,
+		       TnyList *all_headers,
+		       GError *err,
+		       gpointer user_data)
+{
+	GetHeadersByUidInfo *info = (GetHeadersByUidInfo *) user_data;
+	TnyList *headers;
+
+	headers = tny_simple_list_new ();
+	if (!cancelled && !err)
+		filter_headers_by_uid (all_headers, info->wanted, headers);
+
+	if (info->callback)
+		info->callback (folder, cancelled, headers, err, info->user_data);
+
+	g_object_unref (headers);
+	g_hash_table_destroy (info->wanted);
+	g_slice_free (GetHeadersByUidInfo, info);
+}
+
+void
+modest_tny_folder_get_headers_by_uid_async (TnyFolder *folder,
+					    GSList *uids,
+					    TnyGetHeadersCallback callback,
+					    gpointer user_data)
+{
+	GetHeadersByUidInfo *info;
+	TnyList *all_headers;
+	GSList *node;
+
+	g_return_if_fail (TNY_IS_FOLDER (folder));
+
+	/* The uids could change before the headers are there */
+	info = g_slice_new0 (GetHeadersByUidInfo);
+	info->wanted = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	for (node = uids; node; node = g_slist_next (node))
+		g_hash_table_insert (info->wanted, g_strdup (node->data), NULL);
+	info->callback = callback;
+	info->user_data = user_data;
+
+	all_headers = tny_simple_list_new ();
+	tny_folder_get_headers_async (folder, all_headers, FALSE,
+				      on_get_headers_by_uid, NULL, info);
+	g_object_unref (all_headers);
+}
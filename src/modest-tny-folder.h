@@ -226,6 +226,38 @@ TnyFolder *modest_tny_folder_store_find_folder_from_uri (TnyFolderStore *folder_
  */
 gchar * modest_tny_folder_get_display_name (TnyFolder *folder);
 
+/**
+ * modest_tny_folder_get_headers_by_uid:
+ * @folder: a #TnyFolder
+ * @uids: a list of message uids
+ * @headers: a #TnyList where the found headers will be appended
+ *
+ * gets the headers of the messages with the given @uids from the
+ * local summary of @folder, in a single pass. It neither refreshes
+ * the folder nor retrieves any message. The uids that are not in the
+ * summary are ignored
+ *
+ * Returns: the number of headers found
+ */
+guint modest_tny_folder_get_headers_by_uid (TnyFolder *folder,
+					    GSList *uids,
+					    TnyList *headers);
+
+/**
+ * modest_tny_folder_get_headers_by_uid_async:
+ * @folder: a #TnyFolder
+ * @uids: a list of message uids
+ * @callback: called with the found headers, from the main loop
+ * @user_data: data for @callback
+ *
+ * asynchronous version of modest_tny_folder_get_headers_by_uid(),
+ * so loading a big summary does not block the UI. @uids are copied
+ */
+void modest_tny_folder_get_headers_by_uid_async (TnyFolder *folder,
+						 GSList *uids,
+						 TnyGetHeadersCallback callback,
+						 gpointer user_data);
+
 G_END_DECLS
 
 #endif /* __MODEST_TNY_FOLDER_H__*/
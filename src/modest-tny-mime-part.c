@@ -74,49 +74,40 @@ modest_tny_mime_part_get_header_value (TnyMimePart *part, const gchar *header)
 
 
 
+typedef struct {
+	ModestTnyMimePartInfo info;
+	GPtrArray *children;	/* TnyMimePart refs, NULL until asked for */
+} PartIndex;
+
+#define PART_INDEX_KEY "modest-mime-part-index"
+
+/* protects attaching the indexes to the parts and filling the children */
+G_LOCK_DEFINE_STATIC (part_index);
+
 /* we consider more things attachments than tinymail does...
+ * @content_type and @content_disp must be lowercase already
  */
-gboolean
-modest_tny_mime_part_is_attachment_for_modest (TnyMimePart *part)
+static gboolean
+is_attachment_for_modest (TnyMimePart *part, const gchar *content_type, const gchar *content_disp)
 {
-	gchar *tmp, *content_type;
 	gboolean has_content_disp_name = FALSE;
 
-	g_return_val_if_fail (part && TNY_IS_MIME_PART(part), FALSE);
-
-	/* purged attachments were attachments in the past, so they're
-	 * still attachments */
-	if (tny_mime_part_is_purged (part))
-		return TRUE; 
-	
 	/* if tinymail thinks it's an attachment, it is. One exception: if it's
 	 * a multipart and it's not a message/rfc822 it cannot be an attahcment */
 	if (tny_mime_part_is_attachment (part)) {
-		if (!TNY_IS_MSG (part)) {
-			const gchar *content_type;
-			gchar *down_content_type;
-			gboolean is_attachment;
-
-			content_type = tny_mime_part_get_content_type (part);
-			down_content_type = g_ascii_strdown (content_type, -1);
-
-			is_attachment = !g_str_has_prefix (down_content_type, "multipart/");
-			g_free (down_content_type);
-			return is_attachment;
-		} else {
+		if (!TNY_IS_MSG (part))
+			return !g_str_has_prefix (content_type, "multipart/");
+		else
 			return TRUE;
-		}
 	}
 
 	/* if the mime part is a message itself (ie. embedded), it's an attachment */
 	if (TNY_IS_MSG (part))
 		return TRUE;
 	
-	tmp = modest_tny_mime_part_get_header_value (part, "Content-Disposition");
-	if (tmp) {
+	if (content_disp) {
 		/* If the Content-Disposition header contains a "name"
 		 * parameter, treat the mime part as an attachment */
-		gchar *content_disp = g_ascii_strdown(tmp, -1);
 		gint len = strlen (content_disp);
 		const gchar *substr = g_strstr_len (content_disp, len, "name");
 		if (substr != NULL) {
@@ -129,8 +120,6 @@ modest_tny_mime_part_is_attachment_for_modest (TnyMimePart *part)
 				g_strstr_len (substr, substrlen, "name*0=") != NULL ||
 				g_strstr_len (substr, substrlen, "name*0*=") != NULL;
 		}
-		g_free (tmp);
-		g_free (content_disp);
 	}
 		
 	/* if it doesn't have a content deposition with a name= attribute, it's not an attachment */
@@ -141,13 +130,8 @@ modest_tny_mime_part_is_attachment_for_modest (TnyMimePart *part)
 	 * is already handle above "...is_attachment". modest consider these "inline" things
          * attachments as well, unless they are embedded images for html mail 
 	 */
-	content_type = g_ascii_strdown (tny_mime_part_get_content_type (part), -1);
-	if (!g_str_has_prefix (content_type, "image/")) {
-		g_free (content_type);
+	if (!g_str_has_prefix (content_type, "image/"))
 		return TRUE; /* it's not an image, so it must be an attachment */
-	}
-	g_free (content_type);
-
 
 	/* now, if it's an inline-image, and it has a content-id or location, we
 	 * we guess it's an inline image, and not an attachment */
@@ -158,6 +142,178 @@ modest_tny_mime_part_is_attachment_for_modest (TnyMimePart *part)
 	return TRUE;
 }
 
+static PartIndex *
+part_index_new (TnyMimePart *part)
+{
+	PartIndex *index;
+	TnyList *pairs;
+	TnyIterator *iter;
+	gchar *content_disp = NULL;
+	const gchar *content_type;
+
+	index = g_slice_new0 (PartIndex);
+
+	/* we need to strdown the content type, because
+	 * tny_mime_part_has_content_type does not do it...
+	 */
+	content_type = tny_mime_part_get_content_type (part);
+	index->info.content_type = g_ascii_strdown (content_type ? content_type : "", -1);
+	index->info.is_msg = TNY_IS_MSG (part);
+
+	/* one pass over the headers for both Content-Type and
+	 * Content-Disposition */
+	pairs = tny_simple_list_new ();
+	tny_mime_part_get_header_pairs (part, pairs);
+	for (iter = tny_list_create_iterator (pairs);
+	     !tny_iterator_is_done (iter);
+	     tny_iterator_next (iter)) {
+		TnyPair *pair = (TnyPair*) tny_iterator_get_current (iter);
+		const gchar *name = tny_pair_get_name (pair);
+
+		if (!index->info.header_content_type && strcasecmp (name, "Content-Type") == 0) {
+			gchar *value = g_strstrip (g_strdup (tny_pair_get_value (pair)));
+			index->info.header_content_type = g_ascii_strdown (value, -1);
+			g_free (value);
+		} else if (!content_disp && strcasecmp (name, "Content-Disposition") == 0) {
+			content_disp = g_ascii_strdown (tny_pair_get_value (pair), -1);
+		}
+		g_object_unref (pair);
+	}
+	g_object_unref (iter);
+	g_object_unref (pairs);
+
+	/* mime-parts with a content-disposition header (either 'inline' or 'attachment')
+	 * and a 'name=' thingy cannot be body parts */
+	index->info.has_disp_name = content_disp && strstr (content_disp, "name=") != NULL;
+	index->info.is_attachment = is_attachment_for_modest (part, index->info.content_type,
+							      content_disp);
+	g_free (content_disp);
+
+	return index;
+}
+
+static void
+part_index_free (PartIndex *index)
+{
+	g_free (index->info.content_type);
+	g_free (index->info.header_content_type);
+	if (index->children) {
+		g_ptr_array_foreach (index->children, (GFunc) g_object_unref, NULL);
+		g_ptr_array_free (index->children, TRUE);
+	}
+	g_slice_free (PartIndex, index);
+}
+
+static PartIndex *
+get_part_index (TnyMimePart *part)
+{
+	PartIndex *index, *other;
+
+	G_LOCK (part_index);
+	index = g_object_get_data (G_OBJECT (part), PART_INDEX_KEY);
+	G_UNLOCK (part_index);
+	if (index)
+		return index;
+
+	/* build it without the lock held, tinymail takes its own locks
+	 * when reading the headers */
+	index = part_index_new (part);
+
+	G_LOCK (part_index);
+	other = g_object_get_data (G_OBJECT (part), PART_INDEX_KEY);
+	if (other) {
+		part_index_free (index);
+		index = other;
+	} else {
+		g_object_set_data_full (G_OBJECT (part), PART_INDEX_KEY, index,
+					(GDestroyNotify) part_index_free);
+	}
+	G_UNLOCK (part_index);
+
+	return index;
+}
+
+const ModestTnyMimePartInfo *
+modest_tny_mime_part_get_info (TnyMimePart *part)
+{
+	g_return_val_if_fail (part && TNY_IS_MIME_PART (part), NULL);
+
+	return &(get_part_index (part)->info);
+}
+
+GPtrArray *
+modest_tny_mime_part_get_children (TnyMimePart *part)
+{
+	PartIndex *index;
+	GPtrArray *children;
+	TnyList *parts;
+	TnyIterator *iter;
+
+	g_return_val_if_fail (part && TNY_IS_MIME_PART (part), NULL);
+
+	index = get_part_index (part);
+
+	G_LOCK (part_index);
+	children = index->children;
+	G_UNLOCK (part_index);
+	if (children)
+		return children;
+
+	/* keeping the children alive is what keeps their indexes, as
+	 * tinymail creates new wrappers on each get_parts */
+	parts = tny_simple_list_new ();
+	tny_mime_part_get_parts (part, parts);
+	children = g_ptr_array_sized_new (tny_list_get_length (parts));
+	for (iter = tny_list_create_iterator (parts);
+	     !tny_iterator_is_done (iter);
+	     tny_iterator_next (iter)) {
+		TnyMimePart *child = TNY_MIME_PART (tny_iterator_get_current (iter));
+
+		if (!child) {
+			g_warning ("%s: not a valid mime part", __FUNCTION__);
+			continue;
+		}
+		g_ptr_array_add (children, child);
+	}
+	g_object_unref (iter);
+	g_object_unref (parts);
+
+	G_LOCK (part_index);
+	if (index->children) {
+		g_ptr_array_foreach (children, (GFunc) g_object_unref, NULL);
+		g_ptr_array_free (children, TRUE);
+	} else {
+		index->children = children;
+	}
+	children = index->children;
+	G_UNLOCK (part_index);
+
+	return children;
+}
+
+void
+modest_tny_mime_part_invalidate_info (TnyMimePart *part)
+{
+	g_return_if_fail (part && TNY_IS_MIME_PART (part));
+
+	G_LOCK (part_index);
+	g_object_set_data (G_OBJECT (part), PART_INDEX_KEY, NULL);
+	G_UNLOCK (part_index);
+}
+
+gboolean
+modest_tny_mime_part_is_attachment_for_modest (TnyMimePart *part)
+{
+	g_return_val_if_fail (part && TNY_IS_MIME_PART(part), FALSE);
+
+	/* purged attachments were attachments in the past, so they're
+	 * still attachments */
+	if (tny_mime_part_is_purged (part))
+		return TRUE; 
+
+	return get_part_index (part)->info.is_attachment;
+}
+
 gboolean
 modest_tny_mime_part_is_msg (TnyMimePart *part)
 {
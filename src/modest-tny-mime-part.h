@@ -45,6 +45,60 @@
 gchar* modest_tny_mime_part_get_header_value (TnyMimePart *part, const gchar *header);
 
 
+/**
+ * ModestTnyMimePartInfo:
+ * @content_type: the lowercase content type, as tinymail reports it
+ * @header_content_type: the lowercase and stripped value of the
+ * Content-Type header (parameters included), or %NULL
+ * @is_msg: whether the part is an embedded #TnyMsg
+ * @has_disp_name: whether the Content-Disposition header has a name=
+ * parameter, so the part cannot be a body
+ * @is_attachment: whether modest considers the part an attachment
+ *
+ * the structure of a mime part, read once from its headers. It's
+ * cached with the part, so walking the same message again (body
+ * lookup, attachments view, forwarding...) does not parse the
+ * headers again. Nothing here touches the content of the part.
+ */
+typedef struct {
+	gchar    *content_type;
+	gchar    *header_content_type;
+	gboolean  is_msg;
+	gboolean  has_disp_name;
+	gboolean  is_attachment;
+} ModestTnyMimePartInfo;
+
+/**
+ * modest_tny_mime_part_get_info:
+ * @part: a #TnyMimePart
+ *
+ * gets the structure info of @part, building it on first use
+ *
+ * Returns: the info, owned by @part
+ **/
+const ModestTnyMimePartInfo *modest_tny_mime_part_get_info (TnyMimePart *part);
+
+/**
+ * modest_tny_mime_part_get_children:
+ * @part: a #TnyMimePart
+ *
+ * gets the sub parts of @part. They're listed once and kept with
+ * @part, so their own infos are kept as well
+ *
+ * Returns: a #GPtrArray of #TnyMimePart, owned by @part
+ **/
+GPtrArray *modest_tny_mime_part_get_children (TnyMimePart *part);
+
+/**
+ * modest_tny_mime_part_invalidate_info:
+ * @part: a #TnyMimePart
+ *
+ * drops the cached info and children of @part. Call it after
+ * changing the headers or the sub parts of a part that could have
+ * been inspected already
+ **/
+void modest_tny_mime_part_invalidate_info (TnyMimePart *part);
+
 /**
  * modest_tny_mime_part_is_attachment_for_modest
  * @self: some #TnyMimePart 
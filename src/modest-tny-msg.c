@@ -40,6 +40,7 @@
 #include <glib/gprintf.h>
 #include <modest-tny-folder.h>
 #include "modest-tny-mime-part.h"
+#include "modest-attachment-store.h"
 #include <modest-error.h>
 
 
@@ -274,7 +275,23 @@ copy_mime_part (TnyMimePart *part, GError **err)
 	/* get mime part headers */
 	attachment_filename = tny_mime_part_get_filename (part);
 	attachment_cid = tny_mime_part_get_content_id (part);
-	
+
+	/* Single parts are shared through the attachment store, so
+	   saving a draft again or forwarding does not decode nor copy
+	   them again */
+	if (attachment_content_type &&
+	    g_ascii_strncasecmp (attachment_content_type, "multipart/", 10)) {
+		if (!modest_attachment_store_construct_part (part, result)) {
+			if (err != NULL && *err == NULL)
+				g_set_error (err, MODEST_MAIL_OPERATION_ERROR, MODEST_MAIL_OPERATION_ERROR_FILE_IO, _("TODO: couldn't retrieve attachment"));
+			g_object_unref (result);
+			return NULL;
+		}
+		tny_mime_part_set_filename (result, attachment_filename);
+		tny_mime_part_set_content_id (result, attachment_cid);
+		return result;
+	}
+
 	/* fill the stream */
  	attachment_stream = tny_mime_part_get_decoded_stream (part);
 	enc = tny_mime_part_get_transfer_encoding (part);
@@ -371,6 +388,8 @@ add_attachments (TnyMimePart *part, GList *attachments_list, gboolean add_inline
 			g_free (old_cid);
 		}
 	}
+	if (attached > 0)
+		modest_tny_mime_part_invalidate_info (part);
 	return attached;
 }
 
@@ -454,357 +473,185 @@ modest_tny_msg_get_body (TnyMsg *msg, gboolean want_html, gboolean *is_html)
 }
 
 
+/* If it's an application multipart, then we don't get into as we don't
+ * support them (for example application/sml or wap messages */
+static gboolean
+is_application_multipart (const ModestTnyMimePartInfo *info)
+{
+	return info->header_content_type &&
+		g_str_has_prefix (info->header_content_type, "multipart/") &&
+		!g_str_has_prefix (info->header_content_type, "multipart/signed") &&
+		strstr (info->header_content_type, "application/");
+}
+
 TnyMimePart*
 modest_tny_msg_find_body_part_in_alternative (TnyMimePart *msg, gboolean want_html)
 {
-	TnyList *parts;
-	TnyIterator *iter;
-	TnyMimePart *part = NULL, *related_or_mixed = NULL;
-	TnyMimePart *first_part = NULL;
+	GPtrArray *children;
+	TnyMimePart *related_or_mixed = NULL;
 	const gchar *desired_mime_type = want_html ? "text/html" : "text/plain";
+	guint i;
 
-	parts = TNY_LIST (tny_simple_list_new());
-	tny_mime_part_get_parts (TNY_MIME_PART (msg), parts);
+	children = modest_tny_mime_part_get_children (msg);
 
-	for (iter  = tny_list_create_iterator(parts);
-	     !tny_iterator_is_done (iter);
-	     tny_iterator_next (iter)) {
-		gchar *content_type;
-		gboolean is_body;
-
-		part = TNY_MIME_PART (tny_iterator_get_current (iter));
-
-		if (first_part == NULL) {
-			g_object_ref (part);
-			first_part = part;
-		}
+	for (i = 0; i < children->len; i++) {
+		TnyMimePart *part = g_ptr_array_index (children, i);
+		const ModestTnyMimePartInfo *info = modest_tny_mime_part_get_info (part);
 
-		is_body = FALSE;
-		content_type = g_ascii_strdown (tny_mime_part_get_content_type (part), -1);
-		is_body = g_str_has_prefix (content_type, desired_mime_type);
-		if (is_body)
-			break;
+		if (g_str_has_prefix (info->content_type, desired_mime_type))
+			return g_object_ref (part);
 
 		/* Makes no sense to look for related MIME parts if we
-		   only want the plain text parts */
+		   only want the plain text parts. In an alternative the
+		   last part is supposed to be the richest */
 		if (want_html &&
-		    (g_str_has_prefix (content_type, "multipart/related") ||
-		     g_str_has_prefix (content_type, "multipart/mixed"))) {
-			/* In an alternative the last part is supposed
-			   to be the richest */
-			if (related_or_mixed)
-				g_object_unref (related_or_mixed);
-			related_or_mixed = g_object_ref (part);
-		}
-
-		g_free (content_type);
-		g_object_unref (part);
-		part = NULL;
-
+		    (g_str_has_prefix (info->content_type, "multipart/related") ||
+		     g_str_has_prefix (info->content_type, "multipart/mixed")))
+			related_or_mixed = part;
 	}
-	g_object_unref (iter);
-	g_object_unref (parts);
 
-	if (part == NULL) {
-		if (related_or_mixed) {
-			TnyMimePart *retval;
-			if (first_part)
-				g_object_unref (first_part);
-			retval = modest_tny_msg_find_body_part_from_mime_part (related_or_mixed, want_html);
-			g_object_unref (related_or_mixed);
-			return retval;
-		} else {
-			return first_part;
-		}
-	} else {
-		if (first_part)
-			g_object_unref (first_part);
-		if (related_or_mixed)
-			g_object_unref (related_or_mixed);
-		return part;
-	}
+	if (related_or_mixed)
+		return modest_tny_msg_find_body_part_from_mime_part (related_or_mixed, want_html);
+	else if (children->len > 0)
+		return g_object_ref (g_ptr_array_index (children, 0));
+	else
+		return NULL;
 }
 
 static TnyMimePart*
 modest_tny_msg_find_body_part_from_mime_part (TnyMimePart *msg, gboolean want_html)
 {
-	TnyMimePart *part = NULL;
-	TnyList *parts = NULL;
-	TnyIterator *iter = NULL;
-	gchar *header_content_type;
-	gchar *header_content_type_lower = NULL;
+	const ModestTnyMimePartInfo *msg_info;
+	GPtrArray *children;
+	TnyMimePart *fallback = NULL;
 	gboolean is_related_or_mixed = FALSE;
+	guint i;
 
 	if (!msg)
 		return NULL;
 
-	/* If it's an application multipart, then we don't get into as we don't
-	 * support them (for example application/sml or wap messages */
-	header_content_type = modest_tny_mime_part_get_header_value (msg, "Content-Type");
-	if (header_content_type) {
-		header_content_type = g_strstrip (header_content_type);
-		header_content_type_lower = g_ascii_strdown (header_content_type, -1);
-	}
-	if (header_content_type_lower &&
-	    g_str_has_prefix (header_content_type_lower, "multipart/") &&
-	    !g_str_has_prefix (header_content_type_lower, "multipart/signed") &&
-	    strstr (header_content_type_lower, "application/")) {
-		g_free (header_content_type_lower);
-		g_free (header_content_type);
+	msg_info = modest_tny_mime_part_get_info (msg);
+	if (is_application_multipart (msg_info))
 		return NULL;
-	}
-	if (header_content_type_lower && 
-	    g_str_has_prefix (header_content_type_lower, "multipart/alternative")) {
-		g_free (header_content_type_lower);
-		g_free (header_content_type);
+
+	if (msg_info->header_content_type && 
+	    g_str_has_prefix (msg_info->header_content_type, "multipart/alternative"))
 		return modest_tny_msg_find_body_part_in_alternative (msg, want_html);
-	}
 
-	if (header_content_type_lower &&
-	    (g_str_has_prefix (header_content_type_lower, "multipart/related") ||
-	     g_str_has_prefix (header_content_type_lower, "multipart/mixed")))
+	if (msg_info->header_content_type &&
+	    (g_str_has_prefix (msg_info->header_content_type, "multipart/related") ||
+	     g_str_has_prefix (msg_info->header_content_type, "multipart/mixed")))
 		is_related_or_mixed = TRUE;
 
-	g_free (header_content_type_lower);
-	g_free (header_content_type);
-
-	parts = TNY_LIST (tny_simple_list_new());
-	tny_mime_part_get_parts (TNY_MIME_PART (msg), parts);
+	children = modest_tny_mime_part_get_children (msg);
 
 	/* no parts? assume it's single-part message */
-	iter  = tny_list_create_iterator (parts);
-	if (tny_iterator_is_done(iter)) {
+	if (children->len == 0) {
 		gchar *content_type;
 		gboolean is_text_part;
 
 		content_type = modest_tny_mime_part_get_content_type (msg);
 		if (content_type == NULL)
-			goto frees;
+			return NULL;
 		is_text_part = g_str_has_prefix (content_type, "text/");
 		g_free (content_type);
 
 		/* if this part cannot be a supported body return NULL */
-		if (is_text_part)
-			part = TNY_MIME_PART (g_object_ref(G_OBJECT(msg)));
-	} else {
-		TnyMimePart *fallback = NULL;
-		do {
-			gchar *tmp, *content_type = NULL;
-			gboolean has_content_disp_name = FALSE;
-
-			part = TNY_MIME_PART(tny_iterator_get_current (iter));
-
-			if (!part) {
-				g_warning ("%s: not a valid mime part", __FUNCTION__);
-				tny_iterator_next (iter);
-				continue;
-			}
-
-			/* it's a message --> ignore */
-			if (part && TNY_IS_MSG (part)) {
-				g_object_unref (part);
-				part = NULL;
-				tny_iterator_next (iter);
-				continue;
-			}			
-
-			/* we need to strdown the content type, because
-			 * tny_mime_part_has_content_type does not do it...
-			 */
-			content_type = g_ascii_strdown (tny_mime_part_get_content_type (part), -1);
-
-			/* mime-parts with a content-disposition header (either 'inline' or 'attachment')
-			 * and a 'name=' thingy cannot be body parts
-                         */
-
-			tmp = modest_tny_mime_part_get_header_value (part, "Content-Disposition");
-			if (tmp) {
-				gchar *content_disp = g_ascii_strdown(tmp, -1);
-				g_free (tmp);
-				has_content_disp_name = g_strstr_len (content_disp, strlen(content_disp), "name=") != NULL;
-				g_free (content_disp);
-			}
-
-			if (g_str_has_prefix (content_type, "text/") &&
-			    !has_content_disp_name &&
-			    !modest_tny_mime_part_is_attachment_for_modest (part)) {
-				/* We found that some multipart/related emails include
-				   empty text/plain parts at the end that could confuse the body
-				   detection algorithm */
-				if (is_related_or_mixed && g_str_has_prefix (content_type, "text/plain")) {
-					fallback = g_object_ref (part);
-				} else {
-					/* we found the body. Doesn't have to be the desired mime part, first
-					   text/ part in a multipart/mixed is the body */
-					g_free (content_type);
-					break;
-				}
-			} else if (g_str_has_prefix(content_type, "multipart/alternative")) {
+		return is_text_part ? TNY_MIME_PART (g_object_ref (msg)) : NULL;
+	}
 
-				/* multipart? recurse! */
-				g_object_unref (part);
-				g_free (content_type);
-				part = modest_tny_msg_find_body_part_in_alternative (part, want_html);
-				if (part)
-					break;
+	for (i = 0; i < children->len; i++) {
+		TnyMimePart *part = g_ptr_array_index (children, i);
+		const ModestTnyMimePartInfo *info = modest_tny_mime_part_get_info (part);
+		TnyMimePart *body;
 
-			} else 	if (g_str_has_prefix(content_type, "multipart")) {
+		/* it's a message --> ignore */
+		if (info->is_msg)
+			continue;
 
-				/* multipart? recurse! */
-				g_object_unref (part);
-				g_free (content_type);
-				part = modest_tny_msg_find_body_part_from_mime_part (part, want_html);
-				if (part)
-					break;
+		if (g_str_has_prefix (info->content_type, "text/") &&
+		    !info->has_disp_name &&
+		    !modest_tny_mime_part_is_attachment_for_modest (part)) {
+			/* We found that some multipart/related emails include
+			   empty text/plain parts at the end that could confuse the body
+			   detection algorithm */
+			if (is_related_or_mixed && g_str_has_prefix (info->content_type, "text/plain")) {
+				fallback = part;
 			} else {
-				g_free (content_type);
-			}
-
-			if (part) {
-				g_object_unref (G_OBJECT(part));
-				part = NULL;
+				/* we found the body. Doesn't have to be the desired mime part, first
+				   text/ part in a multipart/mixed is the body */
+				return g_object_ref (part);
 			}
-			tny_iterator_next (iter);
-
-		} while (!tny_iterator_is_done(iter));
-
-		if (!part && fallback)
-			part = g_object_ref (fallback);
-		if (fallback)
-			g_object_unref (fallback);
+		} else if (g_str_has_prefix (info->content_type, "multipart/alternative")) {
+			/* multipart? recurse! */
+			body = modest_tny_msg_find_body_part_in_alternative (part, want_html);
+			if (body)
+				return body;
+		} else if (g_str_has_prefix (info->content_type, "multipart")) {
+			/* multipart? recurse! */
+			body = modest_tny_msg_find_body_part_from_mime_part (part, want_html);
+			if (body)
+				return body;
+		}
 	}
 
- frees:
-	g_object_unref (G_OBJECT(iter));
-	g_object_unref (G_OBJECT(parts));
-
-	return part;
+	return fallback ? g_object_ref (fallback) : NULL;
 }
 
 static TnyMimePart*
 modest_tny_msg_find_calendar_from_mime_part (TnyMimePart *msg)
 {
-	TnyMimePart *part = NULL;
-	TnyList *parts = NULL;
-	TnyIterator *iter = NULL;
-	gchar *header_content_type;
-	gchar *header_content_type_lower = NULL;
+	GPtrArray *children;
+	guint i;
 	
 	if (!msg)
 		return NULL;
 
-	/* If it's an application multipart, then we don't get into as we don't
-	 * support them (for example application/sml or wap messages */
-	header_content_type = modest_tny_mime_part_get_header_value (msg, "Content-Type");
-	if (header_content_type) {
-		header_content_type = g_strstrip (header_content_type);
-		header_content_type_lower = g_ascii_strdown (header_content_type, -1);
-	}
-	if (header_content_type_lower && 
-	    g_str_has_prefix (header_content_type_lower, "multipart/") &&
-	    !g_str_has_prefix (header_content_type_lower, "multipart/signed") &&
-	    strstr (header_content_type_lower, "application/")) {
-		g_free (header_content_type_lower);
-		g_free (header_content_type);
+	if (is_application_multipart (modest_tny_mime_part_get_info (msg)))
 		return NULL;
-	}	
-	g_free (header_content_type_lower);
-	g_free (header_content_type);
-
-	parts = TNY_LIST (tny_simple_list_new());
-	tny_mime_part_get_parts (TNY_MIME_PART (msg), parts);
 
-	iter  = tny_list_create_iterator(parts);
+	children = modest_tny_mime_part_get_children (msg);
 
 	/* no parts? assume it's single-part message */
-	if (tny_iterator_is_done(iter)) {
+	if (children->len == 0) {
 		gchar *content_type;
 		gboolean is_calendar_part;
-		g_object_unref (G_OBJECT(iter));
+
 		content_type = modest_tny_mime_part_get_content_type (msg);
 		if (content_type == NULL)
 			return NULL;
-		is_calendar_part = 
-			g_str_has_prefix (content_type, "text/calendar");
+		is_calendar_part = g_str_has_prefix (content_type, "text/calendar");
 		g_free (content_type);
-		/* if this part cannot be a supported body return NULL */
-		if (!is_calendar_part) {
-			return NULL;
-		} else {
-			return TNY_MIME_PART (g_object_ref(G_OBJECT(msg)));
-		}
-	} else {
-		do {
-			gchar *tmp, *content_type = NULL;
-			gboolean has_content_disp_name = FALSE;
-
-			part = TNY_MIME_PART(tny_iterator_get_current (iter));
 
-			if (!part) {
-				g_warning ("%s: not a valid mime part", __FUNCTION__);
-				tny_iterator_next (iter);
-				continue;
-			}
+		/* if this part cannot be a supported body return NULL */
+		return is_calendar_part ? TNY_MIME_PART (g_object_ref (msg)) : NULL;
+	}
 
-			/* it's a message --> ignore */
-			if (part && TNY_IS_MSG (part)) {
-				g_object_unref (part);
-				part = NULL;
-				tny_iterator_next (iter);
-				continue;
-			}			
-
-			/* we need to strdown the content type, because
-			 * tny_mime_part_has_content_type does not do it...
-			 */
-			content_type = g_ascii_strdown (tny_mime_part_get_content_type (part), -1);
-			
-			/* mime-parts with a content-disposition header (either 'inline' or 'attachment')
-			 * and a 'name=' thingy cannot be body parts
-                         */
-				
-			tmp = modest_tny_mime_part_get_header_value (part, "Content-Disposition");
-			if (tmp) {
-				gchar *content_disp = g_ascii_strdown(tmp, -1);
-				g_free (tmp);
-				has_content_disp_name = g_strstr_len (content_disp, strlen(content_disp), "name=") != NULL;
-				g_free (content_disp);
-			}
-			
-			if (g_str_has_prefix (content_type, "text/calendar") && 
-			    !has_content_disp_name &&
-			    !modest_tny_mime_part_is_attachment_for_modest (part)) {
-				/* we found the body. Doesn't have to be the desired mime part, first
-				   text/ part in a mixed is the body */
-				g_free (content_type);
-				break;
+	for (i = 0; i < children->len; i++) {
+		TnyMimePart *part = g_ptr_array_index (children, i);
+		const ModestTnyMimePartInfo *info = modest_tny_mime_part_get_info (part);
 
-			} else 	if (g_str_has_prefix(content_type, "multipart")) {
+		/* it's a message --> ignore */
+		if (info->is_msg)
+			continue;
 
-				/* multipart? recurse! */
-				g_object_unref (part);
-				g_free (content_type);
-				part = modest_tny_msg_find_calendar_from_mime_part (part);
-				if (part)
-					break;
-			} else
-				g_free (content_type);
-			
-			if (part) {
-				g_object_unref (G_OBJECT(part));
-				part = NULL;
-			}
-			
-			tny_iterator_next (iter);
-			
-		} while (!tny_iterator_is_done(iter));
+		if (g_str_has_prefix (info->content_type, "text/calendar") && 
+		    !info->has_disp_name &&
+		    !modest_tny_mime_part_is_attachment_for_modest (part)) {
+			/* we found the body. Doesn't have to be the desired mime part, first
+			   text/ part in a mixed is the body */
+			return g_object_ref (part);
+		} else if (g_str_has_prefix (info->content_type, "multipart")) {
+			/* multipart? recurse! */
+			TnyMimePart *calendar = modest_tny_msg_find_calendar_from_mime_part (part);
+			if (calendar)
+				return calendar;
+		}
 	}
-	
-	g_object_unref (G_OBJECT(iter));
-	g_object_unref (G_OBJECT(parts));
 
-	return part; /* this maybe NULL, this is not an error; some message just don't have a body
-		      * part */
+	/* this maybe NULL, this is not an error; some message just don't
+	 * have a calendar part */
+	return NULL;
 }
 
 
@@ -987,20 +834,18 @@ modest_tny_msg_get_attachments_parent (TnyMsg *msg)
 
 	content_type = tny_mime_part_get_content_type (TNY_MIME_PART (msg));
 	if (content_type && !strcmp (content_type, "multipart/signed")) {
-		TnyList *msg_children;
-		TnyIterator *iterator;
+		GPtrArray *msg_children;
 		gchar *signed_protocol;
+		guint i;
 
-		msg_children = TNY_LIST (tny_simple_list_new ());
-		tny_mime_part_get_parts (TNY_MIME_PART (msg), msg_children);
-
-		iterator = tny_list_create_iterator (msg_children);
+		/* the children are kept with the message, so the
+		 * structure info of the part we return is kept too */
+		msg_children = modest_tny_mime_part_get_children (TNY_MIME_PART (msg));
 		signed_protocol = get_signed_protocol (TNY_MIME_PART (msg));
 			
-		while (!result && !tny_iterator_is_done (iterator)) {
-			TnyMimePart *part;
+		for (i = 0; !result && i < msg_children->len; i++) {
+			TnyMimePart *part = g_ptr_array_index (msg_children, i);
 
-			part = TNY_MIME_PART (tny_iterator_get_current (iterator));
 			if (signed_protocol) {
 				const gchar *part_content_type;
 
@@ -1011,14 +856,9 @@ modest_tny_msg_get_attachments_parent (TnyMsg *msg)
 			} else {
 				result = g_object_ref (part);
 			}
-
-			g_object_unref (part);
-			tny_iterator_next (iterator);
 		}
 
-		g_object_unref (iterator);
 		g_free (signed_protocol);
-		g_object_unref (msg_children);
 	}
 	if (result == NULL) {
 		result = TNY_MIME_PART(g_object_ref (msg));
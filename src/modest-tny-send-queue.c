@@ -42,6 +42,8 @@
 #include <widgets/modest-window-mgr.h>
 #include <modest-marshal.h>
 #include <modest-debug.h>
+#include <modest-string-pool.h>
+#include <modest-search.h>
 #include <string.h> /* strcmp */
 
 /* 'private'/'protected' functions */
@@ -96,7 +98,7 @@ enum {
 
 typedef struct _SendInfo SendInfo;
 struct _SendInfo {
-	gchar* msg_id;
+	const gchar* msg_id;	/* interned */
 	ModestTnySendQueueStatus status;
 };
 
@@ -146,7 +148,7 @@ on_modest_tny_send_queue_compare_id (gconstpointer info, gconstpointer msg_id)
 static void
 modest_tny_send_queue_info_free (SendInfo *info)
 {
-	g_free(info->msg_id);
+	modest_string_pool_unref (info->msg_id);
 	g_slice_free(SendInfo, info);
 }
 
@@ -238,12 +240,13 @@ _on_added_to_outbox (TnySendQueue *self,
 		info->status = MODEST_TNY_SEND_QUEUE_WAITING;
 	} else {
 		info = g_slice_new (SendInfo);
-		info->msg_id = msg_id;
+		info->msg_id = modest_string_pool_intern (msg_id);
 		info->status = MODEST_TNY_SEND_QUEUE_WAITING;
 		g_queue_push_tail (priv->queue, info);
 	}
 
 	g_signal_emit (self, signals[STATUS_CHANGED_SIGNAL], 0, info->msg_id, info->status);
+	g_free (msg_id);
 
  end:
 	g_object_unref (G_OBJECT(header));
@@ -291,7 +294,7 @@ _add_message (ModestTnySendQueue *self, TnyHeader *header)
 		
 		/* Add new meesage info */
 		info = g_slice_new0 (SendInfo);
-		info->msg_id = strdup(msg_uid);
+		info->msg_id = modest_string_pool_intern (msg_uid);
 		info->status = MODEST_TNY_SEND_QUEUE_WAITING;
 		g_queue_push_tail (priv->queue, info);
 		break;
@@ -683,6 +686,10 @@ _on_msg_has_been_sent (TnySendQueue *self,
 
 	tny_folder_sync_async (priv->sentbox, FALSE, NULL, NULL, NULL);
 
+	/* The message moved from the outbox to the sent folder */
+	modest_search_folder_changed (priv->outbox);
+	modest_search_folder_changed (priv->sentbox);
+
 	/* Get status info */
 	item = modest_tny_send_queue_lookup_info (MODEST_TNY_SEND_QUEUE (self), msg_id);
 
@@ -984,12 +991,12 @@ wakeup_get_headers_async_cb (TnyFolder *folder,
 			item = modest_tny_send_queue_lookup_info (MODEST_TNY_SEND_QUEUE (self), msg_id);
 			if (!item) {
 				info = g_slice_new (SendInfo);
-				info->msg_id = msg_id;
+				info->msg_id = modest_string_pool_intern (msg_id);
 				g_queue_push_tail (priv->queue, info);
 			} else {
 				info = (SendInfo *) item->data;
-				g_free (msg_id);
 			}
+			g_free (msg_id);
 			info->status = MODEST_TNY_SEND_QUEUE_WAITING;
 			g_signal_emit (self, signals[STATUS_CHANGED_SIGNAL], 0, info->msg_id, info->status);		
 		}
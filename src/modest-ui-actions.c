@@ -34,6 +34,7 @@
 #include <glib/gi18n.h>
 #include <glib/gprintf.h>
 #include <string.h>
+#include <time.h>
 #include <modest-runtime.h>
 #include <modest-defs.h>
 #include <modest-tny-folder.h>
@@ -71,6 +72,9 @@
 #include "widgets/modest-global-settings-dialog.h"
 #include "modest-account-mgr-helpers.h"
 #include "modest-mail-operation.h"
+#include "modest-push-monitor.h"
+#include "modest-offline-journal.h"
+#include "modest-search.h"
 #include "modest-text-utils.h"
 #include <modest-widget-memory.h>
 #include <tny-error.h>
@@ -341,6 +345,7 @@ headers_action_mark_as_read (TnyHeader *header,
 	flags = tny_header_get_flags (header);
 	if (flags & TNY_HEADER_FLAG_SEEN) return;
 	tny_header_set_flag (header, TNY_HEADER_FLAG_SEEN);
+	modest_search_header_changed (header);
 	uid = modest_tny_folder_get_header_unique_id (header);
 	modest_platform_emit_msg_read_changed_signal (uid, TRUE);
 	g_free (uid);
@@ -360,6 +365,7 @@ headers_action_mark_as_unread (TnyHeader *header,
 		gchar *uid;
 		uid = modest_tny_folder_get_header_unique_id (header);
 		tny_header_unset_flag (header, TNY_HEADER_FLAG_SEEN);
+		modest_search_header_changed (header);
 		modest_platform_emit_msg_read_changed_signal (uid, FALSE);
 	}
 }
@@ -2199,9 +2205,8 @@ sync_folder_cb (ModestMailOperation *mail_op,
 	if (modest_mail_operation_get_status (mail_op) == MODEST_MAIL_OPERATION_STATUS_SUCCESS) {
 		ModestWindow *parent = (ModestWindow *) modest_mail_operation_get_source (mail_op);
 
-		/* We must clear first, because otherwise set_folder will ignore */
-		/*    the change as the folders are the same */
-		modest_header_view_clear (header_view);
+		/* Same folder, so the header view keeps its model and
+		   only applies the changes of the refresh */
 		modest_header_view_set_folder (header_view, folder, TRUE, parent, NULL, NULL);
 
 		g_object_unref (parent);
@@ -2249,6 +2254,27 @@ update_account_cb (ModestMailOperation *self,
 	top = modest_window_mgr_get_current_top (modest_runtime_get_window_mgr ());
 	show_visual_notifications = (top) ? FALSE : TRUE;
 
+	/* Accounts with new mail are updated first next time */
+	if (TNY_IS_LIST (new_headers) && tny_list_get_length (new_headers) > 0)
+		set_last_new_mail (self);
+
+	/* After a successful update, keep listening to the server if
+	   the account is in push mode */
+	if (modest_mail_operation_get_status (self) == MODEST_MAIL_OPERATION_STATUS_SUCCESS) {
+		TnyAccount *account = modest_mail_operation_get_account (self);
+
+		if (account) {
+			const gchar *account_name;
+
+			account_name = modest_tny_account_get_parent_modest_account_name_for_server_account (account);
+			if (account_name &&
+			    !modest_push_monitor_is_active (account_name) &&
+			    modest_account_mgr_get_push (modest_runtime_get_account_mgr (), account_name))
+				modest_push_monitor_start (account_name, update_account_cb, NULL);
+			g_object_unref (account);
+		}
+	}
+
 	/* Notify new messages have been downloaded. If the
 	   send&receive was invoked by the user then do not show any
 	   visual notification, only play a sound and activate the LED
@@ -2318,6 +2344,154 @@ typedef struct {
 	gboolean force_connection;
 } SendReceiveInfo;
 
+/*
+ * Send&Receive scheduling. Updating many accounts at the same time
+ * over a weak connection makes all of them slow (and time out), so
+ * only MAX_PARALLEL_SEND_RECEIVE run at the same time and the rest
+ * wait in the _send_receive_waiting queue. The mail operations of
+ * the waiting accounts are already in the mail operation queue, so
+ * the progress indicators see one send&receive from the first
+ * account to the last one, and the queue does not get empty in
+ * between
+ */
+#define MAX_PARALLEL_SEND_RECEIVE 2
+
+/* key of the mail operations that hold a slot */
+#define SEND_RECEIVE_SLOT_KEY "modest-send-receive-slot"
+
+static GQueue _send_receive_waiting = G_QUEUE_INIT;
+static guint  _send_receive_running = 0;
+
+/* account name -> time of the last update that got new mail */
+static GHashTable *_send_receive_last_new_mail = NULL;
+
+static void send_receive_info_start (SendReceiveInfo *info);
+
+static void
+send_receive_info_free (SendReceiveInfo *info)
+{
+	if (info->mail_op)
+		g_object_unref (G_OBJECT (info->mail_op));
+	if (info->account_name)
+		g_free (info->account_name);
+	if (info->win)
+		g_object_unref (info->win);
+	if (info->account)
+		g_object_unref (info->account);
+	g_slice_free (SendReceiveInfo, info);
+}
+
+static time_t
+get_last_new_mail (const gchar *account_name)
+{
+	gpointer value = NULL;
+
+	if (_send_receive_last_new_mail && account_name)
+		value = g_hash_table_lookup (_send_receive_last_new_mail, account_name);
+
+	return (time_t) GPOINTER_TO_SIZE (value);
+}
+
+static void
+set_last_new_mail (ModestMailOperation *mail_op)
+{
+	TnyAccount *account;
+	const gchar *account_name;
+
+	account = modest_mail_operation_get_account (mail_op);
+	if (!account)
+		return;
+
+	account_name = modest_tny_account_get_parent_modest_account_name_for_server_account (account);
+	if (account_name) {
+		if (!_send_receive_last_new_mail)
+			_send_receive_last_new_mail = g_hash_table_new_full (g_str_hash, g_str_equal,
+									     g_free, NULL);
+		g_hash_table_replace (_send_receive_last_new_mail, g_strdup (account_name),
+				      GSIZE_TO_POINTER ((gsize) time (NULL)));
+	}
+	g_object_unref (account);
+}
+
+/* Accounts that got new mail more recently go first */
+static gint
+compare_send_receive_priority (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+	time_t time_a = get_last_new_mail (((SendReceiveInfo *) a)->account_name);
+	time_t time_b = get_last_new_mail (((SendReceiveInfo *) b)->account_name);
+
+	if (time_a == time_b)
+		return 0;
+	return (time_a > time_b) ? -1 : 1;
+}
+
+static void
+run_waiting_send_receives (void)
+{
+	while (_send_receive_running < MAX_PARALLEL_SEND_RECEIVE &&
+	       !g_queue_is_empty (&_send_receive_waiting)) {
+		SendReceiveInfo *info = (SendReceiveInfo *) g_queue_pop_head (&_send_receive_waiting);
+
+		/* Canceled while waiting for a slot. It never started,
+		   so nobody else will take it out of the queue */
+		if (modest_mail_operation_get_status (info->mail_op) ==
+		    MODEST_MAIL_OPERATION_STATUS_CANCELED) {
+			modest_mail_operation_queue_remove (modest_runtime_get_mail_operation_queue (),
+							    info->mail_op);
+			send_receive_info_free (info);
+			continue;
+		}
+
+		_send_receive_running++;
+		g_object_set_data (G_OBJECT (info->mail_op), SEND_RECEIVE_SLOT_KEY,
+				   GINT_TO_POINTER (TRUE));
+		send_receive_info_start (info);
+	}
+}
+
+/* Called when the update of an account finishes, either from the
+   operation-finished signal or because it could not start */
+static void
+release_send_receive_slot (ModestMailOperation *mail_op)
+{
+	if (!g_object_get_data (G_OBJECT (mail_op), SEND_RECEIVE_SLOT_KEY))
+		return;
+
+	g_object_set_data (G_OBJECT (mail_op), SEND_RECEIVE_SLOT_KEY, NULL);
+	_send_receive_running--;
+	run_waiting_send_receives ();
+}
+
+static void
+on_send_receive_finished (ModestMailOperation *mail_op, gpointer user_data)
+{
+	release_send_receive_slot (mail_op);
+}
+
+/* A waiting update removed from the mail operation queue (for
+   example by closing the window that owns it) must not start later */
+static void
+on_send_receive_queue_changed (ModestMailOperationQueue *queue,
+			       ModestMailOperation *mail_op,
+			       ModestMailOperationQueueNotification type,
+			       gpointer user_data)
+{
+	GList *link;
+
+	if (type != MODEST_MAIL_OPERATION_QUEUE_OPERATION_REMOVED)
+		return;
+
+	for (link = _send_receive_waiting.head; link; link = g_list_next (link)) {
+		SendReceiveInfo *info = (SendReceiveInfo *) link->data;
+
+		if (info->mail_op == mail_op) {
+			g_queue_delete_link (&_send_receive_waiting, link);
+			send_receive_info_free (info);
+			break;
+		}
+	}
+}
+
 static void
 do_send_receive_performer (gboolean canceled,
 			   GError *err,
@@ -2336,6 +2510,7 @@ do_send_receive_performer (gboolean canceled,
 								account, NULL);
 
 		if (info->mail_op) {
+			release_send_receive_slot (info->mail_op);
 			modest_mail_operation_queue_remove (modest_runtime_get_mail_operation_queue (),
 							    info->mail_op);
 		}
@@ -2343,6 +2518,10 @@ do_send_receive_performer (gboolean canceled,
 	}
 
 
+	/* We're connected, do the transfers that were waiting for it */
+	if (account)
+		modest_offline_journal_replay (account);
+
 	/* Send & receive. */
 	modest_mail_operation_update_account (info->mail_op, info->account_name,
 					      info->poke_status, info->interactive,
@@ -2350,35 +2529,23 @@ do_send_receive_performer (gboolean canceled,
 
  clean:
 	/* Frees */
-	if (info->mail_op)
-		g_object_unref (G_OBJECT (info->mail_op));
-	if (info->account_name)
-		g_free (info->account_name);
-	if (info->win)
-		g_object_unref (info->win);
-	if (info->account)
-		g_object_unref (info->account);
-	g_slice_free (SendReceiveInfo, info);
+	send_receive_info_free (info);
 }
 
-/*
- * This function performs the send & receive required actions. The
- * window is used to create the mail operation. Typically it should
- * always be the main window, but we pass it as argument in order to
- * be more flexible.
- */
-void
-modest_ui_actions_do_send_receive (const gchar *account_name,
-				   gboolean force_connection,
-				   gboolean poke_status,
-				   gboolean interactive,
-				   ModestWindow *win)
+/* Creates the mail operation of the update of an account, or returns
+   NULL if it should not be updated */
+static SendReceiveInfo *
+send_receive_info_new (const gchar *account_name,
+		       gboolean force_connection,
+		       gboolean poke_status,
+		       gboolean interactive,
+		       ModestWindow *win)
 {
 	gchar *acc_name = NULL;
 	SendReceiveInfo *info;
-	ModestProtocolType account_type;
 	ModestTnyAccountStore *acc_store;
 	TnyAccount *account;
+	static gboolean queue_handler_connected = FALSE;
 
 	/* If no account name was provided then get the current account, and if
 	   there is no current account then pick the default one: */
@@ -2389,7 +2556,7 @@ modest_ui_actions_do_send_receive (const gchar *account_name,
 			acc_name  = modest_account_mgr_get_default_account (modest_runtime_get_account_mgr());
 		if (!acc_name) {
 			modest_platform_information_banner (NULL, NULL, _("emev_ni_internal_error"));
-			return;
+			return NULL;
 		}
 	} else {
 		acc_name = g_strdup (account_name);
@@ -2401,7 +2568,7 @@ modest_ui_actions_do_send_receive (const gchar *account_name,
 	if (!account) {
 		g_free (acc_name);
 		modest_platform_information_banner (NULL, NULL, _("emev_ni_internal_error"));
-		return;
+		return NULL;
 	}
 
 	/* Do not automatically refresh accounts that are flagged as
@@ -2417,7 +2584,7 @@ modest_ui_actions_do_send_receive (const gchar *account_name,
 				g_debug ("%s no auto update allowed for account %s", __FUNCTION__, account_name);
 				g_object_unref (account);
 				g_free (acc_name);
-				return;
+				return NULL;
 			}
 		}
 	}
@@ -2431,16 +2598,33 @@ modest_ui_actions_do_send_receive (const gchar *account_name,
 	info->account = account;
 	info->parent_window = (win ? GTK_WINDOW (win) : NULL);
 	info->force_connection = force_connection;
+	info->disconnect_op = NULL;
 	/* We need to create the operation here, because otherwise it
 	   could happen that the queue emits the queue-empty signal
 	   while we're trying to connect the account */
 	info->mail_op = modest_mail_operation_new_with_error_handling ((info->win) ? G_OBJECT (info->win) : NULL,
 								       modest_ui_actions_disk_operations_error_handler,
 								       NULL, NULL);
+	if (!queue_handler_connected) {
+		g_signal_connect (G_OBJECT (modest_runtime_get_mail_operation_queue ()),
+				  "queue-changed",
+				  G_CALLBACK (on_send_receive_queue_changed), NULL);
+		queue_handler_connected = TRUE;
+	}
 	modest_mail_operation_queue_add (modest_runtime_get_mail_operation_queue (), info->mail_op);
+	g_signal_connect (G_OBJECT (info->mail_op), "operation-finished",
+			  G_CALLBACK (on_send_receive_finished), NULL);
+
+	return info;
+}
+
+static void
+send_receive_info_start (SendReceiveInfo *info)
+{
+	ModestProtocolType account_type;
 
 	/* for POP3 account we should go offline before we can sync account */
-	account_type = modest_tny_account_get_protocol_type (account);
+	account_type = modest_tny_account_get_protocol_type (info->account);
 	if (MODEST_PROTOCOLS_STORE_POP == account_type) {
 		info->disconnect_op =
 			modest_mail_operation_new ((info->win) ? G_OBJECT (info->win) : NULL);
@@ -2448,16 +2632,44 @@ modest_ui_actions_do_send_receive (const gchar *account_name,
 			info->disconnect_op);
 		g_signal_connect (G_OBJECT (info->disconnect_op), "operation-finished",
 			G_CALLBACK (modest_ui_actions_send_receive_offline), info);
-		modest_mail_operation_disconnect_account (info->disconnect_op, account);
+		modest_mail_operation_disconnect_account (info->disconnect_op, info->account);
 	}
 	else {
 		/* Invoke the connect and perform */
 		modest_platform_connect_and_perform (MODEST_WINDOW(info->parent_window),
-		force_connection, info->account, do_send_receive_performer, info);
-		info->disconnect_op = NULL;
+		info->force_connection, info->account, do_send_receive_performer, info);
 	}
 }
 
+/*
+ * This function performs the send & receive required actions. The
+ * window is used to create the mail operation. Typically it should
+ * always be the main window, but we pass it as argument in order to
+ * be more flexible.
+ */
+void
+modest_ui_actions_do_send_receive (const gchar *account_name,
+				   gboolean force_connection,
+				   gboolean poke_status,
+				   gboolean interactive,
+				   ModestWindow *win)
+{
+	SendReceiveInfo *info;
+
+	info = send_receive_info_new (account_name, force_connection, poke_status,
+				      interactive, win);
+	if (!info)
+		return;
+
+	/* The user is waiting for this one, so it goes before the
+	   accounts of an automatic update */
+	if (interactive)
+		g_queue_push_head (&_send_receive_waiting, info);
+	else
+		g_queue_push_tail (&_send_receive_waiting, info);
+	run_waiting_send_receives ();
+}
+
 static void
 modest_ui_actions_send_receive_offline (ModestMailOperation *mail_op, gpointer user_data)
 {
@@ -2560,20 +2772,32 @@ modest_ui_actions_do_send_receive_all (ModestWindow *win,
 				       gboolean interactive)
 {
 	GSList *account_names, *iter;
+	GQueue infos = G_QUEUE_INIT;
+	SendReceiveInfo *info;
 
 	account_names = modest_account_mgr_account_names (modest_runtime_get_account_mgr(),
 							  TRUE);
 
+	/* Create all the mail operations now, they're started as the
+	   running ones finish, see run_waiting_send_receives */
 	iter = account_names;
 	while (iter) {
-		modest_ui_actions_do_send_receive ((const char*) iter->data,
-						   force_connection,
-						   poke_status, interactive, win);
+		info = send_receive_info_new ((const char*) iter->data,
+					      force_connection,
+					      poke_status, interactive, win);
+		if (info)
+			g_queue_push_tail (&infos, info);
 		iter = g_slist_next (iter);
 	}
 
 	modest_account_mgr_free_account_names (account_names);
 	account_names = NULL;
+
+	g_queue_sort (&infos, compare_send_receive_priority, NULL);
+	while ((info = (SendReceiveInfo *) g_queue_pop_head (&infos)))
+		g_queue_push_tail (&_send_receive_waiting, info);
+
+	run_waiting_send_receives ();
 }
 
 /*
@@ -3668,6 +3892,25 @@ typedef struct {
 	gboolean move_to_trash;
 } DeleteFolderInfo;
 
+/* The viewers of the messages of a removed folder would be left
+   showing messages that do not exist anymore */
+static void
+close_folder_viewers (TnyFolder *folder)
+{
+	GList *windows, *node;
+
+	windows = modest_window_mgr_get_windows_for_folder (modest_runtime_get_window_mgr (),
+							    folder);
+	for (node = windows; node; node = g_list_next (node)) {
+		if (MODEST_IS_MSG_VIEW_WINDOW (node->data)) {
+			gboolean retval;
+
+			g_signal_emit_by_name (G_OBJECT (node->data), "delete-event", NULL, &retval);
+		}
+	}
+	g_list_free (windows);
+}
+
 static void
 on_delete_folder_cb (gboolean canceled,
 		     GError *err,
@@ -3716,6 +3959,8 @@ on_delete_folder_cb (gboolean canceled,
 	sel = gtk_tree_view_get_selection (GTK_TREE_VIEW (folder_view));
 	gtk_tree_selection_unselect_all (sel);
 
+	close_folder_viewers (TNY_FOLDER (info->folder));
+
 	/* Create the mail operation */
 	mail_op =
 		modest_mail_operation_new_with_error_handling (G_OBJECT(parent_window),
@@ -5325,6 +5570,42 @@ modest_ui_actions_on_folder_window_move_to (GtkWidget *folder_view,
 }
 
 
+static gboolean
+journal_transfer (ModestWindow *win,
+		  TnyList *headers,
+		  TnyFolder *dst_folder)
+{
+	TnyAccount *dst_account;
+	gboolean dst_forbids_message_add;
+
+	/* Let the usual path show the error */
+	dst_account = tny_folder_get_account (dst_folder);
+	dst_forbids_message_add = modest_protocol_registry_protocol_type_has_tag (modest_runtime_get_protocol_registry (),
+										  modest_tny_account_get_protocol_type (dst_account),
+										  MODEST_PROTOCOL_REGISTRY_STORE_FORBID_INCOMING_XFERS);
+	g_object_unref (dst_account);
+	if (dst_forbids_message_add)
+		return FALSE;
+
+	if (!modest_offline_journal_add_xfer (headers, dst_folder, TRUE))
+		return FALSE;
+
+	/* The messages are not in their folder anymore for the user */
+	if (MODEST_IS_HEADER_WINDOW (win)) {
+		modest_header_view_refilter (modest_header_window_get_header_view (MODEST_HEADER_WINDOW (win)));
+	} else if (MODEST_IS_MSG_VIEW_WINDOW (win)) {
+		ModestMsgViewWindow *self = MODEST_MSG_VIEW_WINDOW (win);
+
+		if (!modest_msg_view_window_select_previous_message (self) &&
+		    !modest_msg_view_window_select_next_message (self)) {
+			/* No more messages to view, so close this window */
+			modest_ui_actions_on_close_window (NULL, MODEST_WINDOW(self));
+		}
+	}
+
+	return TRUE;
+}
+
 void
 modest_ui_actions_transfer_messages_helper (ModestWindow *win,
 					    TnyFolder *src_folder,
@@ -5339,6 +5620,14 @@ modest_ui_actions_transfer_messages_helper (ModestWindow *win,
 	g_return_if_fail (TNY_IS_FOLDER (dst_folder));
 	g_return_if_fail (TNY_IS_LIST (headers));
 
+	/* While offline, the messages that were not retrieved yet are
+	   moved when we get online instead of asking to connect now */
+	if (modest_tny_folder_store_is_remote (TNY_FOLDER_STORE (src_folder)) &&
+	    !tny_device_is_online (modest_runtime_get_device ()) &&
+	    header_list_count_uncached_msgs (headers) > 0 &&
+	    journal_transfer (win, headers, dst_folder))
+		return;
+
 	modest_ui_actions_xfer_messages_check (win, TNY_FOLDER_STORE (src_folder),
 					       headers, TNY_FOLDER (dst_folder),
 					       TRUE, &need_connection,
@@ -30,6 +30,7 @@
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <errno.h>
+#include <sys/stat.h>
 #include <string.h> /* for strlen */
 #include <modest-runtime.h>
 #include <tny-fs-stream.h>
@@ -811,21 +812,28 @@ modest_utils_on_entry_invalid_character (ModestValidatingEntry *self,
 	g_free (message);
 }
 
+static const gchar*
+get_mcc_mapping_path (void)
+{
+	if (access (MODEST_OPERATOR_WIZARD_MCC_MAPPING, R_OK) == 0)
+		return MODEST_OPERATOR_WIZARD_MCC_MAPPING;
+	else if (access (MODEST_MCC_MAPPING, R_OK) == 0)
+		return MODEST_MCC_MAPPING;
+
+	g_warning ("%s: neither '%s' nor '%s' is a readable mapping file",
+		   __FUNCTION__, MODEST_OPERATOR_WIZARD_MCC_MAPPING, MODEST_MCC_MAPPING);
+	return NULL;
+}
+
 FILE*
 modest_utils_open_mcc_mapping_file (void)
 {
 	FILE* result = NULL;
 	const gchar* path;
 
-	if (access (MODEST_OPERATOR_WIZARD_MCC_MAPPING, R_OK) == 0) {
-		path = MODEST_OPERATOR_WIZARD_MCC_MAPPING;
-	} else if (access (MODEST_MCC_MAPPING, R_OK) == 0) {
-		path = MODEST_MCC_MAPPING;
-	} else {
-		g_warning ("%s: neither '%s' nor '%s' is a readable mapping file",
-			   __FUNCTION__, MODEST_OPERATOR_WIZARD_MCC_MAPPING, MODEST_MCC_MAPPING);
+	path = get_mcc_mapping_path ();
+	if (!path)
 		return NULL;
-	}
 
 	result = fopen (path, "r");
 	if (!result) {
@@ -933,94 +941,309 @@ modest_utils_country_model_check_territory_exceptions (const gchar *territory)
 	return result;
 }
 
-void
-modest_utils_fill_country_model (GtkTreeModel *model, gint *locale_mcc)
+/* The countries of the mcc_mapping file, translated to the current
+ * locale and sorted. They're computed once, and cached in
+ * MODEST_DIR/MODEST_COUNTRY_CACHE_FILE, as the translations require
+ * switching the locale and collating every country */
+typedef struct {
+	gint   mcc;
+	gchar *name;
+} CountryEntry;
+
+#define COUNTRY_CACHE_GROUP          "countries"
+#define COUNTRY_CACHE_KEY_ID         "id"
+#define COUNTRY_CACHE_KEY_LOCALE_MCC "locale-mcc"
+#define COUNTRY_CACHE_KEY_MCCS       "mccs"
+#define COUNTRY_CACHE_KEY_NAMES      "names"
+
+static GArray *_countries = NULL;
+static gchar  *_countries_id = NULL;
+static gint    _countries_locale_mcc = 0;
+
+static void
+clear_countries (void)
+{
+	guint i;
+
+	if (!_countries)
+		return;
+
+	for (i = 0; i < _countries->len; i++)
+		g_free (g_array_index (_countries, CountryEntry, i).name);
+	g_array_free (_countries, TRUE);
+	_countries = NULL;
+	g_free (_countries_id);
+	_countries_id = NULL;
+}
+
+/* identifies the contents of the table: the mapping file and the
+   locale the names are translated to */
+static gchar*
+get_countries_id (const gchar *territory)
+{
+	const gchar *path;
+	struct stat st;
+
+	path = get_mcc_mapping_path ();
+	if (!path || g_stat (path, &st) != 0)
+		return NULL;
+
+	return g_strdup_printf ("%s:%ld:%s:%s", path, (glong) st.st_mtime,
+				setlocale (LC_MESSAGES, NULL), territory);
+}
+
+static gchar*
+get_countries_cache_filename (void)
+{
+	return g_build_filename (MODEST_DIR, MODEST_COUNTRY_CACHE_FILE, NULL);
+}
+
+static gboolean
+load_countries_cache (const gchar *id)
+{
+	GKeyFile *key_file;
+	gchar *filename, *cached_id;
+	gchar **names = NULL;
+	gint *mccs = NULL;
+	gsize n_names = 0, n_mccs = 0, i;
+	gboolean retval = FALSE;
+
+	key_file = g_key_file_new ();
+	filename = get_countries_cache_filename ();
+	if (!g_key_file_load_from_file (key_file, filename, G_KEY_FILE_NONE, NULL))
+		goto frees;
+
+	cached_id = g_key_file_get_string (key_file, COUNTRY_CACHE_GROUP, COUNTRY_CACHE_KEY_ID, NULL);
+	if (g_strcmp0 (cached_id, id)) {
+		g_free (cached_id);
+		goto frees;
+	}
+	g_free (cached_id);
+
+	mccs = g_key_file_get_integer_list (key_file, COUNTRY_CACHE_GROUP,
+					    COUNTRY_CACHE_KEY_MCCS, &n_mccs, NULL);
+	names = g_key_file_get_string_list (key_file, COUNTRY_CACHE_GROUP,
+					    COUNTRY_CACHE_KEY_NAMES, &n_names, NULL);
+	if (!mccs || !names || n_mccs != n_names)
+		goto frees;
+
+	_countries = g_array_sized_new (FALSE, FALSE, sizeof (CountryEntry), n_names);
+	for (i = 0; i < n_names; i++) {
+		CountryEntry entry;
+
+		entry.mcc = mccs[i];
+		entry.name = names[i];
+		g_array_append_val (_countries, entry);
+	}
+	/* the names are owned by the table now */
+	g_free (names);
+	names = NULL;
+
+	_countries_locale_mcc = g_key_file_get_integer (key_file, COUNTRY_CACHE_GROUP,
+							COUNTRY_CACHE_KEY_LOCALE_MCC, NULL);
+	_countries_id = g_strdup (id);
+	retval = TRUE;
+
+ frees:
+	g_strfreev (names);
+	g_free (mccs);
+	g_free (filename);
+	g_key_file_free (key_file);
+
+	return retval;
+}
+
+static void
+save_countries_cache (void)
+{
+	GKeyFile *key_file;
+	gchar *filename, *data;
+	const gchar **names;
+	gint *mccs;
+	gsize len;
+	guint i;
+	GError *err = NULL;
+
+	names = g_new0 (const gchar *, _countries->len + 1);
+	mccs = g_new0 (gint, _countries->len);
+	for (i = 0; i < _countries->len; i++) {
+		CountryEntry *entry = &g_array_index (_countries, CountryEntry, i);
+		names[i] = entry->name;
+		mccs[i] = entry->mcc;
+	}
+
+	key_file = g_key_file_new ();
+	g_key_file_set_string (key_file, COUNTRY_CACHE_GROUP, COUNTRY_CACHE_KEY_ID, _countries_id);
+	g_key_file_set_integer (key_file, COUNTRY_CACHE_GROUP, COUNTRY_CACHE_KEY_LOCALE_MCC,
+				_countries_locale_mcc);
+	g_key_file_set_integer_list (key_file, COUNTRY_CACHE_GROUP, COUNTRY_CACHE_KEY_MCCS,
+				     mccs, _countries->len);
+	g_key_file_set_string_list (key_file, COUNTRY_CACHE_GROUP, COUNTRY_CACHE_KEY_NAMES,
+				    names, _countries->len);
+	data = g_key_file_to_data (key_file, &len, NULL);
+
+	filename = get_countries_cache_filename ();
+	if (!g_file_set_contents (filename, data, len, &err)) {
+		g_warning ("%s: failed to save %s: %s", __FUNCTION__, filename,
+			   err ? err->message : "unknown error");
+		g_clear_error (&err);
+	}
+
+	g_free (filename);
+	g_free (data);
+	g_key_file_free (key_file);
+	g_free (names);
+	g_free (mccs);
+}
+
+typedef struct {
+	gchar        *collate_key;
+	CountryEntry  country;
+} SortableCountry;
+
+static gint
+compare_countries (gconstpointer a, gconstpointer b)
+{
+	return strcmp (((const SortableCountry *) a)->collate_key,
+		       ((const SortableCountry *) b)->collate_key);
+}
+
+/* parses the mcc_mapping file, reading it only once */
+static gboolean
+build_countries (const gchar *territory)
 {
 	char line[MCC_FILE_MAX_LINE_LEN];
-	guint previous_mcc = 0;
-	const gchar *territory;
+	GArray *lines, *sortable;
 	GHashTable *country_hash;
+	guint i;
+	gint previous_mcc;
 	FILE *file;
 
-	/* First we need to know our current region */
 	file = modest_utils_open_mcc_mapping_file ();
 	if (!file) {
 		g_warning ("Could not open mcc_mapping file");
-		return;
+		return FALSE;
 	}
 
-	/* Get the territory specified for the current locale */
-	territory = modest_utils_country_model_check_territory_exceptions (nl_langinfo (_NL_IDENTIFICATION_TERRITORY));
-
-	setlocale (LC_MESSAGES, "en_GB");
-
+	lines = g_array_new (FALSE, FALSE, sizeof (CountryEntry));
+	previous_mcc = 0;
 	while (fgets (line, MCC_FILE_MAX_LINE_LEN, file) != NULL) {
-		int mcc;
+		CountryEntry entry;
 		char *country = NULL;
 
-		mcc = parse_mcc_mapping_line (line, &country);
-		if (!country || mcc == 0) {
+		entry.mcc = parse_mcc_mapping_line (line, &country);
+		if (!country || entry.mcc == 0) {
 			g_warning ("%s: error parsing line: '%s'", __FUNCTION__, line);
 			continue;
 		}
 
-		if (mcc == previous_mcc) {
-			/* g_warning ("already seen: %s", line); */
+		if (entry.mcc == previous_mcc)
 			continue;
-		}
-		previous_mcc = mcc;
+		previous_mcc = entry.mcc;
 
-		if (!(*locale_mcc)) {
-			gchar *translation = dgettext ("osso-countries", country);
-			if (!g_utf8_collate (translation, territory))
-				*locale_mcc = mcc;
-		}
+		entry.name = g_strdup (country);
+		g_array_append_val (lines, entry);
 	}
+	fclose (file);
 
-	setlocale (LC_MESSAGES, "");
+	/* First we need to know our current region */
+	_countries_locale_mcc = 0;
+	setlocale (LC_MESSAGES, "en_GB");
+	for (i = 0; i < lines->len && !_countries_locale_mcc; i++) {
+		CountryEntry *entry = &g_array_index (lines, CountryEntry, i);
+		gchar *translation = dgettext ("osso-countries", entry->name);
 
-	/* Now we fill the model */
-	rewind (file);
-	country_hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
-	while (fgets (line, MCC_FILE_MAX_LINE_LEN, file) != NULL) {
+		if (!g_utf8_collate (translation, territory))
+			_countries_locale_mcc = entry->mcc;
+	}
+	setlocale (LC_MESSAGES, "");
 
-		int mcc;
-		char *country = NULL;
-		GtkTreeIter iter;
+	/* Then translate the countries */
+	sortable = g_array_sized_new (FALSE, FALSE, sizeof (SortableCountry), lines->len);
+	country_hash = g_hash_table_new (g_str_hash, g_str_equal);
+	for (i = 0; i < lines->len; i++) {
+		CountryEntry *entry = &g_array_index (lines, CountryEntry, i);
 		const gchar *name_translated;
 
-		mcc = parse_mcc_mapping_line (line, &country);
-		if (!country || mcc == 0) {
-			g_warning ("%s: error parsing line: '%s'", __FUNCTION__, line);
+		if (g_hash_table_lookup (country_hash, entry->name)) {
+			g_debug ("already seen: '%s' %d", entry->name, entry->mcc);
 			continue;
 		}
+		g_hash_table_insert (country_hash, entry->name, GINT_TO_POINTER (entry->mcc));
 
-		if (mcc == previous_mcc ||
-		    g_hash_table_lookup (country_hash, country)) {
-			g_debug ("already seen: '%s' %d", country, mcc);
-			continue;
+		name_translated = dgettext ("osso-countries", entry->name);
+
+		/* Add the country if we have translation for it */
+		if (g_utf8_collate (entry->name, name_translated)) {
+			SortableCountry item;
+
+			item.country.mcc = entry->mcc;
+			item.country.name = g_strdup (name_translated);
+			item.collate_key = g_utf8_collate_key (name_translated, -1);
+			g_array_append_val (sortable, item);
+		} else {
+			g_debug ("%s no translation for %s", __FUNCTION__, entry->name);
 		}
-		previous_mcc = mcc;
+	}
+	g_hash_table_destroy (country_hash);
 
-		g_hash_table_insert (country_hash, g_strdup (country), GINT_TO_POINTER (mcc));
+	for (i = 0; i < lines->len; i++)
+		g_free (g_array_index (lines, CountryEntry, i).name);
+	g_array_free (lines, TRUE);
 
-		name_translated = dgettext ("osso-countries", country);
+	/* Sort them by name, collating every name only once */
+	g_array_sort (sortable, compare_countries);
+	_countries = g_array_sized_new (FALSE, FALSE, sizeof (CountryEntry), sortable->len);
+	for (i = 0; i < sortable->len; i++) {
+		SortableCountry *item = &g_array_index (sortable, SortableCountry, i);
 
-		/* Add the row to the model if we have translation for it */
-		if (g_utf8_collate (country, name_translated)) {
-			gtk_list_store_append (GTK_LIST_STORE (model), &iter);
-			gtk_list_store_set(GTK_LIST_STORE (model), &iter,
-					   MODEST_UTILS_COUNTRY_MODEL_COLUMN_MCC, mcc,
-					   MODEST_UTILS_COUNTRY_MODEL_COLUMN_NAME, name_translated,
-					   -1);
-		} else {
-			g_debug ("%s no translation for %s", __FUNCTION__, country);
+		g_array_append_val (_countries, item->country);
+		g_free (item->collate_key);
+	}
+	g_array_free (sortable, TRUE);
+
+	return TRUE;
+}
+
+void
+modest_utils_fill_country_model (GtkTreeModel *model, gint *locale_mcc)
+{
+	const gchar *territory;
+	gchar *id;
+	guint i;
+
+	/* Get the territory specified for the current locale */
+	territory = modest_utils_country_model_check_territory_exceptions (nl_langinfo (_NL_IDENTIFICATION_TERRITORY));
+
+	id = get_countries_id (territory);
+	if (!_countries || g_strcmp0 (id, _countries_id)) {
+		clear_countries ();
+		if (!id || !load_countries_cache (id)) {
+			if (!build_countries (territory)) {
+				g_free (id);
+				return;
+			}
+			_countries_id = id;
+			id = NULL;
+			if (_countries_id)
+				save_countries_cache ();
 		}
 	}
+	g_free (id);
 
+	/* The countries are already sorted, so the model does not
+	   need to move any row */
+	for (i = 0; i < _countries->len; i++) {
+		CountryEntry *entry = &g_array_index (_countries, CountryEntry, i);
 
-	g_hash_table_unref (country_hash);
-	fclose (file);
+		gtk_list_store_insert_with_values (GTK_LIST_STORE (model), NULL, i,
+						   MODEST_UTILS_COUNTRY_MODEL_COLUMN_MCC, entry->mcc,
+						   MODEST_UTILS_COUNTRY_MODEL_COLUMN_NAME, entry->name,
+						   -1);
+	}
+
+	if (!(*locale_mcc))
+		*locale_mcc = _countries_locale_mcc;
 
 	/* Fallback to Finland */
 	if (!(*locale_mcc))
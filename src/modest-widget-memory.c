@@ -350,6 +350,9 @@ restore_settings_header_view (ModestConf *conf, ModestHeaderView *header_view,
 	folder = modest_header_view_get_folder (header_view);
 	if (!folder)
 		return TRUE; /* no folder: no settings */
+
+	/* the defaults are written on demand */
+	modest_init_require_service ("header-columns");
 	
 	type = modest_tny_folder_guess_folder_type (folder);	
 	if (type == TNY_FOLDER_TYPE_INVALID)
@@ -117,30 +117,22 @@ modest_attachments_view_new (TnyMsg *msg)
 static void
 add_digest_attachments (ModestAttachmentsView *attachments_view, TnyMimePart *part)
 {
-	TnyList *parts;
-	TnyIterator *iter;
-
-	parts = TNY_LIST (tny_simple_list_new());
-	tny_mime_part_get_parts (TNY_MIME_PART (part), parts);
-
-	for (iter  = tny_list_create_iterator(parts); 
-	     !tny_iterator_is_done (iter);
-	     tny_iterator_next (iter)) {
-		TnyMimePart *cur_part = TNY_MIME_PART (tny_iterator_get_current (iter));
-		modest_attachments_view_add_attachment (attachments_view, cur_part, TRUE, 0);
-		g_object_unref (cur_part);
-	}
-	g_object_unref (iter);
-	g_object_unref (parts);
-
+	GPtrArray *children;
+	guint i;
+
+	children = modest_tny_mime_part_get_children (part);
+	for (i = 0; i < children->len; i++)
+		modest_attachments_view_add_attachment (attachments_view,
+							g_ptr_array_index (children, i),
+							TRUE, 0);
 }
 
 void
 modest_attachments_view_set_message (ModestAttachmentsView *attachments_view, TnyMsg *msg, gboolean want_html)
 {
 	ModestAttachmentsViewPrivate *priv = MODEST_ATTACHMENTS_VIEW_GET_PRIVATE (attachments_view);
-	TnyList *parts;
-	TnyIterator *iter;
+	GPtrArray *children;
+	guint i;
 	gchar *msg_content_type = NULL;
 	TnyMimePart *part_to_check;
 	gboolean body_found;
@@ -206,20 +198,16 @@ modest_attachments_view_set_message (ModestAttachmentsView *attachments_view, Tn
 		}
 	}
 
-	parts = TNY_LIST (tny_simple_list_new ());
-	tny_mime_part_get_parts (TNY_MIME_PART (part_to_check), parts);
-	iter = tny_list_create_iterator (parts);
+	children = modest_tny_mime_part_get_children (part_to_check);
 
 	body_found = FALSE;
-	while (!tny_iterator_is_done (iter)) {
-		TnyMimePart *part;
-		gchar *content_type;
+	for (i = 0; i < children->len; i++) {
+		TnyMimePart *part = g_ptr_array_index (children, i);
+		const ModestTnyMimePartInfo *info;
 		TnyMimePart *body = NULL;
 		gboolean has_body = FALSE;
 
-		part = TNY_MIME_PART (tny_iterator_get_current (iter));
-
-		if (part && is_alternate) {
+		if (is_alternate) {
 			body = modest_tny_msg_find_body_part_in_alternative (part, want_html);
 
 			if (body) {
@@ -228,38 +216,28 @@ modest_attachments_view_set_message (ModestAttachmentsView *attachments_view, Tn
 			}
 		}
 
-		if (part && (modest_tny_mime_part_is_attachment_for_modest (part))) {
+		info = modest_tny_mime_part_get_info (part);
+		if (modest_tny_mime_part_is_attachment_for_modest (part)) {
 			modest_attachments_view_add_attachment (attachments_view, part, TRUE, 0);
 
-		} else if (part && (!is_alternate || has_body)) {
-			content_type = g_ascii_strdown (tny_mime_part_get_content_type (part), -1);
-			g_strstrip (content_type);
-
-			if (g_str_has_prefix (content_type, "multipart/digest")) {
+		} else if (!is_alternate || has_body) {
+			if (g_str_has_prefix (info->content_type, "multipart/digest")) {
 				add_digest_attachments (attachments_view, part);
 			} else if (body_found && 
-				   (g_str_has_prefix (content_type, "text/plain") ||
-				    g_str_has_prefix (content_type, "text/html"))) {
+				   (g_str_has_prefix (info->content_type, "text/plain") ||
+				    g_str_has_prefix (info->content_type, "text/html"))) {
 				   modest_attachments_view_add_attachment (attachments_view, part, TRUE, 0);
-			} else if (g_str_has_prefix (content_type, "multipart/mixed")) {
-				if (modest_attachments_view_add_attachments (attachments_view,
-					TNY_MIME_PART (part))) {
+			} else if (g_str_has_prefix (info->content_type, "multipart/mixed")) {
+				if (modest_attachments_view_add_attachments (attachments_view, part)) {
 					body_found = TRUE;
 				}
-			} else if (g_str_has_prefix (content_type, "multipart/") ||
-				   g_str_has_prefix (content_type, "text/plain") ||
-				   g_str_has_prefix (content_type, "text/html")) {
+			} else if (g_str_has_prefix (info->content_type, "multipart/") ||
+				   g_str_has_prefix (info->content_type, "text/plain") ||
+				   g_str_has_prefix (info->content_type, "text/html")) {
 				body_found = TRUE;
 			}
 		}
-
-		if (part)
-			g_object_unref (part);
-
-		tny_iterator_next (iter);
 	}
-	g_object_unref (iter);
-	g_object_unref (parts);
 	g_object_unref (part_to_check);
 
 	gtk_widget_queue_draw (GTK_WIDGET (attachments_view));
@@ -269,8 +247,8 @@ modest_attachments_view_set_message (ModestAttachmentsView *attachments_view, Tn
 static gboolean
 modest_attachments_view_add_attachments (ModestAttachmentsView *self, TnyMimePart *part)
 {
-	TnyList *sub_parts;
-	TnyIterator *sub_parts_iter;
+	GPtrArray *children;
+	guint i;
 	gboolean is_attachment = FALSE;
 
 	g_return_val_if_fail (self, FALSE);
@@ -278,38 +256,29 @@ modest_attachments_view_add_attachments (ModestAttachmentsView *self, TnyMimePar
 	g_return_val_if_fail (TNY_IS_MIME_PART (part), FALSE);
 	g_return_val_if_fail (MODEST_IS_ATTACHMENTS_VIEW (self), FALSE);
 
-	sub_parts = TNY_LIST (tny_simple_list_new ());
-	tny_mime_part_get_parts (part, sub_parts);
-	sub_parts_iter = tny_list_create_iterator (sub_parts);
-	while (!tny_iterator_is_done (sub_parts_iter)) {
-		TnyMimePart *sub_part;
+	children = modest_tny_mime_part_get_children (part);
+	for (i = 0; i < children->len; i++) {
+		TnyMimePart *sub_part = g_ptr_array_index (children, i);
+		const gchar *sub_content_type;
 
 		/* if this is an attachment, add it to the attachment list */
-		sub_part = TNY_MIME_PART (tny_iterator_get_current (sub_parts_iter));
 		if (modest_tny_mime_part_is_attachment_for_modest (sub_part)) {
 			modest_attachments_view_add_attachment (self, sub_part, TRUE, 0);
 			is_attachment = TRUE;
+			continue;
 		}
-		else {
-			const gchar *sub_content_type;
 
-			sub_content_type = tny_mime_part_get_content_type (sub_part);
-			if (g_str_has_prefix (sub_content_type, "multipart/mixed")) {
-				if (modest_attachments_view_add_attachments (self, sub_part)) {
-					is_attachment = TRUE;
-				}
-			}
-			else if (g_str_has_prefix (sub_content_type, "application/")) {
-				modest_attachments_view_add_attachment (self, sub_part, TRUE, 0);
+		sub_content_type = modest_tny_mime_part_get_info (sub_part)->content_type;
+		if (g_str_has_prefix (sub_content_type, "multipart/mixed")) {
+			if (modest_attachments_view_add_attachments (self, sub_part)) {
 				is_attachment = TRUE;
 			}
 		}
-
-		/* move on to the next part */
-		tny_iterator_next (sub_parts_iter);
+		else if (g_str_has_prefix (sub_content_type, "application/")) {
+			modest_attachments_view_add_attachment (self, sub_part, TRUE, 0);
+			is_attachment = TRUE;
+		}
 	}
-	g_object_unref (sub_parts_iter);
-	g_object_unref (sub_parts);
 
 	return is_attachment;
 }
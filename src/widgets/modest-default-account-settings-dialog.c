@@ -129,6 +129,7 @@ struct _ModestDefaultAccountSettingsDialogPrivate
 	GtkWidget *button_outgoing_smtp_servers;
 	GtkWidget *checkbox_offline_sync;
 	GtkWidget *checkbox_update_all_folders;
+	GtkWidget *checkbox_push;
 	
 	GtkWidget *signature_dialog;
 
@@ -848,6 +849,19 @@ create_page_outgoing (ModestDefaultAccountSettingsDialog *self,
 			    FALSE, FALSE, 0);
 	connect_for_modified (self, priv->checkbox_update_all_folders);
 
+	/* push checkbox, only shown for IMAP accounts: */
+	if (!priv->checkbox_push) {
+		priv->checkbox_push = hildon_check_button_new (MODEST_EDITABLE_SIZE);
+		hildon_check_button_set_active (HILDON_CHECK_BUTTON (priv->checkbox_push),
+			FALSE);
+		gtk_button_set_label (GTK_BUTTON (priv->checkbox_push),
+				      _("mcen_fi_advsetup_push_email"));
+		gtk_button_set_alignment (GTK_BUTTON (priv->checkbox_push), 0.0, 0.5);
+	}
+	gtk_box_pack_start (GTK_BOX (box), priv->checkbox_push,
+			    FALSE, FALSE, 0);
+	connect_for_modified (self, priv->checkbox_push);
+
 	gtk_widget_show (GTK_WIDGET (box));
 
 	return GTK_WIDGET (box);
@@ -1269,6 +1283,13 @@ modest_default_account_settings_dialog_load_settings (ModestAccountSettingsDialo
 
 		hildon_check_button_set_active (HILDON_CHECK_BUTTON (priv->checkbox_update_all_folders), update_all_folders);
 
+		hildon_check_button_set_active (HILDON_CHECK_BUTTON (priv->checkbox_push),
+						modest_account_settings_get_push (settings));
+		if (incoming_protocol == MODEST_PROTOCOLS_STORE_IMAP)
+			gtk_widget_show (priv->checkbox_push);
+		else
+			gtk_widget_hide (priv->checkbox_push);
+
 		/* Load security settings */
 		modest_security_options_view_load_settings (
 			    MODEST_SECURITY_OPTIONS_VIEW (priv->incoming_security), 
@@ -1380,6 +1401,10 @@ save_configuration (ModestDefaultAccountSettingsDialog *dialog)
 	leave_on_server = modest_togglable_get_active (priv->checkbox_leave_messages);
 	modest_account_settings_set_leave_messages_on_server (priv->settings, leave_on_server); 
 
+	modest_account_settings_set_push
+		(priv->settings,
+		 hildon_check_button_get_active (HILDON_CHECK_BUTTON (priv->checkbox_push)));
+
 	store_settings = modest_account_settings_get_store_settings (priv->settings);
 			
 	hostname = gtk_entry_get_text (GTK_ENTRY (priv->entry_incomingserver));
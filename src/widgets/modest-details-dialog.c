@@ -79,8 +79,31 @@ typedef struct _ModestDetailsDialogPrivate ModestDetailsDialogPrivate;
 struct _ModestDetailsDialogPrivate
 {
 	GtkWidget *props_table;
+
+	/* the folder stats being computed, 0 if none */
+	guint      stats_request;
+	GtkWidget *count_w;
+	GtkWidget *size_w;
 };
 
+static void
+modest_details_dialog_dispose (GObject *object)
+{
+	ModestDetailsDialogPrivate *priv;
+
+	priv = MODEST_DETAILS_DIALOG_GET_PRIVATE (object);
+
+	/* Don't keep walking the folders of a closed dialog */
+	if (priv->stats_request) {
+		modest_tny_folder_store_cancel_folder_stats (priv->stats_request);
+		priv->stats_request = 0;
+	}
+	priv->count_w = NULL;
+	priv->size_w = NULL;
+
+	G_OBJECT_CLASS (modest_details_dialog_parent_class)->dispose (object);
+}
+
 static void
 modest_details_dialog_finalize (GObject *object)
 {
@@ -93,6 +116,7 @@ modest_details_dialog_class_init (ModestDetailsDialogClass *klass)
 	GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
 	g_type_class_add_private (klass, sizeof (ModestDetailsDialogPrivate));
+	object_class->dispose = modest_details_dialog_dispose;
 	object_class->finalize = modest_details_dialog_finalize;
 
 	klass->create_container_func = modest_details_dialog_create_container_default;
@@ -361,28 +385,87 @@ modest_details_dialog_set_message_size_default (ModestDetailsDialog *self,
 	gtk_widget_show_all (GTK_WIDGET (self));
 }
 
+/* Returns the value label of the last row added with
+   modest_details_dialog_add_data_default, or NULL */
+static GtkWidget *
+get_last_value_label (ModestDetailsDialog *self)
+{
+	ModestDetailsDialogPrivate *priv;
+	GList *children, *node;
+	GtkWidget *value_w = NULL;
+	guint n_rows = 0;
+
+	priv = MODEST_DETAILS_DIALOG_GET_PRIVATE (self);
+	if (!priv->props_table)
+		return NULL;
+
+	g_object_get (G_OBJECT (priv->props_table), "n-rows", &n_rows, NULL);
+	children = gtk_container_get_children (GTK_CONTAINER (priv->props_table));
+	for (node = children; node && !value_w; node = g_list_next (node)) {
+		guint left, top;
+
+		gtk_container_child_get (GTK_CONTAINER (priv->props_table), node->data,
+					 "left-attach", &left, "top-attach", &top, NULL);
+		if (left == 1 && top + 1 == n_rows && GTK_IS_LABEL (node->data))
+			value_w = node->data;
+	}
+	g_list_free (children);
+
+	return value_w;
+}
+
+static void
+update_folder_stats (ModestDetailsDialog *self, ModestFolderStats stats)
+{
+	ModestDetailsDialogPrivate *priv;
+	gchar *count_s, *size_s;
+
+	priv = MODEST_DETAILS_DIALOG_GET_PRIVATE (self);
+
+	count_s = g_strdup_printf ("%d", stats.msg_count);
+	size_s = modest_text_utils_get_display_size (stats.local_size);
+	if (priv->count_w)
+		gtk_label_set_text (GTK_LABEL (priv->count_w), count_s);
+	if (priv->size_w)
+		gtk_label_set_text (GTK_LABEL (priv->size_w), size_s);
+	g_free (size_s);
+	g_free (count_s);
+}
+
+static void
+on_folder_stats_status (ModestFolderStats stats, gpointer user_data)
+{
+	update_folder_stats (MODEST_DETAILS_DIALOG (user_data), stats);
+}
+
+static void
+on_folder_stats (ModestFolderStats stats, gpointer user_data)
+{
+	ModestDetailsDialogPrivate *priv;
+
+	priv = MODEST_DETAILS_DIALOG_GET_PRIVATE (user_data);
+	priv->stats_request = 0;
+
+	update_folder_stats (MODEST_DETAILS_DIALOG (user_data), stats);
+}
+
 static void
 modest_details_dialog_set_folder_default (ModestDetailsDialog *self,
 					  TnyFolder *folder)
 {
-	gchar *count_s, *size_s, *name = NULL;
-	guint size, count;
+	ModestDetailsDialogPrivate *priv;
+	gchar *name = NULL;
+	guint request;
 
 	g_return_if_fail (folder && TNY_IS_FOLDER (folder));
 	g_return_if_fail (modest_tny_folder_guess_folder_type (folder)
 			  != TNY_FOLDER_TYPE_INVALID);
 
+	priv = MODEST_DETAILS_DIALOG_GET_PRIVATE (self);
+
 	/* Set window title */
 	gtk_window_set_title (GTK_WINDOW (self), _("mcen_ti_folder_properties"));
 
-	/* Get data. We use our function because it's recursive */
-	count = tny_folder_get_all_count (TNY_FOLDER (folder));
-	size = tny_folder_get_local_size (TNY_FOLDER (folder));
-
-	/* Format count and size */
-	count_s = g_strdup_printf ("%d", count);
-	size_s = modest_text_utils_get_display_size (size);
-
 	/* Different names for the local folders */
 	if (modest_tny_folder_is_local_folder (folder) ||
 	    modest_tny_folder_is_memory_card_folder (folder)) {
@@ -406,26 +489,38 @@ modest_details_dialog_set_folder_default (ModestDetailsDialog *self,
 	g_free (tmp);
 #endif
 
+	/* The count and the size are filled as the folder stats are
+	   computed, stat()ing the messages could block the UI */
 #ifdef MODEST_TOOLKIT_HILDON2
-	modest_details_dialog_add_data (self, _("mcen_fi_folder_properties_messages"), count_s);
+	modest_details_dialog_add_data (self, _("mcen_fi_folder_properties_messages"), "");
 #else
 	tmp = g_strconcat (_("mcen_fi_folder_properties_messages"), ":", NULL);
-	modest_details_dialog_add_data (self, tmp, count_s);
+	modest_details_dialog_add_data (self, tmp, "");
 	g_free (tmp);
 #endif
+	priv->count_w = get_last_value_label (self);
 
 #ifdef MODEST_TOOLKIT_HILDON2
-	modest_details_dialog_add_data (self, _("mcen_fi_folder_properties_size"), size_s);
+	modest_details_dialog_add_data (self, _("mcen_fi_folder_properties_size"), "");
 #else
 	tmp = g_strconcat (_("mcen_fi_folder_properties_size"), ":", NULL);
-	modest_details_dialog_add_data (self, tmp, size_s);
+	modest_details_dialog_add_data (self, tmp, "");
 	g_free (tmp);
 #endif
+	priv->size_w = get_last_value_label (self);
+
+	/* Get data. We use our function because it's recursive. The
+	   callbacks could be called before it returns */
+	priv->stats_request = G_MAXUINT;
+	request = modest_tny_folder_store_get_folder_stats (TNY_FOLDER_STORE (folder),
+							    on_folder_stats,
+							    on_folder_stats_status,
+							    self);
+	if (priv->stats_request)
+		priv->stats_request = request;
 
 	/* Frees */
 	g_free (name);
-	g_free (size_s);
-	g_free (count_s);
 }
 
 static void 
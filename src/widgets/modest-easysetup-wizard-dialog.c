@@ -1937,6 +1937,42 @@ util_get_default_servername_from_email_address (const gchar* email_address, Mode
 	return g_strdup_printf ("%s.%s", hostname, domain);
 }
 
+/* Gets the server of the known provider of the domain of the email
+ * address, if it uses the given protocol */
+static gchar*
+get_preset_servername_from_email_address (ModestEasysetupWizardDialog *self,
+					  const gchar *email_address,
+					  ModestProtocolType protocol_type)
+{
+	ModestEasysetupWizardDialogPrivate *priv = MODEST_EASYSETUP_WIZARD_DIALOG_GET_PRIVATE(self);
+	gchar *provider_id, *servername = NULL;
+	const gchar *at;
+	gboolean incoming;
+
+	if (!priv->presets || !email_address)
+		return NULL;
+
+	at = strchr (email_address, '@');
+	if (!at || !at[1])
+		return NULL;
+
+	provider_id = modest_presets_get_provider_for_domain (priv->presets, at + 1);
+	if (!provider_id)
+		return NULL;
+
+	incoming = (protocol_type != MODEST_PROTOCOLS_TRANSPORT_SMTP);
+	if (modest_presets_get_info_server_type (priv->presets, provider_id, incoming) == protocol_type) {
+		servername = modest_presets_get_server (priv->presets, provider_id, incoming);
+
+		/* The port is set in its own field */
+		if (servername && strchr (servername, ':'))
+			*(strchr (servername, ':')) = '\0';
+	}
+	g_free (provider_id);
+
+	return servername;
+}
+
 static void
 set_default_custom_servernames (ModestEasysetupWizardDialog *self)
 {
@@ -1956,8 +1992,14 @@ set_default_custom_servernames (ModestEasysetupWizardDialog *self)
 		/* This could happen when the combo box has still no active iter */
 		if (protocol_type != MODEST_PROTOCOL_REGISTRY_TYPE_INVALID) {
 			const gchar* email_address = modest_entry_get_text (priv->entry_user_email);
-			gchar* servername = util_get_default_servername_from_email_address (email_address,
-											    protocol_type);
+			gchar* servername;
+
+			/* Prefer the servers of a known provider of that domain */
+			servername = get_preset_servername_from_email_address (self, email_address,
+									       protocol_type);
+			if (!servername)
+				servername = util_get_default_servername_from_email_address (email_address,
+											     protocol_type);
 
 			/* Do not set the INCOMING_CHANGED flag because of this edit */
 			g_signal_handlers_block_by_func (G_OBJECT (priv->entry_incomingserver), G_CALLBACK (on_entry_incoming_servername_changed), self);
@@ -1977,8 +2019,13 @@ set_default_custom_servernames (ModestEasysetupWizardDialog *self)
 	if (priv->entry_user_email
 	    && ((priv->server_changes & MODEST_EASYSETUP_WIZARD_DIALOG_OUTGOING_CHANGED) == 0)) {
 		const gchar* email_address = modest_entry_get_text (priv->entry_user_email);
+		gchar* servername;
 
-		gchar* servername = util_get_default_servername_from_email_address (email_address, MODEST_PROTOCOLS_TRANSPORT_SMTP);
+		servername = get_preset_servername_from_email_address (self, email_address,
+								       MODEST_PROTOCOLS_TRANSPORT_SMTP);
+		if (!servername)
+			servername = util_get_default_servername_from_email_address (email_address,
+										     MODEST_PROTOCOLS_TRANSPORT_SMTP);
 
 		/* Do not set the OUTGOING_CHANGED flag because of this edit */
 		g_signal_handlers_block_by_func (G_OBJECT (priv->entry_outgoingserver), G_CALLBACK (on_entry_outgoing_servername_changed), self);
@@ -66,6 +66,7 @@
 #include <modest-account-mgr.h>
 #include <modest-account-mgr-helpers.h>
 #include <modest-datetime-formatter.h>
+#include <modest-folder-counts.h>
 #ifdef MODEST_TOOLKIT_HILDON2
 #include <hildon/hildon.h>
 #endif
@@ -188,8 +189,7 @@ struct _ModestFolderViewPrivate {
 	ModestEmailClipboard *clipboard;
 
 	/* Filter tree model */
-	gchar **hidding_ids;
-	guint n_selected;
+	GHashTable *hidding_ids;
 	ModestFolderViewFilter filter;
 #ifdef MODEST_TOOLKIT_HILDON2
 	GtkWidget *live_search;
@@ -681,6 +681,7 @@ text_cell_data  (GtkTreeViewColumn *column,
 
 	if (type != TNY_FOLDER_TYPE_ROOT) {
 		gint number = 0;
+		guint count = 0;
 		gboolean drafts;
 		gboolean is_local;
 
@@ -707,15 +708,19 @@ text_cell_data  (GtkTreeViewColumn *column,
 		 * tny_folder for some reason. Select the number to
 		 * show: the unread or unsent messages. in case of
 		 * outbox/drafts, show all */
+		/* The counts of the last session are used until
+		 * the folder reports its own, see
+		 * modest_folder_counts_get_for_folder */
 		if (is_local && ((type == TNY_FOLDER_TYPE_DRAFTS) ||
 				 (type == TNY_FOLDER_TYPE_OUTBOX) ||
 				 (type == TNY_FOLDER_TYPE_MERGE))) { /* _OUTBOX actually returns _MERGE... */
-			number = tny_folder_get_all_count (TNY_FOLDER(instance));
+			modest_folder_counts_get_for_folder (TNY_FOLDER (instance), &count, NULL);
 			drafts = TRUE;
 		} else {
-			number = tny_folder_get_unread_count (TNY_FOLDER(instance));
+			modest_folder_counts_get_for_folder (TNY_FOLDER (instance), NULL, &count);
 			drafts = FALSE;
 		}
+		number = count;
 
 		if (priv->cell_style == MODEST_FOLDER_VIEW_CELL_STYLE_COMPACT) {
 			item_name = g_strdup (fname);
@@ -1406,7 +1411,6 @@ modest_folder_view_init (ModestFolderView *obj)
 	/* Init email clipboard */
 	priv->clipboard = modest_runtime_get_email_clipboard ();
 	priv->hidding_ids = NULL;
-	priv->n_selected = 0;
 	priv->filter = MODEST_FOLDER_VIEW_FILTER_NONE;
 	priv->reselect = FALSE;
 	priv->show_non_move = TRUE;
@@ -2092,8 +2096,6 @@ filter_row (GtkTreeModel *model, GtkTreeIter *iter, gpointer data)
 	TnyFolderType type = TNY_FOLDER_TYPE_UNKNOWN;
 	GObject *instance = NULL;
 	const gchar *id = NULL;
-	guint i;
-	gboolean found = FALSE;
 	gboolean cleared = FALSE;
 	ModestTnyFolderRules rules = 0;
 	gchar *fname;
@@ -2178,12 +2180,8 @@ filter_row (GtkTreeModel *model, GtkTreeIter *iter, gpointer data)
 	cleared = modest_email_clipboard_cleared (priv->clipboard);
 	if ((retval) && (!cleared) && (TNY_IS_FOLDER (instance))) {
 		id = tny_folder_get_id (TNY_FOLDER(instance));
-		if (priv->hidding_ids != NULL)
-			for (i=0; i < priv->n_selected && !found; i++)
-				if (priv->hidding_ids[i] != NULL && id != NULL)
-					found = (!strcmp (priv->hidding_ids[i], id));
-
-		retval = !found;
+		if (priv->hidding_ids != NULL && id != NULL)
+			retval = (g_hash_table_lookup (priv->hidding_ids, id) == NULL);
 	}
 
 	/* If this is a move to dialog, hide Sent, Outbox and Drafts
@@ -3292,8 +3290,6 @@ modest_folder_view_cut_selection (ModestFolderView *folder_view)
 {
 	ModestFolderViewPrivate *priv = NULL;
 	GtkTreeModel *model = NULL;
-	const gchar **hidding = NULL;
-	guint i, n_selected;
 
 	g_return_if_fail (folder_view && MODEST_IS_FOLDER_VIEW (folder_view));
 	priv = MODEST_FOLDER_VIEW_GET_PRIVATE (folder_view);
@@ -3302,17 +3298,11 @@ modest_folder_view_cut_selection (ModestFolderView *folder_view)
 	if (!_clipboard_set_selected_data (folder_view, TRUE))
 		return;
 
-	/* Get hidding ids */
-	hidding = modest_email_clipboard_get_hidding_ids (priv->clipboard, &n_selected);
-
-	/* Clear hidding array created by previous cut operation */
+	/* Clear hidding set created by previous cut operation */
 	_clear_hidding_filter (MODEST_FOLDER_VIEW (folder_view));
 
-	/* Copy hidding array */
-	priv->n_selected = n_selected;
-	priv->hidding_ids = g_malloc0(sizeof(gchar *) * n_selected);
-	for (i=0; i < n_selected; i++)
-		priv->hidding_ids[i] = g_strdup(hidding[i]);
+	/* Get hidding ids */
+	priv->hidding_ids = modest_email_clipboard_get_hidding_set (priv->clipboard);
 
 	/* Hide cut folders */
 	model = gtk_tree_view_get_model (GTK_TREE_VIEW (folder_view));
@@ -3438,15 +3428,13 @@ static void
 _clear_hidding_filter (ModestFolderView *folder_view)
 {
 	ModestFolderViewPrivate *priv;
-	guint i;
 
 	g_return_if_fail (MODEST_IS_FOLDER_VIEW (folder_view));
 	priv = MODEST_FOLDER_VIEW_GET_PRIVATE(folder_view);
 
 	if (priv->hidding_ids != NULL) {
-		for (i=0; i < priv->n_selected; i++)
-			g_free (priv->hidding_ids[i]);
-		g_free(priv->hidding_ids);
+		g_hash_table_unref (priv->hidding_ids);
+		priv->hidding_ids = NULL;
 	}
 }
 
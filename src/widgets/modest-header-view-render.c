@@ -40,6 +40,7 @@
 #include <modest-runtime.h>
 #include <glib/gi18n.h>
 #include <modest-platform.h>
+#include <modest-string-pool.h>
 #include <string.h>
 
 #ifdef MODEST_TOOLKIT_HILDON2
@@ -50,6 +51,52 @@
 
 #define MODEST_HEADER_VIEW_MAX_TEXT_LENGTH 128
 
+/* raw recipients -> display addresses, both interned. Every row of
+   the same sender shares the strings, and the key can be compared
+   by pointer */
+#define DISPLAY_ADDRESSES_CACHE "header-view-display-addresses"
+#define DISPLAY_ADDRESSES_CACHE_SIZE (128*1024)
+
+static gsize
+display_addresses_size (gconstpointer key, gconstpointer value)
+{
+	return strlen ((const gchar *) key) + strlen ((const gchar *) value) + 2;
+}
+
+/* Returns an interned string, never NULL */
+static const gchar *
+get_display_addresses (const gchar *recipients)
+{
+	static ModestCache *cache = NULL;
+	const gchar *key, *addresses;
+
+	if (G_UNLIKELY (!cache))
+		cache = modest_cache_mgr_new_cache (modest_runtime_get_cache_mgr (),
+						    DISPLAY_ADDRESSES_CACHE,
+						    DISPLAY_ADDRESSES_CACHE_SIZE,
+						    g_direct_hash, g_direct_equal,
+						    (GDestroyNotify) modest_string_pool_unref,
+						    (GDestroyNotify) modest_string_pool_unref,
+						    (GBoxedCopyFunc) modest_string_pool_ref,
+						    display_addresses_size);
+
+	key = modest_string_pool_intern (recipients ? recipients : "");
+	addresses = modest_cache_lookup (cache, key);
+	if (addresses) {
+		modest_string_pool_unref (key);
+		return addresses;
+	}
+
+	addresses = modest_string_pool_intern_take (modest_text_utils_get_display_addresses (key));
+	if (!addresses)
+		addresses = modest_string_pool_intern ("");
+
+	/* the cache takes the reference of the key */
+	modest_cache_insert (cache, (gpointer) key, (gpointer) modest_string_pool_ref (addresses));
+
+	return addresses;
+}
+
 static const gchar *
 get_status_string (ModestTnySendQueueStatus status)
 {
@@ -297,7 +344,8 @@ _modest_header_view_compact_header_cell_data  (GtkTreeViewColumn *column,  GtkCe
 					       GtkTreeModel *tree_model,  GtkTreeIter *iter,  gpointer user_data)
 {
 	TnyHeaderFlags flags = 0;
-	gchar *recipients = NULL, *addresses;
+	gchar *recipients = NULL;
+	const gchar *addresses;
 	gchar *subject = NULL;
 	time_t date;
 	GtkCellRenderer *recipient_cell, *date_or_status_cell, *subject_cell,
@@ -376,9 +424,9 @@ _modest_header_view_compact_header_cell_data  (GtkTreeViewColumn *column,  GtkCe
 	g_free (subject);
 
 	/* Show the list of senders/recipients */
-	addresses = modest_text_utils_get_display_addresses ((const gchar *) recipients);
-	set_cell_text (recipient_cell, (addresses) ? addresses : _("mail_va_no_to"), flags);
-	g_free (addresses);
+	addresses = get_display_addresses (recipients);
+	set_cell_text (recipient_cell, (addresses[0] != '\0') ? addresses : _("mail_va_no_to"), flags);
+	modest_string_pool_unref (addresses);
 	g_free (recipients);
 
 	/* Show status (outbox folder) or sent date */
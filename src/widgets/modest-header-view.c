@@ -51,6 +51,11 @@
 #include <modest-vbox-cell-renderer.h>
 #include <modest-datetime-formatter.h>
 #include <modest-ui-constants.h>
+#include <modest-folder-counts.h>
+#include <modest-folder-change-bus.h>
+#include <modest-search-query.h>
+#include <modest-search.h>
+#include <modest-offline-journal.h>
 #ifdef MODEST_TOOLKIT_HILDON2
 #include <hildon/hildon.h>
 #endif
@@ -113,6 +118,10 @@ static void          folder_monitor_update  (TnyFolderObserver *self,
 
 static void          tny_folder_observer_init (TnyFolderObserverIface *klass);
 
+static void          on_folder_changes      (TnyFolder *folder,
+					     TnyFolderChange *change,
+					     gpointer user_data);
+
 static void          _clipboard_set_selected_data (ModestHeaderView *header_view, gboolean delete);
 
 static void          _clear_hidding_filter (ModestHeaderView *header_view);
@@ -143,6 +152,7 @@ struct _ModestHeaderViewPrivate {
 
 	TnyFolderMonitor     *monitor;
 	GMutex               *observers_lock;
+	guint                 change_subscription;
 
 	/*header-view-observer observer*/
 	GMutex *observer_list_lock;
@@ -152,8 +162,7 @@ struct _ModestHeaderViewPrivate {
 	ModestEmailClipboard *clipboard;
 
 	/* Filter tree model */
-	gchar **hidding_ids;
-	guint   n_selected;
+	GHashTable *hidding_ids;
 	GtkTreeRowReference *autoselect_reference;
 	ModestHeaderViewFilter filter;
 #ifdef MODEST_TOOLKIT_HILDON2
@@ -182,11 +191,8 @@ struct _ModestHeaderViewPrivate {
 	GdkColor active_color;
 	GdkColor secondary_color;
 
-	gchar *filter_string;
-	gchar **filter_string_splitted;
-	gboolean filter_date_range;
-	time_t date_range_start;
-	time_t date_range_end;
+	/* live search, see modest-search-query.h */
+	ModestSearchQuery *filter_query;
 
 	guint refilter_handler_id;
 	GtkTreeModel *filtered_model;
@@ -209,11 +215,6 @@ struct _HeadersCountChangedHelper {
 
 #define MODEST_HEADER_VIEW_PTR "modest-header-view"
 
-#define _HEADER_VIEW_SUBJECT_FOLD "_subject_modest_header_view"
-#define _HEADER_VIEW_FROM_FOLD "_from_modest_header_view"
-#define _HEADER_VIEW_TO_FOLD "_to_modest_header_view"
-#define _HEADER_VIEW_CC_FOLD "_cc_modest_header_view"
-#define _HEADER_VIEW_BCC_FOLD "_bcc_modest_header_view"
 
 enum {
 	HEADER_SELECTED_SIGNAL,
@@ -643,6 +644,7 @@ modest_header_view_init (ModestHeaderView *obj)
 
 	priv->monitor	     = NULL;
 	priv->observers_lock = g_mutex_new ();
+	priv->change_subscription = 0;
 	priv->autoselect_reference = NULL;
 
 	priv->status  = HEADER_VIEW_INIT;
@@ -654,14 +656,11 @@ modest_header_view_init (ModestHeaderView *obj)
 
 	priv->clipboard = modest_runtime_get_email_clipboard ();
 	priv->hidding_ids = NULL;
-	priv->n_selected = 0;
 	priv->filter = MODEST_HEADER_VIEW_FILTER_NONE;
 #ifdef MODEST_TOOLKIT_HILDON2
 	priv->live_search = NULL;
 #endif
-	priv->filter_string = NULL;
-	priv->filter_string_splitted = NULL;
-	priv->filter_date_range = FALSE;
+	priv->filter_query = NULL;
 	priv->selection_changed_handler = 0;
 	priv->acc_removed_handler = 0;
 
@@ -712,8 +711,11 @@ modest_header_view_dispose (GObject *obj)
 	}
 
 	/* Free in the dispose to avoid unref cycles */
+	if (priv->change_subscription) {
+		modest_folder_change_bus_unsubscribe (priv->change_subscription);
+		priv->change_subscription = 0;
+	}
 	if (priv->folder) {
-		tny_folder_remove_observer (priv->folder, TNY_FOLDER_OBSERVER (obj));
 		g_object_unref (G_OBJECT (priv->folder));
 		priv->folder = NULL;
 	}
@@ -765,12 +767,9 @@ modest_header_view_finalize (GObject *obj)
 		priv->autoselect_reference = NULL;
 	}
 
-	if (priv->filter_string) {
-		g_free (priv->filter_string);
-	}
-
-	if (priv->filter_string_splitted) {
-		g_strfreev (priv->filter_string_splitted);
+	if (priv->filter_query) {
+		modest_search_query_free (priv->filter_query);
+		priv->filter_query = NULL;
 	}
 
 	G_OBJECT_CLASS(parent_class)->finalize (obj);
@@ -1348,8 +1347,11 @@ typedef struct {
 	ModestHeaderView *header_view;
 	RefreshAsyncUserCallback cb;
 	gpointer user_data;
+	gboolean in_place;
 } SetFolderHelper;
 
+static gboolean current_folder_needs_filtering (ModestHeaderViewPrivate *priv);
+
 static void
 folder_refreshed_cb (ModestMailOperation *mail_op,
 		     TnyFolder *folder,
@@ -1371,7 +1373,10 @@ folder_refreshed_cb (ModestMailOperation *mail_op,
 	   called for this refresh but now we know that the callback
 	   was previously called */
 	g_mutex_lock (priv->observers_lock);
-	tny_folder_add_observer (folder, TNY_FOLDER_OBSERVER (info->header_view));
+	if (folder == priv->folder && !priv->change_subscription)
+		priv->change_subscription =
+			modest_folder_change_bus_subscribe (folder, on_folder_changes,
+							    info->header_view);
 	g_mutex_unlock (priv->observers_lock);
 
 	/* Notify the observers that the update is over */
@@ -1385,6 +1390,17 @@ folder_refreshed_cb (ModestMailOperation *mail_op,
 	if (priv->folder == folder)
 		priv->notify_status = TRUE;
 
+	/* The monitor already applied the added and expunged headers
+	   to the model. The flags are read when the rows are drawn,
+	   so the changed ones only need a redraw, or a refilter if
+	   the filter depends on them */
+	if (info->in_place && priv->folder == folder) {
+		if (current_folder_needs_filtering (priv))
+			modest_header_view_refilter (info->header_view);
+		else
+			gtk_widget_queue_draw (GTK_WIDGET (info->header_view));
+	}
+
 	/* Frees */
 	g_object_unref (info->header_view);
 	g_free (info);
@@ -1409,6 +1425,51 @@ refresh_folder_error_handler (ModestMailOperation *mail_op,
 	}
 }
 
+static void
+refresh_folder (ModestHeaderView *self,
+		TnyFolder *folder,
+		gboolean refresh,
+		gboolean in_place,
+		ModestWindow *progress_window,
+		RefreshAsyncUserCallback callback,
+		gpointer user_data)
+{
+	SetFolderHelper *info;
+	ModestMailOperation *mail_op = NULL;
+
+	/* Notify the observers that the update begins */
+	g_signal_emit (G_OBJECT (self), signals[UPDATING_MSG_LIST_SIGNAL],
+		       0, TRUE, NULL);
+
+	/* create the helper */
+	info = g_malloc0 (sizeof (SetFolderHelper));
+	info->header_view = g_object_ref (self);
+	info->cb = callback;
+	info->user_data = user_data;
+	info->in_place = in_place;
+
+	/* Create the mail operation (source will be the parent widget) */
+	if (progress_window)
+		mail_op = modest_mail_operation_new_with_error_handling (G_OBJECT(progress_window),
+									 refresh_folder_error_handler,
+									 NULL, NULL);
+	if (refresh) {
+		modest_mail_operation_queue_add (modest_runtime_get_mail_operation_queue (),
+						 mail_op);
+
+		/* Refresh the folder asynchronously */
+		modest_mail_operation_refresh_folder (mail_op,
+						      folder,
+						      folder_refreshed_cb,
+						      info);
+	} else {
+		folder_refreshed_cb (mail_op, folder, info);
+	}
+	/* Free */
+	if (mail_op)
+		g_object_unref (mail_op);
+}
+
 void
 modest_header_view_set_folder (ModestHeaderView *self,
 			       TnyFolder *folder,
@@ -1423,6 +1484,17 @@ modest_header_view_set_folder (ModestHeaderView *self,
 
 	priv =     MODEST_HEADER_VIEW_GET_PRIVATE(self);
 
+	/* Refreshing the folder already shown. Its monitor is
+	   watching the headers of the model, so it will apply the
+	   changes of the refresh to the rows, and we keep the model,
+	   the selection and the scroll position */
+	if (folder && folder == priv->folder && priv->monitor &&
+	    gtk_tree_view_get_model (GTK_TREE_VIEW (self))) {
+		refresh_folder (self, folder, refresh, TRUE,
+				progress_window, callback, user_data);
+		return;
+	}
+
 	if (priv->folder) {
 		if (priv->status_timeout) {
 			g_source_remove (priv->status_timeout);
@@ -1430,7 +1502,10 @@ modest_header_view_set_folder (ModestHeaderView *self,
 		}
 
 		g_mutex_lock (priv->observers_lock);
-		tny_folder_remove_observer (priv->folder, TNY_FOLDER_OBSERVER (self));
+		if (priv->change_subscription) {
+			modest_folder_change_bus_unsubscribe (priv->change_subscription);
+			priv->change_subscription = 0;
+		}
 		g_object_unref (priv->folder);
 		priv->folder = NULL;
 		g_mutex_unlock (priv->observers_lock);
@@ -1438,8 +1513,6 @@ modest_header_view_set_folder (ModestHeaderView *self,
 
 	if (folder) {
 		GtkTreeSelection *selection;
-		SetFolderHelper *info;
-		ModestMailOperation *mail_op = NULL;
 
 		/* Set folder in the model */
 		modest_header_view_set_folder_intern (self, folder, refresh);
@@ -1455,36 +1528,8 @@ modest_header_view_set_folder (ModestHeaderView *self,
 		gtk_tree_selection_unselect_all(selection);
 		g_signal_emit (G_OBJECT(self), signals[HEADER_SELECTED_SIGNAL], 0, NULL);
 
-		/* Notify the observers that the update begins */
-		g_signal_emit (G_OBJECT (self), signals[UPDATING_MSG_LIST_SIGNAL],
-			       0, TRUE, NULL);
-
-		/* create the helper */
-		info = g_malloc0 (sizeof (SetFolderHelper));
-		info->header_view = g_object_ref (self);
-		info->cb = callback;
-		info->user_data = user_data;
-
-		/* Create the mail operation (source will be the parent widget) */
-		if (progress_window)
-			mail_op = modest_mail_operation_new_with_error_handling (G_OBJECT(progress_window),
-										 refresh_folder_error_handler,
-										 NULL, NULL);
-		if (refresh) {
-			modest_mail_operation_queue_add (modest_runtime_get_mail_operation_queue (),
-							 mail_op);
-
-			/* Refresh the folder asynchronously */
-			modest_mail_operation_refresh_folder (mail_op,
-							      folder,
-							      folder_refreshed_cb,
-							      info);
-		} else {
-			folder_refreshed_cb (mail_op, folder, info);
-		}
-		/* Free */
-		if (mail_op)
-			g_object_unref (mail_op);
+		refresh_folder (self, folder, refresh, FALSE,
+				progress_window, callback, user_data);
 	} else {
 		g_mutex_lock (priv->observers_lock);
 
@@ -1988,6 +2033,15 @@ on_button_press_event(GtkWidget * self, GdkEventButton * event, gpointer userdat
 	return FALSE;
 }
 
+/* Called by the change bus with the changes of a whole frame */
+static void
+on_folder_changes (TnyFolder *folder,
+		   TnyFolderChange *change,
+		   gpointer user_data)
+{
+	folder_monitor_update (TNY_FOLDER_OBSERVER (user_data), change);
+}
+
 static void
 folder_monitor_update (TnyFolderObserver *self,
 		       TnyFolderChange *change)
@@ -2030,6 +2084,10 @@ folder_monitor_update (TnyFolderObserver *self,
 			    g_print ("---------------------------------------------------\n");
 			    );
 
+	/* Keep the persistent counts up to date */
+	modest_folder_counts_update_from_change (change);
+	modest_search_update_from_change (change);
+
 	/* Check folder count */
 	if ((changed & TNY_FOLDER_CHANGE_CHANGED_ADDED_HEADERS) ||
 	    (changed & TNY_FOLDER_CHANGE_CHANGED_EXPUNGED_HEADERS)) {
@@ -2088,30 +2146,68 @@ void
 modest_header_view_cut_selection (ModestHeaderView *header_view)
 {
 	ModestHeaderViewPrivate *priv = NULL;
-	const gchar **hidding = NULL;
-	guint i, n_selected;
+	GtkTreeSelection *sel;
+	GtkTreeModel *model = NULL;
+	GList *rows, *node;
+	gboolean previous_cut;
 
 	g_return_if_fail (header_view && MODEST_IS_HEADER_VIEW (header_view));
 
 	priv = MODEST_HEADER_VIEW_GET_PRIVATE (header_view);
 
+	/* Get the rows that are going to be hidden before the filter
+	   changes them */
+	sel = gtk_tree_view_get_selection (GTK_TREE_VIEW (header_view));
+	rows = gtk_tree_selection_get_selected_rows (sel, &model);
+
 	/* Copy selection */
 	_clipboard_set_selected_data (header_view, TRUE);
 
+	/* Clear hidding set created by previous cut operation */
+	previous_cut = (priv->hidding_ids != NULL);
+	_clear_hidding_filter (MODEST_HEADER_VIEW (header_view));
+
 	/* Get hidding ids */
-	hidding = modest_email_clipboard_get_hidding_ids (priv->clipboard, &n_selected);
+	priv->hidding_ids = modest_email_clipboard_get_hidding_set (priv->clipboard);
+
+	/* Hide cut headers. A previous cut could have hidden rows
+	   that must be shown again, and hiding all the rows changes
+	   the empty status of the view, so refilter the whole model
+	   in those cases. Otherwise just reevaluate the selected
+	   rows */
+	if (previous_cut || !GTK_IS_TREE_MODEL_FILTER (model) ||
+	    g_list_length (rows) >= gtk_tree_model_iter_n_children (model, NULL)) {
+		modest_header_view_refilter (header_view);
+	} else {
+		GtkTreeModel *child_model;
+		GSList *child_paths = NULL, *cursor;
+
+		/* Paths in the filter model change as rows get
+		   hidden, so convert all of them to child paths
+		   first */
+		child_model = gtk_tree_model_filter_get_model (GTK_TREE_MODEL_FILTER (model));
+		for (node = rows; node; node = g_list_next (node)) {
+			GtkTreePath *child_path;
+
+			child_path = gtk_tree_model_filter_convert_path_to_child_path (GTK_TREE_MODEL_FILTER (model),
+										       (GtkTreePath *) node->data);
+			if (child_path)
+				child_paths = g_slist_prepend (child_paths, child_path);
+		}
 
-	/* Clear hidding array created by previous cut operation */
-	_clear_hidding_filter (MODEST_HEADER_VIEW (header_view));
+		for (cursor = child_paths; cursor; cursor = g_slist_next (cursor)) {
+			GtkTreeIter child_iter;
+			GtkTreePath *child_path = (GtkTreePath *) cursor->data;
 
-	/* Copy hidding array */
-	priv->n_selected = n_selected;
-	priv->hidding_ids = g_malloc0(sizeof(gchar *) * n_selected);
-	for (i=0; i < n_selected; i++)
-		priv->hidding_ids[i] = g_strdup(hidding[i]);
+			if (gtk_tree_model_get_iter (child_model, &child_iter, child_path))
+				gtk_tree_model_row_changed (child_model, child_path, &child_iter);
+			gtk_tree_path_free (child_path);
+		}
+		g_slist_free (child_paths);
+	}
 
-	/* Hide cut headers */
-	modest_header_view_refilter (header_view);
+	g_list_foreach (rows, (GFunc) gtk_tree_path_free, NULL);
+	g_list_free (rows);
 }
 
 
@@ -2174,97 +2270,6 @@ current_folder_needs_filtering (ModestHeaderViewPrivate *priv)
 	return priv->is_outbox;
 }
 
-static gboolean
-header_match_string (TnyHeader *header, gchar **words)
-{
-	gchar *subject_fold;
-	gchar *cc_fold;
-	gchar *bcc_fold;
-	gchar *to_fold;
-	gchar *from_fold;
-
-	gchar **current_word;
-	gboolean found;
-
-	subject_fold = g_object_get_data (G_OBJECT (header), _HEADER_VIEW_SUBJECT_FOLD);
-	if (subject_fold == NULL) {
-		gchar *subject;
-		subject = tny_header_dup_subject (header);
-		if (subject != NULL) {
-			subject_fold = subject?g_utf8_casefold (subject, -1):NULL;
-			g_object_set_data_full (G_OBJECT (header), _HEADER_VIEW_SUBJECT_FOLD,
-						subject_fold, (GDestroyNotify) g_free);
-		}
-		g_free (subject);
-	}
-
-	from_fold = g_object_get_data (G_OBJECT (header), _HEADER_VIEW_FROM_FOLD);
-	if (from_fold == NULL) {
-		gchar *from;
-		from = tny_header_dup_from (header);
-		if (from != NULL) {
-			from_fold = from?g_utf8_casefold (from, -1):NULL;
-			g_object_set_data_full (G_OBJECT (header), _HEADER_VIEW_FROM_FOLD,
-						from_fold, (GDestroyNotify) g_free);
-		}
-		g_free (from);
-	}
-
-	to_fold = g_object_get_data (G_OBJECT (header), _HEADER_VIEW_TO_FOLD);
-	if (to_fold == NULL) {
-		gchar *to;
-		to = tny_header_dup_to (header);
-		if (to != NULL) {
-			to_fold = to?g_utf8_casefold (to, -1):NULL;
-			g_object_set_data_full (G_OBJECT (header), _HEADER_VIEW_TO_FOLD,
-						to_fold, (GDestroyNotify) g_free);
-		}
-		g_free (to);
-	}
-
-	cc_fold = g_object_get_data (G_OBJECT (header), _HEADER_VIEW_CC_FOLD);
-	if (cc_fold == NULL) {
-		gchar *cc;
-		cc = tny_header_dup_cc (header);
-		if (cc != NULL) {
-			cc_fold = cc?g_utf8_casefold (cc, -1):NULL;
-			g_object_set_data_full (G_OBJECT (header), _HEADER_VIEW_CC_FOLD,
-						cc_fold, (GDestroyNotify) g_free);
-		}
-		g_free (cc);
-	}
-
-	bcc_fold = g_object_get_data (G_OBJECT (header), _HEADER_VIEW_BCC_FOLD);
-	if (bcc_fold == NULL) {
-		gchar *bcc;
-		bcc = tny_header_dup_bcc (header);
-		if (bcc != NULL) {
-			bcc_fold = bcc?g_utf8_casefold (bcc, -1):NULL;
-			g_object_set_data_full (G_OBJECT (header), _HEADER_VIEW_BCC_FOLD,
-						bcc_fold, (GDestroyNotify) g_free);
-		}
-		g_free (bcc);
-	}
-
-	found = TRUE;
-
-	for (current_word = words; *current_word != NULL; current_word++) {
-
-		if ((subject_fold && g_strstr_len (subject_fold, -1, *current_word))
-		    || (cc_fold && g_strstr_len (cc_fold, -1, *current_word))
-		    || (bcc_fold && g_strstr_len (bcc_fold, -1, *current_word))
-		    || (to_fold && g_strstr_len (to_fold, -1, *current_word))
-		    || (from_fold && g_strstr_len (from_fold, -1, *current_word))) {
-			found = TRUE;
-		} else {
-			found = FALSE;
-			break;
-		}
-	}
-
-	return found;
-}
-
 static gboolean
 filter_row (GtkTreeModel *model,
 	    GtkTreeIter *iter,
@@ -2273,10 +2278,8 @@ filter_row (GtkTreeModel *model,
 	ModestHeaderViewPrivate *priv = NULL;
 	TnyHeaderFlags flags;
 	TnyHeader *header = NULL;
-	guint i;
 	gchar *id = NULL;
 	gboolean visible = TRUE;
-	gboolean found = FALSE;
 	GValue value = {0,};
 	HeaderViewStatus old_status;
 
@@ -2302,6 +2305,12 @@ filter_row (GtkTreeModel *model,
 		goto frees;
 	}
 
+	/* Hide the messages that will be moved when we get online */
+	if (modest_offline_journal_is_pending (header)) {
+		visible = FALSE;
+		goto frees;
+	}
+
 	if (visible && (priv->filter & MODEST_HEADER_VIEW_FILTER_DELETABLE)) {
 		if (current_folder_needs_filtering (priv) &&
 		    modest_tny_all_send_queues_get_msg_status (header) == MODEST_TNY_SEND_QUEUE_SENDING) {
@@ -2318,18 +2327,14 @@ filter_row (GtkTreeModel *model,
 		}
 	}
 
-	if (visible && priv->filter_string) {
-		if (!header_match_string (header, priv->filter_string_splitted)) {
+	/* We never open the messages here, so the rows that depend on
+	   the body (body: terms) are hidden */
+	if (visible && priv->filter_query) {
+		if (modest_search_query_match_header (priv->filter_query, header) !=
+		    MODEST_SEARCH_QUERY_MATCH) {
 			visible = FALSE;
 			goto frees;
 		}
-		if (priv->filter_date_range) {
-			if ((tny_header_get_date_sent (TNY_HEADER (header)) < priv->date_range_start) ||
-			    ((priv->date_range_end != -1) && (tny_header_get_date_sent (TNY_HEADER (header)) > priv->date_range_end))) {
-				visible = FALSE;
-				goto frees;
-			}
-		}
 	}
 
 	/* If no data on clipboard, return always TRUE */
@@ -2340,12 +2345,9 @@ filter_row (GtkTreeModel *model,
 
 	/* Check hiding */
 	if (priv->hidding_ids != NULL) {
-		id = tny_header_dup_message_id (header);
-		for (i=0; i < priv->n_selected && !found; i++)
-			if (priv->hidding_ids[i] != NULL && id != NULL)
-				found = (!strcmp (priv->hidding_ids[i], id));
-
-		visible = !found;
+		id = tny_header_dup_uid (header);
+		if (id && g_hash_table_lookup (priv->hidding_ids, id))
+			visible = FALSE;
 		g_free(id);
 	}
 
@@ -2377,15 +2379,13 @@ static void
 _clear_hidding_filter (ModestHeaderView *header_view)
 {
 	ModestHeaderViewPrivate *priv = NULL;
-	guint i;
 
 	g_return_if_fail (MODEST_IS_HEADER_VIEW (header_view));
 	priv = MODEST_HEADER_VIEW_GET_PRIVATE(header_view);
 
 	if (priv->hidding_ids != NULL) {
-		for (i=0; i < priv->n_selected; i++)
-			g_free (priv->hidding_ids[i]);
-		g_free(priv->hidding_ids);
+		g_hash_table_unref (priv->hidding_ids);
+		priv->hidding_ids = NULL;
 	}
 }
 
@@ -2654,92 +2654,6 @@ modest_header_view_get_header_at_pos (ModestHeaderView *header_view,
 	return header;
 }
 
-static gboolean
-parse_date_side (const gchar *string, time_t *date_side)
-{
-	gchar *today;
-	gchar *yesterday;
-	gchar *casefold;
-	GDate *date;
-	gboolean result = FALSE;
-
-	if (string && string[0] == '\0') {
-		*date_side = 0;
-		return TRUE;
-	}
-
-	casefold = g_utf8_casefold (string, -1);
-	today = g_utf8_casefold (dgettext ("gtk20", "Today"), -1);
-	yesterday = g_utf8_casefold (dgettext ("gtk20", "Yesterday"), -1);
-	date = g_date_new ();
-
-	if (g_utf8_collate (casefold, today) == 0) {
-		*date_side = time (NULL);
-		result = TRUE;
-		goto frees;
-	}
-
-	if (g_utf8_collate (casefold, yesterday) == 0) {
-		*date_side = time (NULL) - 24*60*60;
-		result = TRUE;
-		goto frees;
-	}
-
-	g_date_set_parse (date, string);
-	if (g_date_valid (date)) {
-		struct tm tm = {0};
-		g_date_to_struct_tm (date, &tm);
-		*date_side = mktime (&tm);
-		
-		result = TRUE;
-		goto frees;
-	}
-frees:
-	g_free (today);
-	g_free (yesterday);
-	g_free (casefold);
-	g_date_free (date);
-
-	return result;
-}
-
-static gboolean
-parse_date_range (const gchar *string, time_t *date_range_start, time_t *date_range_end)
-{
-	gchar ** parts;
-	gboolean valid;
-
-	parts = g_strsplit (string, "..", 2);
-	valid = TRUE;
-
-	if (g_strv_length (parts) != 2) {
-		valid = FALSE;
-		goto frees;
-		g_strfreev (parts);
-		return FALSE;
-	}
-
-	if (!parse_date_side (parts[0], date_range_start)) {
-		valid = FALSE;
-		goto frees;
-	}
-
-	if (parse_date_side (parts[1], date_range_end)) {
-		if (*date_range_end == 0) {
-			*date_range_end = (time_t) -1;
-		} else {
-			*date_range_end += (24*60*60 - 1);
-		}
-	} else {
-		valid = FALSE;
-		goto frees;
-	}
-		
-frees:
-	g_strfreev (parts);
-	return valid;
-}
-
 void
 modest_header_view_set_filter_string (ModestHeaderView *self,
 				      const gchar *filter_string)
@@ -2749,44 +2663,13 @@ modest_header_view_set_filter_string (ModestHeaderView *self,
 	g_return_if_fail (MODEST_IS_HEADER_VIEW (self));
 	priv = MODEST_HEADER_VIEW_GET_PRIVATE (self);
 
-	if (priv->filter_string)
-		g_free (priv->filter_string);
-
-	priv->filter_string = g_strdup (filter_string);
-	priv->filter_date_range = FALSE;
-
-	if (priv->filter_string_splitted) {
-		g_strfreev (priv->filter_string_splitted);
-		priv->filter_string_splitted = NULL;
-	}
-
-	if (priv->filter_string) {
-		gchar **split, **current, **current_target;
+	if (priv->filter_query)
+		modest_search_query_free (priv->filter_query);
 
-		split = g_strsplit (priv->filter_string, " ", 0);
+	/* The same query language of the search, with plain words
+	   matching the subject or the addresses */
+	priv->filter_query = filter_string ? modest_search_query_new (filter_string) : NULL;
 
-		priv->filter_string_splitted = g_malloc0 (sizeof (gchar *)*(g_strv_length (split) + 1));
-		current_target = priv->filter_string_splitted;
-		for (current = split; *current != 0; current ++) {
-			gboolean has_date_range = FALSE;;
-			if (g_strstr_len (*current, -1, "..") && strcmp(*current, "..")) {
-				time_t range_start, range_end;
-				/* It contains .. but it's not ".." so it may be a date range */
-				if (parse_date_range (*current, &range_start, &range_end)) {
-					priv->filter_date_range = TRUE;
-					has_date_range = TRUE;
-					priv->date_range_start = range_start;
-					priv->date_range_end = range_end;
-				}
-			}
-			if (!has_date_range) {
-				*current_target = g_utf8_casefold (*current, -1);
-				current_target++;
-			}
-		}
-		*current_target = '\0';
-		g_strfreev (split);
-	}
 	modest_header_view_refilter (MODEST_HEADER_VIEW (self));
 }
 
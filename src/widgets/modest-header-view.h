@@ -163,7 +163,10 @@ GtkWidget*   modest_header_view_new        (TnyFolder *folder,
  * @self: a ModestHeaderView instance
  * @folder: a TnyFolder object
  * 
- * set the folder for this ModestHeaderView
+ * set the folder for this ModestHeaderView. If @folder is the one
+ * already shown then the model, the selection and the scroll
+ * position are kept, and the rows are only updated with the changes
+ * of the refresh
  */
 void         modest_header_view_set_folder (ModestHeaderView *self,
 					    TnyFolder *folder,
@@ -427,6 +430,7 @@ void modest_header_view_unset_filter (ModestHeaderView *self,
  * @filter_string: a string
  *
  * Set a string for filtering visible messages. If %NULL, no filtering is done.
+ * The string is a query as described in modest-search-query.h
  */
 void modest_header_view_set_filter_string (ModestHeaderView *self,
 					   const gchar *filter_string);
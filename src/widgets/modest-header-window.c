@@ -50,6 +50,7 @@
 #include <modest-ui-dimming-rules.h>
 #include <modest-tny-folder.h>
 #include <modest-tny-account.h>
+#include <modest-search.h>
 #include <tny-simple-list.h>
 #include <gdk/gdkkeysyms.h>
 #include <modest-isearch-toolbar.h>
@@ -571,6 +572,7 @@ on_mark_read_csm_activated (GtkMenuItem *item,
 	if (header) {
 		gchar *uid;
 		tny_header_set_flag (header, TNY_HEADER_FLAG_SEEN);
+		modest_search_header_changed (header);
 		uid = modest_tny_folder_get_header_unique_id (header);
 		modest_platform_emit_msg_read_changed_signal (uid, TRUE);
 		g_free (uid);
@@ -595,6 +597,7 @@ on_mark_unread_csm_activated (GtkMenuItem *item,
 	if (header) {
 		gchar *uid;
 		tny_header_unset_flag (header, TNY_HEADER_FLAG_SEEN);
+		modest_search_header_changed (header);
 		uid = modest_tny_folder_get_header_unique_id (header);
 		modest_platform_emit_msg_read_changed_signal (uid, FALSE);
 		g_free (uid);
@@ -334,6 +334,7 @@ struct _ModestMsgEditWindowPrivate {
 	TnyMsg      *draft_msg;
 	TnyMsg      *outbox_msg;
 	gchar       *msg_uid;
+	gchar       *folder_url;
 
 	gboolean    sent;
 
@@ -457,6 +458,7 @@ modest_msg_edit_window_init (ModestMsgEditWindow *obj)
 	priv->draft_msg = NULL;
 	priv->outbox_msg = NULL;
 	priv->msg_uid = NULL;
+	priv->folder_url = NULL;
 
 	priv->can_undo = FALSE;
 	priv->can_redo = FALSE;
@@ -1195,6 +1197,7 @@ modest_msg_edit_window_finalize (GObject *obj)
 	if (priv->original_mailbox)
 		g_free (priv->original_mailbox);
 	g_free (priv->msg_uid);
+	g_free (priv->folder_url);
 	g_free (priv->last_search);
         g_slist_free (priv->font_items_group);
 	g_free (priv->references);
@@ -1564,6 +1567,8 @@ set_msg (ModestMsgEditWindow *self, TnyMsg *msg, gboolean preserve_is_rich)
 		g_free (priv->msg_uid);
 		priv->msg_uid = NULL;
 	}
+	g_free (priv->folder_url);
+	priv->folder_url = NULL;
 
 	/* we should set a reference to the incoming message if it is a draft */
 	msg_folder = tny_msg_get_folder (msg);
@@ -1578,6 +1583,7 @@ set_msg (ModestMsgEditWindow *self, TnyMsg *msg, gboolean preserve_is_rich)
 			if (type == TNY_FOLDER_TYPE_OUTBOX)
 				priv->outbox_msg = g_object_ref(msg);
 			priv->msg_uid = modest_tny_folder_get_header_unique_id (header);
+			priv->folder_url = tny_folder_get_url_string (msg_folder);
 		}
 		g_object_unref (msg_folder);
 	}
@@ -4163,6 +4169,7 @@ modest_msg_edit_window_set_draft (ModestMsgEditWindow *window,
 {
 	ModestMsgEditWindowPrivate *priv;
 	TnyHeader *header = NULL;
+	TnyFolder *draft_folder;
 
 	g_return_if_fail (MODEST_IS_MSG_EDIT_WINDOW (window));
 	g_return_if_fail ((draft == NULL)||(TNY_IS_MSG (draft)));
@@ -4181,9 +4188,21 @@ modest_msg_edit_window_set_draft (ModestMsgEditWindow *window,
 			priv->msg_uid = NULL;
 		}
 		priv->msg_uid = modest_tny_folder_get_header_unique_id (header);
+		g_object_unref (header);
+
+		g_free (priv->folder_url);
+		priv->folder_url = NULL;
+		draft_folder = tny_msg_get_folder (draft);
+		if (draft_folder) {
+			priv->folder_url = tny_folder_get_url_string (draft_folder);
+			g_object_unref (draft_folder);
+		}
 	}
 
 	priv->draft_msg = draft;
+
+	modest_window_mgr_update_window_index (modest_runtime_get_window_mgr (),
+					       MODEST_WINDOW (window));
 }
 
 static void  
@@ -4227,6 +4246,17 @@ modest_msg_edit_window_get_message_uid (ModestMsgEditWindow *window)
 	return priv->msg_uid;
 }
 
+const gchar*
+modest_msg_edit_window_get_folder_url (ModestMsgEditWindow *window)
+{
+	ModestMsgEditWindowPrivate *priv;
+
+	g_return_val_if_fail (MODEST_IS_MSG_EDIT_WINDOW (window), NULL);
+	priv = MODEST_MSG_EDIT_WINDOW_GET_PRIVATE (window);
+
+	return priv->folder_url;
+}
+
 GtkWidget *
 modest_msg_edit_window_get_child_widget (ModestMsgEditWindow *win,
 					 ModestMsgEditWindowWidgetType widget_type)
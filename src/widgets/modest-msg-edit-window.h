@@ -467,6 +467,17 @@ void            modest_msg_edit_window_set_draft           (ModestMsgEditWindow
  */
 const gchar*    modest_msg_edit_window_get_message_uid (ModestMsgEditWindow *window);
 
+/**
+ * modest_msg_edit_window_get_folder_url:
+ * @window: an #ModestMsgEditWindow instance
+ *
+ * gets the url of the folder of the draft or outbox message the
+ * editor was opened from. The returned value *must* not be freed
+ *
+ * Returns: the url of the folder, or NULL for new messages
+ */
+const gchar*    modest_msg_edit_window_get_folder_url (ModestMsgEditWindow *window);
+
 /**
  * modest_msg_edit_window_get_child_widget:
  * @win: a #ModestMsgEditWindow
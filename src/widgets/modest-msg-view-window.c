@@ -47,6 +47,7 @@
 #include <modest-window-priv.h>
 #include <modest-tny-folder.h>
 #include <modest-text-utils.h>
+#include <modest-search.h>
 #include <modest-account-mgr-helpers.h>
 #include <modest-toolkit-factory.h>
 #include <modest-scrollable.h>
@@ -137,6 +138,7 @@ struct _ModestMsgViewWindowPrivate {
 	GtkWidget *remove_attachment_banner;
 
 	gchar *msg_uid;
+	gchar *folder_url;
 	TnyMimePart *other_body;
 	TnyMsg * top_msg;
 
@@ -512,6 +514,7 @@ modest_msg_view_window_init (ModestMsgViewWindow *obj)
 	priv->purge_timeout = 0;
 	priv->remove_attachment_banner = NULL;
 	priv->msg_uid = NULL;
+	priv->folder_url = NULL;
 	priv->other_body = NULL;
 
 	priv->sighandlers = NULL;
@@ -708,6 +711,8 @@ modest_msg_view_window_finalize (GObject *obj)
 		g_free (priv->msg_uid);
 		priv->msg_uid = NULL;
 	}
+	g_free (priv->folder_url);
+	priv->folder_url = NULL;
 
 	G_OBJECT_CLASS(parent_class)->finalize (obj);
 }
@@ -1038,6 +1043,9 @@ modest_msg_view_window_new_from_uid (const gchar *modest_account_name,
 			TnyDevice *device;
 			gboolean device_online;
 
+			/* The message could take a while to arrive */
+			priv->folder_url = tny_folder_get_url_string (folder);
+
 			device = modest_runtime_get_device();
 			device_online = tny_device_is_online (device);
 			if (device_online) {
@@ -1599,6 +1607,32 @@ modest_msg_view_window_get_message_uid (ModestMsgViewWindow *self)
 	return (const gchar*) priv->msg_uid;
 }
 
+const gchar*
+modest_msg_view_window_get_folder_url (ModestMsgViewWindow *self)
+{
+	ModestMsgViewWindowPrivate *priv;
+
+	g_return_val_if_fail (MODEST_IS_MSG_VIEW_WINDOW (self), NULL);
+
+	priv = MODEST_MSG_VIEW_WINDOW_GET_PRIVATE (self);
+
+	if (!priv->folder_url) {
+		TnyHeader *header;
+
+		header = modest_msg_view_window_get_header (self);
+		if (header) {
+			TnyFolder *folder = tny_header_get_folder (header);
+			if (folder) {
+				priv->folder_url = tny_folder_get_url_string (folder);
+				g_object_unref (folder);
+			}
+			g_object_unref (header);
+		}
+	}
+
+	return (const gchar*) priv->folder_url;
+}
+
 /* Used for the Ctrl+F accelerator */
 static void
 modest_msg_view_window_toggle_isearch_toolbar (GtkWidget *obj,
@@ -2335,6 +2369,7 @@ view_msg_cb (ModestMailOperation *mail_op,
 		gchar *uid;
 
 		tny_header_set_flag (header, TNY_HEADER_FLAG_SEEN);
+		modest_search_header_changed (header);
 		uid = modest_tny_folder_get_header_unique_id (header);
 		modest_platform_emit_msg_read_changed_signal (uid, TRUE);
 		g_free (uid);
@@ -2354,6 +2389,10 @@ view_msg_cb (ModestMailOperation *mail_op,
 		g_free (priv->msg_uid);
 		priv->msg_uid = modest_tny_folder_get_header_unique_id (header);
 	}
+	g_free (priv->folder_url);
+	priv->folder_url = NULL;
+	modest_window_mgr_update_window_index (modest_runtime_get_window_mgr (),
+					       MODEST_WINDOW (self));
 
 	/* Notify the observers */
 	g_signal_emit (G_OBJECT (self), signals[MSG_CHANGED_SIGNAL],
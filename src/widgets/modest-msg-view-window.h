@@ -252,6 +252,17 @@ TnyMsg*         modest_msg_view_window_get_top_message     (ModestMsgViewWindow
  */
 const gchar*    modest_msg_view_window_get_message_uid (ModestMsgViewWindow *window);
 
+/**
+ * modest_msg_view_window_get_folder_url:
+ * @window: an #ModestMsgViewWindow instance
+ *
+ * gets the url of the folder of the message in this msg view. The
+ * returned value *must* not be freed
+ *
+ * Returns: the url of the folder, or NULL if it's not known
+ */
+const gchar*    modest_msg_view_window_get_folder_url (ModestMsgViewWindow *window);
+
 /**
  * modest_msg_view_window_select_next_message:
  * @window: a #ModestMsgViewWindow instance
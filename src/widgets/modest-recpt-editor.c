@@ -41,6 +41,7 @@
 #include <modest-ui-constants.h>
 #include <modest-toolkit-factory.h>
 #include <modest-runtime.h>
+#include <modest-address-index.h>
 
 #ifdef MODEST_TOOLKIT_HILDON2
 #include "modest-hildon-includes.h"
@@ -48,6 +49,9 @@
 
 #define RECPT_BUTTON_WIDTH_HILDON2 118
 
+/* minimum number of typed characters to complete a recipient */
+#define COMPLETION_MIN_CHARS 2
+
 
 static GObjectClass *parent_class = NULL;
 
@@ -69,6 +73,9 @@ struct _ModestRecptEditorPrivate
 	gchar *recipients;
 	gulong on_mark_set_handler;
 	gboolean show_abook;
+	/* offsets of the selected inline completion, -1 if none */
+	gint completion_start;
+	gint completion_end;
 };
 
 #define MODEST_RECPT_EDITOR_GET_PRIVATE(o)	\
@@ -89,6 +96,9 @@ static void modest_recpt_editor_add_tags (ModestRecptEditor *editor,
 static gboolean modest_recpt_editor_on_focus_in (GtkTextView *text_view,
 					     GdkEventFocus *event,
 					     ModestRecptEditor *editor);
+static gboolean modest_recpt_editor_on_focus_out (GtkTextView *text_view,
+						  GdkEventFocus *event,
+						  ModestRecptEditor *editor);
 static void modest_recpt_editor_on_mark_set (GtkTextBuffer *buffer,
 					     GtkTextIter *iter,
 					     GtkTextMark *mark,
@@ -113,6 +123,9 @@ static GtkTextTag *prev_iter_has_recipient (GtkTextIter *iter);
 /* static GtkTextTag *next_iter_has_recipient (GtkTextIter *iter); */
 static void select_tag_of_iter (GtkTextIter *iter, GtkTextTag *tag, gboolean grow, gboolean left_not_right);
 static gboolean quote_opened (GtkTextIter *iter);
+static void complete_recipient (ModestRecptEditor *editor, GtkTextBuffer *buffer);
+static gboolean accept_completion (ModestRecptEditor *editor, GtkTextBuffer *buffer);
+static void discard_completion (ModestRecptEditor *editor, GtkTextBuffer *buffer);
 static gboolean is_valid_insert (const gchar *text, gint len);
 static gchar *create_valid_text (const gchar *text, gint len);
 
@@ -390,6 +403,8 @@ modest_recpt_editor_instance_init (GTypeInstance *instance, gpointer g_class)
 #endif
 	
 	priv->recipients = NULL;
+	priv->completion_start = -1;
+	priv->completion_end = -1;
 
 #ifdef MODEST_TOOLKIT_HILDON2
 	priv->scrolled_window = NULL;
@@ -422,6 +437,7 @@ modest_recpt_editor_instance_init (GTypeInstance *instance, gpointer g_class)
 	g_signal_connect (G_OBJECT (priv->abook_button), "clicked", G_CALLBACK (modest_recpt_editor_on_abook_clicked), instance);
 	g_signal_connect (G_OBJECT (priv->text_view), "key-press-event", G_CALLBACK (modest_recpt_editor_on_key_press_event), instance);
 	g_signal_connect (G_OBJECT (priv->text_view), "focus-in-event", G_CALLBACK (modest_recpt_editor_on_focus_in), instance);
+	g_signal_connect (G_OBJECT (priv->text_view), "focus-out-event", G_CALLBACK (modest_recpt_editor_on_focus_out), instance);
 	g_signal_connect (G_OBJECT (buffer), "insert-text",
 			  G_CALLBACK (modest_recpt_editor_on_insert_text),
 			  instance);
@@ -547,6 +563,17 @@ modest_recpt_editor_on_focus_in (GtkTextView *text_view,
 	return FALSE;
 }
 
+static gboolean
+modest_recpt_editor_on_focus_out (GtkTextView *text_view,
+				  GdkEventFocus *event,
+				  ModestRecptEditor *editor)
+{
+	/* Leaving the field does not accept the completion */
+	discard_completion (editor, gtk_text_view_get_buffer (text_view));
+
+	return FALSE;
+}
+
 static gboolean
 is_valid_insert (const gchar *text, gint len)
 {
@@ -649,26 +676,136 @@ modest_recpt_editor_on_insert_text_after (GtkTextBuffer *buffer,
 {
 	GtkTextIter prev;
 	gunichar prev_char;
+	gboolean break_inserted = FALSE;
 	ModestRecptEditorPrivate *priv = MODEST_RECPT_EDITOR_GET_PRIVATE (editor);
 
+	/* Typing replaces the previous completion */
+	priv->completion_start = -1;
+	priv->completion_end = -1;
+
 	prev = *location;
 	/* We must go backwards twice as location points to the next
 	   valid position to insert text */
-	if (!gtk_text_iter_backward_chars (&prev, 2))
+	if (gtk_text_iter_backward_chars (&prev, 2)) {
+		prev_char = gtk_text_iter_get_char (&prev);
+		g_signal_handlers_block_by_func (buffer, modest_recpt_editor_on_insert_text, editor);
+		g_signal_handlers_block_by_func (buffer, modest_recpt_editor_on_insert_text_after, editor);
+		if ((prev_char == ';'||prev_char == ',')&&(!quote_opened(&prev))) {
+			GtkTextMark *insert;
+			gtk_text_iter_forward_char (&prev);
+			gtk_text_buffer_insert (buffer, &prev, "\n",-1);
+			insert = gtk_text_buffer_get_insert (buffer);
+			gtk_text_view_scroll_to_iter (GTK_TEXT_VIEW (priv->text_view), &prev, 0.0,TRUE, 0.0, 1.0);
+			break_inserted = TRUE;
+		}
+		g_signal_handlers_unblock_by_func (buffer, modest_recpt_editor_on_insert_text, editor);
+		g_signal_handlers_unblock_by_func (buffer, modest_recpt_editor_on_insert_text_after, editor);
+	}
+
+	/* Only complete what the user is typing, not pasted text */
+	if (!break_inserted && g_utf8_strlen (text, len) == 1)
+		complete_recipient (editor, buffer);
+}
+
+/* Inserts the rest of the best ranked address starting with the
+   recipient being typed, selected, so typing just replaces it */
+static void
+complete_recipient (ModestRecptEditor *editor,
+		    GtkTextBuffer *buffer)
+{
+	ModestRecptEditorPrivate *priv = MODEST_RECPT_EDITOR_GET_PRIVATE (editor);
+	GtkTextIter start, end;
+	gchar *typed, *completion;
+	gunichar c;
+
+	gtk_text_buffer_get_iter_at_mark (buffer, &end, gtk_text_buffer_get_insert (buffer));
+
+	/* Only complete at the end of a recipient */
+	c = gtk_text_iter_get_char (&end);
+	if (!gtk_text_iter_is_end (&end) && c != '\n' && c != ';' && c != ',')
 		return;
+	if (prev_iter_has_recipient (&end))
+		return;
+
+	/* Look for the start of the recipient */
+	start = end;
+	while (!gtk_text_iter_is_start (&start)) {
+		c = iter_previous_char (&start);
+		if (c == '\n' || c == ';' || c == ',')
+			break;
+		gtk_text_iter_backward_char (&start);
+	}
+	while (gtk_text_iter_get_char (&start) == ' ' &&
+	       gtk_text_iter_compare (&start, &end) < 0)
+		gtk_text_iter_forward_char (&start);
 
-	prev_char = gtk_text_iter_get_char (&prev);
-	g_signal_handlers_block_by_func (buffer, modest_recpt_editor_on_insert_text, editor);
-	g_signal_handlers_block_by_func (buffer, modest_recpt_editor_on_insert_text_after, editor);
-	if ((prev_char == ';'||prev_char == ',')&&(!quote_opened(&prev))) {
-		GtkTextMark *insert;
-		gtk_text_iter_forward_char (&prev);
-		gtk_text_buffer_insert (buffer, &prev, "\n",-1);
-		insert = gtk_text_buffer_get_insert (buffer);
-		gtk_text_view_scroll_to_iter (GTK_TEXT_VIEW (priv->text_view), &prev, 0.0,TRUE, 0.0, 1.0);
+	if (gtk_text_iter_get_offset (&end) - gtk_text_iter_get_offset (&start) < COMPLETION_MIN_CHARS)
+		return;
+
+	typed = gtk_text_buffer_get_text (buffer, &start, &end, FALSE);
+	completion = modest_address_index_complete (typed);
+	if (completion) {
+		const gchar *rest;
+
+		rest = g_utf8_offset_to_pointer (completion, g_utf8_strlen (typed, -1));
+		if (*rest) {
+			gint offset = gtk_text_iter_get_offset (&end);
+
+			g_signal_handlers_block_by_func (buffer, modest_recpt_editor_on_insert_text, editor);
+			g_signal_handlers_block_by_func (buffer, modest_recpt_editor_on_insert_text_after, editor);
+			gtk_text_buffer_insert (buffer, &end, rest, -1);
+			gtk_text_buffer_get_iter_at_offset (buffer, &start, offset);
+			gtk_text_buffer_select_range (buffer, &start, &end);
+			g_signal_handlers_unblock_by_func (buffer, modest_recpt_editor_on_insert_text, editor);
+			g_signal_handlers_unblock_by_func (buffer, modest_recpt_editor_on_insert_text_after, editor);
+
+			priv->completion_start = offset;
+			priv->completion_end = gtk_text_iter_get_offset (&end);
+		}
+		g_free (completion);
 	}
-	g_signal_handlers_unblock_by_func (buffer, modest_recpt_editor_on_insert_text, editor);
-	g_signal_handlers_unblock_by_func (buffer, modest_recpt_editor_on_insert_text_after, editor);
+	g_free (typed);
+}
+
+/* Moves the cursor to the end of the completion if it's still
+   selected. Returns TRUE if it was */
+static gboolean
+accept_completion (ModestRecptEditor *editor,
+		   GtkTextBuffer *buffer)
+{
+	ModestRecptEditorPrivate *priv = MODEST_RECPT_EDITOR_GET_PRIVATE (editor);
+	GtkTextIter start, end;
+	gboolean accepted = FALSE;
+
+	if (priv->completion_start >= 0 &&
+	    gtk_text_buffer_get_selection_bounds (buffer, &start, &end) &&
+	    gtk_text_iter_get_offset (&start) == priv->completion_start &&
+	    gtk_text_iter_get_offset (&end) == priv->completion_end) {
+		gtk_text_buffer_place_cursor (buffer, &end);
+		accepted = TRUE;
+	}
+	priv->completion_start = -1;
+	priv->completion_end = -1;
+
+	return accepted;
+}
+
+/* Removes the completion if it's still selected */
+static void
+discard_completion (ModestRecptEditor *editor,
+		    GtkTextBuffer *buffer)
+{
+	ModestRecptEditorPrivate *priv = MODEST_RECPT_EDITOR_GET_PRIVATE (editor);
+	GtkTextIter start, end;
+
+	if (priv->completion_start >= 0 &&
+	    gtk_text_buffer_get_selection_bounds (buffer, &start, &end) &&
+	    gtk_text_iter_get_offset (&start) == priv->completion_start &&
+	    gtk_text_iter_get_offset (&end) == priv->completion_end) {
+		gtk_text_buffer_delete (buffer, &start, &end);
+	}
+	priv->completion_start = -1;
+	priv->completion_end = -1;
 }
 
 /* Called before the default handler, we use it to validate the inputs */
@@ -977,6 +1114,12 @@ modest_recpt_editor_on_key_press_event (GtkTextView *text_view,
 	case GDK_KP_Enter:
 	{
 		gint insert_offset, selection_offset;
+
+		/* Accept the completion and finish the recipient */
+		if (accept_completion (editor, buffer)) {
+			gtk_text_buffer_get_iter_at_mark (buffer, &location, insert);
+			selection_loc = location;
+		}
 		insert_offset = gtk_text_iter_get_offset (&location);
 		selection_offset = gtk_text_iter_get_offset (&selection_loc);
 		g_signal_handlers_block_by_func (buffer, modest_recpt_editor_on_insert_text, editor);
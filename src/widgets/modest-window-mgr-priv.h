@@ -31,6 +31,8 @@
 #define __MODEST_WINDOW_MGR_PRIV_H__
 
 #include <glib-object.h>
+#include <tny-header.h>
+#include "modest-window-mgr.h"
 
 G_BEGIN_DECLS
 
@@ -45,6 +47,43 @@ G_BEGIN_DECLS
  **/
 gboolean       _modest_window_mgr_close_active_modals   (ModestWindowMgr *self);
 
+/**
+ * _modest_window_mgr_lookup_window_by_uid:
+ * @self: a #ModestWindowMgr
+ * @msg_uid: a message uid
+ *
+ * gets the registered msg window that shows the message with
+ * @msg_uid, using the index kept by the base class
+ *
+ * Return value: a #ModestWindow (not referenced) or NULL
+ **/
+ModestWindow * _modest_window_mgr_lookup_window_by_uid  (ModestWindowMgr *self,
+							 const gchar *msg_uid);
+
+/**
+ * _modest_window_mgr_lookup_window_by_header:
+ * @self: a #ModestWindowMgr
+ * @header: a #TnyHeader
+ *
+ * gets the registered msg view window that shows @header. Used for
+ * messages without uid, like the embedded ones
+ *
+ * Return value: a #ModestWindow (not referenced) or NULL
+ **/
+ModestWindow * _modest_window_mgr_lookup_window_by_header (ModestWindowMgr *self,
+							   TnyHeader *header);
+
+/**
+ * _modest_window_mgr_unindex_window:
+ * @self: a #ModestWindowMgr
+ * @window: a #ModestWindow
+ *
+ * removes @window from the lookup indexes. Subclasses must call it
+ * if they fail to register a window after chaining up
+ **/
+void           _modest_window_mgr_unindex_window        (ModestWindowMgr *self,
+							 ModestWindow *window);
+
 G_END_DECLS
 
 #endif /* __MODEST_WINDOW_MGR_PRIV_H__ */
@@ -29,6 +29,7 @@
 
 #include <string.h>
 #include "modest-window-mgr.h"
+#include "modest-window-mgr-priv.h"
 #include "modest-runtime.h"
 #include "modest-tny-folder.h"
 #include "modest-ui-actions.h"
@@ -37,6 +38,8 @@
 #include "widgets/modest-msg-edit-window.h"
 #include "widgets/modest-msg-view-window.h"
 #include "modest-debug.h"
+#include "modest-init.h"
+#include "modest-startup-trace.h"
 #include <tny-simple-list.h>
 
 
@@ -91,12 +94,21 @@ enum {
 	NUM_SIGNALS
 };
 
+typedef struct _WindowIndexEntry WindowIndexEntry;
+static void window_index_entry_free (WindowIndexEntry *entry);
+
 typedef struct _ModestWindowMgrPrivate ModestWindowMgrPrivate;
 struct _ModestWindowMgrPrivate {
 	guint         banner_counter;
 
 	GSList       *windows_that_prevent_hibernation;
-	GSList       *preregistered_uids;
+	GHashTable   *preregistered_uids;
+
+	/* Indexes of the registered msg windows, see index_window */
+	GHashTable   *indexed_windows;
+	GHashTable   *uid_windows;
+	GHashTable   *header_windows;
+	GHashTable   *folder_windows;
 
 	guint        closing_time;
 
@@ -251,7 +263,14 @@ modest_window_mgr_init (ModestWindowMgr *obj)
 
 	priv = MODEST_WINDOW_MGR_GET_PRIVATE(obj);
 	priv->banner_counter = 0;
-	priv->preregistered_uids = NULL;
+	priv->preregistered_uids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	priv->indexed_windows = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+						       (GDestroyNotify) window_index_entry_free);
+	priv->uid_windows = g_hash_table_new (g_str_hash, g_str_equal);
+	priv->header_windows = g_hash_table_new (g_direct_hash, g_direct_equal);
+	priv->folder_windows = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+						      (GDestroyNotify) g_list_free);
 
 	priv->closing_time = 0;
 
@@ -305,8 +324,13 @@ modest_window_mgr_finalize (GObject *obj)
 		priv->progress_operations = NULL;
 	}
 
-	g_slist_foreach (priv->preregistered_uids, (GFunc)g_free, NULL);
-	g_slist_free (priv->preregistered_uids);
+	g_hash_table_destroy (priv->preregistered_uids);
+
+	/* The lookup tables point to the strings owned by the entries */
+	g_hash_table_destroy (priv->uid_windows);
+	g_hash_table_destroy (priv->header_windows);
+	g_hash_table_destroy (priv->folder_windows);
+	g_hash_table_destroy (priv->indexed_windows);
 
 	G_OBJECT_CLASS(parent_class)->finalize (obj);
 }
@@ -322,49 +346,224 @@ modest_window_mgr_new (void)
 
 /* do we have uid? */
 static gboolean
-has_uid (GSList *list, const gchar *uid)
+has_uid (GHashTable *uids, const gchar *uid)
 {
-	GSList *cursor = list;
-
 	if (!uid)
 		return FALSE;
-	
-	while (cursor) {
-		if (cursor->data && strcmp (cursor->data, uid) == 0)
-			return TRUE;
-		cursor = g_slist_next (cursor);
-	}
-	return FALSE;
-}
 
+	return g_hash_table_lookup_extended (uids, uid, NULL, NULL);
+}
 
-/* remove all from the list have have uid = uid */
-static GSList*
-remove_uid (GSList *list, const gchar *uid)
+/* remove uid from the set */
+static void
+remove_uid (GHashTable *uids, const gchar *uid)
 {
-	GSList *cursor = list, *start = list;
-	
 	if (!uid)
-		return list;
-	
-	while (cursor) {
-		GSList *next = g_slist_next (cursor);
-		if (cursor->data && strcmp (cursor->data, uid) == 0) {
-			g_free (cursor->data);
-			start = g_slist_delete_link (start, cursor);
+		return;
+
+	g_hash_table_remove (uids, uid);
+}
+
+static void
+append_uid (GHashTable *uids, const gchar *uid)
+{
+	g_hash_table_insert (uids, g_strdup (uid), NULL);
+}
+
+/*
+ * Every registered msg view/edit window gets an entry with the keys
+ * it's indexed by, so it could be removed from the lookup tables
+ * even if the window changed its message in the meantime (see
+ * modest_window_mgr_update_window_index)
+ */
+struct _WindowIndexEntry {
+	gchar     *uid;
+	gchar     *folder_url;
+	TnyHeader *header;
+};
+
+static void
+window_index_entry_free (WindowIndexEntry *entry)
+{
+	g_free (entry->uid);
+	g_free (entry->folder_url);
+	if (entry->header)
+		g_object_unref (entry->header);
+	g_slice_free (WindowIndexEntry, entry);
+}
+
+static void
+unindex_window (ModestWindowMgr *self, ModestWindow *window)
+{
+	ModestWindowMgrPrivate *priv;
+	WindowIndexEntry *entry;
+
+	priv = MODEST_WINDOW_MGR_GET_PRIVATE (self);
+
+	entry = g_hash_table_lookup (priv->indexed_windows, window);
+	if (!entry)
+		return;
+
+	/* Only remove the mappings that still point to this window */
+	if (entry->uid &&
+	    g_hash_table_lookup (priv->uid_windows, entry->uid) == window)
+		g_hash_table_remove (priv->uid_windows, entry->uid);
+
+	if (entry->header &&
+	    g_hash_table_lookup (priv->header_windows, entry->header) == window)
+		g_hash_table_remove (priv->header_windows, entry->header);
+
+	if (entry->folder_url) {
+		GList *windows;
+
+		/* Steal it, the key could be owned by this entry. Re-add
+		   the remaining windows using a key of their own */
+		windows = g_hash_table_lookup (priv->folder_windows, entry->folder_url);
+		g_hash_table_steal (priv->folder_windows, entry->folder_url);
+		windows = g_list_remove (windows, window);
+		if (windows) {
+			WindowIndexEntry *other;
+
+			other = g_hash_table_lookup (priv->indexed_windows, windows->data);
+			g_hash_table_insert (priv->folder_windows, other->folder_url, windows);
 		}
-		cursor = next;
 	}
-	return start;
+
+	g_hash_table_remove (priv->indexed_windows, window);
 }
 
+static void
+index_window (ModestWindowMgr *self, ModestWindow *window)
+{
+	ModestWindowMgrPrivate *priv;
+	WindowIndexEntry *entry;
+	const gchar *uid = NULL;
+	const gchar *folder_url = NULL;
+	TnyHeader *header = NULL;
+
+	priv = MODEST_WINDOW_MGR_GET_PRIVATE (self);
+
+	if (MODEST_IS_MSG_VIEW_WINDOW (window)) {
+		uid = modest_msg_view_window_get_message_uid (MODEST_MSG_VIEW_WINDOW (window));
+		folder_url = modest_msg_view_window_get_folder_url (MODEST_MSG_VIEW_WINDOW (window));
+		header = modest_msg_view_window_get_header (MODEST_MSG_VIEW_WINDOW (window));
+	} else if (MODEST_IS_MSG_EDIT_WINDOW (window)) {
+		uid = modest_msg_edit_window_get_message_uid (MODEST_MSG_EDIT_WINDOW (window));
+		folder_url = modest_msg_edit_window_get_folder_url (MODEST_MSG_EDIT_WINDOW (window));
+	} else {
+		return;
+	}
+
+	unindex_window (self, window);
 
-static GSList *
-append_uid (GSList *list, const gchar *uid)
+	entry = g_slice_new0 (WindowIndexEntry);
+	entry->header = header;
+	if (uid)
+		entry->uid = g_strdup (uid);
+	else if (header)
+		entry->uid = modest_tny_folder_get_header_unique_id (header);
+	g_hash_table_insert (priv->indexed_windows, window, entry);
+
+	if (entry->uid)
+		g_hash_table_insert (priv->uid_windows, entry->uid, window);
+
+	/* The windows know their folder, the uids can't be split
+	   reliably as the folder urls could contain '/' */
+	if (folder_url) {
+		GList *windows;
+
+		entry->folder_url = g_strdup (folder_url);
+		windows = g_hash_table_lookup (priv->folder_windows, entry->folder_url);
+		g_hash_table_steal (priv->folder_windows, entry->folder_url);
+		windows = g_list_prepend (windows, window);
+		g_hash_table_insert (priv->folder_windows, entry->folder_url, windows);
+	}
+
+	/* Embedded messages do not have uid, they could be only found
+	   by header */
+	if (entry->header)
+		g_hash_table_insert (priv->header_windows, entry->header, window);
+}
+
+ModestWindow *
+_modest_window_mgr_lookup_window_by_uid (ModestWindowMgr *self,
+					 const gchar *msg_uid)
 {
-	return g_slist_append (list, g_strdup(uid));
+	ModestWindowMgrPrivate *priv;
+
+	g_return_val_if_fail (MODEST_IS_WINDOW_MGR (self), NULL);
+
+	if (!msg_uid)
+		return NULL;
+
+	priv = MODEST_WINDOW_MGR_GET_PRIVATE (self);
+	return (ModestWindow *) g_hash_table_lookup (priv->uid_windows, msg_uid);
+}
+
+ModestWindow *
+_modest_window_mgr_lookup_window_by_header (ModestWindowMgr *self,
+					    TnyHeader *header)
+{
+	ModestWindowMgrPrivate *priv;
+
+	g_return_val_if_fail (MODEST_IS_WINDOW_MGR (self), NULL);
+
+	if (!header)
+		return NULL;
+
+	priv = MODEST_WINDOW_MGR_GET_PRIVATE (self);
+	return (ModestWindow *) g_hash_table_lookup (priv->header_windows, header);
+}
+
+void
+_modest_window_mgr_unindex_window (ModestWindowMgr *self,
+				   ModestWindow *window)
+{
+	g_return_if_fail (MODEST_IS_WINDOW_MGR (self));
+
+	unindex_window (self, window);
 }
 
+void
+modest_window_mgr_update_window_index (ModestWindowMgr *self,
+				       ModestWindow *window)
+{
+	ModestWindowMgrPrivate *priv;
+
+	g_return_if_fail (MODEST_IS_WINDOW_MGR (self));
+	g_return_if_fail (MODEST_IS_WINDOW (window));
+
+	priv = MODEST_WINDOW_MGR_GET_PRIVATE (self);
+
+	/* Not registered (yet), it'll be indexed on registration */
+	if (!g_hash_table_lookup (priv->indexed_windows, window))
+		return;
+
+	index_window (self, window);
+}
+
+GList *
+modest_window_mgr_get_windows_for_folder (ModestWindowMgr *self,
+					  TnyFolder *folder)
+{
+	ModestWindowMgrPrivate *priv;
+	GList *windows;
+	gchar *url;
+
+	g_return_val_if_fail (MODEST_IS_WINDOW_MGR (self), NULL);
+	g_return_val_if_fail (TNY_IS_FOLDER (folder), NULL);
+
+	priv = MODEST_WINDOW_MGR_GET_PRIVATE (self);
+
+	url = tny_folder_get_url_string (folder);
+	if (!url)
+		return NULL;
+
+	windows = g_list_copy (g_hash_table_lookup (priv->folder_windows, url));
+	g_free (url);
+
+	return windows;
+}
 
 
 void 
@@ -385,7 +584,7 @@ modest_window_mgr_register_header (ModestWindowMgr *self,  TnyHeader *header, co
 
 	if (!has_uid (priv->preregistered_uids, uid)) {
 		MODEST_DEBUG_BLOCK(g_debug ("registering new uid %s", uid););
-		priv->preregistered_uids = append_uid (priv->preregistered_uids, uid);
+		append_uid (priv->preregistered_uids, uid);
 	} else
 		MODEST_DEBUG_BLOCK(g_debug ("already had uid %s", uid););
 	
@@ -406,16 +605,9 @@ modest_window_mgr_unregister_header (ModestWindowMgr *self,  TnyHeader *header)
 
 	if (!has_uid (priv->preregistered_uids, uid)) {
 		MODEST_DEBUG_BLOCK(g_debug ("trying to unregister non-existing uid %s", uid););
-		priv->preregistered_uids = append_uid (priv->preregistered_uids, uid);
-	} else
+	} else {
 		MODEST_DEBUG_BLOCK(g_debug ("unregistering uid %s", uid););
-	
-	if (has_uid (priv->preregistered_uids, uid)) {
-		priv->preregistered_uids = remove_uid (priv->preregistered_uids, uid);
-		if (has_uid (priv->preregistered_uids, uid))
-			g_debug ("BUG: uid %s NOT removed", uid);
-		else
-			MODEST_DEBUG_BLOCK(g_debug ("uid %s removed", uid););
+		remove_uid (priv->preregistered_uids, uid);
 	}
 		
 	g_free (uid);
@@ -474,16 +666,19 @@ modest_window_mgr_find_registered_header_default (ModestWindowMgr *self, TnyHead
 						  ModestWindow **win)
 {
 	gchar* uid = NULL;
+	gboolean found = FALSE;
 
 	g_return_val_if_fail (MODEST_IS_WINDOW_MGR (self), FALSE);
 	g_return_val_if_fail (TNY_IS_HEADER(header), FALSE);
 
 	uid = modest_tny_folder_get_header_unique_id (header);
 
-	if (uid)
-		return modest_window_mgr_find_registered_message_uid (self, uid, win);
-	else
-		return FALSE;
+	if (uid) {
+		found = modest_window_mgr_find_registered_message_uid (self, uid, win);
+		g_free (uid);
+	}
+
+	return found;
 }
 
 gboolean
@@ -498,8 +693,6 @@ modest_window_mgr_find_registered_message_uid_default (ModestWindowMgr *self, co
 						       ModestWindow **win)
 {
 	ModestWindowMgrPrivate *priv = NULL;
-	gchar* uid = NULL;
-	gboolean has_header = FALSE;
 
 	g_return_val_if_fail (MODEST_IS_WINDOW_MGR (self), FALSE);
 	g_return_val_if_fail (msg_uid && msg_uid[0] != '\0', FALSE);
@@ -509,10 +702,7 @@ modest_window_mgr_find_registered_message_uid_default (ModestWindowMgr *self, co
 	if (win)
 		*win = NULL;
 
-	has_header = has_uid (priv->preregistered_uids, msg_uid);
-	g_free (uid);
-
-	return has_header;
+	return has_uid (priv->preregistered_uids, msg_uid);
 }
 
 GList *
@@ -532,10 +722,16 @@ modest_window_mgr_register_window (ModestWindowMgr *self,
 				   ModestWindow *window,
 				   ModestWindow *parent)
 {
+	static gboolean first_window_traced = FALSE;
 	gboolean no_windows, retval;
 
 	no_windows = (modest_window_mgr_get_num_windows (self) == 0);
 
+	/* Windows not created by show_initial_window (ie. the ones
+	   opened by D-Bus methods) need them too */
+	if (no_windows)
+		modest_init_start_ui_services ();
+
 	retval = MODEST_WINDOW_MGR_GET_CLASS (self)->register_window (self, window, parent);
 
 	if  (no_windows) {
@@ -549,6 +745,11 @@ modest_window_mgr_register_window (ModestWindowMgr *self,
 		/* Do also allow modest to shutdown when the
 		   application is closed */
 		modest_runtime_set_allow_shutdown (TRUE);
+
+		if (!first_window_traced) {
+			modest_startup_trace_mark ("first-window");
+			first_window_traced = TRUE;
+		}
 	}
 
 	return retval;
@@ -580,24 +781,18 @@ modest_window_mgr_register_window_default (ModestWindowMgr *self,
 
 		MODEST_DEBUG_BLOCK(g_debug ("registering window for %s", uid ? uid : "<none>"););
 
-		if (has_uid (priv->preregistered_uids, uid)) {
-			priv->preregistered_uids = 
-				remove_uid (priv->preregistered_uids,
-					    modest_msg_view_window_get_message_uid
-					    (MODEST_MSG_VIEW_WINDOW (window)));
-		}
+		remove_uid (priv->preregistered_uids, uid);
 	} else if (MODEST_IS_MSG_EDIT_WINDOW(window)) {
 		const gchar *uid = modest_msg_edit_window_get_message_uid
 			(MODEST_MSG_EDIT_WINDOW (window));
 
 		MODEST_DEBUG_BLOCK(g_debug ("registering window for %s", uid););
 
-		priv->preregistered_uids = 
-			remove_uid (priv->preregistered_uids,
-				    modest_msg_edit_window_get_message_uid
-				    (MODEST_MSG_EDIT_WINDOW (window)));
+		remove_uid (priv->preregistered_uids, uid);
 	}
 
+	index_window (self, window);
+
 	return TRUE;
 }
 
@@ -615,6 +810,8 @@ modest_window_mgr_unregister_window_default (ModestWindowMgr *self,
 	g_return_if_fail (MODEST_IS_WINDOW_MGR (self));
 	g_return_if_fail (MODEST_IS_WINDOW (window));
 
+	unindex_window (self, window);
+
 	/* Save state */
 	modest_window_save_state (window);
 
@@ -872,6 +1069,9 @@ modest_window_mgr_show_initial_window (ModestWindowMgr *self)
 {
 	ModestWindow *window = NULL;
 
+	/* Start the services deferred by modest_init */
+	modest_init_start_ui_services ();
+
 	/* Call the children */
 	window = MODEST_WINDOW_MGR_GET_CLASS (self)->show_initial_window (self);
 
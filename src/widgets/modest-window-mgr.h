@@ -33,6 +33,7 @@
 #include <glib-object.h>
 #include "modest-window.h"
 #include <tny-header.h>
+#include <tny-folder.h>
 
 G_BEGIN_DECLS
 
@@ -283,6 +284,31 @@ gboolean modest_window_mgr_find_registered_message_uid (ModestWindowMgr *self,
  */
 GList *modest_window_mgr_get_window_list (ModestWindowMgr *self);
 
+/**
+ * modest_window_mgr_get_windows_for_folder:
+ * @self: a #ModestWindowMgr
+ * @folder: a #TnyFolder
+ *
+ * get the registered msg view and msg edit windows that show a
+ * message stored in @folder. The windows are not referenced
+ *
+ * Returns: a #GList, that caller should free
+ */
+GList *modest_window_mgr_get_windows_for_folder (ModestWindowMgr *self,
+						 TnyFolder *folder);
+
+/**
+ * modest_window_mgr_update_window_index:
+ * @self: a #ModestWindowMgr
+ * @window: a #ModestWindow
+ *
+ * msg windows must call this whenever the message they show
+ * changes, so the window could be found by its new uid. It does
+ * nothing if @window is not registered
+ */
+void   modest_window_mgr_update_window_index (ModestWindowMgr *self,
+					      ModestWindow *window);
+
 /**
  * modest_window_mgr_close_all_windows
  * @self: a #ModestWindowMgr
@@ -0,0 +1,427 @@
+/* Copyright (c) 2006, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <gtk/gtk.h>
+#include <tny-msg.h>
+#include <tny-header.h>
+#include <modest-init.h>
+#include <modest-tny-msg.h>
+#include <modest-search-query.h>
+
+typedef struct {
+	const gchar *query;
+	ModestSearchQueryResult expected;
+} QueryResult;
+
+static TnyMsg *msg = NULL;
+static TnyHeader *header = NULL;
+
+static void
+fx_setup_i18n ()
+{
+	fail_unless (gtk_init_check (NULL, NULL));
+	fail_unless (modest_init (0, NULL), "Failed running modest_init");
+}
+
+static void
+fx_setup_msg ()
+{
+	fx_setup_i18n ();
+
+	msg = modest_tny_msg_new ("Bob Smith <bob@example.com>",
+				  "Alice Jones <alice@example.com>",
+				  "carol@example.com", NULL,
+				  "Quarterly budget review",
+				  NULL, NULL, "Some text about the numbers",
+				  NULL, NULL, NULL);
+	fail_unless (TNY_IS_MSG (msg), "modest_tny_msg_new failed");
+	header = tny_msg_get_header (msg);
+	tny_header_set_flag (header, TNY_HEADER_FLAG_ATTACHMENTS);
+}
+
+static void
+fx_teardown_msg ()
+{
+	g_object_unref (header);
+	g_object_unref (msg);
+	header = NULL;
+	msg = NULL;
+}
+
+/* sets the Date: of the test message to @date */
+static void
+set_msg_date (time_t date)
+{
+	gchar buf[64];
+	struct tm tm;
+
+	gmtime_r (&date, &tm);
+	strftime (buf, sizeof (buf), "%d %b %Y %H:%M:%S +0000", &tm);
+	tny_mime_part_set_header_pair (TNY_MIME_PART (msg), "Date", buf);
+}
+
+/* the local midnight that starts today */
+static time_t
+today_midnight (void)
+{
+	time_t now;
+	struct tm tm;
+
+	now = time (NULL);
+	localtime_r (&now, &tm);
+	tm.tm_hour = 0;
+	tm.tm_min = 0;
+	tm.tm_sec = 0;
+	tm.tm_isdst = -1;
+
+	return mktime (&tm);
+}
+
+static void
+check_queries (const QueryResult *tests, guint n_tests)
+{
+	guint i;
+
+	for (i = 0; i < n_tests; i++) {
+		ModestSearchQuery *query;
+		ModestSearchQueryResult result;
+
+		query = modest_search_query_new (tests[i].query);
+		fail_unless (query != NULL,
+			     "modest_search_query_new failed for '%s'",
+			     tests[i].query);
+		result = modest_search_query_match_header (query, header);
+		fail_unless (result == tests[i].expected,
+			     "modest_search_query_match_header failed for '%s': "
+			     "expected %d but got %d",
+			     tests[i].query, tests[i].expected, result);
+		modest_search_query_free (query);
+	}
+}
+
+static gboolean
+body_contains (TnyMsg *message, const gchar *term, gpointer user_data)
+{
+	return strstr ((const gchar *) user_data, term) != NULL;
+}
+
+/* -------------------- field tests -------------------- */
+
+/**
+ * Test the text terms
+ *  - Test 1: Check bare words, looked for in the subject and addresses
+ *  - Test 2: Check that the field operators only look into their field
+ *  - Test 3: Check case insensitive matching
+ *  - Test 4: Check quoted text
+ */
+START_TEST (test_fields_regular)
+{
+	const QueryResult tests[] = {
+		/* Test 1 */
+		{ "budget", MODEST_SEARCH_QUERY_MATCH },
+		{ "alice", MODEST_SEARCH_QUERY_MATCH },
+		{ "carol", MODEST_SEARCH_QUERY_MATCH },
+		{ "dave", MODEST_SEARCH_QUERY_NO_MATCH },
+		/* Test 2 */
+		{ "subject:budget", MODEST_SEARCH_QUERY_MATCH },
+		{ "subject:alice", MODEST_SEARCH_QUERY_NO_MATCH },
+		{ "from:alice", MODEST_SEARCH_QUERY_MATCH },
+		{ "from:bob", MODEST_SEARCH_QUERY_NO_MATCH },
+		{ "to:bob", MODEST_SEARCH_QUERY_MATCH },
+		{ "to:carol", MODEST_SEARCH_QUERY_NO_MATCH },
+		{ "cc:carol", MODEST_SEARCH_QUERY_MATCH },
+		{ "bcc:carol", MODEST_SEARCH_QUERY_NO_MATCH },
+		/* Test 3 */
+		{ "QUARTERLY", MODEST_SEARCH_QUERY_MATCH },
+		{ "From:ALICE", MODEST_SEARCH_QUERY_MATCH },
+		/* Test 4 */
+		{ "\"budget review\"", MODEST_SEARCH_QUERY_MATCH },
+		{ "\"review budget\"", MODEST_SEARCH_QUERY_NO_MATCH },
+		{ "subject:\"quarterly budget\"", MODEST_SEARCH_QUERY_MATCH },
+		{ "subject:\"alice jones\"", MODEST_SEARCH_QUERY_NO_MATCH },
+		{ "\"from:alice\"", MODEST_SEARCH_QUERY_NO_MATCH },
+	};
+
+	check_queries (tests, G_N_ELEMENTS (tests));
+}
+END_TEST
+
+/**
+ * Test the boolean operators
+ *  - Test 1: Check the implicit AND
+ *  - Test 2: Check OR and NOT, also with a leading -
+ *  - Test 3: Check the parentheses, also unbalanced
+ */
+START_TEST (test_operators_regular)
+{
+	const QueryResult tests[] = {
+		/* Test 1 */
+		{ "budget alice", MODEST_SEARCH_QUERY_MATCH },
+		{ "budget dave", MODEST_SEARCH_QUERY_NO_MATCH },
+		/* Test 2 */
+		{ "budget OR dave", MODEST_SEARCH_QUERY_MATCH },
+		{ "dave OR erin", MODEST_SEARCH_QUERY_NO_MATCH },
+		{ "NOT dave", MODEST_SEARCH_QUERY_MATCH },
+		{ "-budget", MODEST_SEARCH_QUERY_NO_MATCH },
+		{ "-from:bob", MODEST_SEARCH_QUERY_MATCH },
+		/* Test 3 */
+		{ "(dave OR alice) budget", MODEST_SEARCH_QUERY_MATCH },
+		{ "(dave OR erin) budget", MODEST_SEARCH_QUERY_NO_MATCH },
+		{ "budget (dave OR alice", MODEST_SEARCH_QUERY_MATCH },
+	};
+
+	check_queries (tests, G_N_ELEMENTS (tests));
+}
+END_TEST
+
+/**
+ * Test the flag and size terms
+ *  - Test 1: Check has:attachment
+ *  - Test 2: Check is:read and is:unread
+ *  - Test 3: Check size: with its suffixes
+ */
+START_TEST (test_flags_size_regular)
+{
+	const QueryResult tests[] = {
+		/* Test 1 */
+		{ "has:attachment", MODEST_SEARCH_QUERY_MATCH },
+		{ "-has:attachment", MODEST_SEARCH_QUERY_NO_MATCH },
+		/* Test 2 */
+		{ "is:unread", MODEST_SEARCH_QUERY_MATCH },
+		{ "is:read", MODEST_SEARCH_QUERY_NO_MATCH },
+		/* Test 3 */
+		{ "size:10M", MODEST_SEARCH_QUERY_NO_MATCH },
+		{ "size:10240k", MODEST_SEARCH_QUERY_NO_MATCH },
+		{ "-size:10m", MODEST_SEARCH_QUERY_MATCH },
+	};
+
+	ModestSearchQuery *query;
+
+	check_queries (tests, G_N_ELEMENTS (tests));
+
+	tny_header_set_flag (header, TNY_HEADER_FLAG_SEEN);
+	query = modest_search_query_new ("is:read");
+	fail_unless (modest_search_query_match_header (query, header) ==
+		     MODEST_SEARCH_QUERY_MATCH,
+		     "is:read does not match a seen message");
+	modest_search_query_free (query);
+}
+END_TEST
+
+/**
+ * Test the body terms
+ *  - Test 1: Check that the summary is not enough for body:
+ *  - Test 2: Check body: with the message contents
+ *  - Test 3: Check that a header term short-circuits body:
+ */
+START_TEST (test_body_regular)
+{
+	ModestSearchQuery *query;
+	const gchar *body = "some text about the numbers";
+
+	/* Test 1 */
+	query = modest_search_query_new ("body:numbers");
+	fail_unless (modest_search_query_match_header (query, header) ==
+		     MODEST_SEARCH_QUERY_NEEDS_BODY,
+		     "body: should need the message contents");
+
+	/* Test 2 */
+	fail_unless (modest_search_query_match_msg (query, header, msg,
+						    body_contains, (gpointer) body),
+		     "body:numbers should match");
+	modest_search_query_free (query);
+
+	query = modest_search_query_new ("body:letters");
+	fail_unless (!modest_search_query_match_msg (query, header, msg,
+						     body_contains, (gpointer) body),
+		     "body:letters should not match");
+	modest_search_query_free (query);
+
+	/* Test 3 */
+	query = modest_search_query_new ("from:bob body:numbers");
+	fail_unless (modest_search_query_match_header (query, header) ==
+		     MODEST_SEARCH_QUERY_NO_MATCH,
+		     "from:bob body:numbers should not need the body");
+	modest_search_query_free (query);
+}
+END_TEST
+
+/* -------------------- date tests -------------------- */
+
+/**
+ * Test the day bounds of the date terms, that are the local midnights
+ *  - Test 1: Check a message sent just after today's midnight
+ *  - Test 2: Check a message sent just before today's midnight
+ *  - Test 3: Check a message sent just before yesterday's midnight
+ */
+START_TEST (test_dates_regular)
+{
+	time_t midnight;
+
+	midnight = today_midnight ();
+
+	/* Test 1 */
+	set_msg_date (midnight + 60);
+	{
+		const QueryResult tests[] = {
+			{ "date:today", MODEST_SEARCH_QUERY_MATCH },
+			{ "date:yesterday", MODEST_SEARCH_QUERY_NO_MATCH },
+			{ "after:yesterday", MODEST_SEARCH_QUERY_MATCH },
+			{ "after:today", MODEST_SEARCH_QUERY_NO_MATCH },
+			{ "before:today", MODEST_SEARCH_QUERY_NO_MATCH },
+			{ "date:today..", MODEST_SEARCH_QUERY_MATCH },
+			{ "date:..yesterday", MODEST_SEARCH_QUERY_NO_MATCH },
+			{ "yesterday..today", MODEST_SEARCH_QUERY_MATCH },
+		};
+		check_queries (tests, G_N_ELEMENTS (tests));
+	}
+
+	/* Test 2 */
+	set_msg_date (midnight - 60);
+	{
+		const QueryResult tests[] = {
+			{ "date:today", MODEST_SEARCH_QUERY_NO_MATCH },
+			{ "date:yesterday", MODEST_SEARCH_QUERY_MATCH },
+			{ "after:yesterday", MODEST_SEARCH_QUERY_NO_MATCH },
+			{ "before:today", MODEST_SEARCH_QUERY_MATCH },
+			{ "before:yesterday", MODEST_SEARCH_QUERY_NO_MATCH },
+			{ "date:today..", MODEST_SEARCH_QUERY_NO_MATCH },
+			{ "date:..yesterday", MODEST_SEARCH_QUERY_MATCH },
+			{ "date:yesterday..today", MODEST_SEARCH_QUERY_MATCH },
+		};
+		check_queries (tests, G_N_ELEMENTS (tests));
+	}
+
+	/* Test 3 */
+	set_msg_date (today_midnight () - 25 * 60 * 60);
+	{
+		const QueryResult tests[] = {
+			{ "date:yesterday", MODEST_SEARCH_QUERY_NO_MATCH },
+			{ "before:yesterday", MODEST_SEARCH_QUERY_MATCH },
+			{ "date:yesterday..today", MODEST_SEARCH_QUERY_NO_MATCH },
+		};
+		check_queries (tests, G_N_ELEMENTS (tests));
+	}
+}
+END_TEST
+
+/**
+ * Test invalid usage of modest_search_query_new
+ *  - Test 1: Check with an empty query
+ *  - Test 2: Check with incomplete field terms
+ */
+START_TEST (test_query_invalid)
+{
+	ModestSearchQuery *query;
+
+	/* Test 1 */
+	fail_unless (modest_search_query_new ("") == NULL,
+		     "an empty query should have no terms");
+	fail_unless (modest_search_query_new ("   ") == NULL,
+		     "a blank query should have no terms");
+
+	/* Test 2 */
+	query = modest_search_query_new ("size:lots");
+	fail_unless (query == NULL ||
+		     modest_search_query_match_header (query, header) !=
+		     MODEST_SEARCH_QUERY_NEEDS_BODY,
+		     "a wrong size: should not need the body");
+	if (query)
+		modest_search_query_free (query);
+}
+END_TEST
+
+/* ---------------------- Suite creation ---------------------- */
+
+/**
+ * Create a new suite for the search query parser and matcher
+ */
+static Suite*
+search_query_suite (void)
+{
+	Suite *suite = suite_create ("ModestSearchQuery");
+	TCase *tc = NULL;
+
+	/* Test case for the text terms and operators */
+	tc = tcase_create ("text");
+	tcase_add_checked_fixture (tc,
+				   fx_setup_msg,
+				   fx_teardown_msg);
+	tcase_add_test (tc, test_fields_regular);
+	tcase_add_test (tc, test_operators_regular);
+	tcase_add_test (tc, test_body_regular);
+	suite_add_tcase (suite, tc);
+
+	/* Test case for the flags and sizes */
+	tc = tcase_create ("flags_size");
+	tcase_add_checked_fixture (tc,
+				   fx_setup_msg,
+				   fx_teardown_msg);
+	tcase_add_test (tc, test_flags_size_regular);
+	suite_add_tcase (suite, tc);
+
+	/* Test case for the dates */
+	tc = tcase_create ("dates");
+	tcase_add_checked_fixture (tc,
+				   fx_setup_msg,
+				   fx_teardown_msg);
+	tcase_add_test (tc, test_dates_regular);
+	tcase_add_test (tc, test_query_invalid);
+	suite_add_tcase (suite, tc);
+
+	return suite;
+}
+
+/* --------------------- Main program ------------------- */
+
+gint
+main ()
+{
+	SRunner *srunner;
+	Suite   *suite;
+	int     failures;
+
+	/* far from UTC, so the local midnights are not the UTC ones */
+	setenv ("TZ", "America/Los_Angeles", 1);
+	setenv ("LANG", "en_GB", 1);
+	setenv ("LC_MESSAGES", "en_GB", 1);
+
+	suite   = search_query_suite ();
+	srunner = srunner_create (suite);
+
+	srunner_run_all (srunner, CK_ENV);
+	failures = srunner_ntests_failed (srunner);
+	srunner_free (srunner);
+
+	return failures;
+}